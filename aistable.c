@@ -0,0 +1,178 @@
+/****************************************************************************
+
+NAME
+   aistable.c - keep the latest AIS state of each vessel heard
+
+DESCRIPTION
+   Class A vessels broadcast their static and voyage data (type 5) only
+every six minutes, class B ones their static data (type 24) at the same
+rate, so a client that connects to gpsd has to wait that long before it
+can put names and dimensions to the positions it sees.  This module
+keeps, for each MMSI, the latest position report, type 5 and merged
+type 24 parts, and renders them for the ?AIS command so a new client
+gets the whole picture in one burst.
+
+   The table is hashed by MMSI; a vessel is looked for in a short probe
+window from its home slot.  Vessels not heard from in AIS_VESSEL_EXPIRY
+seconds are skipped and their slots reused; when a window is full, the
+vessel heard least recently is evicted.
+
+PERMISSIONS
+   This file is Copyright (c) 2019 by the GPSD project
+   SPDX-License-Identifier: BSD-2-clause
+
+***************************************************************************/
+
+#include "gpsd_config.h"  /* must be before all includes */
+
+#if defined(AIVDM_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gpsd.h"
+#include "gps_json.h"		/* needs gpsd.h */
+#include "strfuncs.h"
+
+struct ais_vessel_t {
+    unsigned int mmsi;			/* 0 marks a free slot */
+    timestamp_t heard;
+    char devpath[GPS_PATH_MAX];
+    /* type 0 in any of these means not heard yet */
+    struct ais_t position;		/* types 1-4, 9, 18, 19, 21, 27 */
+    struct ais_t voyage;		/* type 5 */
+    struct ais_t statics;		/* type 24, parts A and B merged */
+};
+
+static struct ais_vessel_t vessels[AIS_VESSELS];
+
+static struct ais_vessel_t *vessel_next(struct ais_vessel_t *vp)
+{
+    return (++vp < vessels + AIS_VESSELS) ? vp : vessels;
+}
+
+static bool vessel_live(const struct ais_vessel_t *vp, timestamp_t now)
+{
+    return vp->mmsi != 0 && now - vp->heard <= AIS_VESSEL_EXPIRY;
+}
+
+static struct ais_vessel_t *vessel_find(unsigned int mmsi, timestamp_t now)
+/* find a vessel's slot, or claim one for it */
+{
+    struct ais_vessel_t *home = &vessels[(mmsi * 2654435761U) % AIS_VESSELS];
+    struct ais_vessel_t *vp, *use = NULL;
+    int i;
+
+    for (i = 0, vp = home; i < AIS_VESSEL_PROBES; i++, vp = vessel_next(vp)) {
+	if (vp->mmsi == mmsi) {
+	    if (vessel_live(vp, now))
+		return vp;
+	    use = vp;		/* gone quiet for too long, start over */
+	    break;
+	}
+	if (use == NULL && !vessel_live(vp, now))
+	    use = vp;
+    }
+    if (use == NULL) {
+	use = home;
+	for (i = 0, vp = home; i < AIS_VESSEL_PROBES;
+	     i++, vp = vessel_next(vp))
+	    if (vp->heard < use->heard)
+		use = vp;
+    }
+    memset(use, '\0', sizeof(*use));
+    use->mmsi = mmsi;
+    return use;
+}
+
+void ais_table_update(const struct gps_device_t *device)
+/* merge the AIS report just decoded into its vessel's state */
+{
+    const struct ais_t *ais = &device->gpsdata.ais;
+    timestamp_t now = timestamp();
+    struct ais_vessel_t *vp;
+
+    switch (ais->type) {
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+    case 9:
+    case 18:
+    case 19:
+    case 21:
+    case 27:
+	vp = vessel_find(ais->mmsi, now);
+	vp->position = *ais;
+	break;
+    case 5:
+	vp = vessel_find(ais->mmsi, now);
+	vp->voyage = *ais;
+	break;
+    case 24:
+	vp = vessel_find(ais->mmsi, now);
+	if (ais->type24.part == both || vp->statics.type == 0) {
+	    vp->statics = *ais;
+	    break;
+	}
+	/* keep the half we already have */
+	if (ais->type24.part == part_a) {
+	    (void)strlcpy(vp->statics.type24.shipname, ais->type24.shipname,
+			  sizeof(vp->statics.type24.shipname));
+	    if (vp->statics.type24.part == part_b)
+		vp->statics.type24.part = both;
+	} else {
+	    char shipname[sizeof(ais->type24.shipname)];
+	    int had = (int)vp->statics.type24.part;
+
+	    (void)strlcpy(shipname, vp->statics.type24.shipname,
+			  sizeof(shipname));
+	    vp->statics = *ais;
+	    (void)strlcpy(vp->statics.type24.shipname, shipname,
+			  sizeof(vp->statics.type24.shipname));
+	    if (had != (int)part_b)
+		vp->statics.type24.part = both;
+	}
+	break;
+    default:
+	/* binary, safety and addressed messages aren't vessel state */
+	return;
+    }
+    vp->heard = now;
+    (void)strlcpy(vp->devpath, device->gpsdata.dev.path,
+		  sizeof(vp->devpath));
+}
+
+int ais_table_dump(int cursor, bool scaled, char *buf, size_t buflen)
+/*
+ * Render the reports of the first live vessel at or after cursor.
+ * Returns the cursor to continue from, or -1 when the table is done.
+ */
+{
+    timestamp_t now = timestamp();
+
+    buf[0] = '\0';
+    for (; cursor >= 0 && cursor < AIS_VESSELS; cursor++) {
+	const struct ais_vessel_t *vp = &vessels[cursor];
+
+	if (!vessel_live(vp, now))
+	    continue;
+	/* position last, so a client ends up with the freshest fix */
+	if (vp->voyage.type != 0)
+	    json_aivdm_dump(&vp->voyage, vp->devpath, scaled,
+			    buf + strlen(buf), buflen - strlen(buf));
+	if (vp->statics.type != 0)
+	    json_aivdm_dump(&vp->statics, vp->devpath, scaled,
+			    buf + strlen(buf), buflen - strlen(buf));
+	if (vp->position.type != 0)
+	    json_aivdm_dump(&vp->position, vp->devpath, scaled,
+			    buf + strlen(buf), buflen - strlen(buf));
+	return cursor + 1;
+    }
+    return -1;
+}
+
+#endif /* AIVDM_ENABLE && SOCKET_EXPORT_ENABLE */
+
+/* aistable.c ends here */
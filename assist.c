@@ -0,0 +1,241 @@
+/* assist.c -- remember navigation data for warm-starting receivers
+ *
+ * Receivers without a battery-backed RAM forget the sky each time they
+ * lose power and need the better part of a minute, or more, to collect
+ * ephemerides again.  Everything needed to help them is already going
+ * past gpsd in the subframe data some chips report, so it is kept here,
+ * together with the last good position, and can be written out at
+ * shutdown and read back at startup.  Drivers that can accept aiding
+ * feed it to a receiver that comes up without a fix.
+ *
+ * The state file is text, one record per line:
+ *
+ *	leap <seconds>
+ *	fix <time> <latitude> <longitude> <altitude>
+ *	eph <prn> <time> <how> <24 words>
+ *	alm <prn> <time> <8 words>
+ *
+ * with times in Unix seconds and words in hex.  Unknown records are
+ * skipped, so older daemons can read what newer ones write.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+
+#include "gpsd_config.h"  /* must be before all includes */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpsd.h"
+
+void gpsd_assist_subframe(struct gps_context_t *context,
+			  unsigned int tSVID, const uint32_t words[])
+/* stash a subframe, parity already stripped, if it's worth keeping */
+{
+    unsigned int subframe = (words[1] >> 2) & 0x07;
+    unsigned int pageid = (words[2] >> 16) & 0x3f;
+    unsigned int data_id = (words[2] >> 22) & 0x03;
+
+    if (subframe >= 1 && subframe <= 3) {
+	struct gps_assist_t *ap = &context->assist;
+	unsigned int iode, have_iode = 0;
+	int i;
+
+	if (tSVID < 1 || tSVID > ASSIST_SVS)
+	    return;
+	i = (int)tSVID - 1;
+	/* subframe 1 has IODC, whose low 8 bits must match IODE */
+	if (subframe == 1)
+	    iode = (words[7] >> 16) & 0xff;
+	else if (subframe == 2)
+	    iode = (words[2] >> 16) & 0xff;
+	else
+	    iode = (words[9] >> 16) & 0xff;
+	if ((ap->eph[i].next_have & 0x01) != 0)
+	    have_iode = (ap->eph[i].next[0][5] >> 16) & 0xff;
+	else if ((ap->eph[i].next_have & 0x02) != 0)
+	    have_iode = (ap->eph[i].next[1][0] >> 16) & 0xff;
+	else if ((ap->eph[i].next_have & 0x04) != 0)
+	    have_iode = (ap->eph[i].next[2][7] >> 16) & 0xff;
+	if (ap->eph[i].next_have != 0 && have_iode != iode)
+	    ap->eph[i].next_have = 0;	/* new issue, start over */
+	memcpy(ap->eph[i].next[subframe - 1], words + 2,
+	       sizeof(ap->eph[i].next[0]));
+	if (subframe == 1)
+	    ap->eph[i].next_how = words[1];
+	ap->eph[i].next_have |= 1 << (subframe - 1);
+	if (ap->eph[i].next_have == 0x07) {
+	    memcpy(ap->eph[i].words, ap->eph[i].next,
+		   sizeof(ap->eph[i].words));
+	    ap->eph[i].how = ap->eph[i].next_how;
+	    ap->eph[i].heard = timestamp();
+	    ap->eph[i].next_have = 0;
+	    gpsd_log(&context->errout, LOG_PROG,
+		     "ASSIST: ephemeris for PRN %u, IODE %u\n", tSVID, iode);
+	}
+    } else if ((subframe == 4 || subframe == 5) && data_id == 1
+	       && pageid >= 1 && pageid <= ASSIST_SVS) {
+	/* pages holding an almanac have its SV ID as page ID */
+	struct gps_assist_t *ap = &context->assist;
+
+	memcpy(ap->alm[pageid - 1].words, words + 2,
+	       sizeof(ap->alm[0].words));
+	ap->alm[pageid - 1].heard = timestamp();
+    }
+}
+
+void gpsd_assist_fix(struct gps_context_t *context,
+		     const struct gps_data_t *gpsdata)
+/* remember where the last good fix was */
+{
+    struct gps_assist_t *ap = &context->assist;
+
+    if (gpsdata->fix.mode < MODE_2D
+	|| 0 == isfinite(gpsdata->fix.latitude)
+	|| 0 == isfinite(gpsdata->fix.longitude))
+	return;
+    ap->fix_time = timestamp();
+    ap->latitude = gpsdata->fix.latitude;
+    ap->longitude = gpsdata->fix.longitude;
+    if (gpsdata->fix.mode >= MODE_3D && 0 != isfinite(gpsdata->fix.altitude)) {
+	ap->altitude = gpsdata->fix.altitude;
+	if (0 != isfinite(gpsdata->separation))
+	    ap->altitude += gpsdata->separation;
+    }
+}
+
+void gpsd_assist_ecef(const struct gps_assist_t *ap,
+		      double *x, double *y, double *z)
+/* the last good fix, in ECEF meters */
+{
+    double e2 = (2.0 - 1.0 / WGS84F) / WGS84F;
+    double phi = ap->latitude * DEG_2_RAD;
+    double lambda = ap->longitude * DEG_2_RAD;
+    double n = WGS84A / sqrt(1.0 - e2 * sin(phi) * sin(phi));
+
+    *x = (n + ap->altitude) * cos(phi) * cos(lambda);
+    *y = (n + ap->altitude) * cos(phi) * sin(lambda);
+    *z = (n * (1.0 - e2) + ap->altitude) * sin(phi);
+}
+
+static int scan_words(const char *p, uint32_t *words, int count)
+/* parse count hex words; return how many were there */
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+	unsigned long w;
+	char *end;
+
+	errno = 0;
+	w = strtoul(p, &end, 16);
+	if (end == p || errno != 0)
+	    break;
+	words[i] = (uint32_t)(w & 0xffffff);
+	p = end;
+    }
+    return i;
+}
+
+bool gpsd_assist_load(struct gps_context_t *context, const char *path)
+/* read back what an earlier run saved */
+{
+    struct gps_assist_t *ap = &context->assist;
+    char line[BUFSIZ];
+    int neph = 0, nalm = 0;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	gpsd_log(&context->errout, errno == ENOENT ? LOG_INF : LOG_WARN,
+		 "ASSIST: can't read %s: %s\n", path, strerror(errno));
+	return false;
+    }
+    while (fgets(line, (int)sizeof(line), fp) != NULL) {
+	unsigned int prn, how;
+	int leap, n;
+	double t, lat, lon, alt;
+
+	if (sscanf(line, "leap %d", &leap) == 1) {
+	    /* never step back from what we were built knowing */
+	    if (leap > context->leap_seconds)
+		context->leap_seconds = leap;
+	} else if (sscanf(line, "fix %lf %lf %lf %lf",
+			  &t, &lat, &lon, &alt) == 4) {
+	    ap->fix_time = t;
+	    ap->latitude = lat;
+	    ap->longitude = lon;
+	    ap->altitude = alt;
+	} else if (sscanf(line, "eph %u %lf %x %n", &prn, &t, &how, &n) == 3) {
+	    if (prn < 1 || prn > ASSIST_SVS
+		|| scan_words(line + n, ap->eph[prn - 1].words[0], 24) != 24)
+		continue;
+	    ap->eph[prn - 1].heard = t;
+	    ap->eph[prn - 1].how = how;
+	    neph++;
+	} else if (sscanf(line, "alm %u %lf %n", &prn, &t, &n) == 2) {
+	    if (prn < 1 || prn > ASSIST_SVS
+		|| scan_words(line + n, ap->alm[prn - 1].words, 8) != 8)
+		continue;
+	    ap->alm[prn - 1].heard = t;
+	    nalm++;
+	}
+    }
+    (void)fclose(fp);
+    gpsd_log(&context->errout, LOG_INF,
+	     "ASSIST: read %d ephemerides, %d almanac pages%s from %s\n",
+	     neph, nalm, ap->fix_time > 0 ? " and a position" : "", path);
+    return true;
+}
+
+bool gpsd_assist_save(const struct gps_context_t *context, const char *path)
+/* write out what we know, replacing the old file only once complete */
+{
+    const struct gps_assist_t *ap = &context->assist;
+    char tmp[PATH_MAX];
+    FILE *fp;
+    int i, j;
+
+    (void)snprintf(tmp, sizeof(tmp), "%s.new", path);
+    if ((fp = fopen(tmp, "w")) == NULL) {
+	gpsd_log(&context->errout, LOG_WARN,
+		 "ASSIST: can't write %s: %s\n", tmp, strerror(errno));
+	return false;
+    }
+    (void)fprintf(fp, "# gpsd warm-start data, rewritten by the daemon\n");
+    (void)fprintf(fp, "leap %d\n", context->leap_seconds);
+    if (ap->fix_time > 0)
+	(void)fprintf(fp, "fix %.3f %.9f %.9f %.3f\n", ap->fix_time,
+		      ap->latitude, ap->longitude, ap->altitude);
+    for (i = 0; i < ASSIST_SVS; i++) {
+	if (ap->eph[i].heard <= 0)
+	    continue;
+	(void)fprintf(fp, "eph %d %.3f %06x", i + 1, ap->eph[i].heard,
+		      ap->eph[i].how);
+	for (j = 0; j < 24; j++)
+	    (void)fprintf(fp, " %06x", ap->eph[i].words[j / 8][j % 8]);
+	(void)fputc('\n', fp);
+    }
+    for (i = 0; i < ASSIST_SVS; i++) {
+	if (ap->alm[i].heard <= 0)
+	    continue;
+	(void)fprintf(fp, "alm %d %.3f", i + 1, ap->alm[i].heard);
+	for (j = 0; j < 8; j++)
+	    (void)fprintf(fp, " %06x", ap->alm[i].words[j]);
+	(void)fputc('\n', fp);
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+	gpsd_log(&context->errout, LOG_WARN,
+		 "ASSIST: can't update %s: %s\n", path, strerror(errno));
+	(void)unlink(tmp);
+	return false;
+    }
+    return true;
+}
+
+/* assist.c ends here */
@@ -9,6 +9,9 @@
  *
  * The sbits() function assumes twos-complement arithmetic. ubits()
  * and sbits() assume no padding in integers.
+ *
+ * The bitreader_*() functions extract consecutive fields, keeping the
+ * bit index in a cursor so callers need not count it themselves.
  */
 #include "gpsd_config.h"  /* must be before all includes */
 
@@ -20,40 +23,92 @@
 
 #include "bits.h"
 
+/* each byte value with its bit order reversed */
+#define R2(n)	(n), (n) + 2*64, (n) + 1*64, (n) + 3*64
+#define R4(n)	R2(n), R2((n) + 2*16), R2((n) + 1*16), R2((n) + 3*16)
+#define R6(n)	R4(n), R4((n) + 2*4), R4((n) + 1*4), R4((n) + 3*4)
+static const unsigned char reverse_byte[256] = {
+    R6(0), R6(2), R6(1), R6(3)
+};
+#undef R2
+#undef R4
+#undef R6
+
+static inline uint64_t load_be64(const unsigned char *p)
+/* one unaligned big-endian 64-bit load */
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t w;
+
+    memcpy(&w, p, sizeof(w));
+    return __builtin_bswap64(w);
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint64_t w;
+
+    memcpy(&w, p, sizeof(w));
+    return w;
+#else
+    return getbeu64(p, 0);
+#endif
+}
+
 uint64_t ubits(unsigned char buf[], unsigned int start, unsigned int width, bool le)
 /* extract a (zero-origin) bitfield from the buffer as an unsigned big-endian uint64_t */
 {
     uint64_t fld = 0;
     unsigned int i;
+    unsigned int first = start / CHAR_BIT;
+    unsigned int last = (start + width + CHAR_BIT - 1) / CHAR_BIT;
     unsigned end;
 
     assert(width <= sizeof(uint64_t) * CHAR_BIT);
-    for (i = start / CHAR_BIT;
-	 i < (start + width + CHAR_BIT - 1) / CHAR_BIT; i++) {
-	fld <<= CHAR_BIT;
-	fld |= (unsigned char)buf[i];
-    }
-
+    if (width == 0)
+	return 0;
+
+    /*
+     * When the field lies within 8 bytes, fetch the 8 bytes that end
+     * with its last one in a single load.  Nothing past the field is
+     * read, and nothing before the start of the buffer as long as the
+     * field ends at or beyond byte 8; fields nearer the start are
+     * gathered a byte at a time.
+     */
     end = (start + width) % CHAR_BIT;
-    if (end != 0) {
-	fld >>= (CHAR_BIT - end);
+    if (last - first > sizeof(uint64_t)) {
+	/* straddles 9 bytes, the low bits of the first go on top */
+	fld = load_be64(buf + first + 1) >> (CHAR_BIT - end);
+	fld |= (uint64_t)buf[first]
+	    << (sizeof(uint64_t) * CHAR_BIT - (CHAR_BIT - end));
+    } else {
+	if (last >= sizeof(uint64_t))
+	    fld = load_be64(buf + last - sizeof(uint64_t));
+	else
+	    for (i = first; i < last; i++) {
+		fld <<= CHAR_BIT;
+		fld |= (unsigned char)buf[i];
+	    }
+	if (end != 0) {
+	    fld >>= (CHAR_BIT - end);
+	}
     }
 
-    fld &= ~(~0ULL << width);
+    if (width < sizeof(uint64_t) * CHAR_BIT)
+	fld &= ~(~0ULL << width);
 
     /* was extraction as a little-endian requested? */
     if (le)
     {
 	uint64_t reversed = 0;
+	unsigned int nbytes = BITS_TO_BYTES(width);
 
-	for (i = width; i; --i)
-	{
-	    reversed <<= 1;
-	    if (fld & 1)
-		reversed |= 1;
-	    fld >>= 1;
+	/* reverse whole bytes, then drop the padding this shifted in */
+	for (i = 0; i < nbytes; i++) {
+	    reversed <<= CHAR_BIT;
+	    reversed |= reverse_byte[fld & 0xff];
+	    fld >>= CHAR_BIT;
 	}
-	fld = reversed;
+	fld = reversed >> (nbytes * CHAR_BIT - width);
     }
 
     return fld;
@@ -75,6 +130,24 @@ int64_t sbits(signed char buf[], unsigned int start, unsigned int width, bool le
     return (int64_t)fld;
 }
 
+uint64_t bitreader_u(struct bitreader_t *br, unsigned int width)
+/* extract the next bitfield of a stream as an unsigned big-endian uint64_t */
+{
+    uint64_t fld = ubits(br->buf, br->pos, width, false);
+
+    br->pos += width;
+    return fld;
+}
+
+int64_t bitreader_s(struct bitreader_t *br, unsigned int width)
+/* extract the next bitfield of a stream as a signed big-endian long */
+{
+    int64_t fld = sbits((signed char *)br->buf, br->pos, width, false);
+
+    br->pos += width;
+    return fld;
+}
+
 union int_float {
     int32_t i;
     float f;
@@ -61,4 +61,17 @@ extern void shiftleft(unsigned char *, int, unsigned short);
 extern uint64_t ubits(unsigned char buf[], unsigned int, unsigned int, bool);
 extern int64_t sbits(signed char buf[], unsigned int, unsigned int, bool);
 
+/* sequential extraction, for decoders walking consecutive fields */
+struct bitreader_t {
+    unsigned char *buf;
+    unsigned int pos;		/* bit index of the next field */
+};
+
+#define bitreader_init(br, b, start) \
+    do {(br)->buf = (unsigned char *)(b); (br)->pos = (start);} while (0)
+#define bitreader_skip(br, width)	((br)->pos += (width))
+
+extern uint64_t bitreader_u(struct bitreader_t *, unsigned int);
+extern int64_t bitreader_s(struct bitreader_t *, unsigned int);
+
 #endif /* _GPSD_BITS_H_ */
@@ -0,0 +1,353 @@
+/* capture.c -- log raw device input and play it back
+ *
+ * With a capture directory configured, everything read from a device is
+ * appended to a log there, named after the device path, exactly as
+ * read() returned it.  A log starts with the eight bytes "GPSDCAP1",
+ * then holds one record per read:
+ *
+ *	length	4 bytes, big-endian, of the data alone
+ *	time	8 bytes, big-endian, microseconds since the Unix epoch
+ *	data	the bytes read
+ *
+ * Records are written with one writev() of the header and the lexer's
+ * input buffer, so nothing is copied on the way.  Beside the log, under
+ * the same name with ".idx" appended, is a sparse index of 16-byte
+ * entries, a time and the offset of the record read at that time, both
+ * big-endian, written at most once every CAPTURE_INDEX_INTERVAL seconds.
+ * As long as the system clock doesn't step back, index times increase,
+ * so finding where to start a replay is a binary search of the index
+ * followed by a short scan of the log.
+ *
+ * A device named replay://path[?option&...] plays a log back into the
+ * daemon through a socket pair, fed by a thread that sleeps between
+ * records so they arrive as they did originally.  Options:
+ *
+ *	speed=N		N times as fast as recorded; speed=0 or speed=max
+ *			for as fast as the daemon will take it
+ *	start=T		skip records before T, Unix seconds or ISO 8601
+ *
+ * A replayed device is never written to.  At the end of the log the
+ * thread closes its end and the daemon sees the device hang up.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+
+#include "gpsd_config.h"  /* must be before all includes */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gpsd.h"
+#include "bits.h"
+#include "strfuncs.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0	/* the daemon ignores SIGPIPE anyway */
+#endif /* MSG_NOSIGNAL */
+
+static void put_u64(unsigned char *buf, int off, uint64_t u)
+{
+    putbe32(buf, off, (uint32_t)(u >> 32));
+    putbe32(buf, off + 4, (uint32_t)u);
+}
+
+void gpsd_capture_open(struct gps_device_t *session)
+/* start logging a device's input, appending to what is there */
+{
+    struct gps_capture_t *cap = &session->capture;
+    char path[GPS_PATH_MAX * 2], idx[GPS_PATH_MAX * 2 + 4];
+    const char *device = session->gpsdata.dev.path;
+    struct stat sb;
+    char *p;
+
+    /* one log per device, named after its path */
+    while (*device == '/')
+	device++;
+    (void)snprintf(path, sizeof(path), "%s/", session->context->capture_dir);
+    p = path + strlen(path);
+    (void)snprintf(p, sizeof(path) - (size_t)(p - path), "%s.gpscap", device);
+    for (; *p != '\0'; p++)
+	if (*p == '/' || *p == ':' || *p == '?')
+	    *p = '_';
+
+    cap->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (cap->fd == -1 || fstat(cap->fd, &sb) == -1
+	|| (sb.st_size == 0
+	    && write(cap->fd, CAPTURE_MAGIC,
+		     CAPTURE_MAGIC_LEN) != CAPTURE_MAGIC_LEN)) {
+	gpsd_log(&session->context->errout, LOG_ERROR,
+		 "CAPTURE: can't log %s to %s: %s\n",
+		 session->gpsdata.dev.path, path, strerror(errno));
+	if (cap->fd != -1)
+	    (void)close(cap->fd);
+	cap->fd = -1;
+	return;
+    }
+    cap->offset = (sb.st_size == 0) ? CAPTURE_MAGIC_LEN : sb.st_size;
+    cap->indexed = 0;
+
+    (void)snprintf(idx, sizeof(idx), "%s.idx", path);
+    cap->idxfd = open(idx, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (cap->idxfd == -1)
+	gpsd_log(&session->context->errout, LOG_WARN,
+		 "CAPTURE: can't write index %s: %s\n", idx, strerror(errno));
+
+    session->lexer.capture = cap;
+    gpsd_log(&session->context->errout, LOG_INF,
+	     "CAPTURE: logging %s to %s\n", session->gpsdata.dev.path, path);
+}
+
+void gpsd_capture_close(struct gps_device_t *session)
+{
+    struct gps_capture_t *cap = &session->capture;
+
+    session->lexer.capture = NULL;
+    if (cap->fd != -1)
+	(void)close(cap->fd);
+    if (cap->idxfd != -1)
+	(void)close(cap->idxfd);
+    cap->fd = cap->idxfd = -1;
+}
+
+bool gpsd_capture_write(struct gps_capture_t *cap,
+			const unsigned char *buf, size_t len)
+/* log one read's worth of input; false if the log can't be written */
+{
+    unsigned char hdr[CAPTURE_HEADER];
+    struct iovec iov[2];
+    timestamp_t now = timestamp();
+    uint64_t usec = (uint64_t)(now * 1e6);
+
+    if (cap->idxfd != -1 && now - cap->indexed >= CAPTURE_INDEX_INTERVAL) {
+	unsigned char entry[CAPTURE_INDEX_ENTRY];
+
+	put_u64(entry, 0, usec);
+	put_u64(entry, 8, (uint64_t)cap->offset);
+	/* a lost entry only makes seeking slower */
+	if (write(cap->idxfd, entry, sizeof(entry)) == (ssize_t)sizeof(entry))
+	    cap->indexed = now;
+    }
+
+    putbe32(hdr, 0, (uint32_t)len);
+    put_u64(hdr, 4, usec);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)buf;
+    iov[1].iov_len = len;
+    if (writev(cap->fd, iov, 2) != (ssize_t)(sizeof(hdr) + len))
+	return false;
+    cap->offset += (off_t)(sizeof(hdr) + len);
+    return true;
+}
+
+struct replay_t {
+    FILE *log;
+    int sock;			/* our end of the socket pair */
+    double speed;		/* 0 for as fast as possible */
+    uint64_t start;		/* microseconds, skip records before this */
+};
+
+static double monotonic_now(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *replay_thread(void *arg)
+/* feed the log to the daemon at the pace it was recorded, scaled */
+{
+    struct replay_t *rp = (struct replay_t *)arg;
+    unsigned char hdr[CAPTURE_HEADER];
+    unsigned char data[MAX_PACKET_LENGTH*2+1];
+    uint64_t first = 0;
+    double base = 0;
+
+    while (fread(hdr, 1, sizeof(hdr), rp->log) == sizeof(hdr)) {
+	size_t len = getbeu32(hdr, 0);
+	uint64_t usec = getbeu64(hdr, 4);
+	unsigned char *p = data;
+
+	/* a record longer than the lexer reads means a damaged log */
+	if (len > sizeof(data) || fread(data, 1, len, rp->log) != len)
+	    break;
+	if (usec < rp->start)
+	    continue;
+	if (rp->speed > 0) {
+	    if (first == 0) {
+		first = usec;
+		base = monotonic_now();
+	    } else if (usec > first) {
+		double left = base + (double)(usec - first) / 1e6 / rp->speed
+			      - monotonic_now();
+
+		if (left > 0) {
+		    struct timespec delay;
+
+		    delay.tv_sec = (time_t)left;
+		    delay.tv_nsec = (long)((left - (double)delay.tv_sec) * 1e9);
+		    while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+			continue;
+		}
+	    }
+	}
+	while (len > 0) {
+	    ssize_t sent = send(rp->sock, p, len, MSG_NOSIGNAL);
+
+	    if (sent == -1 && errno == EINTR)
+		continue;
+	    if (sent <= 0)
+		goto done;	/* the daemon closed the device */
+	    p += sent;
+	    len -= (size_t)sent;
+	}
+    }
+done:
+    (void)fclose(rp->log);
+    (void)close(rp->sock);
+    free(rp);
+    return NULL;
+}
+
+static void replay_seek(struct replay_t *rp, const char *path,
+			const struct gpsd_errout_t *errout)
+/* move to the last indexed record at or before the start time */
+{
+    char idx[GPS_PATH_MAX + 4];
+    unsigned char entry[CAPTURE_INDEX_ENTRY];
+    off_t lo, hi, offset = CAPTURE_MAGIC_LEN;
+    struct stat sb;
+    int fd;
+
+    (void)snprintf(idx, sizeof(idx), "%s.idx", path);
+    if ((fd = open(idx, O_RDONLY)) == -1 || fstat(fd, &sb) == -1) {
+	gpsd_log(errout, LOG_WARN,
+		 "REPLAY: no index %s, scanning from the start\n", idx);
+	if (fd != -1)
+	    (void)close(fd);
+	return;
+    }
+    /* entries before lo are all at or before the start time */
+    lo = 0;
+    hi = sb.st_size / CAPTURE_INDEX_ENTRY;
+    while (lo < hi) {
+	off_t mid = lo + (hi - lo) / 2;
+
+	if (pread(fd, entry, sizeof(entry),
+		  mid * CAPTURE_INDEX_ENTRY) != (ssize_t)sizeof(entry))
+	    break;
+	if (getbeu64(entry, 0) <= rp->start) {
+	    offset = (off_t)getbeu64(entry, 8);
+	    lo = mid + 1;
+	} else
+	    hi = mid;
+    }
+    (void)close(fd);
+    if (fseeko(rp->log, offset, SEEK_SET) != 0)
+	(void)fseeko(rp->log, CAPTURE_MAGIC_LEN, SEEK_SET);
+    gpsd_log(errout, LOG_PROG, "REPLAY: starting from offset %lld of %s\n",
+	     (long long)offset, path);
+}
+
+int gpsd_replay_open(struct gps_device_t *session)
+/* start playing back a capture log; return the daemon's end */
+{
+    const struct gpsd_errout_t *errout = &session->context->errout;
+    char path[GPS_PATH_MAX], *opts;
+    char magic[CAPTURE_MAGIC_LEN];
+    struct replay_t *rp;
+    pthread_attr_t attr;
+    pthread_t pt;
+    double speed;
+    int sv[2];
+
+    if ((rp = calloc(1, sizeof(*rp))) == NULL)
+	return -1;
+    rp->speed = 1.0;
+    (void)strlcpy(path, session->gpsdata.dev.path + 9, sizeof(path));
+    if ((opts = strchr(path, '?')) != NULL) {
+	char *opt, *save = NULL;
+
+	*opts++ = '\0';
+	for (opt = strtok_r(opts, "&", &save); opt != NULL;
+	     opt = strtok_r(NULL, "&", &save)) {
+	    if (str_starts_with(opt, "speed=")) {
+		rp->speed = (strcmp(opt + 6, "max") == 0)
+			    ? 0 : safe_atof(opt + 6);
+		if (!(rp->speed >= 0)) {
+		    gpsd_log(errout, LOG_ERROR,
+			     "REPLAY: bad speed %s\n", opt + 6);
+		    free(rp);
+		    return -1;
+		}
+	    } else if (str_starts_with(opt, "start=")) {
+		timestamp_t t = (strchr(opt + 6, 'T') != NULL)
+				? iso8601_to_unix(opt + 6)
+				: safe_atof(opt + 6);
+
+		if (t > 0)
+		    rp->start = (uint64_t)(t * 1e6);
+	    } else
+		gpsd_log(errout, LOG_WARN,
+			 "REPLAY: unknown option %s ignored\n", opt);
+	}
+    }
+
+    if ((rp->log = fopen(path, "rb")) == NULL) {
+	gpsd_log(errout, LOG_ERROR, "REPLAY: can't open %s: %s\n",
+		 path, strerror(errno));
+	free(rp);
+	return -1;
+    }
+    if (fread(magic, 1, sizeof(magic), rp->log) != sizeof(magic)
+	|| memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0) {
+	gpsd_log(errout, LOG_ERROR, "REPLAY: %s is not a capture log\n", path);
+	(void)fclose(rp->log);
+	free(rp);
+	return -1;
+    }
+    if (rp->start > 0)
+	replay_seek(rp, path, errout);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+	gpsd_log(errout, LOG_ERROR, "REPLAY: socketpair failed: %s\n",
+		 strerror(errno));
+	(void)fclose(rp->log);
+	free(rp);
+	return -1;
+    }
+    rp->sock = sv[1];
+    speed = rp->speed;		/* rp is the thread's from here on */
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&pt, &attr, replay_thread, rp) != 0) {
+	gpsd_log(errout, LOG_ERROR, "REPLAY: can't start thread for %s\n",
+		 path);
+	(void)pthread_attr_destroy(&attr);
+	(void)close(sv[0]);
+	(void)close(sv[1]);
+	(void)fclose(rp->log);
+	free(rp);
+	return -1;
+    }
+    (void)pthread_attr_destroy(&attr);
+
+    gpsd_log(errout, LOG_INF, "REPLAY: playing %s at speed %g on fd %d\n",
+	     path, speed, sv[0]);
+    session->gpsdata.gps_fd = sv[0];
+    session->sourcetype = source_replay;
+    return sv[0];
+}
+
+/* capture.c ends here */
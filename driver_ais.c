@@ -75,6 +75,86 @@ static void from_sixbit(unsigned char *bitvec, unsigned int start, int count,
        trim_spaces_on_right_end(to);
 }
 
+static struct ais_type24a_t *type24a_home(struct ais_type24_queue_t *queue,
+					  unsigned int mmsi)
+/* first slot of an MMSI's probe window */
+{
+    return &queue->ships[(mmsi * 2654435761U) % AIS_TYPE24_SLOTS];
+}
+
+static struct ais_type24a_t *type24a_next(struct ais_type24_queue_t *queue,
+					  struct ais_type24a_t *slot)
+{
+    return (++slot < queue->ships + AIS_TYPE24_SLOTS) ? slot : queue->ships;
+}
+
+void ais_type24a_stash(const struct gpsd_errout_t *errout,
+		       struct ais_type24_queue_t *queue,
+		       unsigned int mmsi, const char *shipname)
+/* hold a part A until its part B comes in */
+{
+    timestamp_t now = timestamp();
+    struct ais_type24a_t *slot, *use = NULL;
+    int i;
+
+    /* take our own slot, else the first free or expired one */
+    for (i = 0, slot = type24a_home(queue, mmsi); i < TYPE24_PROBES;
+	 i++, slot = type24a_next(queue, slot)) {
+	if (slot->mmsi == mmsi) {
+	    use = slot;
+	    break;
+	}
+	if (use == NULL
+	    && (slot->mmsi == 0 || now - slot->stashed > TYPE24_EXPIRY))
+	    use = slot;
+    }
+    if (use == NULL) {
+	/* window full of live part As: the oldest one goes */
+	use = type24a_home(queue, mmsi);
+	for (i = 0, slot = use; i < TYPE24_PROBES;
+	     i++, slot = type24a_next(queue, slot))
+	    if (slot->stashed < use->stashed)
+		use = slot;
+	queue->evicted++;
+	gpsd_log(errout, LOG_PROG,
+		 "AIVDM: 24A from %09u evicted unmatched.\n", use->mmsi);
+    } else if (use->mmsi != 0 && use->mmsi != mmsi)
+	queue->orphaned++;
+
+    use->mmsi = mmsi;
+    use->stashed = now;
+    (void)strlcpy(use->shipname, shipname, sizeof(use->shipname));
+    gpsd_log(errout, LOG_PROG, "AIVDM: 24A from %09u stashed.\n", mmsi);
+}
+
+bool ais_type24a_match(const struct gpsd_errout_t *errout,
+		       struct ais_type24_queue_t *queue,
+		       unsigned int mmsi, char *shipname, size_t len)
+/* find and release the part A for a part B */
+{
+    struct ais_type24a_t *slot;
+    int i;
+
+    for (i = 0, slot = type24a_home(queue, mmsi); i < TYPE24_PROBES;
+	 i++, slot = type24a_next(queue, slot)) {
+	if (slot->mmsi != mmsi)
+	    continue;
+	/* prevent false match if a 24B is repeated */
+	slot->mmsi = 0;
+	if (timestamp() - slot->stashed > TYPE24_EXPIRY)
+	    break;
+	(void)strlcpy(shipname, slot->shipname, len);
+	queue->matched++;
+	gpsd_log(errout, LOG_PROG,
+		 "AIVDM 24B from %09u matches a 24A "
+		 "(%lu matched, %lu evicted, %lu orphaned).\n",
+		 mmsi, queue->matched, queue->evicted, queue->orphaned);
+	return true;
+    }
+    queue->orphaned++;
+    return false;
+}
+
 bool ais_binary_decode(const struct gpsd_errout_t *errout,
 		       struct ais_t *ais,
 		       const unsigned char *bits, size_t bitlen,
@@ -971,21 +1051,12 @@ bool ais_binary_decode(const struct gpsd_errout_t *errout,
 	switch (UBITS(38, 2)) {
 	case 0:
 	    RANGE_CHECK(160, 168);
-	    /* save incoming 24A shipname/MMSI pairs in a circular queue */
-	    {
-		struct ais_type24a_t *saveptr = &type24_queue->ships[type24_queue->index];
-
-		gpsd_log(errout, LOG_PROG,
-			 "AIVDM: 24A from %09u stashed.\n",
-			 ais->mmsi);
-		saveptr->mmsi = ais->mmsi;
-		UCHARS(40, saveptr->shipname);
-		++type24_queue->index;
-		type24_queue->index %= MAX_TYPE24_INTERLEAVE;
-	    }
 	    //ais->type24.a.spare	= UBITS(160, 8);
 
 	    UCHARS(40, ais->type24.shipname);
+	    /* save incoming 24A shipname/MMSI pairs for the 24B */
+	    ais_type24a_stash(errout, type24_queue,
+			      ais->mmsi, ais->type24.shipname);
 	    ais->type24.part = part_a;
 	    return true;
 	case 1:
@@ -1016,20 +1087,12 @@ bool ais_binary_decode(const struct gpsd_errout_t *errout,
 	    }
 	    //ais->type24.b.spare	    = UBITS(162, 8);
 
-	    /* search the 24A queue for a matching MMSI */
-	    for (i = 0; i < MAX_TYPE24_INTERLEAVE; i++) {
-		if (type24_queue->ships[i].mmsi == ais->mmsi) {
-		    (void)strlcpy(ais->type24.shipname,
-				  type24_queue->ships[i].shipname,
-				  sizeof(ais->type24.shipname));
-		    gpsd_log(errout, LOG_PROG,
-			     "AIVDM 24B from %09u matches a 24A.\n",
-			     ais->mmsi);
-		    /* prevent false match if a 24B is repeated */
-		    type24_queue->ships[i].mmsi = 0;
-		    ais->type24.part = both;
-		    return true;
-		}
+	    /* search the 24A table for a matching MMSI */
+	    if (ais_type24a_match(errout, type24_queue, ais->mmsi,
+				  ais->type24.shipname,
+				  sizeof(ais->type24.shipname))) {
+		ais->type24.part = both;
+		return true;
 	    }
 
 	    /* no match, return Part B */
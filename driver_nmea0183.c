@@ -3228,11 +3228,12 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
              *
 	     */
 	    if (0 < lasttag &&
+		'\0' == session->nmea.cycle_ender[0] &&
 		0 == (session->nmea.cycle_enders & lasttag_mask) &&
 		!session->nmea.cycle_continue) {
 		session->nmea.cycle_enders |= lasttag_mask;
 		/* cast for 32/64 bit compat */
-		gpsd_log(&session->context->errout, LOG_PROG,
+		gpsd_log(&session->context->errout, LOG_INF,
 			 "tagged %s as a cycle ender. %#llx\n",
 			 nmea_phrase[lasttag - 1].name,
                          (unsigned long long)lasttag_mask);
@@ -3245,7 +3246,8 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
 		     "%s is just after a cycle ender.\n",
 		     session->nmea.field[0]);
         }
-	if (session->nmea.cycle_continue) {
+	if (session->nmea.cycle_continue &&
+	    '\0' == session->nmea.cycle_ender[0]) {
 	    gpsd_log(&session->context->errout, LOG_PROG,
 		     "%s extends the reporting cycle.\n",
 		     session->nmea.field[0]);
@@ -3256,7 +3258,19 @@ gps_mask_t nmea_parse(char *sentence, struct gps_device_t * session)
     }
 
     /* here's where we check for end-of-cycle */
-    if ((session->nmea.latch_frac_time || session->nmea.cycle_continue)
+    if ('\0' != session->nmea.cycle_ender[0]) {
+	/* configured ender, with or without talker ID; time or not */
+	const char *tag = session->nmea.field[0];
+
+	if (0 == strcmp(tag, session->nmea.cycle_ender) ||
+	    (5 == strlen(tag) &&
+	     0 == strcmp(tag + 2, session->nmea.cycle_ender))) {
+	    gpsd_log(&session->context->errout, LOG_PROG,
+		     "%s ends a reporting cycle, as configured.\n", tag);
+	    mask |= REPORT_IS;
+	}
+	session->cycle_end_reliable = true;
+    } else if ((session->nmea.latch_frac_time || session->nmea.cycle_continue)
 	&& (session->nmea.cycle_enders & thistag_mask)!=0) {
 	gpsd_log(&session->context->errout, LOG_PROG,
 		 "%s ends a reporting cycle.\n",
@@ -10,7 +10,9 @@
 #if defined(NMEA2000_ENABLE)
 
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
 #include <math.h>
@@ -22,6 +24,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -37,6 +40,8 @@
 #define CAN_NAMELEN 32
 #define MIN(a,b) ((a < b) ? a : b)
 
+#define NMEA2000_BATCH 32	/* CAN frames per recvmmsg() */
+
 #define NMEA2000_DEBUG_AIS 0
 #define NMEA2000_FAST_DEBUG 0
 
@@ -830,7 +835,7 @@ static gps_mask_t hnd_129802(unsigned char *bu, int len, PGN *pgn, struct gps_de
 	     "pgn %6d(%3d):\n", pgn->pgn, session->driver.nmea2000.unit);
 
     if (decode_ais_header(session->context, bu, len, ais, 0x3fffffff) != 0) {
-        int                   l;
+        int l;
 
 /*      ais->type14.channel = (bu[ 5] >> 0) & 0x1f; */
 	for (l=0;l<36;l++) {
@@ -858,26 +863,16 @@ static gps_mask_t hnd_129809(unsigned char *bu, int len, PGN *pgn, struct gps_de
 	     "pgn %6d(%3d):\n", pgn->pgn, session->driver.nmea2000.unit);
 
     if (decode_ais_header(session->context, bu, len, ais, 0xffffffffU) != 0) {
-        int                   l;
-	int                   index   = session->driver.aivdm.context[0].type24_queue.index;
-	struct ais_type24a_t *saveptr = &session->driver.aivdm.context[0].type24_queue.ships[index];
-
-	gpsd_log(&session->context->errout, LOG_PROG,
-		 "NMEA2000: AIS message 24A from %09u stashed.\n",
-		 ais->mmsi);
+        int l;
 
 	for (l=0;l<AIS_SHIPNAME_MAXLEN;l++) {
 	    ais->type24.shipname[l] = (char) bu[ 5+l];
-	    saveptr->shipname[l] = (char) bu[ 5+l];
 	}
 	ais->type24.shipname[AIS_SHIPNAME_MAXLEN] = (char) 0;
-	saveptr->shipname[AIS_SHIPNAME_MAXLEN] = (char) 0;
-	
-	saveptr->mmsi = ais->mmsi;
 
-	index += 1;
-	index %= MAX_TYPE24_INTERLEAVE;
-	session->driver.aivdm.context[0].type24_queue.index = index;
+	ais_type24a_stash(&session->context->errout,
+			  &session->driver.aivdm.context[0].type24_queue,
+			  ais->mmsi, ais->type24.shipname);
 
 	decode_ais_channel_info(bu, len, 200, session);
 
@@ -901,7 +896,7 @@ static gps_mask_t hnd_129810(unsigned char *bu, int len, PGN *pgn, struct gps_de
 	     "pgn %6d(%3d):\n", pgn->pgn, session->driver.nmea2000.unit);
 
     if (decode_ais_header(session->context, bu, len, ais, 0xffffffffU) != 0) {
-        int l, i;
+        int l;
 
 	ais->type24.shiptype = (unsigned int) ((bu[ 5] >> 0) & 0xff);
 
@@ -941,34 +936,25 @@ static gps_mask_t hnd_129810(unsigned char *bu, int len, PGN *pgn, struct gps_de
 	    ais->type24.dim.to_starboard  = (unsigned int) (to_starboard/10);
 	}
 
-	for (i = 0; i < MAX_TYPE24_INTERLEAVE; i++) {
-	    if (session->driver.aivdm.context[0].type24_queue.ships[i].mmsi == ais->mmsi) {
-	        for (l=0;l<AIS_SHIPNAME_MAXLEN;l++) {
-		    ais->type24.shipname[l] = (char)(session->driver.aivdm.context[0].type24_queue.ships[i].shipname[l]);
-		}
-		ais->type24.shipname[AIS_SHIPNAME_MAXLEN] = (char) 0;
-
-		gpsd_log(&session->context->errout, LOG_PROG,
-			 "NMEA2000: AIS 24B from %09u matches a 24A.\n",
-			    ais->mmsi);
-		/* prevent false match if a 24B is repeated */
-		session->driver.aivdm.context[0].type24_queue.ships[i].mmsi = 0;
+	if (ais_type24a_match(&session->context->errout,
+			      &session->driver.aivdm.context[0].type24_queue,
+			      ais->mmsi, ais->type24.shipname,
+			      sizeof(ais->type24.shipname))) {
 #if NMEA2000_DEBUG_AIS
-		printf("AIS: MMSI:  %09u\n", ais->mmsi);
-		printf("AIS: name:  %-20.20s v:%-8.8s c:%-8.8s b:%6u s:%6u p:%6u s:%6u\n",
-		       ais->type24.shipname,
-		       ais->type24.vendorid,
-		       ais->type24.callsign,
-		       ais->type24.dim.to_bow,
-		       ais->type24.dim.to_stern,
-		       ais->type24.dim.to_port,
-		       ais->type24.dim.to_starboard);
+	    printf("AIS: MMSI:  %09u\n", ais->mmsi);
+	    printf("AIS: name:  %-20.20s v:%-8.8s c:%-8.8s b:%6u s:%6u p:%6u s:%6u\n",
+		   ais->type24.shipname,
+		   ais->type24.vendorid,
+		   ais->type24.callsign,
+		   ais->type24.dim.to_bow,
+		   ais->type24.dim.to_stern,
+		   ais->type24.dim.to_port,
+		   ais->type24.dim.to_starboard);
 #endif /* of #if NMEA2000_DEBUG_AIS */
 
-		decode_ais_channel_info(bu, len, 264, session);
-		ais->type24.part = both;
-		return(ONLINE_SET | AIS_SET);
-	    }
+	    decode_ais_channel_info(bu, len, 264, session);
+	    ais->type24.part = both;
+	    return(ONLINE_SET | AIS_SET);
 	}
 #if NMEA2000_DEBUG_AIS
 	printf("AIS: MMSI  :  %09u\n", ais->mmsi);
@@ -1286,22 +1272,161 @@ static PGN navpgn[] = {{ 59392, 0, 0, hnd_059392, &msg_059392[0]},
 
 
 
+#define PGN_LISTS 4
+
+static PGN *pgnlists[PGN_LISTS] = {gpspgn, aispgn, pwrpgn, navpgn};
+
+/*
+ * Every frame on the bus needs its PGN looked up, so each list gets a
+ * small open-addressed hash index, built on first use.
+ */
+#define PGN_HASH_SIZE 64	/* power of 2, over twice the longest list */
+
+static PGN *pgn_index[PGN_LISTS][PGN_HASH_SIZE];
+static bool pgn_index_built;
+
+static unsigned int pgn_hash(unsigned int pgn)
+{
+    /* Fibonacci hashing, the top 6 bits of a 32-bit product */
+    return ((pgn * 2654435761U) & 0xffffffffU) >> 26;
+}
+
+static void pgn_index_build(void)
+{
+    int l1;
+
+    for (l1 = 0; l1 < NITEMS(pgnlists); l1++) {
+	PGN *work;
+
+	for (work = pgnlists[l1]; work->pgn != 0; work++) {
+	    unsigned int h = pgn_hash(work->pgn);
+
+	    while (pgn_index[l1][h] != NULL)
+		h = (h + 1) & (PGN_HASH_SIZE - 1);
+	    pgn_index[l1][h] = work;
+	}
+    }
+    pgn_index_built = true;
+}
+
 static PGN *search_pgnlist(unsigned int pgn, PGN *pgnlist)
 {
     int l1;
-    PGN *work;
 
-    l1 = 0;
-    work = NULL;
-    while (pgnlist[l1].pgn != 0) {
-        if (pgnlist[l1].pgn == pgn) {
-	    work = &pgnlist[l1];
+    if (!pgn_index_built)
+	pgn_index_build();
+    for (l1 = 0; l1 < NITEMS(pgnlists); l1++) {
+	if (pgnlists[l1] == pgnlist) {
+	    unsigned int h = pgn_hash(pgn);
+
+	    while (pgn_index[l1][h] != NULL) {
+		if (pgn_index[l1][h]->pgn == pgn)
+		    return pgn_index[l1][h];
+		h = (h + 1) & (PGN_HASH_SIZE - 1);
+	    }
 	    break;
-	} else {
-	    l1 = l1 + 1;
+	}
+    }
+    return NULL;
+}
+
+static bool fast_packet(struct can_frame *frame, struct gps_device_t *session,
+			unsigned int source_pgn, unsigned int source_unit)
+/* feed a fast-packet frame to the reassembly table, true when complete */
+{
+    unsigned char seq = frame->data[0] & 0xe0;
+    unsigned char counter = frame->data[0] & 0x1f;
+    unsigned int l1, first;
+    int slot = -1;
+
+    for (l1 = 0; l1 < NMEA2000_FAST_SLOTS; l1++) {
+	if (session->driver.nmea2000.fast[l1].pgn == source_pgn
+	    && session->driver.nmea2000.fast[l1].source == source_unit
+	    && session->driver.nmea2000.fast[l1].seq == seq) {
+	    slot = (int)l1;
+	    break;
+	}
+    }
+
+    if (counter == 0) {
+	/* first frame; reuse a stale entry with our key, else a free
+	 * slot, else evict the one that has waited longest */
+	if (slot < 0) {
+	    unsigned long oldest = ULONG_MAX;
+
+	    for (l1 = 0; l1 < NMEA2000_FAST_SLOTS; l1++) {
+		if (session->driver.nmea2000.fast[l1].pgn == 0) {
+		    slot = (int)l1;
+		    break;
+		}
+		if (session->driver.nmea2000.fast[l1].age < oldest) {
+		    oldest = session->driver.nmea2000.fast[l1].age;
+		    slot = (int)l1;
+		}
 	    }
+	    if (session->driver.nmea2000.fast[slot].pgn != 0)
+		gpsd_log(&session->context->errout, LOG_WARN,
+			 "NMEA2000: fast packet %6u from %u abandoned\n",
+			 session->driver.nmea2000.fast[slot].pgn,
+			 session->driver.nmea2000.fast[slot].source);
+	}
+	if (frame->data[1] > NMEA2000_FAST_MAX) {
+	    gpsd_log(&session->context->errout, LOG_ERROR,
+		     "NMEA2000: fast packet %6u too long (%u)\n",
+		     source_pgn, frame->data[1]);
+	    session->driver.nmea2000.fast[slot].pgn = 0;
+	    return false;
+	}
+	session->driver.nmea2000.fast[slot].pgn = source_pgn;
+	session->driver.nmea2000.fast[slot].source = (unsigned char)source_unit;
+	session->driver.nmea2000.fast[slot].seq = seq;
+	session->driver.nmea2000.fast[slot].len = frame->data[1];
+	session->driver.nmea2000.fast[slot].got = 0;
+	first = 2;
+#if NMEA2000_FAST_DEBUG
+	gpsd_log(&session->context->errout, LOG_ERROR,
+		 "Fast start %2x %2x %2x %6d slot %d\n",
+		 frame->data[0], source_unit, frame->data[1], source_pgn, slot);
+#endif /* of #if NMEA2000_FAST_DEBUG */
+    } else if (slot < 0
+	       || counter != session->driver.nmea2000.fast[slot].next) {
+	gpsd_log(&session->context->errout, LOG_ERROR,
+		 "Fast error %2x %2x %2x %6d\n",
+		 slot < 0 ? 0 : session->driver.nmea2000.fast[slot].next,
+		 frame->data[0], source_unit, source_pgn);
+	if (slot >= 0)
+	    session->driver.nmea2000.fast[slot].pgn = 0;
+	return false;
+    } else
+	first = 1;
+
+    for (l1 = first; l1 < 8; l1++) {
+	if (session->driver.nmea2000.fast[slot].got
+	    < session->driver.nmea2000.fast[slot].len) {
+	    size_t got = session->driver.nmea2000.fast[slot].got++;
+	    session->driver.nmea2000.fast[slot].buf[got] = frame->data[l1];
 	}
-    return work;
+    }
+    session->driver.nmea2000.fast[slot].next = counter + 1;
+    session->driver.nmea2000.fast[slot].age =
+	++session->driver.nmea2000.fast_clock;
+
+    if (session->driver.nmea2000.fast[slot].got
+	< session->driver.nmea2000.fast[slot].len)
+	return false;
+
+#if NMEA2000_FAST_DEBUG
+    gpsd_log(&session->context->errout, LOG_ERROR,
+	     "Fast done  %2x %2x %2x %6d slot %d\n",
+	     frame->data[0], source_unit,
+	     (unsigned int)session->driver.nmea2000.fast[slot].len,
+	     source_pgn, slot);
+#endif /* of #if  NMEA2000_FAST_DEBUG */
+    session->lexer.outbuflen = session->driver.nmea2000.fast[slot].len;
+    memcpy(session->lexer.outbuffer, session->driver.nmea2000.fast[slot].buf,
+	   session->lexer.outbuflen);
+    session->driver.nmea2000.fast[slot].pgn = 0;
+    return true;
 }
 
 static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
@@ -1420,61 +1545,12 @@ static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
 		    for (l2=0;l2<session->lexer.outbuflen;l2++) {
 		        session->lexer.outbuffer[l2]= frame->data[l2];
 		    }
-		} else if ((frame->data[0] & 0x1f) == 0) {
-		    unsigned int l2;
-
-		    session->driver.nmea2000.fast_packet_len = frame->data[1];
-		    session->driver.nmea2000.idx = frame->data[0];
-#if NMEA2000_FAST_DEBUG
-		    gpsd_log(&session->context->errout, LOG_ERROR,
-			     "Set idx    %2x    %2x %2x %6d\n",
-			     frame->data[0],
-			     session->driver.nmea2000.unit,
-			     frame->data[1],
-			     source_pgn);
-#endif /* of #if NMEA2000_FAST_DEBUG */
-		    session->lexer.inbuflen = 0;
-		    session->driver.nmea2000.idx += 1;
-		    for (l2=2;l2<8;l2++) {
-		        session->lexer.inbuffer[session->lexer.inbuflen++] = frame->data[l2];
-		    }
-		    gpsd_log(&session->context->errout, LOG_DATA,
-			     "pgn %6d:%s \n", work->pgn, work->name);
-		} else if (frame->data[0] == session->driver.nmea2000.idx) {
-		    unsigned int l2;
-
-		    for (l2=1;l2<8;l2++) {
-		        if (session->driver.nmea2000.fast_packet_len > session->lexer.inbuflen) {
-			    session->lexer.inbuffer[session->lexer.inbuflen++] = frame->data[l2];
-			}
-		    }
-		    if (session->lexer.inbuflen == session->driver.nmea2000.fast_packet_len) {
-#if NMEA2000_FAST_DEBUG
-		        gpsd_log(&session->context->errout, LOG_ERROR,
-				 "Fast done  %2x %2x %2x %2x %6d\n",
-				 session->driver.nmea2000.idx,
-				                                                   frame->data[0],
-				                                                   session->driver.nmea2000.unit,
-				                                                   (unsigned int) session->driver.nmea2000.fast_packet_len,
-				                                                   source_pgn);
-#endif /* of #if  NMEA2000_FAST_DEBUG */
-			session->driver.nmea2000.workpgn = (void *) work;
-		        session->lexer.outbuflen = session->driver.nmea2000.fast_packet_len;
-			for(l2=0;l2 < (unsigned int)session->lexer.outbuflen; l2++) {
-			    session->lexer.outbuffer[l2] = session->lexer.inbuffer[l2];
-			}
-			session->driver.nmea2000.fast_packet_len = 0;
-		    } else {
-		        session->driver.nmea2000.idx += 1;
-		    }
 		} else {
-		    gpsd_log(&session->context->errout, LOG_ERROR,
-			     "Fast error %2x %2x %2x %2x %6d\n",
-			     session->driver.nmea2000.idx,
-			     frame->data[0],
-			     session->driver.nmea2000.unit,
-			     (unsigned int) session->driver.nmea2000.fast_packet_len,
-				                                               source_pgn);
+		    if ((frame->data[0] & 0x1f) == 0)
+			gpsd_log(&session->context->errout, LOG_DATA,
+				 "pgn %6d:%s \n", work->pgn, work->name);
+		    if (fast_packet(frame, session, source_pgn, source_unit))
+			session->driver.nmea2000.workpgn = (void *) work;
 		}
 	    } else {
 	        gpsd_log(&session->context->errout, LOG_WARN,
@@ -1503,19 +1579,61 @@ static void find_pgn(struct can_frame *frame, struct gps_device_t *session)
 
 
 static ssize_t nmea2000_get(struct gps_device_t *session)
+/*
+ * Get frames until one completes a packet.  Frames are read in
+ * batches; the lexer input buffer isn't otherwise used by this
+ * driver, so it holds the unconsumed rest of a batch.  At most one
+ * batch is read per call, so a busy bus can't starve other devices.
+ */
 {
+    struct gps_lexer_t *lexer = &session->lexer;
     struct can_frame frame;
-    ssize_t          status;
+    ssize_t consumed = 0;
+    bool refilled = false;
+
+    lexer->outbuflen = 0;
+    for (;;) {
+	if (lexer->inbufptr >= lexer->inbuffer + lexer->inbuflen) {
+	    struct mmsghdr msgs[NMEA2000_BATCH];
+	    struct iovec iovs[NMEA2000_BATCH];
+	    int l1, got, kept;
+
+	    if (refilled)
+		return consumed;
+	    refilled = true;
+	    memset(msgs, 0, sizeof(msgs));
+	    for (l1 = 0; l1 < NMEA2000_BATCH; l1++) {
+		iovs[l1].iov_base = lexer->inbuffer + l1 * sizeof(frame);
+		iovs[l1].iov_len = sizeof(frame);
+		msgs[l1].msg_hdr.msg_iov = &iovs[l1];
+		msgs[l1].msg_hdr.msg_iovlen = 1;
+	    }
+	    got = recvmmsg(session->gpsdata.gps_fd, msgs, NMEA2000_BATCH,
+			   MSG_DONTWAIT, NULL);
+	    /* drop anything that isn't a whole classic CAN frame */
+	    for (l1 = kept = 0; l1 < got; l1++) {
+		if (msgs[l1].msg_len != sizeof(frame))
+		    continue;
+		if (kept != l1)
+		    memmove(lexer->inbuffer + kept * sizeof(frame),
+			    lexer->inbuffer + l1 * sizeof(frame),
+			    sizeof(frame));
+		kept++;
+	    }
+	    lexer->inbufptr = lexer->inbuffer;
+	    lexer->inbuflen = (size_t)kept * sizeof(frame);
+	    if (kept == 0)
+		return consumed;
+	}
+	memcpy(&frame, lexer->inbufptr, sizeof(frame));
+	lexer->inbufptr += sizeof(frame);
+	consumed += (ssize_t)sizeof(frame);
 
-    session->lexer.outbuflen = 0;
-    status = read(session->gpsdata.gps_fd, &frame, sizeof(frame));
-    if (status == (ssize_t)sizeof(frame)) {
-        session->lexer.type = NMEA2000_PACKET;
+	lexer->type = NMEA2000_PACKET;
 	find_pgn(&frame, session);
-
-        return frame.can_dlc & 0x0f;
+	if (session->driver.nmea2000.workpgn != NULL && lexer->outbuflen > 0)
+	    return (ssize_t)lexer->outbuflen;
     }
-    return 0;
 }
 
 static gps_mask_t nmea2000_parse_input(struct gps_device_t *session)
@@ -1537,6 +1655,43 @@ static gps_mask_t nmea2000_parse_input(struct gps_device_t *session)
 }
 
 
+static void nmea2000_filter(struct gps_device_t *session, socket_t sock,
+			    int unit_number)
+/* have the kernel pass only PGNs we decode, and only from our unit */
+{
+    struct can_filter filters[PGN_HASH_SIZE * PGN_LISTS];
+    int l1, l2, count = 0;
+
+    for (l1 = 0; l1 < NITEMS(pgnlists); l1++) {
+	PGN *work;
+
+	for (work = pgnlists[l1]; work->pgn != 0; work++) {
+	    /* PDU1 PGNs carry the destination address in their low byte */
+	    bool pdu1 = ((work->pgn & 0x0ff00) >> 8) < 240;
+
+	    for (l2 = 0; l2 < count; l2++)
+		if ((filters[l2].can_id & CAN_EFF_MASK) >> 8 == work->pgn)
+		    break;
+	    if (l2 < count)
+		continue;
+	    filters[count].can_id = CAN_EFF_FLAG | (work->pgn << 8);
+	    filters[count].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG
+		| ((pdu1 ? 0x1ff00U : 0x1ffffU) << 8);
+	    if (unit_number >= 0) {
+		filters[count].can_id |= (canid_t)unit_number;
+		filters[count].can_mask |= 0xff;
+	    }
+	    count++;
+	}
+    }
+    /* not fatal, find_pgn() filters anyway */
+    if (setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, filters,
+		   (socklen_t)(count * sizeof(filters[0]))) != 0)
+	gpsd_log(&session->context->errout, LOG_WARN,
+		 "NMEA2000 open: can not set CAN filters: %s\n",
+		 strerror(errno));
+}
+
 int nmea2000_open(struct gps_device_t *session)
 {
     char interface_name[GPS_PATH_MAX];
@@ -1655,8 +1810,14 @@ int nmea2000_open(struct gps_device_t *session)
 	return -1;
     }
 
+    nmea2000_filter(session, sock, unit_ptr != NULL ? unit_number : -1);
+
     gpsd_switch_driver(session, "NMEA2000");
     session->gpsdata.gps_fd = sock;
+    session->lexer.inbuflen = 0;
+    session->lexer.inbufptr = session->lexer.inbuffer;
+    memset(session->driver.nmea2000.fast, 0,
+	   sizeof(session->driver.nmea2000.fast));
     session->sourcetype = source_can;
     session->servicetype = service_sensor;
     session->driver.nmea2000.can_net = can_net;
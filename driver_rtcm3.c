@@ -76,13 +76,13 @@ void rtcm3_unpack(const struct gps_context_t *context,
 /* break out the raw bits into the scaled report-structure fields */
 {
     unsigned int n, n2, n3, n4;
-    int bitcount = 0;
+    struct bitreader_t br;
     unsigned int i;
     signed long temp;
     bool unknown = true;;
 
-#define ugrab(width)	(bitcount += width, ubits((unsigned char *)buf, bitcount-width, width, false))
-#define sgrab(width)	(bitcount += width, sbits((signed char *)buf, bitcount-width, width, false))
+#define ugrab(width)	bitreader_u(&br, width)
+#define sgrab(width)	bitreader_s(&br, width)
 #define GPS_PSEUDORANGE(fld, len) \
     {temp = (unsigned long)ugrab(len);		\
     if (temp == GPS_INVALID_PSEUDORANGE)	\
@@ -97,6 +97,7 @@ void rtcm3_unpack(const struct gps_context_t *context,
 	fld.rangediff = temp * PSEUDORANGE_DIFF_RESOLUTION;
 
     memset(rtcm, 0, sizeof(struct rtcm3_t));
+    bitreader_init(&br, buf, 0);
     //assert(ugrab(8) == 0xD3);
     //assert(ugrab(6) == 0x00);
     ugrab(14);
@@ -254,7 +255,7 @@ void rtcm3_unpack(const struct gps_context_t *context,
 	n = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1007.descriptor, buf + 7, n);
 	rtcm->rtcmtypes.rtcm3_1007.descriptor[n] = '\0';
-	bitcount += 8 * n;
+	bitreader_skip(&br, 8 * n);
 	rtcm->rtcmtypes.rtcm3_1007.setup_id = ugrab(8);
 	unknown = false;
 	break;
@@ -265,12 +266,12 @@ void rtcm3_unpack(const struct gps_context_t *context,
 	n = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1008.descriptor, buf + 7, n);
 	rtcm->rtcmtypes.rtcm3_1008.descriptor[n] = '\0';
-	bitcount += 8 * n;
+	bitreader_skip(&br, 8 * n);
 	rtcm->rtcmtypes.rtcm3_1008.setup_id = ugrab(8);
 	n2 = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1008.serial, buf + 9 + n, n2);
 	rtcm->rtcmtypes.rtcm3_1008.serial[n2] = '\0';
-	//bitcount += 8 * n2;
+	//bitreader_skip(&br, 8 * n2);
 	unknown = false;
 	break;
 
@@ -468,20 +469,20 @@ void rtcm3_unpack(const struct gps_context_t *context,
 	n = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1033.descriptor, buf + 7, n);
 	rtcm->rtcmtypes.rtcm3_1033.descriptor[n] = '\0';
-	bitcount += 8 * n;
+	bitreader_skip(&br, 8 * n);
 	rtcm->rtcmtypes.rtcm3_1033.setup_id = ugrab(8);
 	n2 = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1033.serial, buf + 9 + n, n2);
 	rtcm->rtcmtypes.rtcm3_1033.serial[n2] = '\0';
-	bitcount += 8 * n2;
+	bitreader_skip(&br, 8 * n2);
 	n3 = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1033.receiver, buf + 10+n+n2, n3);
 	rtcm->rtcmtypes.rtcm3_1033.receiver[n3] = '\0';
-	bitcount += 8 * n3;
+	bitreader_skip(&br, 8 * n3);
 	n4 = (unsigned long)ugrab(8);
 	(void)memcpy(rtcm->rtcmtypes.rtcm3_1033.firmware, buf + 11+n+n2+n3, n3);
 	rtcm->rtcmtypes.rtcm3_1033.firmware[n4] = '\0';
-	//bitcount += 8 * n4;
+	//bitreader_skip(&br, 8 * n4);
 	// TODO: next is receiver serial number
 	unknown = false;
 	break;
@@ -1479,6 +1479,42 @@ static double sirf_time_offset(struct gps_device_t *session)
 }
 #endif /* TIMEHINT_ENABLE */
 
+/* warm-start a receiver that came up without a fix, MID 128 */
+static void sirf_assist(struct gps_device_t *session)
+{
+    const struct gps_assist_t *ap = &session->context->assist;
+    double gpstime = timestamp() - GPS_EPOCH + session->context->leap_seconds;
+    double x, y, z;
+    unsigned char msg[] = {
+	0xa0, 0xa2, 0x00, 0x19,
+	0x80,			/* MID 128 initialize Data Source */
+	0x00, 0x00, 0x00, 0x00,	/* ECEF X */
+	0x00, 0x00, 0x00, 0x00,	/* ECEF Y */
+	0x00, 0x00, 0x00, 0x00,	/* ECEF Z */
+	0x00, 0x00, 0x00, 0x00,	/* clock drift, 0 for last known */
+	0x00, 0x00, 0x00, 0x00,	/* time of week */
+	0x00, 0x00,		/* week number */
+	0x0C,			/* Chans 1-12 */
+	0x01,			/* reset bit map, initialization data valid */
+	0x00, 0x00, 0xb0, 0xb3
+    };
+
+    if (session->context->readonly || ap->fix_time <= 0)
+	return;
+    gpsd_assist_ecef(ap, &x, &y, &z);
+    putbe32(msg, 5, (uint32_t)(int32_t)x);
+    putbe32(msg, 9, (uint32_t)(int32_t)y);
+    putbe32(msg, 13, (uint32_t)(int32_t)z);
+    putbe32(msg, 21, (uint32_t)(fmod(gpstime, SECS_PER_WEEK) * 100));
+    putbe16(msg, 25, (unsigned int)(gpstime / SECS_PER_WEEK));
+    /* keep the subframe data we asked for at configuration */
+    if (session->gpsdata.dev.baudrate >= 57600)
+	msg[28] |= 0x10;
+    gpsd_log(&session->context->errout, LOG_INF,
+	     "SiRF: aided with position and time\n");
+    (void)sirf_write(session, msg);
+}
+
 /* Measured Navigation Data Out ID 2 (0x02) */
 static gps_mask_t sirf_msg_navsol(struct gps_device_t *session,
 				  unsigned char *buf, size_t len)
@@ -1531,6 +1567,12 @@ static gps_mask_t sirf_msg_navsol(struct gps_device_t *session,
     gpsd_log(&session->context->errout, LOG_PROG,
 	     "SiRF: MND 0x02: Navtype %#0x, Status %d mode %d\n",
 	     navtype, session->gpsdata.status, session->newdata.mode);
+    /* the first solution after activation shows whether aiding helps */
+    if (!session->driver.sirf.assist_checked) {
+	session->driver.sirf.assist_checked = true;
+	if (session->newdata.mode < MODE_2D)
+	    sirf_assist(session);
+    }
     /* byte 20 is HDOP */
     session->gpsdata.dop.hdop = (double)getub(buf, 20) / 5.0;
     /* byte 21 is nav_mode2, not clear how to interpret that */
@@ -2282,6 +2324,7 @@ static void sirfbin_event_hook(struct gps_device_t *session, event_t event)
     case event_identified:
         /* FALLTHROUGH */
     case event_reactivate:
+	session->driver.sirf.assist_checked = false;
 	if (session->lexer.type == NMEA_PACKET) {
 	    gpsd_log(&session->context->errout, LOG_PROG,
 		     "SiRF: Switching chip mode to binary.\n");
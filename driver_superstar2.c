@@ -16,6 +16,7 @@
 #if defined(SUPERSTAR2_ENABLE) && defined(BINARY_ENABLE)
 #include "bits.h"
 #include "driver_superstar2.h"
+#include "timespec.h"
 
 /*
  * These routines are specific to this driver
@@ -345,7 +346,7 @@ superstar2_msg_iono_utc(struct gps_device_t *session, unsigned char *buf,
     gpsd_log(&session->context->errout, LOG_PROG,
 	     "superstar2 #75 - ionospheric & utc data: iono %s utc %s\n",
 	     i ? "ok" : "bad", u ? "ok" : "bad");
-    session->driver.superstar2.last_iono = time(NULL);
+    session->driver.superstar2.last_iono = gps_clock_time();
 
     return 0;
 }
@@ -364,7 +365,7 @@ superstar2_msg_ephemeris(struct gps_device_t *session, unsigned char *buf,
 	     "superstar2 #22 - ephemeris data - prn %u\n", prn);
 
     /* ephemeris data updates fairly slowly, but when it does, poll UTC */
-    if ((time(NULL) - session->driver.superstar2.last_iono) > 60)
+    if ((gps_clock_time() - session->driver.superstar2.last_iono) > 60)
 	(void)superstar2_write(session, (char *)iono_utc_msg,
 			       sizeof(iono_utc_msg));
 
@@ -465,7 +466,7 @@ static void superstar2_event_hook(struct gps_device_t *session, event_t event)
 			       sizeof(ephemeris_msg));
 	(void)superstar2_write(session, (char *)iono_utc_msg,
 			       sizeof(iono_utc_msg));
-	session->driver.superstar2.last_iono = time(NULL);
+	session->driver.superstar2.last_iono = gps_clock_time();
     }
 }
 
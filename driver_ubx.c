@@ -305,6 +305,7 @@ ubx_msg_mon_ver(struct gps_device_t *session, unsigned char *buf,
 	    session->driver.ubx.protver = protver;
         }
     }
+    session->driver.ubx.monver_seen = true;
 
     /* output SW and HW Version at LOG_INFO */
     gpsd_log(&session->context->errout, LOG_INF,
@@ -908,8 +909,23 @@ ubx_msg_nav_eoe(struct gps_device_t *session, unsigned char *buf,
     session->driver.ubx.iTOW = getles32(buf, 0);
     gpsd_log(&session->context->errout, LOG_DATA, "EOE: iTOW=%lld\n",
 	     (long long)session->driver.ubx.iTOW);
-    /* nothing to report, but the iTOW for cycle ender is good */
-    return 0;
+    /*
+     * The receiver says the epoch is complete, so report now rather
+     * than guessing; from here on, this is the only cycle ender.
+     */
+    if (!session->driver.ubx.eoe_seen)
+	gpsd_log(&session->context->errout, LOG_PROG,
+		 "UBX: NAV-EOE seen, using it as cycle ender\n");
+    session->driver.ubx.eoe_seen = true;
+    session->driver.ubx.end_msgid = UBX_NAV_EOE;
+    /* NAV-PVT or NAV-SOL reported this epoch before we knew of EOE */
+    if (session->driver.ubx.early_report) {
+	session->driver.ubx.early_report = false;
+	if (session->driver.ubx.early_iTOW == session->driver.ubx.iTOW)
+	    return 0;
+    }
+    /* STATUS_SET, still good from NAV-PVT, lets the report through */
+    return REPORT_IS | STATUS_SET;
 }
 
 /**
@@ -1537,6 +1553,100 @@ ubx_msg_tim_tp(struct gps_device_t *session, unsigned char *buf,
     return mask;
 }
 
+/* how far off the remembered position and the system clock may be */
+#define ASSIST_POS_ACC		1000000		/* cm */
+#define ASSIST_TIME_ACC		2		/* seconds */
+
+/**
+ * Warm-start a receiver that came up without a fix.
+ * u-blox 9 dropped the AID class, so it gets only position and time
+ * through MGA-INI; MGA-GPS wants decoded ephemerides, which we don't
+ * keep.  Older ones get AID-INI, AID-EPH and AID-ALM.
+ */
+static void ubx_assist(struct gps_device_t *session)
+{
+    const struct gps_assist_t *ap = &session->context->assist;
+    timestamp_t now = timestamp();
+    double gpstime = now - GPS_EPOCH + session->context->leap_seconds;
+    unsigned char msg[104];
+    int i, j, neph = 0, nalm = 0;
+
+    if (session->context->readonly || ap->fix_time <= 0)
+	return;
+
+    if (session->driver.ubx.protver >= 27) {
+	time_t t = (time_t)now;
+	struct tm tm;
+
+	/* MGA-INI-POS_LLH */
+	memset(msg, '\0', 20);
+	msg[0] = 0x01;
+	putle32(msg, 4, (int32_t)(ap->latitude * 1e7));
+	putle32(msg, 8, (int32_t)(ap->longitude * 1e7));
+	putle32(msg, 12, (int32_t)(ap->altitude * 100));
+	putle32(msg, 16, ASSIST_POS_ACC);
+	(void)ubx_write(session, UBX_CLASS_MGA, 0x40, msg, 20);
+
+	/* MGA-INI-TIME_UTC */
+	(void)gmtime_r(&t, &tm);
+	memset(msg, '\0', 24);
+	msg[0] = 0x10;
+	msg[3] = (unsigned char)session->context->leap_seconds;
+	putle16(msg, 4, tm.tm_year + 1900);
+	msg[6] = (unsigned char)(tm.tm_mon + 1);
+	msg[7] = (unsigned char)tm.tm_mday;
+	msg[8] = (unsigned char)tm.tm_hour;
+	msg[9] = (unsigned char)tm.tm_min;
+	msg[10] = (unsigned char)tm.tm_sec;
+	putle32(msg, 12, (uint32_t)((now - (double)t) * 1e9));
+	putle16(msg, 16, ASSIST_TIME_ACC);
+	(void)ubx_write(session, UBX_CLASS_MGA, 0x40, msg, 24);
+	gpsd_log(&session->context->errout, LOG_INF,
+		 "UBX: aided with position and time\n");
+	return;
+    }
+
+    /* AID-INI, position as LLA and GPS time */
+    memset(msg, '\0', 48);
+    putle32(msg, 0, (int32_t)(ap->latitude * 1e7));
+    putle32(msg, 4, (int32_t)(ap->longitude * 1e7));
+    putle32(msg, 8, (int32_t)(ap->altitude * 100));
+    putle32(msg, 12, ASSIST_POS_ACC);
+    putle16(msg, 18, (unsigned int)(gpstime / SECS_PER_WEEK));
+    putle32(msg, 20, (uint32_t)(fmod(gpstime, SECS_PER_WEEK) * 1000));
+    putle32(msg, 28, ASSIST_TIME_ACC * 1000);
+    putle32(msg, 44, 0x23);		/* pos, time valid; LLA */
+    (void)ubx_write(session, UBX_CLASS_AID, 0x01, msg, 48);
+
+    for (i = 0; i < ASSIST_SVS; i++) {
+	if (ap->eph[i].heard <= 0 || now - ap->eph[i].heard > ASSIST_EPH_MAXAGE)
+	    continue;
+	putle32(msg, 0, i + 1);
+	putle32(msg, 4, ap->eph[i].how);
+	for (j = 0; j < 24; j++)
+	    putle32(msg, 8 + 4 * j, ap->eph[i].words[j / 8][j % 8]);
+	(void)ubx_write(session, UBX_CLASS_AID, 0x31, msg, 104);
+	neph++;
+    }
+    for (i = 0; i < ASSIST_SVS; i++) {
+	double heard = ap->alm[i].heard;
+
+	if (heard <= 0 || now - heard > ASSIST_ALM_MAXAGE)
+	    continue;
+	putle32(msg, 0, i + 1);
+	putle32(msg, 4, (unsigned int)((heard - GPS_EPOCH
+					+ session->context->leap_seconds)
+				       / SECS_PER_WEEK));
+	for (j = 0; j < 8; j++)
+	    putle32(msg, 8 + 4 * j, ap->alm[i].words[j]);
+	(void)ubx_write(session, UBX_CLASS_AID, 0x30, msg, 40);
+	nalm++;
+    }
+    gpsd_log(&session->context->errout, LOG_INF,
+	     "UBX: aided with position, time, %d ephemerides "
+	     "and %d almanac pages\n", neph, nalm);
+}
+
 gps_mask_t ubx_parse(struct gps_device_t * session, unsigned char *buf,
 		     size_t len)
 {
@@ -1706,7 +1816,12 @@ gps_mask_t ubx_parse(struct gps_device_t * session, unsigned char *buf,
     case UBX_NAV_PVT:
 	gpsd_log(&session->context->errout, LOG_PROG, "UBX-NAV-PVT\n");
 	mask = ubx_msg_nav_pvt(session, &buf[UBX_PREFIX_LEN], data_len);
-        mask |= REPORT_IS;
+	/* with NAV-EOE coming, the rest of the epoch is still to come */
+	if (!session->driver.ubx.eoe_seen) {
+	    mask |= REPORT_IS;
+	    session->driver.ubx.early_iTOW = session->driver.ubx.iTOW;
+	    session->driver.ubx.early_report = true;
+	}
         break;
     case UBX_NAV_RELPOSNED:
 	gpsd_log(&session->context->errout, LOG_DATA, "UBX-NAV-RELPOSNED\n");
@@ -1730,7 +1845,11 @@ gps_mask_t ubx_parse(struct gps_device_t * session, unsigned char *buf,
          * Use UBX-NAV-PVT instead */
 	gpsd_log(&session->context->errout, LOG_PROG, "UBX-NAV-SOL\n");
 	mask = ubx_msg_nav_sol(session, &buf[UBX_PREFIX_LEN], data_len);
-        mask |= REPORT_IS;
+	if (!session->driver.ubx.eoe_seen) {
+	    mask |= REPORT_IS;
+	    session->driver.ubx.early_iTOW = session->driver.ubx.iTOW;
+	    session->driver.ubx.early_report = true;
+	}
 	break;
     case UBX_NAV_STATUS:
 	gpsd_log(&session->context->errout, LOG_DATA, "UBX-NAV-STATUS\n");
@@ -1859,8 +1978,24 @@ gps_mask_t ubx_parse(struct gps_device_t * session, unsigned char *buf,
 		 "UBX: unknown packet id 0x%04hx (length %zd)\n",
 		 msgid, len);
     }
-    /* end of cycle ? */
-    if (session->driver.ubx.end_msgid == msgid) {
+    /*
+     * The first solution after activation shows whether aiding helps.
+     * What to send depends on the protocol version, so wait for the
+     * MON-VER that identification asked for.
+     */
+    if (!session->driver.ubx.assist_checked && (mask & MODE_SET) != 0) {
+	session->driver.ubx.assist_checked = true;
+	session->driver.ubx.assist_pending =
+	    session->newdata.mode < MODE_2D;
+    }
+    if (session->driver.ubx.assist_pending
+	&& session->driver.ubx.monver_seen) {
+	session->driver.ubx.assist_pending = false;
+	ubx_assist(session);
+    }
+
+    /* end of cycle ?  NAV-EOE's decoder decides that for itself */
+    if (session->driver.ubx.end_msgid == msgid && msgid != UBX_NAV_EOE) {
         /* end of cycle, report it */
 	gpsd_log(&session->context->errout, LOG_PROG,
                  "UBX: cycle end %x\n", msgid);
@@ -1879,7 +2014,8 @@ gps_mask_t ubx_parse(struct gps_device_t * session, unsigned char *buf,
 		 session->driver.ubx.last_msgid);
          */
         /* iTOW is to ms, can go forward or backwards */
-	if ((session->driver.ubx.last_iTOW != session->driver.ubx.iTOW) &&
+	if (!session->driver.ubx.eoe_seen &&
+	    (session->driver.ubx.last_iTOW != session->driver.ubx.iTOW) &&
 	    (session->driver.ubx.end_msgid !=
              session->driver.ubx.last_msgid)) {
             /* time changed, new cycle ender */
@@ -1985,8 +2121,13 @@ static void ubx_event_hook(struct gps_device_t *session, event_t event)
 {
     if (session->context->readonly)
 	return;
-    else if (event == event_identified) {
+    else if (event == event_reactivate) {
+	session->driver.ubx.assist_checked = false;
+	session->driver.ubx.assist_pending = false;
+    } else if (event == event_identified) {
 	gpsd_log(&session->context->errout, LOG_DATA, "UBX identified\n");
+	session->driver.ubx.assist_checked = false;
+	session->driver.ubx.assist_pending = false;
 
         /* no longer set UBX-CFG-SBAS here, u-blox 9 does not have it */
 
@@ -1361,28 +1361,109 @@ const struct gps_type_t driver_isync = {
  *
  **************************************************************************/
 
+static bool aivdm_duplicate(struct gps_device_t *session,
+			    const struct aivdm_context_t *ais_context)
+/* has another device decoded this payload within the window? */
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;	/* FNV-1a offset basis */
+    size_t i, len = BITS_TO_BYTES(ais_context->bitlen);
+    struct ais_dedup_t *slot;
+    timestamp_t now = timestamp();
+
+    /* the bit count tells apart payloads differing only in padding */
+    hash ^= (uint64_t)ais_context->bitlen;
+    hash *= 0x100000001b3ULL;
+    for (i = 0; i < len; i++) {
+	hash ^= ais_context->bits[i];
+	hash *= 0x100000001b3ULL;		/* FNV-1a prime */
+    }
+
+    slot = &session->context->ais_dedup[hash & (AIS_DEDUP_SLOTS - 1)];
+    if (slot->hash == hash && slot->device != session
+	&& now - slot->seen < AIS_DEDUP_WINDOW) {
+	session->context->ais_duplicates++;
+	gpsd_log(&session->context->errout, LOG_PROG,
+		 "AIVDM payload already decoded from %s, dropped (%lu so far)\n",
+		 slot->device->gpsdata.dev.path,
+		 session->context->ais_duplicates);
+	return true;
+    }
+    /* a repeat from the same receiver is a new transmission */
+    slot->hash = hash;
+    slot->seen = now;
+    slot->device = session;
+    return false;
+}
+
+static void aivdm_append(struct aivdm_context_t *ais_context,
+			 uint64_t fld, unsigned int width)
+/* OR a right-aligned field of up to 48 bits onto the end of the bit buffer */
+{
+    size_t byte = ais_context->bitlen / 8;
+    unsigned int off = (unsigned int)(ais_context->bitlen % 8);
+    uint64_t w = fld << (64 - width - off);
+    unsigned int i;
+
+    for (i = 0; i < (off + width + 7) / 8; i++)
+	ais_context->bits[byte + i] |= (unsigned char)(w >> (56 - 8 * i));
+    ais_context->bitlen += width;
+}
+
+/* SWAR constants: a byte value in every lane of a 64-bit word */
+#define LANES(b)	(0x0101010101010101ULL * (b))
+
+static bool aivdm_dearmor(struct aivdm_context_t *ais_context,
+			  const unsigned char *data, size_t len)
+/*
+ * Append the six-bit values of an armored payload to the bit buffer,
+ * eight characters at a time.  Legal characters are '0' to 'W', which
+ * carry 0 to 39, and '`' to 'w', which carry 40 to 63.  Returns false,
+ * with the buffer in an undefined state, on anything else.
+ */
+{
+    size_t n;
+
+    for (n = 0; n + 8 <= len; n += 8) {
+	uint64_t w = getbeu64(data, n);
+	uint64_t w7 = w & LANES(0x7f);
+	/* high bit of each lane set where the character is >= a bound */
+	uint64_t ge48 = (w7 + LANES(0x80 - 48)) & LANES(0x80);
+	uint64_t ge88 = (w7 + LANES(0x80 - 88)) & LANES(0x80);
+	uint64_t ge96 = (w7 + LANES(0x80 - 96)) & LANES(0x80);
+	uint64_t ge120 = (w7 + LANES(0x80 - 120)) & LANES(0x80);
+	uint64_t legal = (ge48 & ~ge88) | (ge96 & ~ge120);
+
+	if (((w & LANES(0x80)) | (legal ^ LANES(0x80))) != 0)
+	    return false;
+	/* '0' is 0, and the 8 characters from 'X' to '_' are skipped */
+	w -= LANES(48) + (ge88 >> 4);
+	/* squeeze the 6-bit lanes together: pairs, then fours, then all */
+	w = ((w & 0x3f003f003f003f00ULL) >> 2) | (w & 0x003f003f003f003fULL);
+	w = ((w & 0x0fff00000fff0000ULL) >> 4) | (w & 0x00000fff00000fffULL);
+	w = ((w & 0x00ffffff00000000ULL) >> 8) | (w & 0x0000000000ffffffULL);
+	aivdm_append(ais_context, w, 48);
+    }
+    for (; n < len; n++) {
+	unsigned char ch = data[n];
+
+	if (ch >= 48 && ch < 88)
+	    ch -= 48;
+	else if (ch >= 96 && ch < 120)
+	    ch -= 56;
+	else
+	    return false;
+	aivdm_append(ais_context, ch, 6);
+    }
+    return true;
+}
+
+#undef LANES
+
 static bool aivdm_decode(const char *buf, size_t buflen,
 		  struct gps_device_t *session,
 		  struct ais_t *ais,
 		  int debug)
 {
-#ifdef __UNUSED_DEBUG__
-    char *sixbits[64] = {
-	"000000", "000001", "000010", "000011", "000100",
-	"000101", "000110", "000111", "001000", "001001",
-	"001010", "001011", "001100", "001101", "001110",
-	"001111", "010000", "010001", "010010", "010011",
-	"010100", "010101", "010110", "010111", "011000",
-	"011001", "011010", "011011", "011100", "011101",
-	"011110", "011111", "100000", "100001", "100010",
-	"100011", "100100", "100101", "100110", "100111",
-	"101000", "101001", "101010", "101011", "101100",
-	"101101", "101110", "101111", "110000", "110001",
-	"110010", "110011", "110100", "110101", "110110",
-	"110111", "111000", "111001", "111010", "111011",
-	"111100", "111101", "111110", "111111",
-    };
-#endif /* __UNUSED_DEBUG__ */
     int nfrags, ifrag, nfields = 0;
     unsigned char *field[NMEA_MAX*2];
     unsigned char fieldcopy[NMEA_MAX*2+1];
@@ -1390,7 +1471,6 @@ static bool aivdm_decode(const char *buf, size_t buflen,
     char const *cp1;
     int pad;
     struct aivdm_context_t *ais_context;
-    int i;
 
     if (buflen == 0)
 	return false;
@@ -1513,28 +1593,16 @@ static bool aivdm_decode(const char *buf, size_t buflen,
     }
 
     /* wacky 6-bit encoding, shades of FIELDATA */
-    for (cp = data; cp < data + strlen((char *)data); cp++) {
-	unsigned char ch;
-	ch = *cp;
-	ch -= 48;
-	if (ch >= 40)
-	    ch -= 8;
-#ifdef __UNUSED_DEBUG__
-	gpsd_log(&session->context->errout, LOG_RAW,
-		 "%c: %s\n", *cp, sixbits[ch]);
-#endif /* __UNUSED_DEBUG__ */
-	for (i = 5; i >= 0; i--) {
-	    if ((ch >> i) & 0x01) {
-		ais_context->bits[ais_context->bitlen / 8] |=
-		    (1 << (7 - ais_context->bitlen % 8));
-	    }
-	    ais_context->bitlen++;
-	    if (ais_context->bitlen > sizeof(ais_context->bits)) {
-		gpsd_log(&session->context->errout, LOG_INF,
-			 "overlong AIVDM payload truncated.\n");
-		return false;
-	    }
-	}
+    if (ais_context->bitlen + 6 * strlen((char *)data)
+	> sizeof(ais_context->bits)) {
+	gpsd_log(&session->context->errout, LOG_INF,
+		 "overlong AIVDM payload truncated.\n");
+	return false;
+    }
+    if (!aivdm_dearmor(ais_context, data, strlen((char *)data))) {
+	gpsd_log(&session->context->errout, LOG_ERROR,
+		 "illegal character in AIVDM payload.\n");
+	return false;
     }
     ais_context->bitlen -= pad;
 
@@ -1552,6 +1620,9 @@ static bool aivdm_decode(const char *buf, size_t buflen,
         /* clear waiting fragments count */
         ais_context->decoded_frags = 0;
 
+	if (aivdm_duplicate(session, ais_context))
+	    return false;
+
 	/* decode the assembled binary packet */
 	return ais_binary_decode(&session->context->errout,
 				 ais,
@@ -1666,12 +1737,20 @@ static gps_mask_t json_pass_packet(struct gps_device_t *session)
     gpsd_log(&session->context->errout, LOG_IO,
 	     "<= GPS: %s\n", (char *)session->lexer.outbuffer);
 
+    /* a new line; it is parsed only if a relay's NMEA watcher needs it */
+    session->relay_unpacked = false;
+
     if (strstr(session->gpsdata.dev.path, ":/") != NULL && strstr(session->gpsdata.dev.path, "localhost") == NULL)
     {
-	/* devices and paths need to be edited */
-	if (strstr((char *)session->lexer.outbuffer, "DEVICE") != NULL)
-	    path_rewrite(session, "\"path\":\"");
-	path_rewrite(session, "\"device\":\"");
+	/*
+	 * Devices and paths need to be edited, except in relay mode,
+	 * where reports go out with the upstream's device paths.
+	 */
+	if (!session->context->passthrough_relay) {
+	    if (strstr((char *)session->lexer.outbuffer, "DEVICE") != NULL)
+		path_rewrite(session, "\"path\":\"");
+	    path_rewrite(session, "\"device\":\"");
+	}
 
 	/* mark certain responses without a path or device attribute */
 	if (session->gpsdata.dev.path[0] != '\0') {
@@ -1702,7 +1781,7 @@ const struct gps_type_t driver_json_passthrough = {
     .packet_type    = JSON_PACKET,	/* associated lexer packet type */
     .flags	    = DRIVER_NOFLAGS,	/* don't remember this */
     .trigger	    = NULL,		/* it's the default */
-    .channels       = 0,		/* not used */
+    .channels       = 12,		/* GSA slots when a relay renders NMEA */
     .probe_detect   = NULL,		/* no probe */
     .get_packet     = generic_get,	/* use generic packet getter */
     .parse_packet   = json_pass_packet,	/* how to interpret a packet */
@@ -68,6 +68,15 @@ otherwise it will terminate immediately.
 To allow for adding and removing clients while the test is running,
 run in threaded mode by calling the start() method.  This simply calls
 the run method in a subthread, with locking of critical regions.
+
+A TestSession created with virtual=True never sleeps.  It freezes the
+daemon's clock at VIRTUAL_EPOCH as soon as the daemon is up, before
+any device is added, and steps it over the control socket after
+every write, by the write delay or by the time the packet would take
+on the wire at the pty's baud rate, whichever is longer.  The daemon
+handles pending input before each step, so timing-dependent code sees
+the same simulated time on every run, and long scenarios finish as
+fast as the daemon can process them.
 """
 # This code runs compatibly under Python 2 and 3.x for x >= 2.
 # Preserve this property!
@@ -118,6 +127,11 @@ WRITE_PAD_SLOWDOWN = 0.01
 # If a test takes longer than this, we deem it to have timed out
 TEST_TIMEOUT = 60
 
+# Where simulated time starts, 2019-07-01T00:00:00Z.  Not the wall
+# clock, so a run sees the same century and GPS week rollovers, and
+# the same timestamps, whenever it is made.
+VIRTUAL_EPOCH = 1561939200
+
 
 def GetDelay(slow=False):
     "Get appropriate per-line delay."
@@ -157,20 +171,18 @@ class TestLoad(object):
         self.serial = None
         self.delay = GetDelay(slow)
         self.delimiter = None
-        # Stash away a copy in case we need to resplit
+        # Keep the text; we frame it in one pass and may need to resplit
         text = logfp.read()
-        logfp = open(logfp.name, 'rb')
         # Grab the packets in the normal way
         getter = sniffer.new()
         # gps.packet.register_report(reporter)
         type_latch = None
         commentlen = 0
-        while True:
+        for (ptype, start, packet) in getter.frame(text):
             # Note that packet data is bytes rather than str
-            (plen, ptype, packet, _counter) = getter.get(logfp.fileno())
-            if plen <= 0:
-                break
-            elif ptype == sniffer.COMMENT_PACKET:
+            if start >= 0:
+                packet = text[start:start + packet]
+            if ptype == sniffer.COMMENT_PACKET:
                 commentlen += len(packet)
                 # Some comments are magic
                 if b"Serial:" in packet:
@@ -247,6 +259,8 @@ class FakeGPS(object):
         self.progress = progress
         self.readers = 0
         self.testload = testload
+        # Replaced by the session when it runs on simulated time
+        self.wait = time.sleep
         self.progress("gpsfake: %s provides %d sentences\n"
                       % (self.testload.name, len(self.testload.sentences)))
 
@@ -254,6 +268,10 @@ class FakeGPS(object):
         "Throw an error if this superclass is ever instantiated."
         raise ValueError(line)
 
+    def airtime(self, line):
+        "Time the line would take on the wire; zero for network feeds."
+        return 0.0
+
     def feed(self):
         "Feed a line from the contents of the GPS log to the daemon."
         line = self.testload.sentences[self.index
@@ -261,10 +279,13 @@ class FakeGPS(object):
         if b"%Delay:" in line:
             # Delay specified number of seconds
             delay = line.split()[1]
-            time.sleep(int(delay))
+            self.wait(int(delay))
         # self.write has to be set by the derived class
         self.write(line)
-        time.sleep(self.testload.delay)
+        if self.wait is time.sleep:
+            time.sleep(self.testload.delay)
+        else:
+            self.wait(max(self.testload.delay, self.airtime(line)))
         self.index += 1
 
 
@@ -348,6 +369,11 @@ class FakePTY(FakeGPS):
         # except IOError:
         #    pass
 
+    def airtime(self, line):
+        "Time the line would take at the pty's baud rate."
+        # start and stop bits frame each character
+        return len(line) * 10.0 / self.speed
+
     def write(self, line):
         self.progress("gpsfake: %s writes %d=%s\n"
                       % (self.testload.name, len(line), repr(line)))
@@ -596,6 +622,20 @@ class DaemonInstance(SubprogramInstance):
             self.sock.recv(12)
             self.sock.close()
 
+    def set_clock(self, when):
+        "Step the daemon's virtual clock, once it has read pending input."
+        # A lost step would silently put the daemon back on real
+        # time, so wait out the window between bind() and listen().
+        while not self.__get_control_socket():
+            if not self.is_alive():
+                raise DaemonError("daemon died")
+            time.sleep(0.01)
+        self.sock.sendall(polybytes("~%.6f\r\n\x00" % when))
+        reply = self.sock.recv(12)
+        self.sock.close()
+        if not reply.startswith(b"OK"):
+            raise DaemonError("daemon refused clock step to %.6f" % when)
+
 
 class TestSessionError(TestError):
     "class TestSessionError"
@@ -608,7 +648,7 @@ class TestSession(object):
 
     def __init__(self, prefix=None, port=None, options=None, verbose=0,
                  predump=False, udp=False, tcp=False, slow=False,
-                 timeout=None):
+                 timeout=None, virtual=False):
         "Initialize the test session by launching the daemon."
         self.prefix = prefix
         self.options = options
@@ -634,6 +674,8 @@ class TestSession(object):
         self.fd_set = []
         self.threadlock = None
         self.timeout = TEST_TIMEOUT if timeout is None else timeout
+        # Simulated time, when the session runs on a virtual clock
+        self.clock = VIRTUAL_EPOCH if virtual else None
 
     def spawn(self):
         "Spawn daemon"
@@ -642,6 +684,13 @@ class TestSession(object):
         self.daemon.spawn(background=True, prefix=self.prefix, port=self.port,
                           options=self.options)
         self.daemon.wait_ready()
+        if self.clock is not None:
+            self.daemon.set_clock(self.clock)
+
+    def advance(self, seconds):
+        "Let simulated time pass, in place of sleeping."
+        self.clock += seconds
+        self.daemon.set_clock(self.clock)
 
     def set_predicate(self, pred):
         "Set a default go predicate for the session."
@@ -668,6 +717,8 @@ class TestSession(object):
                 newgps.go_predicate = pred
             elif self.default_predicate:
                 newgps.go_predicate = self.default_predicate
+            if self.clock is not None:
+                newgps.wait = self.advance
             self.fakegpslist[newgps.byname] = newgps
             self.append(newgps)
             newgps.exhausted = 0
@@ -712,12 +763,18 @@ class TestSession(object):
     def wait(self, seconds):
         "Wait, doing nothing."
         self.progress("gpsfake: wait(%d)\n" % seconds)
-        time.sleep(seconds)
+        if self.clock is not None:
+            self.advance(seconds)
+        else:
+            time.sleep(seconds)
 
     def gather(self, seconds):
         "Wait, doing nothing but watching for sentences."
         self.progress("gpsfake: gather(%d)\n" % seconds)
-        time.sleep(seconds)
+        if self.clock is not None:
+            self.advance(seconds)
+        else:
+            time.sleep(seconds)
 
     def cleanup(self):
         "We're done, kill the daemon."
@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>          /* for setgroups() */
+#include <limits.h>       /* for PATH_MAX */
 #include <math.h>
 #include <netdb.h>
 #include <pthread.h>
@@ -29,8 +30,14 @@
 #include <syslog.h>
 #include <sys/param.h>    /* for setgroups() */
 #include <sys/stat.h>
+#if defined(PPS_ENABLE)
+#include <sys/resource.h> /* for setrlimit() */
+#endif /* PPS_ENABLE */
 #include <sys/types.h>
 #include <sys/un.h>
+#if defined(PPS_ENABLE) && defined(__linux__)
+#include <sys/eventfd.h>
+#endif /* PPS_ENABLE && __linux__ */
 #include <time.h>
 #include <unistd.h>       /* for setgroups() */
 
@@ -46,6 +53,8 @@
 #include "revision.h"
 #include "sockaddr.h"
 #include "strfuncs.h"
+#include "timespec.h"
+#include "tracepoints.h"
 
 #if defined(SYSTEMD_ENABLE)
 #include "sd_socket.h"
@@ -103,6 +112,9 @@
  */
 #define NICEVAL	-10
 
+/* PPS watchers get a PPSSTATS report after this many PPS events */
+#define PPS_STATS_INTERVAL	16
+
 #if (defined(FIXED_PORT_SPEED) || \
      defined(TIMESERVICE_ENABLE) || \
      !defined(SOCKET_EXPORT_ENABLE))
@@ -148,6 +160,19 @@ static bool nowait = true;
 static bool nowait = false;
 #endif /* FORCE_NOWAIT */
 static bool batteryRTC = false;
+/* -A: where warm-start data is kept between runs */
+#define ASSIST_SAVE_INTERVAL	600	/* seconds between saves */
+static char *assist_file = NULL;
+static char capture_dir[PATH_MAX];
+static time_t assist_saved;
+#ifdef NMEA0183_ENABLE
+/* -E: NMEA sentences that end a device's reporting cycle */
+static struct {
+    char tag[8];
+    char devpath[GPS_PATH_MAX];	/* empty means every device */
+} cycle_enders[MAX_DEVICES];
+static int ncycle_enders;
+#endif /* NMEA0183_ENABLE */
 static jmp_buf restartbuf;
 static struct gps_context_t context;
 #if defined(SYSTEMD_ENABLE)
@@ -215,17 +240,35 @@ static void typelist(void)
 #endif
 #if defined(PPS_ENABLE)
     (void)printf("# PPS enabled.\n");
+#endif
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    (void)printf("# Ntrip caster enabled.\n");
+#endif
+#if defined(MCAST_EXPORT_ENABLE)
+    (void)printf("# Multicast export enabled.\n");
 #endif
     exit(EXIT_SUCCESS);
 }
 
 static void usage(void)
 {
-    (void)printf("usage: gpsd [-b] [-D n] [-F sockfile] [-G] [-h] [-n] [-N] [-P pidfile] [-S port] device...\n\
+    (void)printf("usage: gpsd [-A statefile] [-b] [-C port] [-c dir] [-D n] [-E tag[@device]] [-F sockfile] [-G] [-h] [-M group:port] [-n] [-N] [-P pidfile] [-R] [-S port] [-T prio[,cpu]] device...\n\
   Options include: \n\
-  -b		     	    = bluetooth-safe: open data sources read-only\n\
-  -D integer (default 0)    = set debug level \n\
-  -F sockfile		    = specify control socket location\n"
+  -A statefile		    = keep warm-start data for receivers here\n\
+  -b		     	    = bluetooth-safe: open data sources read-only\n"
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+"  -C port		    = serve RTCM corrections as an Ntrip caster\n"
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+"  -c dir		    = log raw device input to capture files in dir\n\
+  -D integer (default 0)    = set debug level \n"
+#ifdef NMEA0183_ENABLE
+"  -E tag[@device]	    = NMEA sentence that ends each reporting cycle\n"
+#endif /* NMEA0183_ENABLE */
+"  -F sockfile		    = specify control socket location\n"
+#ifdef MCAST_EXPORT_ENABLE
+"  -M group:port[,CLASS...][@device]\n"
+"			    = send reports to a UDP multicast group\n"
+#endif /* MCAST_EXPORT_ENABLE */
 #ifndef FORCE_GLOBAL_ENABLE
 "  -G         		    = make gpsd listen on INADDR_ANY\n"
 #endif /* FORCE_GLOBAL_ENABLE */
@@ -238,8 +281,16 @@ static void usage(void)
 #endif /* FORCE_NOWAIT */
 "  -N			    = don't go into background\n\
   -P pidfile	      	    = set file to record process ID\n\
-  -r               	    = use GPS time even if no fix\n\
-  -S integer (default %s) = set port for daemon \n\
+  -r               	    = use GPS time even if no fix\n"
+#ifdef PASSTHROUGH_ENABLE
+"  -R			    = relay gpsd:// JSON to watchers unedited\n"
+#endif /* PASSTHROUGH_ENABLE */
+"\
+  -S integer (default %s) = set port for daemon \n"
+#ifdef PPS_ENABLE
+"  -T priority[,cpu]	    = realtime PPS threads, optionally pinned\n"
+#endif /* PPS_ENABLE */
+"\
   -V			    = emit version and exit.\n"
 #ifdef NETFEED_ENABLE
 "A device may be a local serial device for GPS input, or a URL in one \n\
@@ -250,6 +301,8 @@ of the following forms:\n\
      gpsd://host[:port][/device][?protocol]\n\
 in which case it specifies an input source for device, DGPS or ntrip data.\n"
 #endif /* NETFEED_ENABLE */
+"A device may also be replay://file[?speed=N][&start=time], playing back\n\
+a capture log written with -c.\n"
 "\n\
 The following driver types are compiled into this gpsd instance:\n",
 		 DEFAULT_GPSD_PORT);
@@ -289,9 +342,18 @@ static socket_t filesock(char *filename)
 
 #define sub_index(s) (int)((s) - subscribers)
 #define allocated_device(devp)	 ((devp)->gpsdata.dev.path[0] != '\0')
-#define free_device(devp)	 (devp)->gpsdata.dev.path[0] = '\0'
 #define initialized_device(devp) ((devp)->context != NULL)
 
+static void free_device(struct gps_device_t *device)
+/* give the device slot back to the pool */
+{
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    /* the slot's next tenant must not inherit its caster clients */
+    caster_device_gone(device);
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+    device->gpsdata.dev.path[0] = '\0';
+}
+
 /*
  * This array fills from the bottom, so as an extreme case you can
  * reduce MAX_DEVICES to 1 in the build recipe.
@@ -316,6 +378,18 @@ static void adjust_max_fd(int fd, bool on)
     }
 }
 
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+static void caster_fdhook(socket_t fd, bool on)
+/* let the Ntrip caster add and remove its client descriptors */
+{
+    if (on)
+	FD_SET(fd, &all_fds);
+    else
+	FD_CLR(fd, &all_fds);
+    adjust_max_fd(fd, on);
+}
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+
 #ifdef SOCKET_EXPORT_ENABLE
 #ifndef IPTOS_LOWDELAY
 #define IPTOS_LOWDELAY 0x10
@@ -513,12 +587,46 @@ struct subscriber_t
     time_t active;		  /* when subscriber last polled for data */
     struct gps_policy_t policy;	  /* configurable bits */
     pthread_mutex_t mutex;	  /* serialize access to fd */
+    bool late_join;		  /* replay cached reports after the reply */
+#ifdef AIVDM_ENABLE
+    bool ais_snapshot;		  /* ?AIS table still being sent */
+    int ais_cursor;		  /* next vessel slot to send, -1 at end */
+    int ais_sent;		  /* vessels sent so far */
+    char ais_buf[GPS_JSON_RESPONSE_MAX];  /* reports of the current vessel */
+    size_t ais_len, ais_off;	  /* length of ais_buf, and how much is sent */
+#endif /* AIVDM_ENABLE */
 };
 
 #define subscribed(sub, devp)    (sub->policy.watcher && (sub->policy.devpath[0]=='\0' || strcmp(sub->policy.devpath, devp->gpsdata.dev.path)==0))
 
 static struct subscriber_t subscribers[MAX_CLIENTS];	/* indexed by client file descriptor */
 
+/*
+ * When each device last reported TPV, GST, SKY and ATT.  A client that
+ * enables a JSON watch gets these straight after the WATCH reply,
+ * rendered from the device's current state under its own policy, so
+ * it needn't wait up to a full cycle to learn where it is.
+ */
+#define CACHED_REPORTS	4
+static timestamp_t cached_reports[MAX_DEVICES][CACHED_REPORTS];
+static const gps_mask_t cached_masks[CACHED_REPORTS] = {
+    REPORT_IS, GST_SET, SATELLITE_SET, ATTITUDE_SET,
+};
+
+#ifdef TIMING_ENABLE
+/*
+ * How long each device's reports take from the read of the packet
+ * that ends a cycle to the TPV leaving for the watchers.  Summarized
+ * in the log every LATENCY_INTERVAL reports.
+ */
+#define LATENCY_INTERVAL	60
+struct latency_t {
+    unsigned long count;
+    double min, max, sum;
+};
+static struct latency_t latencies[MAX_DEVICES];
+#endif /* TIMING_ENABLE */
+
 static void lock_subscriber(struct subscriber_t *sub)
 {
     (void)pthread_mutex_lock(&sub->mutex);
@@ -575,23 +683,35 @@ static void detach_client(struct subscriber_t *sub)
     sub->policy.timing = false;
     sub->policy.split24 = false;
     sub->policy.devpath[0] = '\0';
+    sub->late_join = false;
+#ifdef AIVDM_ENABLE
+    sub->ais_snapshot = false;
+    sub->ais_len = sub->ais_off = 0;
+#endif /* AIVDM_ENABLE */
     sub->fd = UNALLOCATED_FD;
     unlock_subscriber(sub);
 }
 
-static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
+static ssize_t throttled_write(struct subscriber_t *sub, const char *buf,
 			       size_t len)
 /* write to client -- throttle if it's gone or we're close to buffer overrun */
 {
     ssize_t status;
 
+#ifdef AIVDM_ENABLE
+    /* never splice a report into a half-sent ?AIS one; drop it instead */
+    if (sub->ais_off < sub->ais_len)
+	return 0;
+#endif /* AIVDM_ENABLE */
+
     if (context.errout.debug >= LOG_CLIENT) {
 	if (isprint((unsigned char) buf[0]))
 	    gpsd_log(&context.errout, LOG_CLIENT,
 		     "=> client(%d): %s\n", sub_index(sub), buf);
 	else {
 #ifndef __clang_analyzer__
-	    char *cp, buf2[MAX_PACKET_LENGTH * 3];
+	    const char *cp;
+	    char buf2[MAX_PACKET_LENGTH * 3];
 	    buf2[0] = '\0';
 	    for (cp = buf; cp < buf + len; cp++)
 		str_appendf(buf2, sizeof(buf2),
@@ -602,14 +722,8 @@ static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
 	}
     }
 
-#if defined(PPS_ENABLE)
-    gpsd_acquire_reporting_lock();
-#endif /* PPS_ENABLE */
     status = send(sub->fd, buf, len, 0);
-#if defined(PPS_ENABLE)
-    gpsd_release_reporting_lock();
-
-#endif /* PPS_ENABLE */
+    GPSD_PROBE4(throttled_write, sub->fd, sub_index(sub), len, status);
     if (status == (ssize_t) len)
 	return status;
     else if (status > -1) {
@@ -624,7 +738,7 @@ static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
 	gpsd_log(&context.errout, LOG_WARN,
 		 "client(%d) has vanished.\n", sub_index(sub));
     else if (errno == EWOULDBLOCK
-	     && time(NULL) - sub->active > NOREAD_TIMEOUT)
+	     && gps_clock_time() - sub->active > NOREAD_TIMEOUT)
 	gpsd_log(&context.errout, LOG_INF,
 		 "client(%d) timed out.\n", sub_index(sub));
     else
@@ -635,6 +749,59 @@ static ssize_t throttled_write(struct subscriber_t *sub, char *buf,
     return status;
 }
 
+#ifdef AIVDM_ENABLE
+static void ais_snapshot_continue(struct subscriber_t *sub)
+/*
+ * Send a client the next stretch of the AIS vessel table, until the
+ * socket would block.  The main loop calls this again once it's
+ * writable, so a slow client is never overrun and a quiet feed never
+ * stalls the table.
+ */
+{
+    size_t sent = 0;
+
+    while (sent < AIS_SNAPSHOT_CHUNK) {
+	ssize_t status;
+
+	if (sub->ais_off == sub->ais_len) {
+	    if (sub->ais_cursor < 0) {
+		sub->ais_snapshot = false;
+		break;
+	    }
+	    sub->ais_cursor = ais_table_dump(sub->ais_cursor,
+					     sub->policy.scaled,
+					     sub->ais_buf,
+					     sizeof(sub->ais_buf));
+	    if (sub->ais_cursor < 0)
+		(void)snprintf(sub->ais_buf, sizeof(sub->ais_buf),
+			       "{\"class\":\"AISTABLE\",\"vessels\":%d}\r\n",
+			       sub->ais_sent);
+	    else
+		sub->ais_sent++;
+	    sub->ais_len = strlen(sub->ais_buf);
+	    sub->ais_off = 0;
+	    gpsd_log(&context.errout, LOG_CLIENT,
+		     "=> client(%d): %s\n", sub_index(sub), sub->ais_buf);
+	}
+	status = send(sub->fd, sub->ais_buf + sub->ais_off,
+		      sub->ais_len - sub->ais_off, 0);
+	GPSD_PROBE4(throttled_write, sub->fd, sub_index(sub),
+		    sub->ais_len - sub->ais_off, status);
+	if (status < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		break;		/* resume when writable */
+	    gpsd_log(&context.errout, LOG_INF,
+		     "client(%d) write: %s\n",
+		     sub_index(sub), strerror(errno));
+	    detach_client(sub);
+	    break;
+	}
+	sub->ais_off += (size_t)status;
+	sent += (size_t)status;
+    }
+}
+#endif /* AIVDM_ENABLE */
+
 static void notify_watchers(struct gps_device_t *device,
 			    bool onjson, bool onpps,
 			    const char *sentence, ...)
@@ -663,7 +830,19 @@ static void deactivate_device(struct gps_device_t *device)
     notify_watchers(device, true, false,
 		    "{\"class\":\"DEVICE\",\"path\":\"%s\",\"activated\":0}\r\n",
 		    device->gpsdata.dev.path);
+    /* a fix from before the device went away is no use to anyone */
+    memset(cached_reports[device - devices], '\0',
+	   sizeof(cached_reports[0]));
+#ifdef TIMING_ENABLE
+    memset(&latencies[device - devices], '\0', sizeof(latencies[0]));
+#endif /* TIMING_ENABLE */
 #endif /* SOCKET_EXPORT_ENABLE */
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    caster_device_gone(device);
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+    /* the receiver may be about to lose power, save what it taught us */
+    if (assist_file != NULL)
+	(void)gpsd_assist_save(&context, assist_file);
     if (!BAD_SOCKET(device->gpsdata.gps_fd)) {
 	FD_CLR(device->gpsdata.gps_fd, &all_fds);
 	adjust_max_fd(device->gpsdata.gps_fd, false);
@@ -743,6 +922,9 @@ bool gpsd_add_device(const char *device_name, bool flag_nowait)
 {
     struct gps_device_t *devp;
     bool ret = false;
+#ifdef NMEA0183_ENABLE
+    int i;
+#endif /* NMEA0183_ENABLE */
     /* we can't handle paths longer than GPS_PATH_MAX, so don't try */
     if (strlen(device_name) >= GPS_PATH_MAX) {
 	gpsd_log(&context.errout, LOG_ERROR,
@@ -754,6 +936,13 @@ bool gpsd_add_device(const char *device_name, bool flag_nowait)
     for (devp = devices; devp < devices + MAX_DEVICES; devp++)
 	if (!allocated_device(devp)) {
 	    gpsd_init(devp, &context, device_name);
+#ifdef NMEA0183_ENABLE
+	    for (i = 0; i < ncycle_enders; i++)
+		if (cycle_enders[i].devpath[0] == '\0'
+		    || strcmp(cycle_enders[i].devpath, device_name) == 0)
+		    (void)strlcpy(devp->nmea.cycle_ender, cycle_enders[i].tag,
+				  sizeof(devp->nmea.cycle_ender));
+#endif /* NMEA0183_ENABLE */
 #ifdef NTPSHM_ENABLE
 	    ntpshm_session_init(devp);
 #endif /* NTPSHM_ENABLE */
@@ -811,7 +1000,85 @@ static int write_gps(char *device, char *hex) {
     return 0;
 }
 
+static void all_reports(struct gps_device_t *device, gps_mask_t changed);
+
+static void service_device(struct gps_device_t *device, bool ready)
+/* consume and report what a device has sent, and track its state */
+{
+    switch (gpsd_multipoll(ready, device, all_reports, DEVICE_REAWAKE)) {
+    case DEVICE_READY:
+	FD_SET(device->gpsdata.gps_fd, &all_fds);
+	adjust_max_fd(device->gpsdata.gps_fd, true);
+	break;
+    case DEVICE_UNREADY:
+	FD_CLR(device->gpsdata.gps_fd, &all_fds);
+	adjust_max_fd(device->gpsdata.gps_fd, false);
+	break;
+    case DEVICE_ERROR:
+    case DEVICE_EOF:
+	deactivate_device(device);
+	break;
+    default:
+	break;
+    }
+}
+
 #ifdef CONTROL_SOCKET_ENABLE
+static bool step_clock(const char *when, fd_set *rfds)
+/* set the virtual clock, once input sent under the old time is handled */
+{
+    struct gps_device_t *devp;
+    struct timespec ts, now;
+    double sec, frac;
+    char *end;
+
+    /*
+     * The harness writes a packet and then steps the clock, so
+     * whatever is readable now belongs to the old time.  Handling
+     * it here, before the step, is what makes runs repeatable.  The
+     * main loop must not then see the drained device as readable, or
+     * the empty read would be taken for a hangup.
+     */
+    for (devp = devices; devp < devices + MAX_DEVICES; devp++)
+	if (allocated_device(devp) && devp->gpsdata.gps_fd > 0
+	    && nanowait(devp->gpsdata.gps_fd, 0)) {
+	    service_device(devp, true);
+	    if (devp->gpsdata.gps_fd > 0)
+		FD_CLR(devp->gpsdata.gps_fd, rfds);
+	}
+
+    if (when[0] == '\0') {
+	gpsd_log(&context.errout, LOG_INF, "clock back on real time\n");
+	gps_clock_set(NULL);
+	return true;
+    }
+    frac = modf(strtod(when, &end), &sec);
+    if (end == when || *end != '\0' || sec <= 0)
+	return false;
+    ts.tv_sec = (time_t)sec;
+    ts.tv_nsec = (long)(frac * NS_IN_SEC);
+    gps_clock_gettime(&now);
+    if (gps_clock_is_virtual()
+	&& (ts.tv_sec < now.tv_sec
+	    || (ts.tv_sec == now.tv_sec && ts.tv_nsec < now.tv_nsec)))
+	return false;		/* simulated time only runs forward */
+    if (!gps_clock_is_virtual()) {
+	/*
+	 * Simulated time begins.  The century and GPS week rollovers
+	 * were worked out from the real clock at startup; work them out
+	 * again from the new one, keeping any newer leap second count
+	 * the aiding state brought in.
+	 */
+	int leap_seconds = context.leap_seconds;
+
+	gpsd_time_init(&context, ts.tv_sec);
+	if (leap_seconds > context.leap_seconds)
+	    context.leap_seconds = leap_seconds;
+    }
+    gps_clock_set(&ts);
+    return true;
+}
+
 static char *snarfline(char *p, char **out)
 /* copy the rest of the command line, before CR-LF */
 {
@@ -827,7 +1094,7 @@ static char *snarfline(char *p, char **out)
     return p;
 }
 
-static void handle_control(int sfd, char *buf)
+static void handle_control(int sfd, char *buf, fd_set *rfds)
 /* handle privileged commands coming through the control socket */
 {
     char *stash;
@@ -927,6 +1194,15 @@ static void handle_control(int sfd, char *buf)
 		ignore_return(write(sfd, "ERROR\n", 6));
             }
 	}
+    } else if (buf[0] == '~') {
+	/* step the virtual clock to the time after ~, or resume real time */
+	(void)snarfline(buf + 1, &stash);
+	gpsd_log(&context.errout, LOG_IO,
+		 "<= control(%d): clock to %s\n", sfd, stash);
+	if (step_clock(stash, rfds))
+	    ignore_return(write(sfd, "OK\n", 3));
+	else
+	    ignore_return(write(sfd, "ERROR\n", 6));
     } else if (strstr(buf, "?devices")==buf) {
 	/* write back devices list followed by OK */
 	for (devp = devices; devp < devices + MAX_DEVICES; devp++) {
@@ -1104,6 +1380,26 @@ static void rstrip(char *str)
     }
 }
 
+static void forward_watch(struct gps_device_t *devp,
+			  const char *start, const char *end)
+/* pass a client's ?WATCH on to the gpsd a gpsd:// device reads */
+{
+#ifdef PASSTHROUGH_ENABLE
+    /*
+     * A relay renders NMEA for its own NMEA watchers, so it only
+     * ever wants JSON; asking for more would get NMEA twice.
+     */
+    if (context.passthrough_relay) {
+	static const char relay_watch[] =
+	    "?WATCH={\"enable\":true,\"json\":true};\r\n";
+
+	(void)gpsd_write(devp, relay_watch, sizeof(relay_watch) - 1);
+	return;
+    }
+#endif /* PASSTHROUGH_ENABLE */
+    (void)gpsd_write(devp, start, (size_t)(end - start));
+}
+
 static void handle_request(struct subscriber_t *sub,
 			   const char *buf, const char **after,
 			   char *reply, size_t replylen)
@@ -1145,8 +1441,7 @@ static void handle_request(struct subscriber_t *sub,
 			    (void)awaken(devp);
 			    if (devp->sourcetype == source_gpsd) {
 			        /* forward to master gpsd */
-				(void)gpsd_write(devp, start,
-				                 (size_t)(end-start));
+				forward_watch(devp, start, end);
 			    }
 			}
 		} else {
@@ -1160,7 +1455,7 @@ static void handle_request(struct subscriber_t *sub,
 			goto bailout;
 		    } else if (awaken(devp)) {
 			if (devp->sourcetype == source_gpsd) {
-			    (void)gpsd_write(devp, start, (size_t)(end-start));
+			    forward_watch(devp, start, end);
 			}
 		    } else {
 			(void)snprintf(reply, replylen,
@@ -1175,6 +1470,7 @@ static void handle_request(struct subscriber_t *sub,
 	}
 	/* display a device list and the user's policy */
 	json_devicelist_dump(reply + strlen(reply), replylen - strlen(reply));
+	sub->late_join = sub->policy.watcher && sub->policy.json;
 	json_watch_dump(&sub->policy,
 			reply + strlen(reply), replylen - strlen(reply));
     } else if (str_starts_with(buf, "?DEVICE")
@@ -1355,6 +1651,15 @@ static void handle_request(struct subscriber_t *sub,
     } else if (str_starts_with(buf, "?VERSION;")) {
 	buf += 9;
 	json_version_dump(reply, replylen);
+#ifdef AIVDM_ENABLE
+    } else if (str_starts_with(buf, "?AIS;")) {
+	/* the table follows the reply, a chunk per pass of the main loop */
+	buf += 5;
+	sub->ais_snapshot = true;
+	sub->ais_cursor = 0;
+	sub->ais_sent = 0;
+	sub->ais_len = sub->ais_off = 0;
+#endif /* AIVDM_ENABLE */
     } else {
 	const char *errend;
 	errend = buf + strlen(buf) - 1;
@@ -1370,93 +1675,81 @@ static void handle_request(struct subscriber_t *sub,
     *after = buf;
 }
 
-static void raw_report(struct subscriber_t *sub, struct gps_device_t *device)
-/* report a raw packet to a subscriber */
+static void cache_reports(struct gps_device_t *device, gps_mask_t changed)
+/* note when the reports a late-joining watcher will want went out */
 {
-    /* *INDENT-OFF* */
-    /*
-     * NMEA and other textual sentences are simply
-     * copied to all clients that are in raw or nmea
-     * mode.
-     */
-    if (TEXTUAL_PACKET_TYPE(device->lexer.type)
-	&& (sub->policy.raw > 0 || sub->policy.nmea)) {
-	(void)throttled_write(sub,
-			      (char *)device->lexer.outbuffer,
-			      device->lexer.outbuflen);
-	return;
-    }
+    timestamp_t *when = cached_reports[device - devices];
+    timestamp_t now = timestamp();
+    int i;
 
-    /*
-     * Also, simply copy if user has specified
-     * super-raw mode.
-     */
-    if (sub->policy.raw > 1) {
-	(void)throttled_write(sub,
-			      (char *)device->lexer.outbuffer,
-			      device->lexer.outbuflen);
-	return;
-    }
-#ifdef BINARY_ENABLE
-    /*
-     * Maybe the user wants a binary packet hexdumped.
-     */
-    if (sub->policy.raw == 1) {
-	const char *hd =
-	    gpsd_hexdump(device->msgbuf, sizeof(device->msgbuf),
-			 (char *)device->lexer.outbuffer,
-			 device->lexer.outbuflen);
-	(void)strlcat((char *)hd, "\r\n", sizeof(device->msgbuf));
-	(void)throttled_write(sub, (char *)hd, strlen(hd));
-    }
-#endif /* BINARY_ENABLE */
+    for (i = 0; i < CACHED_REPORTS; i++)
+	if ((changed & cached_masks[i]) != 0)
+	    when[i] = now;
 }
 
-static void pseudonmea_report(struct subscriber_t *sub,
-			  gps_mask_t changed,
-			  struct gps_device_t *device)
-/* report pseudo-NMEA in appropriate circumstances */
+static void replay_cached_reports(struct subscriber_t *sub)
+/* send a new watcher the latest reports of the devices it watches */
 {
-    if (GPS_PACKET_TYPE(device->lexer.type)
-	&& !TEXTUAL_PACKET_TYPE(device->lexer.type)) {
-	char buf[MAX_PACKET_LENGTH * 3 + 2];
-
-	if ((changed & REPORT_IS) != 0) {
-	    nmea_tpv_dump(device, buf, sizeof(buf));
-	    gpsd_log(&context.errout, LOG_IO,
-		     "<= GPS (binary tpv) %s: %s\n",
-		     device->gpsdata.dev.path, buf);
-	    (void)throttled_write(sub, buf, strlen(buf));
-	}
+    char json[GPS_JSON_RESPONSE_MAX * 2];
+    char buf[GPS_JSON_RESPONSE_MAX * 2 + 64];
+    struct gps_device_t *devp;
+    timestamp_t now = timestamp();
+    int i;
 
-	if ((changed & (SATELLITE_SET|USED_IS)) != 0) {
-	    nmea_sky_dump(device, buf, sizeof(buf));
-	    gpsd_log(&context.errout, LOG_IO,
-		     "<= GPS (binary sky) %s: %s\n",
-		     device->gpsdata.dev.path, buf);
-	    (void)throttled_write(sub, buf, strlen(buf));
-	}
+    for (devp = devices; devp < devices + MAX_DEVICES; devp++) {
+	timestamp_t *when = cached_reports[devp - devices];
 
-	if ((changed & SUBFRAME_SET) != 0) {
-	    nmea_subframe_dump(device, buf, sizeof(buf));
-	    gpsd_log(&context.errout, LOG_IO,
-		     "<= GPS (binary subframe) %s: %s\n",
-		     device->gpsdata.dev.path, buf);
-	    (void)throttled_write(sub, buf, strlen(buf));
-	}
-#ifdef AIVDM_ENABLE
-	if ((changed & AIS_SET) != 0) {
-	    nmea_ais_dump(device, buf, sizeof(buf));
-	    gpsd_log(&context.errout, LOG_IO,
-		     "<= AIS (binary ais) %s: %s\n",
-		     device->gpsdata.dev.path, buf);
+	if (!allocated_device(devp) || !subscribed(sub, devp))
+	    continue;
+	for (i = 0; i < CACHED_REPORTS; i++) {
+	    size_t len;
+
+	    if (when[i] == 0)
+		continue;
+	    json_data_report(cached_masks[i], devp, &sub->policy,
+			     json, sizeof(json));
+	    len = strlen(json);
+	    /*
+	     * Flag the report at its end, not its start: libgps stops
+	     * unpacking an object at the first member it doesn't know.
+	     */
+	    if (len < 3 || strcmp(json + len - 3, "}\r\n") != 0)
+		continue;
+	    (void)snprintf(buf, sizeof(buf),
+			   "%.*s,\"cached\":true,\"age\":%.3f}\r\n",
+			   (int)(len - 3), json, now - when[i]);
 	    (void)throttled_write(sub, buf, strlen(buf));
+	    if (sub->fd == UNALLOCATED_FD)
+		return;
 	}
-#endif /* AIVDM_ENABLE */
     }
 }
 #endif /* SOCKET_EXPORT_ENABLE */
 
+#if defined(SOCKET_EXPORT_ENABLE) && defined(TIMING_ENABLE)
+static void report_latency(struct gps_device_t *device)
+/* account for the time this cycle's report took to go out */
+{
+    struct latency_t *lp = &latencies[device - devices];
+    double delay = timestamp() - device->packet_time;
+
+    GPSD_PROBE2(report_latency, device->gpsdata.dev.path,
+		(long)(delay * 1e9));
+    if (lp->count == 0 || delay < lp->min)
+	lp->min = delay;
+    if (delay > lp->max)
+	lp->max = delay;
+    lp->sum += delay;
+    if (++lp->count >= LATENCY_INTERVAL) {
+	gpsd_log(&context.errout, LOG_INF,
+		 "%s: report latency min %.6f avg %.6f max %.6f sec\n",
+		 device->gpsdata.dev.path,
+		 lp->min, lp->sum / lp->count, lp->max);
+	memset(lp, '\0', sizeof(*lp));
+    }
+}
+#endif /* SOCKET_EXPORT_ENABLE && TIMING_ENABLE */
+
 static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 /* report on the current packet from a specified device */
 {
@@ -1508,6 +1801,9 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 		     device->lexer.outbuflen);
 	} else {
 	    struct gps_device_t *dp;
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+	    caster_relay(device, changed);
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
 	    for (dp = devices; dp < devices+MAX_DEVICES; dp++) {
 		if (allocated_device(dp)) {
 /* *INDENT-OFF* */
@@ -1589,13 +1885,7 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
     }
 #endif /* NTP_ENABLE */
 
-    /*
-     * If no reliable end of cycle, must report every time
-     * a sentence changes position or mode. Likely to
-     * cause display jitter.
-     */
-    if (!device->cycle_end_reliable && (changed & (LATLON_SET | MODE_SET))!=0)
-	changed |= REPORT_IS;
+    changed = gpsd_report_mask(device, changed);
 
     /* a few things are not per-subscriber reports */
     if ((changed & REPORT_IS) != 0) {
@@ -1624,64 +1914,56 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 	shm_update(&context, &device->gpsdata);
 #endif /* SHM_EXPORT_ENABLE */
 
+#ifdef MCAST_EXPORT_ENABLE
+    mcast_report(device, changed);
+#endif /* MCAST_EXPORT_ENABLE */
+
+#if defined(AIVDM_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    if ((changed & AIS_SET) != 0)
+	ais_table_update(device);
+#endif /* AIVDM_ENABLE && SOCKET_EXPORT_ENABLE */
+
 #ifdef SOCKET_EXPORT_ENABLE
+    /* passed-through JSON is kept by the daemon it came from */
+    if ((changed & PASSTHROUGH_IS) == 0)
+	cache_reports(device, changed);
+
     /* update all subscribers associated with this device */
     for (sub = subscribers; sub < subscribers + MAX_CLIENTS; sub++) {
-	if (sub == NULL || sub->active == 0 || !subscribed(sub, device))
-	    continue;
+	char buf[SUBSCRIBER_REPORT_MAX];
+	const char *report;
+	size_t len;
 
-#ifdef PASSTHROUGH_ENABLE
-	/* this is for passing through JSON packets */
-	if ((changed & PASSTHROUGH_IS) != 0) {
-	    (void)strlcat((char *)device->lexer.outbuffer,
-			  "\r\n",
-			  sizeof(device->lexer.outbuffer));
-	    (void)throttled_write(sub,
-				  (char *)device->lexer.outbuffer,
-				  device->lexer.outbuflen+2);
+	if (sub == NULL || sub->active == 0 || !subscribed(sub, device))
 	    continue;
-	}
-#endif /* PASSTHROUGH_ENABLE */
-
-	/* report raw packets to users subscribed to those */
-	raw_report(sub, device);
 
 	/* some listeners may be in watcher mode */
-	if (sub->policy.watcher) {
-	    if (changed & DATA_IS) {
-		/* guard keeps mask dumper from eating CPU */
-		if (context.errout.debug >= LOG_PROG)
-		    gpsd_log(&context.errout, LOG_PROG,
-			     "Changed mask: %s with %sreliable cycle detection\n",
-			     gps_maskdump(changed),
-			     device->cycle_end_reliable ? "" : "un");
-		if ((changed & REPORT_IS) != 0)
-		    gpsd_log(&context.errout, LOG_PROG,
-			     "time to report a fix\n");
-
-		if (sub->policy.nmea)
-		    pseudonmea_report(sub, changed, device);
-
-		if (sub->policy.json)
-		{
-		    char buf[GPS_JSON_RESPONSE_MAX * 4];
-
-		    if ((changed & AIS_SET) != 0)
-			if (device->gpsdata.ais.type == 24
-			    && device->gpsdata.ais.type24.part != both
-			    && !sub->policy.split24)
-			    continue;
-
-		    json_data_report(changed,
-				     device, &sub->policy,
-				     buf, sizeof(buf));
-		    if (buf[0] != '\0')
-			(void)throttled_write(sub, buf, strlen(buf));
-
-		}
-	    }
+	if (sub->policy.watcher && (changed & DATA_IS) != 0) {
+	    /* guard keeps mask dumper from eating CPU */
+	    if (context.errout.debug >= LOG_PROG)
+		gpsd_log(&context.errout, LOG_PROG,
+			 "Changed mask: %s with %sreliable cycle detection\n",
+			 gps_maskdump(changed),
+			 device->cycle_end_reliable ? "" : "un");
+	    if ((changed & REPORT_IS) != 0)
+		gpsd_log(&context.errout, LOG_PROG,
+			 "time to report a fix\n");
 	}
+
+	/*
+	 * Raw packets, pseudo-NMEA and JSON, as the policy asks.
+	 * Passed-through JSON is the one packet shared by every watcher.
+	 */
+	len = json_subscriber_report(changed, device, &sub->policy,
+				     buf, sizeof(buf), &report);
+	if (len > 0)
+	    (void)throttled_write(sub, report, len);
     } /* subscribers */
+
+#ifdef TIMING_ENABLE
+    if ((changed & REPORT_IS) != 0)
+	report_latency(device);
+#endif /* TIMING_ENABLE */
 #endif /* SOCKET_EXPORT_ENABLE */
 }
 
@@ -1692,6 +1974,7 @@ static void all_reports(struct gps_device_t *device, gps_mask_t changed)
 static int handle_gpsd_request(struct subscriber_t *sub, const char *buf)
 {
     char reply[GPS_JSON_RESPONSE_MAX + 1];
+    ssize_t status;
 
     reply[0] = '\0';
     if (buf[0] == '?') {
@@ -1704,7 +1987,13 @@ static int handle_gpsd_request(struct subscriber_t *sub, const char *buf)
 			       reply + strlen(reply),
 			       sizeof(reply) - strlen(reply));
     }
-    return (int)throttled_write(sub, reply, strlen(reply));
+    status = throttled_write(sub, reply, strlen(reply));
+    if (sub->late_join) {
+	sub->late_join = false;
+	if (status >= 0 && sub->fd != UNALLOCATED_FD)
+	    replay_cached_reports(sub);
+    }
+    return (int)status;
 }
 #endif /* SOCKET_EXPORT_ENABLE */
 
@@ -1729,6 +2018,23 @@ static void ship_pps_message(struct gps_device_t *session,
 		    td->clock.tv_sec, td->clock.tv_nsec,
                     precision);
 
+    /*
+     * Every so often, tell PPS watchers how the edges are behaving.
+     * Count the events shipped here, not the thread's edges, which
+     * may already have moved past this one.
+     */
+    if (session->pps_events % PPS_STATS_INTERVAL == 0) {
+	struct pps_stats_t stats;
+
+	pps_thread_stats(&session->pps_thread, &stats);
+	notify_watchers(session, true, true,
+			"{\"class\":\"PPSSTATS\",\"device\":\"%s\",\"edges\":%lu,\"missed\":%lu,\"disagree\":%lu,\"overruns\":%lu,\"interval\":%.9f,\"jitter\":%.9f}\r\n",
+			session->gpsdata.dev.path,
+			stats.edges, stats.missed, stats.disagree,
+			session->pps_thread.event_overruns,
+			stats.interval, sqrt(stats.variance));
+    }
+
     /*
      * PPS receipt resets the device's timeout.  This keeps PPS-only
      * devices, which never deliver in-band data, from timing out.
@@ -1817,12 +2123,7 @@ static void netgnss_autoconnect(struct gps_context_t *context,
 }
 #endif /* __UNUSED_AUTOCONNECT__ */
 
-#ifdef PPS_ENABLE
-#define CONDITIONALLY_UNUSED
-#else
-#define CONDITIONALLY_UNUSED UNUSED
-#endif /* PPS_ENABLE */
-static void gpsd_terminate(struct gps_context_t *context CONDITIONALLY_UNUSED)
+static void gpsd_terminate(struct gps_context_t *context)
 /* finish cleanly, reverting device configuration */
 {
     int dfd;
@@ -1832,6 +2133,8 @@ static void gpsd_terminate(struct gps_context_t *context CONDITIONALLY_UNUSED)
 	    (void)gpsd_wrap(&devices[dfd]);
 	}
     }
+    if (assist_file != NULL)
+	(void)gpsd_assist_save(context, assist_file);
 #ifdef PPS_ENABLE
     context->pps_hook = NULL;	/* tell any PPS-watcher thread to die */
 #endif /* PPS_ENABLE */
@@ -1844,7 +2147,14 @@ int main(int argc, char *argv[])
     static char *gpsd_service = NULL;
     struct subscriber_t *sub;
 #endif /* SOCKET_EXPORT_ENABLE */
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    static char *caster_service = NULL;
+    socket_t castersocks[AFCOUNT] = {-1, -1};
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
     fd_set rfds;
+#if defined(SOCKET_EXPORT_ENABLE) && defined(AIVDM_ENABLE)
+    fd_set wfds;
+#endif /* SOCKET_EXPORT_ENABLE && AIVDM_ENABLE */
 #ifdef CONTROL_SOCKET_ENABLE
     fd_set control_fds;
 #endif /* CONTROL_SOCKET_ENABLE */
@@ -1873,14 +2183,61 @@ int main(int argc, char *argv[])
 #endif /* PPS_ENABLE && SOCKET_EXPORT_ENABLE */
 #endif /* CONTROL_SOCKET_ENABLE */
 
-    while ((option = getopt(argc, argv, "F:D:S:bGhlNnrP:V")) != -1) {
+    while ((option = getopt(argc, argv, "A:C:c:E:F:D:M:S:T:bGhlNnrP:RV")) != -1) {
 	switch (option) {
+	case 'A':
+	    assist_file = optarg;
+	    break;
+	case 'c':
+	    /* resolved now, since daemonizing changes directory */
+	    if (realpath(optarg, capture_dir) == NULL) {
+		gpsd_log(&context.errout, LOG_ERROR,
+			 "can't capture to %s: %s\n", optarg, strerror(errno));
+		exit(EXIT_FAILURE);
+	    }
+	    context.capture_dir = capture_dir;
+	    break;
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+	case 'C':
+	    caster_service = optarg;
+	    break;
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
 	case 'D':
 	    context.errout.debug = (int)strtol(optarg, 0, 0);
 #ifdef CLIENTDEBUG_ENABLE
 	    gps_enable_debug(context.errout.debug, stderr);
 #endif /* CLIENTDEBUG_ENABLE */
 	    break;
+#ifdef NMEA0183_ENABLE
+	case 'E':
+	    if (ncycle_enders >= MAX_DEVICES)
+		gpsd_log(&context.errout, LOG_ERROR,
+			 "too many cycle enders, %s ignored\n", optarg);
+	    else {
+		char *at = strchr(optarg, '@');
+		size_t taglen = (at != NULL) ? (size_t)(at - optarg)
+					     : strlen(optarg);
+
+		if (taglen == 0 || taglen >= sizeof(cycle_enders[0].tag)) {
+		    gpsd_log(&context.errout, LOG_ERROR,
+			     "bad cycle ender %s\n", optarg);
+		    exit(EXIT_FAILURE);
+		}
+		memcpy(cycle_enders[ncycle_enders].tag, optarg, taglen);
+		cycle_enders[ncycle_enders].tag[taglen] = '\0';
+		if (at != NULL)
+		    (void)strlcpy(cycle_enders[ncycle_enders].devpath, at + 1,
+				  sizeof(cycle_enders[0].devpath));
+		ncycle_enders++;
+	    }
+	    break;
+#endif /* NMEA0183_ENABLE */
+#ifdef MCAST_EXPORT_ENABLE
+	case 'M':
+	    if (!mcast_add(&context, optarg))
+		exit(EXIT_FAILURE);
+	    break;
+#endif /* MCAST_EXPORT_ENABLE */
 #ifdef CONTROL_SOCKET_ENABLE
 	case 'F':
 	    control_socket = optarg;
@@ -1892,6 +2249,11 @@ int main(int argc, char *argv[])
 	case 'b':
 	    context.readonly = true;
 	    break;
+#ifdef PASSTHROUGH_ENABLE
+	case 'R':
+	    context.passthrough_relay = true;
+	    break;
+#endif /* PASSTHROUGH_ENABLE */
 #ifndef FORCE_GLOBAL_ENABLE
 	case 'G':
 	    listen_global = true;
@@ -1900,6 +2262,14 @@ int main(int argc, char *argv[])
 	case 'l':		/* list known device types and exit */
 	    typelist();
 	    break;
+#ifdef PPS_ENABLE
+	case 'T':
+	    /* realtime PPS: priority[,cpu] */
+	    context.pps_rtprio = atoi(optarg);
+	    if (strchr(optarg, ',') != NULL)
+		context.pps_cpu = atoi(strchr(optarg, ',') + 1);
+	    break;
+#endif /* PPS_ENABLE */
 	case 'S':
 #ifdef SOCKET_EXPORT_ENABLE
 	    gpsd_service = optarg;
@@ -1958,6 +2328,31 @@ int main(int argc, char *argv[])
 	exit(EXIT_FAILURE);
     }
 
+#ifdef PPS_ENABLE
+    /*
+     * PPS threads queue their events and poke this descriptor; the
+     * client notifications then go out from the main loop, so the PPS
+     * edge path never waits on network I/O.
+     */
+#ifdef __linux__
+    context.pps_wakefd[0] = context.pps_wakefd[1] =
+	eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    if (pipe(context.pps_wakefd) == 0) {
+	(void)fcntl(context.pps_wakefd[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(context.pps_wakefd[1], F_SETFL, O_NONBLOCK);
+    } else
+	context.pps_wakefd[0] = context.pps_wakefd[1] = -1;
+#endif /* __linux__ */
+    if (context.pps_wakefd[0] < 0)
+	gpsd_log(&context.errout, LOG_WARN,
+		 "can't create PPS wakeup descriptor: %s\n", strerror(errno));
+    else {
+	FD_SET(context.pps_wakefd[0], &all_fds);
+	adjust_max_fd(context.pps_wakefd[0], true);
+    }
+#endif /* PPS_ENABLE */
+
     /*
      * Control socket has to be created before we go background in order to
      * avoid a race condition in which hotplug scripts can try opening
@@ -2019,6 +2414,12 @@ int main(int argc, char *argv[])
     }
 
     openlog("gpsd", LOG_PID, LOG_USER);
+#ifdef LOG_ASYNC_ENABLE
+    /* after daemonizing, threads don't survive fork() */
+    if (!gpsd_log_async_start())
+	gpsd_log(&context.errout, LOG_WARN,
+		 "can't start logging thread, logging synchronously\n");
+#endif /* LOG_ASYNC_ENABLE */
     gpsd_log(&context.errout, LOG_INF, "launching (Version %s)\n", VERSION);
 
 #ifdef SOCKET_EXPORT_ENABLE
@@ -2036,6 +2437,27 @@ int main(int argc, char *argv[])
     gpsd_log(&context.errout, LOG_INF, "listening on port %s\n", gpsd_service);
 #endif /* SOCKET_EXPORT_ENABLE */
 
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    if (caster_service != NULL) {
+	/* not passivesocks(), systemd's sockets belong to the gpsd port */
+	castersocks[0] = passivesock_af(AF_INET, caster_service, "tcp", QLEN);
+#ifdef IPV6_ENABLE
+	castersocks[1] = passivesock_af(AF_INET6, caster_service, "tcp", QLEN);
+#endif /* IPV6_ENABLE */
+	if (castersocks[0] < 0 && castersocks[1] < 0) {
+	    gpsd_log(&context.errout, LOG_ERR,
+		     "caster sockets creation failed, netlib errors %d, %d\n",
+		     castersocks[0], castersocks[1]);
+	    if (pid_file != NULL)
+		(void)unlink(pid_file);
+	    exit(EXIT_FAILURE);
+	}
+	caster_init(&context, caster_fdhook);
+	gpsd_log(&context.errout, LOG_INF,
+		 "Ntrip caster listening on port %s\n", caster_service);
+    }
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+
 #ifdef NTPSHM_ENABLE
     if (getuid() == 0) {
 	errno = 0;
@@ -2053,6 +2475,48 @@ int main(int argc, char *argv[])
     (void)ntpshm_context_init(&context);
 #endif /* NTPSHM_ENABLE */
 
+#ifdef PPS_ENABLE
+    if (context.pps_rtprio > 0) {
+	/*
+	 * Realtime PPS: each PPS thread locks its own stack so an edge
+	 * never waits on a page-in.  While we're still root, allow the
+	 * threads of devices hotplugged later to do that and to go
+	 * SCHED_FIFO.
+	 */
+#ifdef RLIMIT_MEMLOCK
+	{
+	    struct rlimit memlimit;
+	    /* a stack and a context each, with room to spare */
+	    rlim_t want = (rlim_t)MAX_DEVICES * 2 * PPS_THREAD_STACK;
+
+	    if (getrlimit(RLIMIT_MEMLOCK, &memlimit) == 0
+		&& memlimit.rlim_cur != RLIM_INFINITY
+		&& memlimit.rlim_cur < want) {
+		memlimit.rlim_cur = want;
+		if (memlimit.rlim_max != RLIM_INFINITY
+		    && memlimit.rlim_max < want)
+		    memlimit.rlim_max = want;
+		if (setrlimit(RLIMIT_MEMLOCK, &memlimit) != 0)
+		    gpsd_log(&context.errout, LOG_WARN,
+			     "PPS: can't raise RLIMIT_MEMLOCK: %s\n",
+			     strerror(errno));
+	    }
+	}
+#endif /* RLIMIT_MEMLOCK */
+#ifdef RLIMIT_RTPRIO
+	{
+	    struct rlimit rtlimit;
+
+	    rtlimit.rlim_cur = rtlimit.rlim_max = (rlim_t)context.pps_rtprio;
+	    if (setrlimit(RLIMIT_RTPRIO, &rtlimit) != 0)
+		gpsd_log(&context.errout, LOG_WARN,
+			 "PPS: can't raise RLIMIT_RTPRIO: %s\n",
+			 strerror(errno));
+	}
+#endif /* RLIMIT_RTPRIO */
+    }
+#endif /* PPS_ENABLE */
+
 #if defined(DBUS_EXPORT_ENABLE)
     /* we need to connect to dbus as root */
     if (initialize_dbus_connection()) {
@@ -2195,12 +2659,25 @@ int main(int argc, char *argv[])
 	    FD_SET(msocks[i], &all_fds);
 	    adjust_max_fd(msocks[i], true);
 	}
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    for (i = 0; i < AFCOUNT; i++)
+	if (castersocks[i] >= 0) {
+	    FD_SET(castersocks[i], &all_fds);
+	    adjust_max_fd(castersocks[i], true);
+	}
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
 #ifdef CONTROL_SOCKET_ENABLE
     FD_ZERO(&control_fds);
 #endif /* CONTROL_SOCKET_ENABLE */
 
     /* initialize the GPS context's time fields */
-    gpsd_time_init(&context, time(NULL));
+    gpsd_time_init(&context, gps_clock_time());
+
+    /* what we knew of the sky last time, for receivers that forgot it */
+    if (assist_file != NULL) {
+	(void)gpsd_assist_load(&context, assist_file);
+	assist_saved = gps_clock_time();
+    }
 
     /*
      * If we got here via SIGINT, reopen any command-line devices. PPS
@@ -2218,8 +2695,19 @@ int main(int argc, char *argv[])
 
     while (0 == signalled) {
 	fd_set efds;
-
-	switch(gpsd_await_data(&rfds, &efds, maxfd, &all_fds, &context.errout))
+	fd_set *wfdsp = NULL;
+
+#if defined(SOCKET_EXPORT_ENABLE) && defined(AIVDM_ENABLE)
+	/* clients still taking an ?AIS table resume when they can */
+	FD_ZERO(&wfds);
+	for (sub = subscribers; sub < subscribers + MAX_CLIENTS; sub++)
+	    if (sub->active != 0 && sub->ais_snapshot) {
+		FD_SET(sub->fd, &wfds);
+		wfdsp = &wfds;
+	    }
+#endif /* SOCKET_EXPORT_ENABLE && AIVDM_ENABLE */
+	switch(gpsd_await_data(&rfds, wfdsp, &efds, maxfd, &all_fds,
+			       &context.errout))
 	{
 	case AWAIT_GOT_INPUT:
 	    break;
@@ -2281,7 +2769,7 @@ int main(int argc, char *argv[])
 			FD_SET(ssock, &all_fds);
 			adjust_max_fd(ssock, true);
 			client->fd = ssock;
-			client->active = time(NULL);
+			client->active = gps_clock_time();
 			gpsd_log(&context.errout, LOG_SPIN,
 				 "client %s (%d) connect on fd %d\n", c_ip,
 				 sub_index(client), ssock);
@@ -2295,6 +2783,52 @@ int main(int argc, char *argv[])
 	}
 #endif /* SOCKET_EXPORT_ENABLE */
 
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+	/* new Ntrip caster clients, then requests from existing ones */
+	for (i = 0; i < AFCOUNT; i++) {
+	    if (castersocks[i] >= 0 && FD_ISSET(castersocks[i], &rfds)) {
+		socklen_t alen = (socklen_t) sizeof(fsin);
+		socket_t ssock =
+		    accept(castersocks[i], (struct sockaddr *)&fsin, &alen);
+
+		if (BAD_SOCKET(ssock))
+		    gpsd_log(&context.errout, LOG_ERROR,
+			     "caster accept: %s\n", strerror(errno));
+		else {
+		    int opts = fcntl(ssock, F_GETFL);
+
+		    if (opts >= 0)
+			(void)fcntl(ssock, F_SETFL, opts | O_NONBLOCK);
+		    if (!caster_attach(ssock))
+			(void)close(ssock);
+		}
+		FD_CLR(castersocks[i], &rfds);
+	    }
+	}
+	if (caster_service != NULL)
+	    caster_poll(&rfds, devices, MAX_DEVICES);
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+
+#ifdef PPS_ENABLE
+	/* hand PPS events queued by the PPS threads to the context hook */
+	if (context.pps_wakefd[0] >= 0
+	    && FD_ISSET(context.pps_wakefd[0], &rfds)) {
+	    char drain[64];
+	    struct timedelta_t td;
+
+	    while (read(context.pps_wakefd[0], drain, sizeof(drain)) > 0)
+		continue;
+	    for (device = devices; device < devices + MAX_DEVICES; device++)
+		while (allocated_device(device)
+		       && pps_thread_event(&device->pps_thread, &td)) {
+		    device->pps_events++;
+		    if (context.pps_hook != NULL)
+			context.pps_hook(device, &td);
+		}
+	    FD_CLR(context.pps_wakefd[0], &rfds);
+	}
+#endif /* PPS_ENABLE */
+
 #ifdef CONTROL_SOCKET_ENABLE
 	/* also be open to new control-socket connections */
 	if (csock > -1 && FD_ISSET(csock, &rfds)) {
@@ -2326,7 +2860,7 @@ int main(int argc, char *argv[])
 		    gpsd_log(&context.errout, LOG_CLIENT,
 			     "<= control(%d): %s\n", cfd, buf);
 		    /* coverity[tainted_data] Safe, never handed to exec */
-		    handle_control(cfd, buf);
+		    handle_control(cfd, buf, &rfds);
 		}
 		gpsd_log(&context.errout, LOG_SPIN,
 			 "close(%d) of control socket\n", cfd);
@@ -2340,24 +2874,8 @@ int main(int argc, char *argv[])
 	/* poll all active devices */
 	for (device = devices; device < devices + MAX_DEVICES; device++)
 	    if (allocated_device(device) && device->gpsdata.gps_fd > 0)
-		switch (gpsd_multipoll(FD_ISSET(device->gpsdata.gps_fd, &rfds),
-				       device, all_reports, DEVICE_REAWAKE))
-		{
-		case DEVICE_READY:
-		    FD_SET(device->gpsdata.gps_fd, &all_fds);
-		    adjust_max_fd(device->gpsdata.gps_fd, true);
-		    break;
-		case DEVICE_UNREADY:
-		    FD_CLR(device->gpsdata.gps_fd, &all_fds);
-		    adjust_max_fd(device->gpsdata.gps_fd, false);
-		    break;
-		case DEVICE_ERROR:
-		case DEVICE_EOF:
-		    deactivate_device(device);
-		    break;
-		default:
-		    break;
-		}
+		service_device(device,
+			       FD_ISSET(device->gpsdata.gps_fd, &rfds));
 
 #ifdef __UNUSED_AUTOCONNECT__
 	if (context.fixcnt > 0 && !context.autconnect) {
@@ -2405,15 +2923,23 @@ int main(int argc, char *argv[])
 		     * after COMMAND_TIMEOUT seconds. This makes
 		     * COMMAND_TIMEOUT useful.
 		     */
-		    sub->active = time(NULL);
+		    sub->active = gps_clock_time();
 		    if (handle_gpsd_request(sub, buf) < 0)
 			detach_client(sub);
 		}
+#ifdef AIVDM_ENABLE
+		if (sub->ais_snapshot)
+		    ais_snapshot_continue(sub);
+#endif /* AIVDM_ENABLE */
 	    } else {
 		unlock_subscriber(sub);
 
+#ifdef AIVDM_ENABLE
+		if (sub->ais_snapshot && FD_ISSET(sub->fd, &wfds))
+		    ais_snapshot_continue(sub);
+#endif /* AIVDM_ENABLE */
 		if (!sub->policy.watcher
-		    && time(NULL) - sub->active > COMMAND_TIMEOUT) {
+		    && gps_clock_time() - sub->active > COMMAND_TIMEOUT) {
 		    gpsd_log(&context.errout, LOG_WARN,
 			     "client(%d) timed out on command wait.\n",
 			     sub_index(sub));
@@ -2449,12 +2975,12 @@ int main(int argc, char *argv[])
 	    if (!device_needed && device->gpsdata.gps_fd > -1 &&
 		    device->lexer.type != BAD_PACKET) {
 		if (device->releasetime == 0) {
-		    device->releasetime = time(NULL);
+		    device->releasetime = gps_clock_time();
 		    gpsd_log(&context.errout, LOG_PROG,
 			     "device %d (fd %d) released\n",
 			     (int)(device - devices),
 			     device->gpsdata.gps_fd);
-		} else if (time(NULL) - device->releasetime > RELEASE_TIMEOUT) {
+		} else if (gps_clock_time() - device->releasetime > RELEASE_TIMEOUT) {
 		    gpsd_log(&context.errout, LOG_PROG,
 			     "device %d closed\n",
 			     (int)(device - devices));
@@ -2467,8 +2993,8 @@ int main(int argc, char *argv[])
 
 	    if (device_needed && BAD_SOCKET(device->gpsdata.gps_fd) &&
 		    (device->opentime == 0 ||
-		    time(NULL) - device->opentime > DEVICE_RECONNECT)) {
-		device->opentime = time(NULL);
+		    gps_clock_time() - device->opentime > DEVICE_RECONNECT)) {
+		device->opentime = gps_clock_time();
 		gpsd_log(&context.errout, LOG_INF,
 			 "reconnection attempt on device %d\n",
 			 (int)(device - devices));
@@ -2488,6 +3014,12 @@ int main(int argc, char *argv[])
 	 * has been launched but not yet received its first device
 	 * over the socket.
 	 */
+	if (assist_file != NULL
+	    && gps_clock_time() - assist_saved > ASSIST_SAVE_INTERVAL) {
+	    (void)gpsd_assist_save(&context, assist_file);
+	    assist_saved = gps_clock_time();
+	}
+
 	if (argc == optind && highwater > 0) {
 	    int subcount = 0, devcount = 0;
 #ifdef SOCKET_EXPORT_ENABLE
@@ -2531,6 +3063,15 @@ shutdown:
     }
 #endif /* SOCKET_EXPORT_ENABLE */
 
+#if defined(NTRIP_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+    if (caster_service != NULL)
+	caster_release();
+#endif /* NTRIP_ENABLE && SOCKET_EXPORT_ENABLE */
+
+#ifdef MCAST_EXPORT_ENABLE
+    mcast_release();
+#endif /* MCAST_EXPORT_ENABLE */
+
 #ifdef SHM_EXPORT_ENABLE
     shm_release(&context);
 #endif /* SHM_EXPORT_ENABLE */
@@ -111,6 +111,9 @@ extern "C" {
 #ifdef ISYNC_ENABLE
 #define STASH_ENABLE
 #endif
+#if defined(PPS_ENABLE) && defined(HAVE_STDATOMIC_H) && !defined(SQUELCH_ENABLE)
+#define LOG_ASYNC_ENABLE	/* threads and atomics for the log ring */
+#endif
 
 /* First, declarations for the packet layer... */
 
@@ -214,6 +217,7 @@ struct gps_lexer_t {
     unsigned long retry_counter;	/* count sniff retries */
     unsigned counter;			/* packets since last driver switch */
     struct gpsd_errout_t errout;		/* how to report errors */
+    struct gps_capture_t *capture;	/* where input is logged, if anywhere */
 #ifdef TIMING_ENABLE
     timestamp_t start_time;		/* timestamp of first input */
     unsigned long start_char;		/* char counter at first input */
@@ -244,6 +248,7 @@ struct gps_lexer_t {
 #ifdef STASH_ENABLE
     unsigned char stashbuffer[MAX_PACKET_LENGTH];
     size_t stashbuflen;
+    size_t unstashlen;		/* stash returned during packet_frame() */
 #endif /* STASH_ENABLE */
 };
 
@@ -252,8 +257,16 @@ extern void packet_reset(struct gps_lexer_t *);
 extern void packet_pushback(struct gps_lexer_t *);
 extern void packet_parse(struct gps_lexer_t *);
 extern ssize_t packet_get(int, struct gps_lexer_t *);
+extern ssize_t packet_frame(struct gps_lexer_t *,
+			    const unsigned char *, size_t, size_t *);
 extern int packet_sniff(struct gps_lexer_t *);
 #define packet_buffered_input(lexer) ((lexer)->inbuffer + (lexer)->inbuflen - (lexer)->inbufptr)
+/* after packet_frame(), input the lexer has not yet looked at */
+#ifdef STASH_ENABLE
+#define packet_unread_input(lexer) ((lexer)->inbuflen - (lexer)->unstashlen)
+#else
+#define packet_unread_input(lexer) ((lexer)->inbuflen)
+#endif /* STASH_ENABLE */
 
 /* Next, declarations for the core library... */
 
@@ -273,6 +286,66 @@ extern int packet_sniff(struct gps_lexer_t *);
 
 struct gps_device_t;
 
+#ifdef AIVDM_ENABLE
+/*
+ * Overlapping AIS receivers hear the same transmission.  Assembled
+ * payloads are remembered briefly so copies arriving via another
+ * device can be dropped before they are decoded.
+ */
+#define AIS_DEDUP_SLOTS		1024	/* power of 2 */
+#define AIS_DEDUP_WINDOW	2.0	/* seconds a payload is remembered */
+struct ais_dedup_t {
+    uint64_t hash;			/* FNV-1a of bit length and payload */
+    timestamp_t seen;			/* when it was last decoded */
+    const struct gps_device_t *device;	/* which device decoded it */
+};
+#endif /* AIVDM_ENABLE */
+
+/*
+ * What we know of the sky, kept so a receiver that lost power can be
+ * given a warm start when it comes back.  Only GPS is covered.  Words
+ * are the 24 data bits of words 3-10 of a subframe, parity stripped,
+ * the form both u-blox AID messages and the state file use.
+ */
+#define ASSIST_SVS		32		/* GPS PRNs 1-32 */
+#define ASSIST_EPH_MAXAGE	(4 * 3600)	/* seconds an ephemeris is used */
+#define ASSIST_ALM_MAXAGE	(4 * SECS_PER_WEEK)	/* an almanac */
+struct gps_assist_t {
+    struct {
+	timestamp_t heard;		/* when completed, 0 if never */
+	uint32_t how;			/* hand-over word of subframe 1 */
+	uint32_t words[3][8];		/* subframes 1-3 */
+	/* the next set, until subframes 1-3 agree on its issue */
+	uint32_t next_how;
+	uint32_t next[3][8];
+	unsigned char next_have;	/* bit n-1 set for subframe n */
+    } eph[ASSIST_SVS];
+    struct {
+	timestamp_t heard;		/* 0 if never */
+	uint32_t words[8];
+    } alm[ASSIST_SVS];
+    timestamp_t fix_time;		/* last good fix, 0 if none */
+    double latitude, longitude;
+    double altitude;			/* WGS84 ellipsoid height */
+};
+
+/*
+ * Raw device input as read, logged with the time it arrived so it can
+ * be replayed later; capture.c describes the format.  A sparse index
+ * beside the log maps times to offsets.
+ */
+#define CAPTURE_MAGIC		"GPSDCAP1"
+#define CAPTURE_MAGIC_LEN	8
+#define CAPTURE_HEADER		12	/* record length and microseconds */
+#define CAPTURE_INDEX_ENTRY	16	/* microseconds and offset */
+#define CAPTURE_INDEX_INTERVAL	1.0	/* seconds between index entries */
+struct gps_capture_t {
+    int fd;				/* the log, -1 if not capturing */
+    int idxfd;				/* its index, -1 if none */
+    off_t offset;			/* where the next record goes */
+    timestamp_t indexed;		/* when the last index entry was made */
+};
+
 struct gps_context_t {
     int valid;				/* member validity flags */
 #define LEAP_SECOND_VALID	0x01	/* we have or don't need correction */
@@ -280,6 +353,9 @@ struct gps_context_t {
 #define CENTURY_VALID		0x04	/* have received ZDA or 4-digit year */
     struct gpsd_errout_t errout;		/* debug verbosity level and hook */
     bool readonly;			/* if true, never write to device */
+#ifdef PASSTHROUGH_ENABLE
+    bool passthrough_relay;		/* forward gpsd:// JSON unedited */
+#endif /* PASSTHROUGH_ENABLE */
     /* DGPS status */
     int fixcnt;				/* count of good fixes seen */
     /* timekeeping */
@@ -303,7 +379,11 @@ struct gps_context_t {
     bool shmTimeInuse[NTPSHMSEGS];
 #endif /* NTPSHM_ENABLE */
 #ifdef PPS_ENABLE
+    /* called from the main loop for PPS events queued by the PPS thread */
     void (*pps_hook)(struct gps_device_t *, struct timedelta_t *);
+    int pps_wakefd[2];			/* PPS events wake the main loop */
+    int pps_rtprio;			/* PPS thread SCHED_FIFO priority */
+    int pps_cpu;			/* CPU to pin PPS threads to, or -1 */
 #endif /* PPS_ENABLE */
 #ifdef SHM_EXPORT_ENABLE
     /* we don't want the compiler to treat writes to shmexport as dead code,
@@ -313,17 +393,34 @@ struct gps_context_t {
 #endif
     ssize_t (*serial_write)(struct gps_device_t *,
 			    const char *buf, const size_t len);
+#ifdef AIVDM_ENABLE
+    struct ais_dedup_t ais_dedup[AIS_DEDUP_SLOTS];
+    unsigned long ais_duplicates;	/* payloads dropped as copies */
+#endif /* AIVDM_ENABLE */
+    struct gps_assist_t assist;		/* warm-start aiding data */
+    const char *capture_dir;		/* log device input here, if set */
 };
 
-/* state for resolving interleaved Type 24 packets */
+/*
+ * State for resolving interleaved Type 24 packets.  Part As wait in a
+ * table hashed by MMSI for the part B that completes them; a part A is
+ * looked for in a short probe window from its MMSI's home slot.
+ */
 struct ais_type24a_t {
-    unsigned int mmsi;
+    unsigned int mmsi;			/* 0 marks a free slot */
+    timestamp_t stashed;
     char shipname[AIS_SHIPNAME_MAXLEN+1];
 };
-#define MAX_TYPE24_INTERLEAVE	8	/* max number of queued type 24s */
+#ifndef AIS_TYPE24_SLOTS
+#define AIS_TYPE24_SLOTS	256	/* pending part As per channel */
+#endif
+#define TYPE24_PROBES		8	/* slots searched per MMSI */
+#define TYPE24_EXPIRY		60.0	/* B follows A within a minute */
 struct ais_type24_queue_t {
-    struct ais_type24a_t ships[MAX_TYPE24_INTERLEAVE];
-    int index;
+    struct ais_type24a_t ships[AIS_TYPE24_SLOTS];
+    unsigned long matched;		/* part Bs paired with a part A */
+    unsigned long evicted;		/* part As pushed out unmatched */
+    unsigned long orphaned;		/* expired As, unmatched Bs */
 };
 
 /* state for resolving AIVDM decodes */
@@ -445,6 +542,7 @@ typedef enum {source_unknown,
 	      source_gpsd,	/* Remote gpsd instance over TCP/IP */
 	      source_pps,	/* PPS-only device, such as /dev/ppsN */
 	      source_pipe,	/* Unix FIFO; don't use blocking I/O */
+	      source_replay,	/* capture log played back, never written */
 } sourcetype_t;
 
 /*
@@ -492,6 +590,25 @@ struct ntrip_stream_t
     int bitrate;
 };
 
+/*
+ * State of an asynchronous connection to a DGNSS service.  Name
+ * resolution and connect(2) happen in a short-lived helper thread so
+ * a slow or dead caster can never stall the main loop; until the
+ * helper is done the device descriptor is the read end of a pipe
+ * that becomes readable when the result is ready.
+ */
+#define NETGNSS_BACKOFF_MIN	1	/* first reconnect delay, seconds */
+#define NETGNSS_BACKOFF_MAX	64	/* ceiling on reconnect delay */
+
+struct netgnss_conn_t
+{
+    char host[256];
+    char port[32];
+    bool pending;		/* helper thread still running */
+    unsigned int backoff;	/* delay before the next attempt, seconds */
+    unsigned int attempts;	/* consecutive failed attempts */
+};
+
 #ifdef PPS_ENABLE
 #include "ppsthread.h"
 #endif /* PPS_ENABLE */
@@ -519,6 +636,7 @@ struct gps_device_t {
 #endif /* FIXED_PORT_SPEED */
     int saved_baud;
     struct gps_lexer_t lexer;
+    struct gps_capture_t capture;
     int badcount;
     int subframe_count;
     /* firmware version or subtype ID, 96 too small for ZED-F9 */
@@ -529,8 +647,14 @@ struct gps_device_t {
     time_t reawake;
 #ifdef TIMING_ENABLE
     timestamp_t sor;	/* timestamp start of this reporting cycle */
+    timestamp_t packet_time;	/* when the last packet was read */
     unsigned long chars;	/* characters in the cycle */
 #endif /* TIMING_ENABLE */
+    gps_mask_t cycle_set;	/* what the current cycle has delivered */
+#ifdef PASSTHROUGH_ENABLE
+    bool relay_unpacked;	/* relayed JSON parsed for NMEA watchers */
+    gps_mask_t relay_mask;	/* and what that parse found */
+#endif /* PASSTHROUGH_ENABLE */
 #ifdef NTP_ENABLE
     bool ship_to_ntpd;
 #ifdef NTPSHM_ENABLE
@@ -543,6 +667,7 @@ struct gps_device_t {
 #endif /* NTP_ENABLE */
 #ifdef PPS_ENABLE
     volatile struct pps_thread_t pps_thread;
+    unsigned long pps_events;		/* PPS events the main loop took */
 #endif /* PPS_ENABLE */
     double mag_var;			/* magnetic variation in degrees */
     bool back_to_nmea;			/* back to NMEA on revert? */
@@ -598,6 +723,7 @@ struct gps_device_t {
 	int lasttag;              /* index into nmea_phrase[] */
 	uint64_t cycle_enders;    /* bit map into nmea_phrase{} */
 	bool cycle_continue;
+	char cycle_ender[8];      /* configured cycle ender, overrides learning */
     } nmea;
 #endif /* NMEA0183_ENABLE */
     /*
@@ -661,6 +787,7 @@ struct gps_device_t {
 #define SIRF_DGPS_SOURCE_SERIAL		2 /* RTCM corrections */
 #define SIRF_DGPS_SOURCE_BEACON		3 /* Beacon corrections */
 #define SIRF_DGPS_SOURCE_SOFTWARE	4 /*  Software API corrections */
+	    bool assist_checked;	/* first fix status looked at? */
 	} sirf;
 #endif /* SIRF_ENABLE */
 #ifdef SUPERSTAR2_ENABLE
@@ -712,9 +839,16 @@ struct gps_device_t {
 	    unsigned int last_msgid;            /* last class/ID */
             timestamp_t last_time;              /* time of last_msgid */
 	    unsigned int end_msgid;             /* cycle ender class/ID */
+	    bool eoe_seen;                      /* NAV-EOE marks cycle ends */
+	    bool assist_checked;                /* first fix status looked at? */
+	    bool assist_pending;                /* aid once MON-VER is in */
+	    bool monver_seen;                   /* protver is from MON-VER */
             /* iTOW, and last_iTOW, in ms, used for cycle end detect. */
             int64_t iTOW;
             int64_t last_iTOW;
+	    /* epoch NAV-PVT or NAV-SOL reported before NAV-EOE was seen */
+	    int64_t early_iTOW;
+	    bool early_report;
     	} ubx;
 #endif /* UBLOX_ENABLE */
 #ifdef NAVCOM_ENABLE
@@ -735,19 +869,29 @@ struct gps_device_t {
 #endif /* ONCORE_ENABLE */
 #ifdef NMEA2000_ENABLE
 	struct {
+#define NMEA2000_FAST_SLOTS	8	/* interleaved fast packets per unit */
+#define NMEA2000_FAST_MAX	223	/* 6 + 31 * 7 payload bytes */
 	    unsigned int can_msgcnt;
 	    unsigned int can_net;
 	    unsigned int unit;
 	    bool unit_valid;
 	    int mode;
 	    unsigned int mode_valid;
-	    unsigned int idx;
-//	    size_t ptr;
-	    size_t fast_packet_len;
 	    int type;
 	    void *workpgn;
 	    void *pgnlist;
 	    unsigned char sid[8];
+	    /* fast packets in reassembly, keyed by (source, PGN, sequence) */
+	    struct {
+		unsigned int pgn;	/* 0 means slot free */
+		unsigned char source;
+		unsigned char seq;	/* sequence ID, top 3 bits of byte 0 */
+		unsigned char next;	/* frame counter expected next */
+		unsigned long age;	/* for evicting abandoned packets */
+		size_t len, got;
+		unsigned char buf[NMEA2000_FAST_MAX];
+	    } fast[NMEA2000_FAST_SLOTS];
+	    unsigned long fast_clock;
 	} nmea2000;
 #endif /* NMEA2000_ENABLE */
 	/*
@@ -784,18 +928,26 @@ struct gps_device_t {
 	/* state information about our response parsing */
 	enum {
 	    ntrip_conn_init,
+	    ntrip_conn_probe_connecting,
 	    ntrip_conn_sent_probe,
+	    ntrip_conn_get_connecting,
 	    ntrip_conn_sent_get,
 	    ntrip_conn_established,
 	    ntrip_conn_err
 	} conn_state; 	/* connection state for multi stage connect */
-	bool works;		/* marks a working connection, so we try to reconnect once */
+	bool works;		/* marks a working connection */
 	bool sourcetable_parse;	/* have we read the sourcetable header? */
+	/* reply bytes carried over between non-blocking reads */
+	char buf[BUFSIZ];
+	size_t buflen;
     } ntrip;
     /* State of a DGPSIP connection */
     struct {
 	bool reported;
+	bool connecting;	/* waiting on the connect helper */
     } dgpsip;
+    /* shared by NTRIP and DGPSIP, survives reactivation */
+    struct netgnss_conn_t netgnss;
 };
 
 /*
@@ -864,6 +1016,11 @@ extern void netgnss_report(struct gps_context_t *,
 			 struct gps_device_t *,
 			 struct gps_device_t *);
 extern void netgnss_autoconnect(struct gps_context_t *, double, double);
+extern socket_t netgnss_connect_start(struct gps_device_t *,
+				      const char *, const char *,
+				      unsigned int);
+extern int netgnss_connect_finish(struct gps_device_t *);
+extern int netgnss_retry(struct gps_device_t *);
 
 extern int dgpsip_open(struct gps_device_t *, const char *);
 extern void dgpsip_report(struct gps_context_t *,
@@ -871,6 +1028,7 @@ extern void dgpsip_report(struct gps_context_t *,
 			 struct gps_device_t *);
 extern void dgpsip_autoconnect(struct gps_context_t *,
 			       double, double, const char *);
+extern int dgpsip_advance(struct gps_device_t *);
 extern int ntrip_open(struct gps_device_t *, char *);
 extern void ntrip_report(struct gps_context_t *,
 			 struct gps_device_t *,
@@ -909,6 +1067,19 @@ extern gps_mask_t gpsd_interpret_subframe(struct gps_device_t *, unsigned int,
 				uint32_t[]);
 extern gps_mask_t gpsd_interpret_subframe_raw(struct gps_device_t *,
 				unsigned int, uint32_t[]);
+
+extern void gpsd_assist_subframe(struct gps_context_t *, unsigned int,
+				 const uint32_t[]);
+extern void gpsd_assist_fix(struct gps_context_t *, const struct gps_data_t *);
+extern void gpsd_assist_ecef(const struct gps_assist_t *,
+			     double *, double *, double *);
+extern bool gpsd_assist_load(struct gps_context_t *, const char *);
+extern bool gpsd_assist_save(const struct gps_context_t *, const char *);
+extern void gpsd_capture_open(struct gps_device_t *);
+extern void gpsd_capture_close(struct gps_device_t *);
+extern bool gpsd_capture_write(struct gps_capture_t *,
+			       const unsigned char *, size_t);
+extern int gpsd_replay_open(struct gps_device_t *);
 extern const char *gpsd_hexdump(char *, size_t, char *, size_t);
 extern const char *gpsd_packetdump(char *, size_t, char *, size_t);
 extern const char *gpsd_prettydump(struct gps_device_t *);
@@ -932,6 +1103,11 @@ extern void nmea_tpv_dump(struct gps_device_t *, char[], size_t);
 extern void nmea_sky_dump(struct gps_device_t *, char[], size_t);
 extern void nmea_subframe_dump(struct gps_device_t *, char[], size_t);
 extern void nmea_ais_dump(struct gps_device_t *, char[], size_t);
+/* room for a raw packet, its pseudo-NMEA and the JSON reports */
+#define SUBSCRIBER_REPORT_MAX	(GPS_JSON_RESPONSE_MAX * 4 + MAX_PACKET_LENGTH * 4)
+extern size_t json_subscriber_report(gps_mask_t, struct gps_device_t *,
+				     const struct gps_policy_t *,
+				     char *, size_t, const char **);
 extern unsigned int ais_binary_encode(struct ais_t *ais, unsigned char *bits, int flag);
 
 #ifdef NTP_ENABLE
@@ -968,6 +1144,37 @@ extern bool shm_acquire(struct gps_context_t *);
 extern void shm_release(struct gps_context_t *);
 extern void shm_update(struct gps_context_t *, struct gps_data_t *);
 
+/* mcastexport.c */
+#ifdef MCAST_EXPORT_ENABLE
+#define MCAST_TARGETS	8	/* most -M targets we accept */
+#define MCAST_TTL	1	/* multicast hop limit, keep it on the LAN */
+extern bool mcast_add(struct gps_context_t *, const char *);
+extern void mcast_report(const struct gps_device_t *, gps_mask_t);
+extern void mcast_release(void);
+#endif /* MCAST_EXPORT_ENABLE */
+
+/* aistable.c */
+#if defined(AIVDM_ENABLE) && defined(SOCKET_EXPORT_ENABLE)
+#define AIS_VESSELS		1024	/* vessels whose state we keep */
+#define AIS_VESSEL_PROBES	16	/* slots searched per MMSI */
+#define AIS_VESSEL_EXPIRY	3600.0	/* forget vessels silent this long */
+#define AIS_SNAPSHOT_CHUNK	8192	/* ?AIS bytes per client per pass */
+extern void ais_table_update(const struct gps_device_t *);
+extern int ais_table_dump(int, bool, char *, size_t);
+#endif /* AIVDM_ENABLE && SOCKET_EXPORT_ENABLE */
+
+/* net_caster.c */
+#ifdef NTRIP_ENABLE
+#define CASTER_CLIENTS	MAX_CLIENTS
+#define CASTER_QUEUE	16384	/* per-client RTCM backlog bound, bytes */
+extern void caster_init(struct gps_context_t *, void (*)(socket_t, bool));
+extern bool caster_attach(socket_t);
+extern void caster_poll(fd_set *, struct gps_device_t *, size_t);
+extern void caster_relay(const struct gps_device_t *, gps_mask_t);
+extern void caster_device_gone(const struct gps_device_t *);
+extern void caster_release(void);
+#endif /* NTRIP_ENABLE */
+
 /* dbusexport.c */
 #if defined(DBUS_EXPORT_ENABLE)
 int initialize_dbus_connection (void);
@@ -1004,11 +1211,14 @@ extern void gpsd_deactivate(struct gps_device_t *);
 #define AWAIT_NOT_READY	0
 #define AWAIT_FAILED	-1
 extern int gpsd_await_data(fd_set *,
+			   fd_set *,
 			   fd_set *,
 			    const int,
 			    fd_set *,
 			    struct gpsd_errout_t *errout);
 extern gps_mask_t gpsd_poll(struct gps_device_t *);
+extern gps_mask_t gpsd_report_mask(const struct gps_device_t *,
+				   gps_mask_t);
 #define DEVICE_EOF	-3
 #define DEVICE_ERROR	-2
 #define DEVICE_UNREADY	-1
@@ -1029,12 +1239,21 @@ extern bool ais_binary_decode(const struct gpsd_errout_t *errout,
 			      struct ais_t *ais,
 			      const unsigned char *, size_t,
 			      struct ais_type24_queue_t *);
+extern void ais_type24a_stash(const struct gpsd_errout_t *,
+			      struct ais_type24_queue_t *,
+			      unsigned int, const char *);
+extern bool ais_type24a_match(const struct gpsd_errout_t *,
+			      struct ais_type24_queue_t *,
+			      unsigned int, char *, size_t);
 
 void gpsd_labeled_report(const int, const int,
 			 const char *, const char *, va_list);
 void gpsd_vlog(const struct gpsd_errout_t *,
 	       const int, char *, size_t, const char *, va_list ap);
 PRINTF_FUNC(3, 4) void gpsd_log(const struct gpsd_errout_t *, const int, const char *, ...);
+#ifdef LOG_ASYNC_ENABLE
+bool gpsd_log_async_start(void);
+#endif /* LOG_ASYNC_ENABLE */
 
 /*
  * How to mix together epx and epy to get a horizontal circular error
@@ -32,6 +32,8 @@
 
 /* #undef HAVE_LIBTHR */
 
+#define HAVE_LIBZ 1
+
 #define HAVE_DBUS 1
 
 #define ENABLE_BLUEZ 1
@@ -64,6 +66,8 @@
 
 /* #undef HAVE_WINSOCK2_H */
 
+/* #undef HAVE_SYS_SDT_H */
+
 #define HAVE_DAEMON 1
 
 /* #undef HAVE_STRLCPY */
@@ -84,6 +88,9 @@
 
 #define HAVE_SYS_TIMEPPS_H 1
 
+/* pending AIS type 24 part As per channel */
+#define AIS_TYPE24_SLOTS 256
+
 /* AIVDM support */
 #define AIVDM_ENABLE 1
 
@@ -198,6 +205,9 @@
 /* manual pages directory */
 #define MANDIR "share/man"
 
+/* export reports over UDP multicast */
+#define MCAST_EXPORT_ENABLE 1
+
 /* maximum allowed clients */
 #define MAX_CLIENTS 64
 
@@ -29,6 +29,7 @@ PERMISSIONS
 #ifdef SOCKET_EXPORT_ENABLE
 #include "gps_json.h"
 #include "timespec.h"
+#include "tracepoints.h"
 #include "revision.h"
 
 /* *INDENT-OFF* */
@@ -240,7 +241,7 @@ void json_tpv_dump(const struct gps_device_t *session,
 #endif /* PPS_ENABLE */
 	    str_appendf(reply, replylen,
 			"\"sor\":%.9f,\"chars\":%lu,\"sats\":%2d,"
-			"\"week\":%u,\"tow\":%.3f,\"rollovers\":%d",
+			"\"week\":%u,\"tow\":%.3f,\"rollovers\":%d,",
 			session->sor,
 			session->chars,
 			gpsdata->satellites_used,
@@ -3552,45 +3553,57 @@ void json_data_report(const gps_mask_t changed,
 /* report a session state in JSON */
 {
     const struct gps_data_t *datap = &session->gpsdata;
+    size_t len = 0;		/* of what's in buf so far */
+
     buf[0] = '\0';
 
+    GPSD_PROBE3(json_report_start, datap->dev.path, session->lexer.type,
+		changed);
     if ((changed & REPORT_IS) != 0) {
-	json_tpv_dump(session, policy, buf+strlen(buf), buflen-strlen(buf));
+	json_tpv_dump(session, policy, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 
     if ((changed & GST_SET) != 0) {
-	json_noise_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	json_noise_dump(datap, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 
     if ((changed & SATELLITE_SET) != 0) {
-	json_sky_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	json_sky_dump(datap, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 
     if ((changed & SUBFRAME_SET) != 0) {
-	json_subframe_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	json_subframe_dump(datap, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 
     if ((changed & RAW_IS) != 0) {
-	json_raw_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	json_raw_dump(datap, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 
 #ifdef COMPASS_ENABLE
     if ((changed & ATTITUDE_SET) != 0) {
-	json_att_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	json_att_dump(datap, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 #endif /* COMPASS_ENABLE */
 
 #ifdef RTCM104V2_ENABLE
     if ((changed & RTCM2_SET) != 0) {
 	json_rtcm2_dump(&datap->rtcm2, datap->dev.path,
-			buf+strlen(buf), buflen-strlen(buf));
+			buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 #endif /* RTCM104V2_ENABLE */
 
 #ifdef RTCM104V3_ENABLE
     if ((changed & RTCM3_SET) != 0) {
 	json_rtcm3_dump(&datap->rtcm3, datap->dev.path,
-			buf+strlen(buf), buflen-strlen(buf));
+			buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 #endif /* RTCM104V3_ENABLE */
 
@@ -3598,15 +3611,184 @@ void json_data_report(const gps_mask_t changed,
     if ((changed & AIS_SET) != 0) {
 	json_aivdm_dump(&datap->ais, datap->dev.path,
 			policy->scaled,
-			buf+strlen(buf), buflen-strlen(buf));
+			buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 #endif /* AIVDM_ENABLE */
 
 #ifdef OSCILLATOR_ENABLE
     if ((changed & OSCILLATOR_SET) != 0) {
-	json_oscillator_dump(datap, buf+strlen(buf), buflen-strlen(buf));
+	json_oscillator_dump(datap, buf + len, buflen - len);
+	len += strlen(buf + len);
     }
 #endif /* OSCILLATOR_ENABLE */
+    GPSD_PROBE3(json_report_done, datap->dev.path, session->lexer.type, len);
+}
+
+static size_t report_append(char *buf, size_t len, size_t buflen,
+			    const char *data, size_t datalen)
+/* copy what may be binary into the report, if it fits */
+{
+    if (len + datalen + 1 > buflen)
+	return len;
+    (void)memcpy(buf + len, data, datalen);
+    len += datalen;
+    buf[len] = '\0';
+    return len;
+}
+
+static size_t pseudonmea_append(gps_mask_t changed,
+				struct gps_device_t *session,
+				char *buf, size_t len, size_t buflen)
+/* render what the packet changed as pseudo-NMEA for NMEA watchers */
+{
+    if ((changed & REPORT_IS) != 0) {
+	nmea_tpv_dump(session, buf + len, buflen - len);
+	gpsd_log(&session->context->errout, LOG_IO,
+		 "<= GPS (binary tpv) %s: %s\n",
+		 session->gpsdata.dev.path, buf + len);
+	len += strlen(buf + len);
+    }
+    if ((changed & (SATELLITE_SET|USED_IS)) != 0) {
+	nmea_sky_dump(session, buf + len, buflen - len);
+	gpsd_log(&session->context->errout, LOG_IO,
+		 "<= GPS (binary sky) %s: %s\n",
+		 session->gpsdata.dev.path, buf + len);
+	len += strlen(buf + len);
+    }
+    if ((changed & SUBFRAME_SET) != 0) {
+	nmea_subframe_dump(session, buf + len, buflen - len);
+	gpsd_log(&session->context->errout, LOG_IO,
+		 "<= GPS (binary subframe) %s: %s\n",
+		 session->gpsdata.dev.path, buf + len);
+	len += strlen(buf + len);
+    }
+#ifdef AIVDM_ENABLE
+    if ((changed & AIS_SET) != 0) {
+	nmea_ais_dump(session, buf + len, buflen - len);
+	gpsd_log(&session->context->errout, LOG_IO,
+		 "<= AIS (binary ais) %s: %s\n",
+		 session->gpsdata.dev.path, buf + len);
+	len += strlen(buf + len);
+    }
+#endif /* AIVDM_ENABLE */
+    return len;
+}
+
+#ifdef PASSTHROUGH_ENABLE
+static gps_mask_t relay_unpack(struct gps_device_t *session)
+/* parse relayed JSON into the session, once per packet */
+{
+    struct devconfig_t dev;
+
+    if (session->relay_unpacked)
+	return session->relay_mask;
+    session->relay_unpacked = true;
+    session->relay_mask = 0;
+
+    /* the upstream's device and path mustn't replace ours */
+    dev = session->gpsdata.dev;
+    session->gpsdata.set = 0;
+    if (libgps_json_unpack((const char *)session->lexer.outbuffer,
+			   &session->gpsdata, NULL) == 0) {
+	session->relay_mask = session->gpsdata.set
+	    & (MODE_SET | SATELLITE_SET | SUBFRAME_SET | AIS_SET);
+	if ((session->relay_mask & MODE_SET) != 0) {
+	    session->newdata = session->gpsdata.fix;
+	    session->relay_mask |= REPORT_IS;
+	}
+    }
+    session->gpsdata.dev = dev;
+    return session->relay_mask;
+}
+#endif /* PASSTHROUGH_ENABLE */
+
+size_t json_subscriber_report(gps_mask_t changed,
+			      struct gps_device_t *session,
+			      const struct gps_policy_t *policy,
+			      char *buf, size_t buflen, const char **reportp)
+/* render everything a subscriber with this policy gets for a packet,
+ * changed being as gpsd_report_mask() left it; *reportp is left
+ * pointing at the rendering, which needn't be buf */
+{
+    const char *packet = (const char *)session->lexer.outbuffer;
+    size_t packetlen = session->lexer.outbuflen;
+    size_t len = 0;		/* of what's in buf so far, NULs and all */
+
+    buf[0] = '\0';
+    *reportp = buf;
+
+#ifdef PASSTHROUGH_ENABLE
+    if ((changed & PASSTHROUGH_IS) != 0) {
+	/*
+	 * A relay forwards JSON it hasn't parsed, so it is parsed here,
+	 * and only if an NMEA watcher needs it rendered.
+	 */
+	if (session->context->passthrough_relay
+	    && policy->nmea && !policy->json) {
+	    if (policy->watcher)
+		len = pseudonmea_append(relay_unpack(session), session,
+					buf, len, buflen);
+	    return len;
+	}
+	/*
+	 * Everyone else gets the packet itself, framed in place once
+	 * and then shared by every subscriber without a copy.
+	 */
+	if (packetlen < 2 || packet[packetlen - 1] != '\n') {
+	    if (packetlen + 3 > sizeof(session->lexer.outbuffer)) {
+		len = report_append(buf, len, buflen, packet, packetlen);
+		return report_append(buf, len, buflen, "\r\n", 2);
+	    }
+	    session->lexer.outbuffer[packetlen++] = '\r';
+	    session->lexer.outbuffer[packetlen++] = '\n';
+	    session->lexer.outbuffer[packetlen] = '\0';
+	    session->lexer.outbuflen = packetlen;
+	}
+	*reportp = packet;
+	return packetlen;
+    }
+#endif /* PASSTHROUGH_ENABLE */
+
+    /*
+     * NMEA and other textual sentences are simply copied to
+     * subscribers in raw or NMEA mode, and anything at all to those
+     * in super-raw mode.
+     */
+    if ((TEXTUAL_PACKET_TYPE(session->lexer.type)
+	 && (policy->raw > 0 || policy->nmea))
+	|| policy->raw > 1)
+	len = report_append(buf, len, buflen, packet, packetlen);
+#ifdef BINARY_ENABLE
+    else if (policy->raw == 1) {
+	/* the user wants a binary packet hexdumped */
+	(void)gpsd_hexdump(buf + len, buflen - len,
+			   (char *)packet, packetlen);
+	(void)strlcat(buf + len, "\r\n", buflen - len);
+	len += strlen(buf + len);
+    }
+#endif /* BINARY_ENABLE */
+
+    if (!policy->watcher || (changed & DATA_IS) == 0)
+	return len;
+
+    /* binary packets are rendered as pseudo-NMEA for NMEA watchers */
+    if (policy->nmea
+	&& GPS_PACKET_TYPE(session->lexer.type)
+	&& !TEXTUAL_PACKET_TYPE(session->lexer.type))
+	len = pseudonmea_append(changed, session, buf, len, buflen);
+
+    if (policy->json) {
+	/* half a type 24 waits for the other half unless asked for */
+	if ((changed & AIS_SET) != 0
+	    && session->gpsdata.ais.type == 24
+	    && session->gpsdata.ais.type24.part != both
+	    && !policy->split24)
+	    return len;
+	json_data_report(changed, session, policy, buf + len, buflen - len);
+	len += strlen(buf + len);
+    }
+    return len;
 }
 
 #undef JSON_BOOL
@@ -347,6 +347,14 @@ static void gpsmon_report(const char *buf)
 	(void)fputs(buf, logfile);
 }
 
+static void gpsmon_report_locked(const char *buf)
+/* errout hook; the PPS thread logs too, and curses isn't thread-safe */
+{
+    report_lock();
+    gpsmon_report(buf);
+    report_unlock();
+}
+
 #ifdef PPS_ENABLE
 static void packet_vlog(char *buf, size_t len, const char *fmt, va_list ap)
 {
@@ -1188,7 +1196,7 @@ int main(int argc, char **argv)
     (void)putenv("TZ=UTC");	// for ctime()
     gps_context_init(&context, "gpsmon");	// initialize the report mutex
     context.serial_write = gpsmon_serial_write;
-    context.errout.report = gpsmon_report;
+    context.errout.report = gpsmon_report_locked;
     while ((option = getopt(argc, argv, "aD:LVhl:nt:?")) != -1) {
 	switch (option) {
 	case 'a':
@@ -1408,7 +1416,8 @@ int main(int argc, char **argv)
 	for (;;)
 	{
 	    fd_set efds;
-	    switch(gpsd_await_data(&rfds, &efds, maxfd, &all_fds, &context.errout))
+	    switch(gpsd_await_data(&rfds, NULL, &efds, maxfd, &all_fds,
+				&context.errout))
 	    {
 	    case AWAIT_GOT_INPUT:
 		break;
@@ -66,6 +66,13 @@ void gpsd_log(const struct gpsd_errout_t *errout UNUSED,
     Py_DECREF(args);
 }
 
+/* lexers made here never capture, so spare us linking capture.c */
+bool gpsd_capture_write(struct gps_capture_t *cap UNUSED,
+			const unsigned char *buf UNUSED, size_t len UNUSED)
+{
+    return false;
+}
+
 
 static PyTypeObject Lexer_Type;
 
@@ -116,6 +123,64 @@ Lexer_get(LexerObject *self, PyObject *args)
 			 self->lexer.char_counter);
 }
 
+static PyObject *
+Lexer_frame(LexerObject *self, PyObject *args)
+{
+    struct gps_lexer_t *lexer = &self->lexer;
+    const unsigned char *buf;
+    Py_buffer data;
+    PyObject *packets, *item;
+    size_t fed = 0, used;
+
+    if (!PyArg_ParseTuple(args, GPSD_PY_BUFFER_FORMAT ";missing or invalid buffer argument to gps.packet.frame", &data))
+        return NULL;
+
+    packets = PyList_New(0);
+    if (packets == NULL) {
+	PyBuffer_Release(&data);
+	return NULL;
+    }
+
+    /* offsets are relative to this buffer, so start from ground state */
+    buf = (const unsigned char *)data.buf;
+    packet_reset(lexer);
+    while (packet_frame(lexer, buf + fed, (size_t)data.len - fed, &used) > 0) {
+	size_t end, start;
+
+	fed += used;
+	if (lexer->outbuflen == 0)
+	    continue;
+	end = fed - packet_unread_input(lexer);
+	start = end - lexer->outbuflen;
+	if (lexer->outbuflen <= end
+	    && memcmp(buf + start, lexer->outbuffer, lexer->outbuflen) == 0)
+	    item = Py_BuildValue("(inn)",
+				 lexer->type,
+				 (Py_ssize_t)start,
+				 (Py_ssize_t)lexer->outbuflen);
+	else
+	    /* pieced together around a sentence interleaved into it */
+	    item = Py_BuildValue("(in" GPSD_PY_BYTE_FORMAT ")",
+				 lexer->type,
+				 (Py_ssize_t)-1,
+				 lexer->outbuffer,
+				 (Py_ssize_t)lexer->outbuflen);
+	if (item == NULL || PyList_Append(packets, item) < 0) {
+	    Py_XDECREF(item);
+	    Py_CLEAR(packets);
+	    break;
+	}
+	Py_DECREF(item);
+    }
+    PyBuffer_Release(&data);
+
+    if (PyErr_Occurred()) {
+	Py_XDECREF(packets);
+	return NULL;
+    }
+    return packets;
+}
+
 static PyObject *
 Lexer_reset(LexerObject *self)
 {
@@ -134,6 +199,8 @@ Lexer_dealloc(LexerObject *self)
 static PyMethodDef Lexer_methods[] = {
     {"get",	(PyCFunction)Lexer_get,	METH_VARARGS,
     		PyDoc_STR("Get a packet from a file descriptor.")},
+    {"frame",	(PyCFunction)Lexer_frame,	METH_VARARGS,
+    		PyDoc_STR("Frame every packet in a buffer.")},
     {"reset",	(PyCFunction)Lexer_reset,	METH_NOARGS,
     		PyDoc_STR("Reset the packet lexer to ground state.")},
     {NULL,		NULL}		/* sentinel */
@@ -249,10 +316,16 @@ static PyMethodDef packet_methods[] = {
 PyDoc_STRVAR(module_doc,
 "Python binding of the libgpsd module for recognizing GPS packets.\n\
 The new() function returns a new packet-lexer instance.  Lexer instances\n\
-have two methods:\n\
+have three methods:\n\
     get() takes a file descriptor argument and returns a tuple consisting of\n\
 the integer packet type and string packet value.  On end of file it returns\n\
 (-1, '').\n\
+    frame() takes a bytes-like object, such as the contents or an mmap of a\n\
+whole log, and returns a list of (type, offset, length) tuples, one for each\n\
+packet in it.  Slicing the buffer with these is much faster than calling\n\
+get() once per packet.  A sentence the lexer pieced together around another\n\
+one interleaved into it has no single slice, so it comes back as\n\
+(type, -1, packet).\n\
     reset() resets the packet-lexer to its initial state.\n\
     The module also has a register_report() function that accepts a callback\n\
 for debug message reporting.  The callback will get two arguments, the error\n\
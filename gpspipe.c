@@ -16,6 +16,15 @@
  * This will dump the GPSD and the NMEA sentences from gpsd to stdout
  *      gpspipe -wr
  *
+ * This will record AIS and NMEA around the clock, a gzipped file an hour
+ *      gpspipe -r -e -z -G 3600 -o /var/log/gps/%Y%m%d-%H.nmea.gz
+ *
+ * Output is collected as a list of pieces pointing into the read buffer,
+ * timestamps included, and handed to writev().  By default that happens
+ * after every line, as stdio's line flushing used to; -B writes once per
+ * wakeup after draining the socket, and -e holds everything until gpsd
+ * goes quiet at the end of an epoch.
+ *
  * Original code by: Gary E. Miller <gem@rellim.com>.  Cleanup by ESR.
  *
  * This file is Copyright (c) 2010-2018 by the GPSD project
@@ -27,6 +36,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>             /* for PATH_MAX */
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +47,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>            /* for writev() */
 #include <time.h>               /* for time_t */
 #include <unistd.h>
 
@@ -48,6 +60,9 @@
 #ifdef HAVE_WINSOCK2_H
 #include <winsock2.h>
 #endif /* HAVE_WINSOCK2_H */
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif /* HAVE_LIBZ */
 
 #include "gpsd.h"
 
@@ -66,8 +81,53 @@ static struct termios oldtio, newtio;
 #endif /* HAVE_TERMIOS_H */
 static int fd_out = 1;		/* output initially goes to standard output */
 static char serbuf[255];
+static size_t serlen;
 static int debug;
 
+/* one read outside bulk mode, and the least worth reading inside it */
+#define READ_SIZE	4096
+/* bulk mode reads up to this much before writing it out */
+#define BULK_BUFSIZE	65536
+/* pieces handed to a single writev(), timestamps included */
+#define IOV_BATCH	512
+#define STAMP_MAX	72
+
+static char *serialport = NULL;
+static bool stamp_lines = false;
+static bool iso8601 = false;
+static char *format = "%F %T";
+static int option_u = 0;                   // option to show uSeconds
+static bool bulk = false;
+static bool new_line = true;
+static long count = -1;
+static volatile sig_atomic_t quit = 0;
+
+/* where the output goes, and when to start another file */
+static struct {
+    int fd;
+#ifdef HAVE_LIBZ
+    gzFile gz;
+#endif /* HAVE_LIBZ */
+    bool compress;		/* -z */
+    const char *pattern;	/* -o, NULL for standard output */
+    off_t limit;		/* -C, 0 for no size limit */
+    time_t interval;		/* -G, 0 for no time limit */
+    off_t size;			/* written to the current file */
+    time_t period;		/* start of the current -G period */
+    unsigned int seq;		/* suffix of the current file */
+    char name[PATH_MAX];	/* current file name, less the suffix */
+} out;
+
+/* output collected since the last write */
+static struct {
+    struct iovec iov[IOV_BATCH];
+    int niov;
+    char stamps[IOV_BATCH / 2][STAMP_MAX];
+    int nstamps;
+    size_t used;		/* read buffer bytes the pieces refer to */
+    time_t since;		/* when the oldest piece arrived */
+} batch;
+
 static void open_serial(char *device)
 /* open the serial port and set it up */
 {
@@ -104,12 +164,294 @@ static void open_serial(char *device)
 #endif /* HAVE_TERMIOS_H */
 }
 
+static void out_open(time_t now)
+/* open the output, naming the file after now when rotating by time */
+{
+    char name[PATH_MAX];
+    char path[PATH_MAX + 16];
+
+    out.size = 0;
+    if (out.pattern == NULL) {
+	out.fd = STDOUT_FILENO;
+    } else {
+	if (out.interval > 0) {
+	    struct tm tm;
+
+	    out.period = now - now % out.interval;
+	    (void)gmtime_r(&out.period, &tm);
+	    if (strftime(name, sizeof(name), out.pattern, &tm) == 0) {
+		(void)fprintf(stderr,
+			      "gpspipe: bad output file name pattern %s\n",
+			      out.pattern);
+		exit(EXIT_FAILURE);
+	    }
+	} else
+	    (void)strlcpy(name, out.pattern, sizeof(name));
+
+	/* never overwrite a file written earlier in this run */
+	if (strcmp(name, out.name) == 0)
+	    out.seq++;
+	else {
+	    out.seq = 0;
+	    (void)strlcpy(out.name, name, sizeof(out.name));
+	}
+	if (out.seq == 0)
+	    (void)strlcpy(path, name, sizeof(path));
+	else
+	    (void)snprintf(path, sizeof(path), "%s.%u", name, out.seq);
+
+	out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out.fd == -1) {
+	    (void)fprintf(stderr,
+			  "gpspipe: unable to open output file:  %s\n",
+			  path);
+	    exit(EXIT_FAILURE);
+	}
+    }
+#ifdef HAVE_LIBZ
+    if (out.compress && (out.gz = gzdopen(out.fd, "wb")) == NULL) {
+	(void)fprintf(stderr, "gpspipe: unable to start compression\n");
+	exit(EXIT_FAILURE);
+    }
+#endif /* HAVE_LIBZ */
+}
+
+static void out_close(void)
+{
+#ifdef HAVE_LIBZ
+    if (out.gz != NULL) {
+	/* closes the descriptor too */
+	if (gzclose(out.gz) != Z_OK)
+	    (void)fprintf(stderr, "gpspipe: error closing compressed file\n");
+	out.gz = NULL;
+	return;
+    }
+#endif /* HAVE_LIBZ */
+    if (out.pattern != NULL)
+	(void)close(out.fd);
+}
+
+static bool out_write(struct iovec *iov, int n)
+/* write out all of iov, whatever the kernel takes at a time */
+{
+#ifdef HAVE_LIBZ
+    if (out.gz != NULL) {
+	for (; n > 0; iov++, n--)
+	    if (gzwrite(out.gz, iov->iov_base, (unsigned)iov->iov_len) == 0)
+		return false;
+	/* keep what is on disk decompressible up to here */
+	if (gzflush(out.gz, Z_SYNC_FLUSH) != Z_OK)
+	    return false;
+	out.size = (off_t)gzoffset(out.gz);
+	return true;
+    }
+#endif /* HAVE_LIBZ */
+    while (n > 0) {
+	ssize_t w = writev(out.fd, iov, n);
+
+	if (w == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return false;
+	}
+	out.size += w;
+	while (n > 0 && (size_t)w >= iov->iov_len) {
+	    w -= (ssize_t)iov->iov_len;
+	    iov++;
+	    n--;
+	}
+	if (n > 0) {
+	    iov->iov_base = (char *)iov->iov_base + w;
+	    iov->iov_len -= (size_t)w;
+	}
+    }
+    return true;
+}
+
+static void flush_batch(void)
+/* write what has been collected, starting a new file first if one is due */
+{
+    if (batch.niov > 0) {
+	if (out.pattern != NULL && (out.limit > 0 || out.interval > 0)) {
+	    time_t now = time(NULL);
+
+	    if ((out.limit > 0 && out.size >= out.limit)
+		|| (out.interval > 0 && now >= out.period + out.interval)) {
+		out_close();
+		out_open(now);
+	    }
+	}
+	if (!out_write(batch.iov, batch.niov)) {
+	    (void)fprintf(stderr, "gpspipe: write error, %s(%d)\n",
+			  strerror(errno), errno);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    batch.niov = 0;
+    batch.nstamps = 0;
+    batch.used = 0;
+    batch.since = 0;
+}
+
+static void batch_add(char *base, size_t len, bool join)
+/* queue a piece, or extend the last one if it ends where this starts */
+{
+    if (join && batch.niov > 0) {
+	struct iovec *last = &batch.iov[batch.niov - 1];
+
+	if ((char *)last->iov_base + last->iov_len == base) {
+	    last->iov_len += len;
+	    return;
+	}
+    }
+    batch.iov[batch.niov].iov_base = base;
+    batch.iov[batch.niov].iov_len = len;
+    batch.niov++;
+}
+
+static char *stamp_next(void)
+/* format a timestamp line prefix, kept until the batch is written */
+{
+    char *stamp = batch.stamps[batch.nstamps++];
+    char tmstr[200];
+    char tmstr_u[40];            // time with "usec" resolution
+    struct timespec now;
+    struct tm tmp_now;
+    int written;
+
+    (void)clock_gettime(CLOCK_REALTIME, &now);
+    (void)gmtime_r((time_t *)&(now.tv_sec), &tmp_now);
+    (void)strftime(tmstr, sizeof(tmstr), format, &tmp_now);
+
+    switch( option_u ) {
+    case 2:
+	if(iso8601){
+	    written = strlen(tmstr);
+	    tmstr[written] = 'Z';
+	    tmstr[written+1] = '\0';
+	}
+	(void)snprintf(tmstr_u, sizeof(tmstr_u),
+		       " %ld.%06ld",
+		       (long)now.tv_sec,
+		       (long)now.tv_nsec/1000);
+	break;
+    case 1:
+	written = snprintf(tmstr_u, sizeof(tmstr_u),
+			   ".%06ld", (long)now.tv_nsec/1000);
+
+	if((0 < written) && (40 > written) && iso8601){
+	    tmstr_u[written-1] = 'Z';
+	    tmstr_u[written] = '\0';
+	}
+	break;
+    default:
+	*tmstr_u = '\0';
+	break;
+    }
+
+    (void)snprintf(stamp, STAMP_MAX, "%.24s%s: ", tmstr, tmstr_u);
+    return stamp;
+}
+
+static bool pipe_lines(char *data, size_t len)
+/* queue what one read brought; false once -n has been satisfied */
+{
+    char *end = data + len;
+    char *stamp = NULL;
+
+    while (data < end) {
+	char *nl = memchr(data, '\n', (size_t)(end - data));
+	char *next = (nl != NULL) ? nl + 1 : end;
+
+	if (batch.niov + 2 > IOV_BATCH) {
+	    flush_batch();
+	    stamp = NULL;
+	}
+	if (new_line && stamp_lines) {
+	    /* lines arriving in one bulk read share their timestamp */
+	    if (stamp == NULL || !bulk)
+		stamp = stamp_next();
+	    batch_add(stamp, strlen(stamp), false);
+	}
+	batch_add(data, (size_t)(next - data), !stamp_lines);
+	if (serialport != NULL) {
+	    size_t n = (size_t)(next - data);
+
+	    if (n > sizeof(serbuf) - 1 - serlen)
+		n = sizeof(serbuf) - 1 - serlen;
+	    memcpy(serbuf + serlen, data, n);
+	    serlen += n;
+	}
+	data = next;
+	new_line = (nl != NULL);
+	if (!new_line)
+	    break;
+
+	if (serialport != NULL) {
+	    if (write(fd_out, serbuf, serlen) == -1) {
+		(void)fprintf(stderr,
+			      "gpspipe: serial port write error,"
+			      " %s(%d)\n",
+			      strerror(errno), errno);
+		exit(EXIT_FAILURE);
+	    }
+	    serlen = 0;
+	}
+	/* flush after every good line, unless batching */
+	if (!bulk)
+	    flush_batch();
+	if (count > 0) {
+	    if (0 >= --count) {
+		/* completed count */
+		return false;
+	    }
+	}
+    }
+    return true;
+}
+
+static void onsig(int sig)
+{
+    quit = sig;
+}
+
+static off_t parse_size(const char *arg)
+/* a byte count with an optional k, M or G suffix; -1 if malformed */
+{
+    char *end;
+    long long n = strtoll(arg, &end, 10);
+
+    switch (*end) {
+    case '\0':
+	break;
+    case 'k':
+    case 'K':
+	n <<= 10;
+	break;
+    case 'm':
+    case 'M':
+	n <<= 20;
+	break;
+    case 'g':
+    case 'G':
+	n <<= 30;
+	break;
+    default:
+	return -1;
+    }
+    return (off_t)n;
+}
+
 static void usage(void)
 {
     (void)fprintf(stderr,
 		  "Usage: gpspipe [OPTIONS] [server[:port[:device]]]\n\n"
 		  "-2 Set the split24 flag.\n"
+		  "-B Bulk mode, write once per wakeup rather than per line.\n"
+		  "-C [size] Start a new output file once it reaches size (k, M, G).\n"
 		  "-d Run as a daemon.\n"
+		  "-e Write when gpsd goes quiet at the end of an epoch, implies -B.\n"
+		  "-G [seconds] Start a new output file every so many seconds.\n"
 		  "-h Show this help.\n"
 		  "-l Sleep for ten seconds before connecting to gpsd.\n"
 		  "-n [count] exit after count packets.\n"
@@ -127,46 +469,47 @@ static void usage(void)
 		  "-V Print version and exit.\n"
 		  "-w Dump gpsd native data.\n"
 		  "-x [seconds] Exit after given delay.\n"
+		  "-z Compress the output with gzip.\n"
 		  "-Z sets the timestamp format iso8601: implies '-t'\n"
 		  "You must specify one, or more, of -r, -R, or -w\n"
-		  "You must use -o if you use -d.\n");
+		  "You must use -o if you use -d, -C or -G.\n");
 }
 
 int main(int argc, char **argv)
 {
-    char buf[4096];
-    bool timestamp = false;
-    bool iso8601 = false;
-    char *format = "%F %T";
+    static char buf[BULK_BUFSIZE];
     char *zulu_format = "%FT%T";
-    char tmstr[200];
     bool daemonize = false;
     bool binary = false;
     bool sleepy = false;
-    bool new_line = true;
     bool raw = false;
     bool watch = false;
     bool profile = false;
-    int option_u = 0;                   // option to show uSeconds
-    long count = -1;
+    bool epoch = false;
     time_t exit_timer = 0;
     int option;
     unsigned int vflag = 0, l = 0;
-    FILE *fp;
     unsigned int flags;
     fd_set fds;
 
     struct fixsource_t source;
-    char *serialport = NULL;
-    char *outfile = NULL;
 
     flags = WATCH_ENABLE;
     while ((option = getopt(argc, argv,
-                            "2?dD:hln:o:pPrRwSs:tT:uvVx:Z")) != -1) {
+                            "2?BC:dD:eG:hln:o:pPrRwSs:tT:uvVx:zZ")) != -1) {
 	switch (option) {
 	case '2':
 	    flags |= WATCH_SPLIT24;
 	    break;
+	case 'B':
+	    bulk = true;
+	    break;
+	case 'C':
+	    if ((out.limit = parse_size(optarg)) <= 0) {
+		(void)fprintf(stderr, "gpspipe: bad file size %s\n", optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
 	case 'D':
 	    debug = atoi(optarg);
 #ifdef CLIENTDEBUG_ENABLE
@@ -176,6 +519,17 @@ int main(int argc, char **argv)
 	case 'd':
 	    daemonize = true;
 	    break;
+	case 'e':
+	    epoch = true;
+	    bulk = true;
+	    break;
+	case 'G':
+	    if ((out.interval = (time_t)strtol(optarg, 0, 0)) <= 0) {
+		(void)fprintf(stderr, "gpspipe: bad rotation interval %s\n",
+			      optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
 	case 'l':
 	    sleepy = true;
 	    break;
@@ -183,7 +537,7 @@ int main(int argc, char **argv)
 	    count = strtol(optarg, 0, 0);
 	    break;
 	case 'o':
-	    outfile = optarg;
+	    out.pattern = optarg;
 	    break;
 	case 'P':
 	    flags |= WATCH_PPS;
@@ -210,14 +564,14 @@ int main(int argc, char **argv)
 	    serialport = optarg;
 	    break;
 	case 'T':
-	    timestamp = true;
+	    stamp_lines = true;
 	    format = optarg;
 	    break;
 	case 't':
-	    timestamp = true;
+	    stamp_lines = true;
 	    break;
 	case 'u':
-	    timestamp = true;
+	    stamp_lines = true;
 	    option_u++;
 	    break;
 	case 'V':
@@ -234,8 +588,17 @@ int main(int argc, char **argv)
 	case 'x':
 	    exit_timer = time(NULL) + strtol(optarg, 0, 0);
 	    break;
+	case 'z':
+#ifdef HAVE_LIBZ
+	    out.compress = true;
+	    break;
+#else
+	    (void)fprintf(stderr, "gpspipe: built without zlib, "
+			  "'-z' is unavailable.\n");
+	    exit(EXIT_FAILURE);
+#endif /* HAVE_LIBZ */
 	case 'Z':
-	    timestamp = true;
+	    stamp_lines = true;
 	    format = zulu_format;
 	    iso8601 = true;
 	    break;
@@ -258,11 +621,16 @@ int main(int argc, char **argv)
 	exit(EXIT_FAILURE);
     }
 
-    if (outfile == NULL && daemonize) {
+    if (out.pattern == NULL && daemonize) {
 	(void)fprintf(stderr, "gpspipe: use of '-d' requires '-o'.\n");
 	exit(EXIT_FAILURE);
     }
 
+    if (out.pattern == NULL && (out.limit > 0 || out.interval > 0)) {
+	(void)fprintf(stderr, "gpspipe: use of '-C' or '-G' requires '-o'.\n");
+	exit(EXIT_FAILURE);
+    }
+
     if (!raw && !watch && !binary) {
 	(void)fprintf(stderr,
 		      "gpspipe: one of '-R', '-r', or '-w' is required.\n");
@@ -280,24 +648,8 @@ int main(int argc, char **argv)
     if (sleepy)
 	(void)sleep(10);
 
-    /* Open the output file if the user requested it.  If the user
-     * requested '-R', we use the 'b' flag in fopen() to "do the right
-     * thing" in non-linux/unix OSes. */
-    if (outfile == NULL) {
-	fp = stdout;
-    } else {
-	if (binary)
-	    fp = fopen(outfile, "wb");
-	else
-	    fp = fopen(outfile, "w");
-
-	if (fp == NULL) {
-	    (void)fprintf(stderr,
-			  "gpspipe: unable to open output file:  %s\n",
-			  outfile);
-	    exit(EXIT_FAILURE);
-	}
-    }
+    /* Open the output file, or set up standard output. */
+    out_open(time(NULL));
 
     /* Open the serial port and set it up. */
     if (serialport)
@@ -319,7 +671,20 @@ int main(int argc, char **argv)
     if ((isatty(STDERR_FILENO) == 0) || daemonize)
 	vflag = 0;
 
-    for (;;) {
+    /* when output is held back or compressed, finish it before exiting */
+    if (epoch || out.compress) {
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onsig;
+	sa.sa_flags = SA_RESTART;
+	(void)sigemptyset(&sa.sa_mask);
+	(void)sigaction(SIGINT, &sa, NULL);
+	(void)sigaction(SIGTERM, &sa, NULL);
+	(void)sigaction(SIGHUP, &sa, NULL);
+    }
+
+    while (quit == 0) {
 	int r = 0;
 	struct timespec tv;
 
@@ -335,115 +700,60 @@ int main(int argc, char **argv)
 	    (void)fprintf(stderr, "gpspipe: select error %s(%d)\n",
 			  strerror(errno), errno);
 	    exit(EXIT_FAILURE);
-	} else if (r == 0)
-		continue;
+	} else if (r == 0) {
+	    /* a tenth of a second of quiet ends an epoch */
+	    flush_batch();
+	    continue;
+	} else if (quit != 0)
+	    break;
 
 	if (vflag)
 	    spinner(vflag, l++);
 
-	/* reading directly from the socket avoids decode overhead */
-	errno = 0;
-	r = (int)recv(gpsdata.gps_fd, buf, sizeof(buf), 0);
-	if (r > 0) {
-	    int i = 0;
-	    int j = 0;
-	    for (i = 0; i < r; i++) {
-		char c = buf[i];
-		if (j < (int)(sizeof(serbuf) - 1)) {
-		    serbuf[j++] = buf[i];
-		}
-		if (new_line && timestamp) {
-		    char tmstr_u[40];            // time with "usec" resolution
-		    struct timespec now;
-		    struct tm tmp_now;
-                    int written;
-
-		    (void)clock_gettime(CLOCK_REALTIME, &now);
-		    (void)gmtime_r((time_t *)&(now.tv_sec), &tmp_now);
-		    (void)strftime(tmstr, sizeof(tmstr), format, &tmp_now);
-		    new_line = 0;
-
-		    switch( option_u ) {
-		    case 2:
-			if(iso8601){
-			    written = strlen(tmstr);
-			    tmstr[written] = 'Z';
-			    tmstr[written+1] = '\0';
-			}
-			(void)snprintf(tmstr_u, sizeof(tmstr_u),
-				       " %ld.%06ld",
-				       (long)now.tv_sec,
-				       (long)now.tv_nsec/1000);
-			break;
-		    case 1:
-                        written = snprintf(tmstr_u, sizeof(tmstr_u),
-                                           ".%06ld", (long)now.tv_nsec/1000);
-
-			if((0 < written) && (40 > written) && iso8601){
-			    tmstr_u[written-1] = 'Z';
-			    tmstr_u[written] = '\0';
-			}
-			break;
-		    default:
-			*tmstr_u = '\0';
-			break;
-		    }
-
-		    if (fprintf(fp, "%.24s%s: ", tmstr, tmstr_u) <= 0) {
-			(void)fprintf(stderr,
-				      "gpspipe: write error, %s(%d)\n",
-				      strerror(errno), errno);
-			exit(EXIT_FAILURE);
-		    }
-		}
-		if (fputc(c, fp) == EOF) {
-		    (void)fprintf(stderr, "gpspipe: write error, %s(%d)\n",
-		                  strerror(errno), errno);
-		    exit(EXIT_FAILURE);
-		}
-
-		if (c == '\n') {
-		    if (serialport != NULL) {
-			if (write(fd_out, serbuf, (size_t) j) == -1) {
-			    (void)fprintf(stderr,
-			                  "gpspipe: serial port write error,"
-			                  " %s(%d)\n",
-			                  strerror(errno), errno);
-			    exit(EXIT_FAILURE);
-			}
-			j = 0;
-		    }
-
-		    new_line = true;
-		    /* flush after every good line */
-		    if (fflush(fp)) {
-			(void)fprintf(stderr,
-				      "gpspipe: fflush error, %s(%d)\n",
-				      strerror(errno), errno);
-			exit(EXIT_FAILURE);
-		    }
-		    if (count > 0) {
-			if (0 >= --count) {
-			    /* completed count */
-			    exit(EXIT_SUCCESS);
-			}
-		    }
-		}
-	    }
-	} else {
-	    if (r == -1) {
-		if (errno == EAGAIN)
-		    continue;
-		else
-		    (void)fprintf(stderr, "gpspipe: read error %s(%d)\n",
-			      strerror(errno), errno);
-		exit(EXIT_FAILURE);
-	    } else {
+	/*
+	 * Reading directly from the socket avoids decode overhead.  In
+	 * bulk mode, keep reading until the socket is drained or the
+	 * buffer is nearly full, then write it all at once.
+	 */
+	do {
+	    size_t at = batch.used;
+
+	    errno = 0;
+	    r = (int)recv(gpsdata.gps_fd, buf + at,
+			  bulk ? sizeof(buf) - at : READ_SIZE,
+			  bulk ? MSG_DONTWAIT : 0);
+	    if (r <= 0)
+		break;
+	    if (!pipe_lines(buf + at, (size_t)r)) {
+		flush_batch();
+		out_close();
 		exit(EXIT_SUCCESS);
 	    }
+	    /* pieces still queued are from this read or earlier ones */
+	    batch.used = (batch.niov > 0) ? at + (size_t)r : 0;
+	} while (bulk && sizeof(buf) - batch.used >= READ_SIZE);
+
+	/* streams that never go quiet, like busy AIS, still get written */
+	if (batch.niov > 0 && batch.since == 0)
+	    batch.since = time(NULL);
+	if (!epoch || sizeof(buf) - batch.used < READ_SIZE
+	    || time(NULL) > batch.since)
+	    flush_batch();
+
+	if (r == 0) {
+	    break;
+	} else if (r == -1) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		continue;
+	    (void)fprintf(stderr, "gpspipe: read error %s(%d)\n",
+			  strerror(errno), errno);
+	    exit(EXIT_FAILURE);
 	}
     }
 
+    flush_batch();
+    out_close();
+
 #ifdef __UNUSED__
     if (serialport != NULL) {
 	/* Restore the old serial port settings. */
@@ -71,6 +71,7 @@
 #include <time.h>
 #include <errno.h>
 #include <libgen.h>
+#include <limits.h>
 #include <signal.h>
 #include <assert.h>
 #include <unistd.h>
@@ -143,7 +144,19 @@ static struct obs_cnt_t {
         unsigned int obs_cnts[CODEMAX+1];    /* count of obscode */
 } obs_cnt[MAXCNT] = {{0}};
 
-static FILE * tmp_file;             /* file handle for temp file */
+/* where the observations go: a temp file, copied to log_file behind
+ * the header at the end, or log_file itself when streaming */
+static FILE * obs_file;
+static bool streaming = false;      /* write the obs file as we go */
+static time_t rotate = 0;           /* seconds of data per file, or 0 */
+static char *fname;                 /* output name, strftime() pattern
+                                     * for rotated files */
+/* offsets of the header records a streamed file gets at close */
+static long pos_approx = -1;        /* APPROX POSITION XYZ */
+static long pos_sats = -1;          /* # OF SATELLITES, PRN / # OF OBS */
+static long pos_last = -1;          /* TIME OF LAST OBS */
+/* lines held for # OF SATELLITES and PRN / # OF OBS in a streamed file */
+#define SAT_LINES (MAXCNT + 1)
 static int sample_count = 20;       /* number of measurement sets to get */
 /* seconds between measurement sets */
 static unsigned int sample_interval = 30;
@@ -274,110 +287,30 @@ static int obs_cnt_prns(unsigned char gnssid)
     return prn_cnt;
 }
 
-/* print_rinex_header()
- * Print a RINEX 3 header to the file "log_file".
- * Some of the data in the header is only known after processing all
- * the raw data.
+/* print_approx_pos()
+ * print the APPROX POSITION XYZ header record
  */
-static void print_rinex_header(void)
+static void print_approx_pos(void)
 {
-    int i, j;
-    char tmstr[40];              /* time: yyyymmdd hhmmss UTC */
-    struct tm *report_time;
-    struct tm *first_time;
-    struct tm *last_time;
-    int cnt;                     /* number of obs for one sat */
-    int prn_count[GNSSID_CNT] = {0};   /* count of PRN per gnssid */
-
-    if (DEBUG_PROG <= debug) {
-        (void)fprintf(stderr, "doing header\n");
-    }
-
-    report_time = gmtime(&(start_time.tv_sec));
-    (void)strftime(tmstr, sizeof(tmstr), "%Y%m%d %H%M%S UTC", report_time);
-
-    (void)fprintf(log_file,
-        "%9s%11s%-20s%-20s%-20s\n",
-        "3.03", "", "OBSERVATION DATA", "M: Mixed", "RINEX VERSION / TYPE");
-    (void)fprintf(log_file,
-        "%-20s%-20s%-20s%-20s\n",
-        "gpsrinex 3.19", "", tmstr,
-        "PGM / RUN BY / DATE");
-    (void)fprintf(log_file, "%-60s%-20s\n",
-         "Source: gpsd live data", "COMMENT");
-    (void)fprintf(log_file, "%-60s%-20s\n", "XXXX", "MARKER NAME");
-    (void)fprintf(log_file, "%-60s%-20s\n", "NON_PHYSICAL", "MARKER TYPE");
-    (void)fprintf(log_file, "%-20s%-20s%-20s%-20s\n",
-                  "Unknown", "Unknown", "", "OBSERVER / AGENCY");
-    (void)fprintf(log_file, "%-20s%-20s%-20s%-20s\n",
-                  "0", "UNKNOWN", "0", "REC # / TYPE / VERS");
-    (void)fprintf(log_file, "%-20s%-20s%-20s%-20s\n",
-                  "0", "UNKNOWN EXT     NONE", "" , "ANT # / TYPE");
-    if (isfinite(ecefx) &&
-	isfinite(ecefy) &&
-	isfinite(ecefz)) {
-	(void)fprintf(log_file, "%14.4f%14.4f%14.4f%18s%-20s\n",
-	    ecefx, ecefy, ecefz, "", "APPROX POSITION XYZ");
-    } else if (DEBUG_INFO <= debug) {
-	(void)fprintf(stderr, "INFO: missing ECEF\n");
-    }
-
     (void)fprintf(log_file, "%14.4f%14.4f%14.4f%18s%-20s\n",
-        0.0, 0.0, 0.0, "", "ANTENNA: DELTA H/E/N");
-    (void)fprintf(log_file, "%6d%6d%48s%-20s\n", 1, 1,
-         "", "WAVELENGTH FACT L1/2");
+        ecefx, ecefy, ecefz, "", "APPROX POSITION XYZ");
+}
 
-    /* get PRN stats */
-    qsort(obs_cnt, MAXCNT, sizeof(struct obs_cnt_t), compare_obs_cnt);
-    for (i = 0; i < GNSSID_CNT; i++ ) {
-        prn_count[i] = obs_cnt_prns(i);
-    }
-    /* CSRS-PPP needs C1C, L1C or C1C, L1C, D1C
-     * CSRS-PPP refuses files with L1C first
-     * convbin wants C1C, L1C, D1C
-     * for some reason gfzrnx_lx wants C1C, D1C, L1C, not C1C, L1C, D1C */
-    if (0 < prn_count[GNSSID_GPS]) {
-        /* GPS, code G */
-        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
-             gnssid2rinex(GNSSID_GPS), 5, "C1C", "L1C", "D1C", "C2C", "L2C",
-             "D2C", "", "", "", "SYS / # / OBS TYPES");
-    }
-    if (0 < prn_count[GNSSID_SBAS]) {
-        /* SBAS, L1 and L5 only, code S */
-        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
-             gnssid2rinex(GNSSID_SBAS), 3, "C1C", "L1C", "D1C", "", "", "",
-             "", "", "", "SYS / # / OBS TYPES");
-    }
-    if (0 < prn_count[GNSSID_GAL]) {
-        /* Galileo, E1, E5 aand E6 only, code E  */
-        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
-             gnssid2rinex(GNSSID_GAL), 3, "C1C", "L1C", "D1C", "C7Q",
-             "L7Q", "D7Q", "", "", "", "SYS / # / OBS TYPES");
-    }
-    if (0 < prn_count[GNSSID_BD]) {
-        /* BeiDou, BDS, code C */
-        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
-             gnssid2rinex(GNSSID_BD), 5, "C1C", "L1C", "D1C", "C7I", "L7I",
-             "D7I", "", "", "", "SYS / # / OBS TYPES");
-    }
-    if (0 < prn_count[GNSSID_QZSS]) {
-        /* QZSS, code J */
-        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
-             gnssid2rinex(GNSSID_QZSS), 5, "C1C", "L1C", "D1C", "C2L",
-             "L2L", "D2L", "", "", "", "SYS / # / OBS TYPES");
-    }
-    if (0 < prn_count[GNSSID_GLO]) {
-        /* GLONASS, R */
-        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
-             gnssid2rinex(GNSSID_GLO), 5, "C1C", "L1C", "D1C", "C2C", "L2C",
-             "D2C", "", "", "", "SYS / # / OBS TYPES");
-    }
+/* print_sat_counts()
+ * print the # OF SATELLITES and PRN / # OF OBS header records,
+ * return the number of lines printed
+ */
+static int print_sat_counts(void)
+{
+    int i, j;
+    int cnt;                     /* number of obs for one sat */
+    int lines = 1;
 
     (void)fprintf(log_file, "%6d%54s%-20s\n", obs_cnt_prns(255),
                   "", "# OF SATELLITES");
 
     /* get all the PRN / # OF OBS */
-    for (i = 0; i <= MAXCNT; i++) {
+    for (i = 0; i < MAXCNT; i++) {
         cnt = 0;
 
         if (0 == obs_cnt[i].svid) {
@@ -391,6 +324,7 @@ static void print_rinex_header(void)
             /* no counts for this sat */
             continue;
         }
+        lines++;
         switch (obs_cnt[i].gnssid) {
         case GNSSID_GPS:
             /* GPS, code G */
@@ -475,34 +409,149 @@ static void print_rinex_header(void)
         }
     }
 
-    (void)fprintf(log_file, "%10.3f%50s%-20s\n",
-                  (double)sample_interval, "", "INTERVAL");
+    return lines;
+}
 
+/* print_obs_time()
+ * print a TIME OF FIRST OBS or TIME OF LAST OBS header record
+ */
+static void print_obs_time(const timespec_t *mtime, const char *label)
+{
     /* GPS time not UTC */
-    first_time = gmtime(&(first_mtime.tv_sec));
-    (void)fprintf(log_file, "%6d%6d%6d%6d%6d%5d.%07ld%8s%9s%-20s\n",
-         first_time->tm_year + 1900,
-         first_time->tm_mon + 1,
-         first_time->tm_mday,
-         first_time->tm_hour,
-         first_time->tm_min,
-         first_time->tm_sec,
-         (long)(first_mtime.tv_nsec / 100),
-         "GPS", "",
-         "TIME OF FIRST OBS");
+    struct tm *obs_time = gmtime(&(mtime->tv_sec));
 
-    /* GPS time not UTC */
-    last_time = gmtime(&(last_mtime.tv_sec));
     (void)fprintf(log_file, "%6d%6d%6d%6d%6d%5d.%07ld%8s%9s%-20s\n",
-         last_time->tm_year + 1900,
-         last_time->tm_mon + 1,
-         last_time->tm_mday,
-         last_time->tm_hour,
-         last_time->tm_min,
-         last_time->tm_sec,
-         (long)(last_mtime.tv_nsec / 100),
+         obs_time->tm_year + 1900,
+         obs_time->tm_mon + 1,
+         obs_time->tm_mday,
+         obs_time->tm_hour,
+         obs_time->tm_min,
+         obs_time->tm_sec,
+         (long)(mtime->tv_nsec / 100),
          "GPS", "",
-         "TIME OF LAST OBS");
+         label);
+}
+
+/* print_rinex_header()
+ * Print a RINEX 3 header to the file "log_file".
+ * Some of the data in the header is only known after processing all
+ * the raw data.  A provisional header, for streaming, declares every
+ * constellation and leaves room for those records, noting where they
+ * go so patch_rinex_header() can fill them in.
+ */
+static void print_rinex_header(bool provisional)
+{
+    int i;
+    char tmstr[40];              /* time: yyyymmdd hhmmss UTC */
+    struct tm *report_time;
+    int prn_count[GNSSID_CNT] = {0};   /* count of PRN per gnssid */
+
+    if (DEBUG_PROG <= debug) {
+        (void)fprintf(stderr, "doing header\n");
+    }
+
+    report_time = gmtime(&(start_time.tv_sec));
+    (void)strftime(tmstr, sizeof(tmstr), "%Y%m%d %H%M%S UTC", report_time);
+
+    (void)fprintf(log_file,
+        "%9s%11s%-20s%-20s%-20s\n",
+        "3.03", "", "OBSERVATION DATA", "M: Mixed", "RINEX VERSION / TYPE");
+    (void)fprintf(log_file,
+        "%-20s%-20s%-20s%-20s\n",
+        "gpsrinex 3.19", "", tmstr,
+        "PGM / RUN BY / DATE");
+    (void)fprintf(log_file, "%-60s%-20s\n",
+         "Source: gpsd live data", "COMMENT");
+    (void)fprintf(log_file, "%-60s%-20s\n", "XXXX", "MARKER NAME");
+    (void)fprintf(log_file, "%-60s%-20s\n", "NON_PHYSICAL", "MARKER TYPE");
+    (void)fprintf(log_file, "%-20s%-20s%-20s%-20s\n",
+                  "Unknown", "Unknown", "", "OBSERVER / AGENCY");
+    (void)fprintf(log_file, "%-20s%-20s%-20s%-20s\n",
+                  "0", "UNKNOWN", "0", "REC # / TYPE / VERS");
+    (void)fprintf(log_file, "%-20s%-20s%-20s%-20s\n",
+                  "0", "UNKNOWN EXT     NONE", "" , "ANT # / TYPE");
+    if (provisional) {
+        /* may not have a fix yet */
+        pos_approx = ftell(log_file);
+        print_approx_pos();
+    } else if (isfinite(ecefx) &&
+	isfinite(ecefy) &&
+	isfinite(ecefz)) {
+        print_approx_pos();
+    } else if (DEBUG_INFO <= debug) {
+	(void)fprintf(stderr, "INFO: missing ECEF\n");
+    }
+
+    (void)fprintf(log_file, "%14.4f%14.4f%14.4f%18s%-20s\n",
+        0.0, 0.0, 0.0, "", "ANTENNA: DELTA H/E/N");
+    (void)fprintf(log_file, "%6d%6d%48s%-20s\n", 1, 1,
+         "", "WAVELENGTH FACT L1/2");
+
+    /* get PRN stats */
+    qsort(obs_cnt, MAXCNT, sizeof(struct obs_cnt_t), compare_obs_cnt);
+    for (i = 0; i < GNSSID_CNT; i++ ) {
+        /* we can't know yet what a streamed file will see */
+        prn_count[i] = provisional ? 1 : obs_cnt_prns(i);
+    }
+    /* CSRS-PPP needs C1C, L1C or C1C, L1C, D1C
+     * CSRS-PPP refuses files with L1C first
+     * convbin wants C1C, L1C, D1C
+     * for some reason gfzrnx_lx wants C1C, D1C, L1C, not C1C, L1C, D1C */
+    if (0 < prn_count[GNSSID_GPS]) {
+        /* GPS, code G */
+        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
+             gnssid2rinex(GNSSID_GPS), 5, "C1C", "L1C", "D1C", "C2C", "L2C",
+             "D2C", "", "", "", "SYS / # / OBS TYPES");
+    }
+    if (0 < prn_count[GNSSID_SBAS]) {
+        /* SBAS, L1 and L5 only, code S */
+        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
+             gnssid2rinex(GNSSID_SBAS), 3, "C1C", "L1C", "D1C", "", "", "",
+             "", "", "", "SYS / # / OBS TYPES");
+    }
+    if (0 < prn_count[GNSSID_GAL]) {
+        /* Galileo, E1, E5 aand E6 only, code E  */
+        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
+             gnssid2rinex(GNSSID_GAL), 3, "C1C", "L1C", "D1C", "C7Q",
+             "L7Q", "D7Q", "", "", "", "SYS / # / OBS TYPES");
+    }
+    if (0 < prn_count[GNSSID_BD]) {
+        /* BeiDou, BDS, code C */
+        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
+             gnssid2rinex(GNSSID_BD), 5, "C1C", "L1C", "D1C", "C7I", "L7I",
+             "D7I", "", "", "", "SYS / # / OBS TYPES");
+    }
+    if (0 < prn_count[GNSSID_QZSS]) {
+        /* QZSS, code J */
+        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
+             gnssid2rinex(GNSSID_QZSS), 5, "C1C", "L1C", "D1C", "C2L",
+             "L2L", "D2L", "", "", "", "SYS / # / OBS TYPES");
+    }
+    if (0 < prn_count[GNSSID_GLO]) {
+        /* GLONASS, R */
+        (void)fprintf(log_file, "%c%5d%4s%4s%4s%4s%4s%4s%4s%4s%22s%-20s\n",
+             gnssid2rinex(GNSSID_GLO), 5, "C1C", "L1C", "D1C", "C2C", "L2C",
+             "D2C", "", "", "", "SYS / # / OBS TYPES");
+    }
+
+    if (provisional) {
+        /* blank comments, to be overwritten */
+        pos_sats = ftell(log_file);
+        for (i = 0; i < SAT_LINES; i++) {
+            (void)fprintf(log_file, "%-60s%-20s\n", "", "COMMENT");
+        }
+    } else {
+        (void)print_sat_counts();
+    }
+
+    (void)fprintf(log_file, "%10.3f%50s%-20s\n",
+                  (double)sample_interval, "", "INTERVAL");
+
+    print_obs_time(&first_mtime, "TIME OF FIRST OBS");
+    if (provisional) {
+        pos_last = ftell(log_file);
+    }
+    print_obs_time(&last_mtime, "TIME OF LAST OBS");
 
     if (0 < prn_count[GNSSID_GPS]) {
         /* GPS, code G */
@@ -554,31 +603,116 @@ static void print_rinex_header(void)
     return;
 }
 
+/* patch_rinex_header()
+ * Fill in what a provisional header could not know when it was
+ * written.  Every record patched is the same length as the one it
+ * replaces.
+ */
+static void patch_rinex_header(void)
+{
+    int lines;
+
+    if (0 != fflush(log_file) ||
+        0 != fseek(log_file, pos_approx, SEEK_SET)) {
+        /* not seekable, say a pipe, the provisional header must do */
+        return;
+    }
+    print_approx_pos();
+
+    (void)fseek(log_file, pos_sats, SEEK_SET);
+    qsort(obs_cnt, MAXCNT, sizeof(struct obs_cnt_t), compare_obs_cnt);
+    for (lines = print_sat_counts(); lines < SAT_LINES; lines++) {
+        (void)fprintf(log_file, "%-60s%-20s\n", "", "COMMENT");
+    }
+
+    (void)fseek(log_file, pos_last, SEEK_SET);
+    print_obs_time(&last_mtime, "TIME OF LAST OBS");
+    (void)fseek(log_file, 0, SEEK_END);
+}
+
+/* open_output()
+ * open a streamed output file and write its provisional header,
+ * mtime is the time of the first epoch to go in it
+ */
+static void open_output(const timespec_t *mtime)
+{
+    char name[PATH_MAX];
+    struct tm *file_time;
+
+    if (0 == rotate) {
+        (void)strlcpy(name, fname, sizeof(name));
+    } else {
+        /* name the file for the start of its period */
+        time_t start = mtime->tv_sec - (mtime->tv_sec % rotate);
+
+        file_time = gmtime(&start);
+        if (0 == strftime(name, sizeof(name), fname, file_time)) {
+            (void)strlcpy(name, fname, sizeof(name));
+        }
+    }
+    log_file = fopen(name, "w");
+    if (log_file == NULL) {
+        syslog(LOG_ERR, "ERROR: Failed to open %s: %s",
+               name, strerror(errno));
+        exit(3);
+    }
+    /* the observations go out in big batches */
+    (void)setvbuf(log_file, NULL, _IOFBF, 65536);
+    if (DEBUG_INFO <= debug) {
+        (void)fprintf(stderr, "INFO: writing %s\n", name);
+    }
+    obs_file = log_file;
+    memset(obs_cnt, 0, sizeof(obs_cnt));
+    first_mtime = *mtime;     /* structure copy */
+    last_mtime = *mtime;      /* structure copy */
+    print_rinex_header(true);
+}
+
+/* close_output()
+ * finish a streamed output file
+ */
+static void close_output(void)
+{
+    if (NULL == log_file) {
+        return;
+    }
+    patch_rinex_header();
+    (void)fclose(log_file);
+    log_file = NULL;
+    obs_file = NULL;
+}
+
 /* print_rinex_footer()
  * print a RINEX 3 footer to the file "log_file".
  * Except RINEX 3 has no footer.  So what this really does is
  * call the header function, then move the processed observations from
- * "tmp_file" to "log_file".
+ * "obs_file" to "log_file".  A streamed file just gets its header
+ * completed.
  */
 static void print_rinex_footer(void)
 {
     char buffer[4096];
 
+    if (streaming) {
+        close_output();
+        (void)gps_close(&gpsdata);
+        return;
+    }
     /* print the header */
-    print_rinex_header();
-    /* now replay the data in the tmp_file into the output */
-    (void)fflush(tmp_file);
-    rewind(tmp_file);
+    print_rinex_header(false);
+    /* now replay the data in the obs_file into the output */
+    (void)fflush(obs_file);
+    rewind(obs_file);
     while (true) {
         size_t count;
 
-        count = fread(buffer, 1, sizeof(buffer), tmp_file);
+        count = fread(buffer, 1, sizeof(buffer), obs_file);
         if (0 >= count ) {
             break;
         }
         (void)fwrite(buffer, 1, count, log_file);
     }
-    (void)fclose(tmp_file);
+    (void)fclose(obs_file);
     (void)fclose(log_file);
     (void)gps_close(&gpsdata);
 }
@@ -745,14 +879,14 @@ static void one_sig(struct meas_t *meas)
 	obs_cnt_inc(gnssid, svid, dxx);
     }
 
-    (void)fputs(fmt_obs(meas->pseudorange, 0, snr), tmp_file);
-    (void)fputs(fmt_obs(meas->carrierphase, meas->lli, 0), tmp_file);
-    (void)fputs(fmt_obs(meas->doppler, 0, 0), tmp_file);
+    (void)fputs(fmt_obs(meas->pseudorange, 0, snr), obs_file);
+    (void)fputs(fmt_obs(meas->carrierphase, meas->lli, 0), obs_file);
+    (void)fputs(fmt_obs(meas->doppler, 0, 0), obs_file);
 }
 
 
 /* print_raw()
- * print one epoch of observations into "tmp_file"
+ * print one epoch of observations into "obs_file"
  */
 static void print_raw(struct gps_data_t *gpsdata)
 {
@@ -764,6 +898,7 @@ static void print_raw(struct gps_data_t *gpsdata)
     unsigned char last_svid = 0;
     int need_nl = 0;
     int got_l1 = 0;
+    struct meas_t *order[MAXCHANNELS];  /* the records, sorted */
 
     if ((last_mtime.tv_sec + (time_t)sample_interval) >
         gpsdata->raw.mtime.tv_sec) {
@@ -782,12 +917,21 @@ static void print_raw(struct gps_data_t *gpsdata)
      * record in RINEX
      */
 
-    /* go through list three times, first just to get a count for sort */
+    /* go through list three times, first to put the records in order.
+     * Receivers send them nearly sorted already, so inserting each one
+     * from the end of the ordered list is next to free. */
     for (i = 0; i < MAXCHANNELS; i++) {
-        if (0 == gpsdata->raw.meas[i].svid) {
+        struct meas_t *meas = &gpsdata->raw.meas[i];
+        unsigned j;
+
+        if (0 == meas->svid) {
             /* bad svid, end of list */
             break;
         }
+        for (j = nrec; 0 < j && 0 < compare_meas(order[j - 1], meas); j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = meas;
         nrec++;
     }
 
@@ -795,31 +939,29 @@ static void print_raw(struct gps_data_t *gpsdata)
         /* nothing to do */
         return;
     }
-    qsort(gpsdata->raw.meas, nrec, sizeof(gpsdata->raw.meas[0]),
-          compare_meas);
 
     /* second just to get a count, needed for epoch header */
     for (i = 0; i < nrec; i++) {
-        if (0 == gpsdata->raw.meas[i].svid) {
+        if (0 == order[i]->svid) {
             /* bad svid */
             continue;
         }
-        if (4 == gpsdata->raw.meas[i].gnssid) {
+        if (4 == order[i]->gnssid) {
             /* skip IMES */
             continue;
         }
-        if (GNSSID_CNT <= gpsdata->raw.meas[i].gnssid) {
+        if (GNSSID_CNT <= order[i]->gnssid) {
             /* invalid gnssid */
             continue;
         }
         /* prevent separate sigid from double counting gnssid:svid */
-        if ((last_gnssid == gpsdata->raw.meas[i].gnssid) &&
-            (last_svid == gpsdata->raw.meas[i].svid)) {
+        if ((last_gnssid == order[i]->gnssid) &&
+            (last_svid == order[i]->svid)) {
             /* duplicate sat */
             continue;
         }
-        last_gnssid = gpsdata->raw.meas[i].gnssid;
-        last_svid = gpsdata->raw.meas[i].svid;
+        last_gnssid = order[i]->gnssid;
+        last_svid = order[i]->svid;
         nsat++;
     }
     if (0 >= nsat) {
@@ -827,6 +969,18 @@ static void print_raw(struct gps_data_t *gpsdata)
         return;
     }
 
+    if (streaming) {
+        if (NULL != log_file && 0 != rotate &&
+            (gpsdata->raw.mtime.tv_sec / rotate) !=
+            (first_mtime.tv_sec / rotate)) {
+            /* time for the next file */
+            close_output();
+        }
+        if (NULL == log_file) {
+            open_output(&gpsdata->raw.mtime);
+        }
+    }
+
     /* save time of last measurement, GPS time, not UTC */
     last_mtime = gpsdata->raw.mtime;     /* structure copy */
     if (0 == first_mtime.tv_sec) {
@@ -836,7 +990,7 @@ static void print_raw(struct gps_data_t *gpsdata)
 
     /* print epoch header line */
     tmp_now = gmtime(&(last_mtime.tv_sec));
-    (void)fprintf(tmp_file,"> %4d %02d %02d %02d %02d %02d.%07ld  0%3u\n",
+    (void)fprintf(obs_file,"> %4d %02d %02d %02d %02d %02d.%07ld  0%3u\n",
          tmp_now->tm_year + 1900,
          tmp_now->tm_mon + 1,
          tmp_now->tm_mday,
@@ -859,75 +1013,75 @@ static void print_raw(struct gps_data_t *gpsdata)
         unsigned char svid;
         unsigned char sigid;
 
-        gnssid = gpsdata->raw.meas[i].gnssid;
+        gnssid = order[i]->gnssid;
         rinex_gnssid = gnssid2rinex(gnssid);
-        svid = gpsdata->raw.meas[i].svid;
-        sigid = gpsdata->raw.meas[i].sigid;
+        svid = order[i]->svid;
+        sigid = order[i]->sigid;
 
 	if (DEBUG_RAW <= debug) {
 	    (void)fprintf(stderr,"record: %u:%u:%u %s\n",
                           gnssid, svid, sigid,
-			  gpsdata->raw.meas[i].obs_code);
+			  order[i]->obs_code);
 	}
 
-        if (0 == gpsdata->raw.meas[i].svid) {
+        if (0 == order[i]->svid) {
             /* should not happen... */
             continue;
         }
 
         /* line can be longer than 80 chars in RINEX 3 */
-        if ((last_gnssid != gpsdata->raw.meas[i].gnssid) ||
-            (last_svid != gpsdata->raw.meas[i].svid)) {
+        if ((last_gnssid != order[i]->gnssid) ||
+            (last_svid != order[i]->svid)) {
 
 	    if (0 != need_nl) {
-		(void)fputs("\n", tmp_file);
+		(void)fputs("\n", obs_file);
 	    }
             got_l1 = 0;
 	    /* new record line gnssid:svid preamble  */
-	    (void)fprintf(tmp_file,"%c%02d", rinex_gnssid, svid);
+	    (void)fprintf(obs_file,"%c%02d", rinex_gnssid, svid);
         }
 
-        last_gnssid = gpsdata->raw.meas[i].gnssid;
-        last_svid = gpsdata->raw.meas[i].svid;
+        last_gnssid = order[i]->gnssid;
+        last_svid = order[i]->svid;
 
         /* L1x */
-        switch (gpsdata->raw.meas[i].sigid) {
+        switch (order[i]->sigid) {
         case 0:
             /* L1 */
-            one_sig(&gpsdata->raw.meas[i]);
+            one_sig(order[i]);
             got_l1 = 1;
             break;
         case 2:
             /* GLONASS L2 OF or BD B2I D1 */
 	    if (0 == got_l1) {
 		/* space to start of L2 */
-		(void)fprintf(tmp_file, "%48s", "");
+		(void)fprintf(obs_file, "%48s", "");
 	    }
-            one_sig(&gpsdata->raw.meas[i]);
+            one_sig(order[i]);
             break;
         case 3:
             /* GPS L2 or BD B2I D2 */
 	    if (0 == got_l1) {
 		/* space to start of L2 */
-		(void)fprintf(tmp_file, "%48s", "");
+		(void)fprintf(obs_file, "%48s", "");
 	    }
-            one_sig(&gpsdata->raw.meas[i]);
+            one_sig(order[i]);
             break;
         case 5:
             /* QZSS L2C (L) */
 	    if (0 == got_l1) {
 		/* space to start of L2 */
-		(void)fprintf(tmp_file, "%48s", "");
+		(void)fprintf(obs_file, "%48s", "");
 	    }
-            one_sig(&gpsdata->raw.meas[i]);
+            one_sig(order[i]);
             break;
         case 6:
             /* Galileo E5 bQ */
 	    if (0 == got_l1) {
 		/* space to start of L2 */
-		(void)fprintf(tmp_file, "%48s", "");
+		(void)fprintf(obs_file, "%48s", "");
 	    }
-            one_sig(&gpsdata->raw.meas[i]);
+            one_sig(order[i]);
             break;
         default:
 	    (void)fprintf(stderr,
@@ -939,7 +1093,7 @@ static void print_raw(struct gps_data_t *gpsdata)
         need_nl = 1;
     }
     if (0 != need_nl) {
-        (void)fputs("\n", tmp_file);
+        (void)fputs("\n", obs_file);
     }
     sample_count--;
 }
@@ -1011,6 +1165,10 @@ static void usage(void)
           "     [-h]              print this usage and exit\n"
           "     [-i interval]     time between samples, default: %d\n"
           "     [-n count]        number samples to collect, default: %d\n"
+          "     [-r hour|day]     start a new file each hour or day,\n"
+          "                       filename is a strftime() pattern,\n"
+          "                       implies -s\n"
+          "     [-s]              stream to filename, header last patched\n"
           "     [-V]              print version and exit\n"
           "\n"
           "defaults to '%s -n %d -i %d localhost:2947'\n",
@@ -1030,13 +1188,12 @@ int main(int argc, char **argv)
     struct tm *report_time;
     int ch;
     unsigned int flags = WATCH_ENABLE;
-    char   *fname = NULL;
     int timeout = 10;
 
     progname = argv[0];
 
     log_file = stdout;
-    while ((ch = getopt(argc, argv, "D:f:hi:n:V")) != -1) {
+    while ((ch = getopt(argc, argv, "D:f:hi:n:r:sV")) != -1) {
         switch (ch) {
         case 'D':
             debug = atoi(optarg);
@@ -1056,6 +1213,19 @@ int main(int argc, char **argv)
         case 'n':
             sample_count = atoi(optarg);
             break;
+        case 'r':
+            if (0 == strcmp(optarg, "hour")) {
+                rotate = 3600;
+            } else if (0 == strcmp(optarg, "day")) {
+                rotate = 86400;
+            } else {
+                usage();
+            }
+            streaming = true;
+            break;
+        case 's':
+            streaming = true;
+            break;
         case 'V':
             (void)fprintf(stderr, "%s: version %s (revision %s)\n",
                           progname, VERSION, REVISION);
@@ -1086,15 +1256,24 @@ int main(int argc, char **argv)
 
     /* open the output file */
     if (NULL == fname) {
-        (void)strftime(tmstr, sizeof(tmstr), "gpsrinex%Y%j%H%M%S.obs",
-                       report_time);
-        fname = tmstr;
+        if (0 != rotate) {
+            fname = (char *)"gpsrinex%Y%j%H%M%S.obs";
+        } else {
+            (void)strftime(tmstr, sizeof(tmstr), "gpsrinex%Y%j%H%M%S.obs",
+                           report_time);
+            fname = tmstr;
+        }
     }
-    log_file = fopen(fname, "w");
-    if (log_file == NULL) {
-        syslog(LOG_ERR, "ERROR: Failed to open %s: %s",
-               fname, strerror(errno));
-        exit(3);
+    if (streaming) {
+        /* opened, and reopened, as the epochs come in */
+        log_file = NULL;
+    } else {
+        log_file = fopen(fname, "w");
+        if (log_file == NULL) {
+            syslog(LOG_ERR, "ERROR: Failed to open %s: %s",
+                   fname, strerror(errno));
+            exit(3);
+        }
     }
 
     /* clear the counts */
@@ -1115,11 +1294,13 @@ int main(int argc, char **argv)
         flags |= WATCH_DEVICE;
     (void)gps_stream(&gpsdata, flags, source.device);
 
-    tmp_file = tmpfile();
-    if (NULL == tmp_file) {
-        (void)fprintf(stderr, "ERROR: could not open temp file: %s\n",
-                      strerror(errno));
-        exit(2);
+    if (!streaming) {
+        obs_file = tmpfile();
+        if (NULL == obs_file) {
+            (void)fprintf(stderr, "ERROR: could not open temp file: %s\n",
+                          strerror(errno));
+            exit(2);
+        }
     }
 
     for (;;) {
@@ -368,12 +368,55 @@ void gps_merge_fix(struct gps_fix_t *to,
     }
 }
 
+/*
+ * The clock the daemon reads for its own timing decisions.  A test
+ * harness may freeze it and step it by hand, so that cycle detection,
+ * timeouts and NTP latching can be run faster than real time with
+ * repeatable results.  Until gps_clock_set() is called it is simply
+ * CLOCK_REALTIME.
+ */
+static bool clock_virtual = false;
+static struct timespec clock_now;
+
+void gps_clock_set(const struct timespec *ts)
+/* freeze the clock at ts, or give it back to the system if NULL */
+{
+    if (ts == NULL)
+	clock_virtual = false;
+    else {
+	clock_now = *ts;
+	clock_virtual = true;
+    }
+}
+
+bool gps_clock_is_virtual(void)
+{
+    return clock_virtual;
+}
+
+void gps_clock_gettime(struct timespec *ts)
+{
+    if (clock_virtual)
+	*ts = clock_now;
+    else
+	(void)clock_gettime(CLOCK_REALTIME, ts);
+}
+
+time_t gps_clock_time(void)
+/* drop-in for time(NULL) */
+{
+    struct timespec ts;
+
+    gps_clock_gettime(&ts);
+    return ts.tv_sec;
+}
+
 /* NOTE: timestamp_t is a double, so this is only precise to
  * near microSec.  Do not use near PPS which is nanoSec precise */
 timestamp_t timestamp(void)
 {
      struct timespec ts;
-     (void)clock_gettime(CLOCK_REALTIME, &ts);
+     gps_clock_gettime(&ts);
      return (timestamp_t)(ts.tv_sec + ts.tv_nsec * 1e-9);
 }
 
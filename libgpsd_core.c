@@ -36,6 +36,8 @@
 #include "gpsd.h"
 #include "matrix.h"
 #include "strfuncs.h"
+#include "timespec.h"
+#include "tracepoints.h"
 #if defined(NMEA2000_ENABLE)
 #include "driver_nmea2000.h"
 #endif /* defined(NMEA2000_ENABLE) */
@@ -112,6 +114,223 @@ static void visibilize(char *outbuf, size_t outlen,
 #endif /* !SQUELCH_ENABLE */
 
 
+#ifndef SQUELCH_ENABLE
+static const char *log_level_name(const int errlevel)
+{
+    switch ( errlevel ) {
+    case LOG_ERROR:
+	return "ERROR: ";
+    case LOG_SHOUT:
+	return "SHOUT: ";
+    case LOG_WARN:
+	return "WARN: ";
+    case LOG_CLIENT:
+	return "CLIENT: ";
+    case LOG_INF:
+	return "INFO: ";
+    case LOG_DATA:
+	return "DATA: ";
+    case LOG_PROG:
+	return "PROG: ";
+    case LOG_IO:
+	return "IO: ";
+    case LOG_SPIN:
+	return "SPIN: ";
+    case LOG_RAW:
+	return "RAW: ";
+    default:
+	return "UNK: ";
+    }
+}
+
+static void log_deliver(void (*report)(const char *), const int errlevel,
+			char *outbuf, size_t outlen, const char *msg)
+/* make a message printable and hand it to syslog or the report hook */
+{
+    visibilize(outbuf, outlen, msg, strlen(msg));
+
+    if (getpid() == getsid(getpid()))
+	syslog((errlevel <= LOG_SHOUT) ? LOG_ERR : LOG_NOTICE, "%s", outbuf);
+    else if (report != NULL)
+	report(outbuf);
+    else
+	(void)fputs(outbuf, stderr);
+}
+#endif /* !SQUELCH_ENABLE */
+
+#if defined(LOG_ASYNC_ENABLE)
+/*
+ * Asynchronous logging.
+ *
+ * At -D 4 and up a busy daemon spends a good part of each cycle in
+ * visibilize() and in writes to a terminal, pipe or syslog socket that
+ * can block.  Once gpsd_log_async_start() has been called, a logging
+ * thread takes over the delivery: the caller only formats its line into
+ * a slot of a fixed ring and returns.  The ring is a bounded
+ * multi-producer queue (the main loop, PPS threads and the NTRIP
+ * connect threads all log), each slot carrying a sequence number that
+ * says whether it is free or filled.  A full ring drops the message and
+ * counts it; the logging thread reports the count when it catches up.
+ * Lines longer than a slot are truncated.
+ */
+#define LOG_RING_SLOTS	256		/* must be a power of 2 */
+#define LOG_RING_TEXT	1024
+
+struct log_slot_t {
+    atomic_ulong seq;
+    int errlevel;
+    void (*report)(const char *);
+    char text[LOG_RING_TEXT];
+};
+
+static struct log_slot_t *log_ring;
+static atomic_ulong log_head;		/* next slot to fill */
+static unsigned long log_tail;		/* next slot to deliver */
+static atomic_ulong log_dropped;
+static atomic_bool log_sleeping, log_stopping;
+static int log_wakefd[2] = {-1, -1};
+static pthread_t log_thread;
+
+static struct log_slot_t *log_claim(void)
+/* reserve a free slot, or NULL if the ring is full */
+{
+    unsigned long pos = atomic_load(&log_head);
+
+    for (;;) {
+	struct log_slot_t *slot = &log_ring[pos & (LOG_RING_SLOTS - 1)];
+	long diff = (long)(atomic_load_explicit(&slot->seq,
+						memory_order_acquire) - pos);
+
+	if (diff == 0) {
+	    if (atomic_compare_exchange_weak(&log_head, &pos, pos + 1))
+		return slot;
+	} else if (diff < 0)
+	    return NULL;
+	else
+	    pos = atomic_load(&log_head);
+    }
+}
+
+static void log_publish(struct log_slot_t *slot)
+/* hand a filled slot to the logging thread */
+{
+    unsigned long pos = atomic_load_explicit(&slot->seq,
+					     memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    if (atomic_exchange(&log_sleeping, false)) {
+	char c = 0;
+	/* the pipe is non-blocking; a full pipe already means "wake up" */
+	(void)write(log_wakefd[1], &c, 1);
+    }
+}
+
+static bool log_pending(void)
+{
+    struct log_slot_t *slot = &log_ring[log_tail & (LOG_RING_SLOTS - 1)];
+
+    return atomic_load_explicit(&slot->seq,
+				memory_order_acquire) == log_tail + 1;
+}
+
+static void *log_writer(void *arg)
+/* logging thread: deliver queued messages in order */
+{
+    static char outbuf[LOG_RING_TEXT * 4 + 1];
+    void (*last_report)(const char *) = NULL;
+    unsigned long reported = 0;
+
+    (void)arg;
+    for (;;) {
+	unsigned long dropped;
+
+	while (log_pending()) {
+	    struct log_slot_t *slot =
+		&log_ring[log_tail & (LOG_RING_SLOTS - 1)];
+
+	    log_deliver(slot->report, slot->errlevel,
+			outbuf, sizeof(outbuf), slot->text);
+	    last_report = slot->report;
+	    atomic_store_explicit(&slot->seq, log_tail + LOG_RING_SLOTS,
+				  memory_order_release);
+	    log_tail++;
+	}
+
+	dropped = atomic_load(&log_dropped);
+	if (dropped != reported) {
+	    char msg[64];
+
+	    (void)snprintf(msg, sizeof(msg),
+			   "gpsd:WARN: %lu log messages dropped\n",
+			   dropped - reported);
+	    log_deliver(last_report, LOG_WARN, outbuf, sizeof(outbuf), msg);
+	    reported = dropped;
+	}
+
+	if (atomic_load(&log_stopping))
+	    break;
+
+	/* announce the nap, then look once more before taking it */
+	atomic_store(&log_sleeping, true);
+	if (log_pending() || atomic_load(&log_stopping)) {
+	    atomic_store(&log_sleeping, false);
+	    continue;
+	} else {
+	    char drain[64];
+	    fd_set rfds;
+
+	    FD_ZERO(&rfds);
+	    FD_SET(log_wakefd[0], &rfds);
+	    if (select(log_wakefd[0] + 1, &rfds, NULL, NULL, NULL) > 0)
+		while (read(log_wakefd[0], drain, sizeof(drain)) > 0)
+		    continue;
+	}
+    }
+    return NULL;
+}
+
+static void gpsd_log_async_stop(void)
+/* flush the ring and stop the logging thread, run at exit */
+{
+    char c = 0;
+
+    atomic_store(&log_stopping, true);
+    (void)write(log_wakefd[1], &c, 1);
+    (void)pthread_join(log_thread, NULL);
+    atomic_store(&log_stopping, false);
+    log_ring = NULL;
+}
+
+bool gpsd_log_async_start(void)
+/* move message delivery to a logging thread */
+{
+    static struct log_slot_t ring[LOG_RING_SLOTS];
+    unsigned long i;
+
+    if (log_ring != NULL)
+	return true;
+    if (pipe(log_wakefd) != 0)
+	return false;
+    (void)fcntl(log_wakefd[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(log_wakefd[1], F_SETFL, O_NONBLOCK);
+    for (i = 0; i < LOG_RING_SLOTS; i++)
+	atomic_init(&ring[i].seq, i);
+    atomic_store(&log_head, 0);
+    log_tail = 0;
+    atomic_store(&log_dropped, 0);
+    atomic_store(&log_sleeping, false);
+    log_ring = ring;
+    if (pthread_create(&log_thread, NULL, log_writer, NULL) != 0) {
+	log_ring = NULL;
+	(void)close(log_wakefd[0]);
+	(void)close(log_wakefd[1]);
+	return false;
+    }
+    (void)atexit(gpsd_log_async_stop);
+    return true;
+}
+#endif /* LOG_ASYNC_ENABLE */
+
 void gpsd_vlog(const struct gpsd_errout_t *errout,
 			 const int errlevel,
 			 char *outbuf, size_t outlen,
@@ -125,63 +344,40 @@ void gpsd_vlog(const struct gpsd_errout_t *errout,
 #else
     if (errout->debug >= errlevel) {
 	char buf[BUFSIZ];
-	char *err_str;
-
-#if defined(PPS_ENABLE)
-	gpsd_acquire_reporting_lock();
-#endif /* PPS_ENABLE */
-	switch ( errlevel ) {
-	case LOG_ERROR:
-		err_str = "ERROR: ";
-		break;
-	case LOG_SHOUT:
-		err_str = "SHOUT: ";
-		break;
-	case LOG_WARN:
-		err_str = "WARN: ";
-		break;
-	case LOG_CLIENT:
-		err_str = "CLIENT: ";
-		break;
-	case LOG_INF:
-		err_str = "INFO: ";
-		break;
-	case LOG_DATA:
-		err_str = "DATA: ";
-		break;
-	case LOG_PROG:
-		err_str = "PROG: ";
-		break;
-	case LOG_IO:
-		err_str = "IO: ";
-		break;
-	case LOG_SPIN:
-		err_str = "SPIN: ";
-		break;
-	case LOG_RAW:
-		err_str = "RAW: ";
-		break;
-	default:
-		err_str = "UNK: ";
-	}
 
+	/*
+	 * No reporting lock here: the message is assembled in local
+	 * storage and delivered with a single call, and the PPS thread
+	 * must not wait on the main loop's logging.  A report hook that
+	 * isn't thread-safe has to do its own locking.
+	 */
 	assert(errout->label != NULL);
+#if defined(LOG_ASYNC_ENABLE)
+	if (log_ring != NULL) {
+	    struct log_slot_t *slot = log_claim();
+
+	    outbuf[0] = '\0';
+	    if (slot == NULL) {
+		(void)atomic_fetch_add(&log_dropped, 1);
+		return;
+	    }
+	    slot->errlevel = errlevel;
+	    slot->report = errout->report;
+	    (void)strlcpy(slot->text, errout->label, sizeof(slot->text));
+	    (void)strlcat(slot->text, ":", sizeof(slot->text));
+	    (void)strlcat(slot->text, log_level_name(errlevel),
+			  sizeof(slot->text));
+	    str_vappendf(slot->text, sizeof(slot->text), fmt, ap);
+	    log_publish(slot);
+	    return;
+	}
+#endif /* LOG_ASYNC_ENABLE */
 	(void)strlcpy(buf, errout->label, sizeof(buf));
 	(void)strlcat(buf, ":", sizeof(buf));
-	(void)strlcat(buf, err_str, sizeof(buf));
+	(void)strlcat(buf, log_level_name(errlevel), sizeof(buf));
 	str_vappendf(buf, sizeof(buf), fmt, ap);
 
-	visibilize(outbuf, outlen, buf, strlen(buf));
-
-	if (getpid() == getsid(getpid()))
-	    syslog((errlevel <= LOG_SHOUT) ? LOG_ERR : LOG_NOTICE, "%s", outbuf);
-	else if (errout->report != NULL)
-	    errout->report(outbuf);
-	else
-	    (void)fputs(outbuf, stderr);
-#if defined(PPS_ENABLE)
-	gpsd_release_reporting_lock();
-#endif /* PPS_ENABLE */
+	log_deliver(errout->report, errlevel, outbuf, outlen, buf);
     }
 #endif /* !SQUELCH_ENABLE */
 }
@@ -299,6 +495,8 @@ void gps_context_init(struct gps_context_t *context,
 
 #if defined(PPS_ENABLE)
     (void)pthread_mutex_init(&report_mutex, NULL);
+    context->pps_wakefd[0] = context->pps_wakefd[1] = -1;
+    context->pps_cpu = -1;
 #endif /* defined(PPS_ENABLE) */
 }
 
@@ -317,6 +515,7 @@ void gpsd_init(struct gps_device_t *session, struct gps_context_t *context,
     session->sourcetype = source_unknown;	/* gpsd_open() sets this */
     session->servicetype = service_unknown;	/* gpsd_open() sets this */
     session->context = context;
+    session->capture.fd = session->capture.idxfd = -1;
     memset(session->subtype, 0, sizeof(session->subtype));
 #ifdef NMEA0183_ENABLE
     memset(&(session->nmea), 0, sizeof(session->nmea));
@@ -367,6 +566,7 @@ void gpsd_deactivate(struct gps_device_t *session)
     else
 #endif /* of defined(NMEA2000_ENABLE) */
         (void)gpsd_close(session);
+    gpsd_capture_close(session);
     if (session->mode == O_OPTIMIZE)
 	gpsd_run_device_hook(&session->context->errout,
 			     session->gpsdata.dev.path,
@@ -438,9 +638,12 @@ void gpsd_clear(struct gps_device_t *session)
     session->pps_thread.devicename = session->gpsdata.dev.path;
     session->pps_thread.log_hook = ppsthread_log;
     session->pps_thread.context = (void *)session;
+    session->pps_thread.wakefd = session->context->pps_wakefd[1];
+    session->pps_thread.rtprio = session->context->pps_rtprio;
+    session->pps_thread.cpu = session->context->pps_cpu;
 #endif /* PPS_ENABLE */
 
-    session->opentime = time(NULL);
+    session->opentime = gps_clock_time();
 }
 
 int gpsd_open(struct gps_device_t *session)
@@ -549,6 +752,9 @@ int gpsd_open(struct gps_device_t *session)
         return nmea2000_open(session);
     }
 #endif /* defined(NMEA2000_ENABLE) */
+    /* or a capture log to play back */
+    if (str_starts_with(session->gpsdata.dev.path, "replay://"))
+	return gpsd_replay_open(session);
     /* fall through to plain serial open */
     /* could be a naked /dev/ppsX */
     return gpsd_serial_open(session);
@@ -607,6 +813,9 @@ foundit:
 #endif /* NON_NMEA0183_ENABLE */
 
     gpsd_clear(session);
+    if (session->context->capture_dir != NULL
+	&& session->sourcetype != source_replay)
+	gpsd_capture_open(session);
     gpsd_log(&session->context->errout, LOG_INF,
 	     "gpsd_activate(%d): activated GPS (fd %d)\n",
 	     session->mode, session->gpsdata.gps_fd);
@@ -1084,11 +1293,16 @@ static void gpsd_error_model(struct gps_device_t *session)
 #endif /* NOFLOATS_ENABLE */
 
 int gpsd_await_data(fd_set *rfds,
+		    fd_set *wfds,
 		    fd_set *efds,
 		     const int maxfd,
 		     fd_set *all_fds,
 		     struct gpsd_errout_t *errout)
-/* await data from any socket in the all_fds set */
+/*
+ * Await data from any socket in the all_fds set.  If wfds isn't NULL,
+ * it holds sockets the caller wants to write to on entry, and those
+ * that became writable on return.
+ */
 {
     int status;
 
@@ -1109,7 +1323,7 @@ int gpsd_await_data(fd_set *rfds,
      */
     errno = 0;
 
-    status = pselect(maxfd + 1, rfds, NULL, NULL, NULL, NULL);
+    status = pselect(maxfd + 1, rfds, wfds, NULL, NULL, NULL);
     if (status == -1) {
 	if (errno == EINTR)
 	    return AWAIT_NOT_READY;
@@ -1301,6 +1515,9 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 	}
 	return NODATA_IS;
     } else /* (newlen > 0) */ {
+#ifdef TIMING_ENABLE
+	session->packet_time = timestamp();
+#endif /* TIMING_ENABLE */
 	gpsd_log(&session->context->errout, LOG_RAW,
 		 "packet sniff on %s finds type %d\n",
 		 session->gpsdata.dev.path, session->lexer.type);
@@ -1393,7 +1610,7 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 		     "%s identified as type %s, %ld sec @ %ubps\n",
 		     session->gpsdata.dev.path,
 		     session->device_type->type_name,
-		     (long)(time(NULL) - session->opentime),
+		     (long)(gps_clock_time() - session->opentime),
 		     (unsigned int)speed);
 
 	    /* fire the init_query method */
@@ -1444,8 +1661,13 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 	/* Get data from current packet into the fix structure */
 	if (session->lexer.type != COMMENT_PACKET)
 	    if (session->device_type != NULL
-		&& session->device_type->parse_packet != NULL)
+		&& session->device_type->parse_packet != NULL) {
+		GPSD_PROBE3(parse_start, session->gpsdata.dev.path,
+			    session->lexer.type, &session->lexer);
 		received |= session->device_type->parse_packet(session);
+		GPSD_PROBE3(parse_done, session->gpsdata.dev.path,
+			    session->lexer.type, received);
+	    }
 
 #ifdef RECONFIGURE_ENABLE
 	/*
@@ -1490,6 +1712,15 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 	}
 #endif /* NOFLOATS_ENABLE */
 
+	/*
+	 * When the cycle ender carries no data of its own, as with
+	 * u-blox NAV-EOE, the report still has to describe the epoch.
+	 */
+	if ((session->cycle_set & REPORT_IS) != 0
+	    || (session->gpsdata.set & CLEAR_IS) != 0)
+	    session->cycle_set = 0;
+	session->cycle_set |= session->gpsdata.set;
+
 	/* copy/merge device data into staging buffers */
 	if ((session->gpsdata.set & CLEAR_IS) != 0) {
             /* CLEAR_IS should only be set on first sentence of cycle */
@@ -1504,7 +1735,11 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 		      session->gpsdata.set, &session->newdata);
 
 #ifndef NOFLOATS_ENABLE
+	GPSD_PROBE2(error_model_start, session->gpsdata.dev.path,
+		    session->lexer.type);
 	gpsd_error_model(session);
+	GPSD_PROBE2(error_model_done, session->gpsdata.dev.path,
+		    session->lexer.type);
 #endif /* NOFLOATS_ENABLE */
 
 	/*
@@ -1523,6 +1758,7 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 	    if ( session->gpsdata.status > STATUS_NO_FIX) {
 		session->context->fixcnt++;
 		session->fixcnt++;
+		gpsd_assist_fix(session->context, &session->gpsdata);
             } else {
 		session->context->fixcnt = 0;
 		session->fixcnt = 0;
@@ -1534,7 +1770,7 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
 	 * driver errors, including 32-vs.-64-bit problems.
 	 */
 	if ((session->gpsdata.set & TIME_SET) != 0) {
-	    if (session->newdata.time > time(NULL) + (60 * 60 * 24 * 365))
+	    if (session->newdata.time > gps_clock_time() + (60 * 60 * 24 * 365))
 		gpsd_log(&session->context->errout, LOG_WARN,
 			 "date (%.3f) more than a year in the future!\n",
 			 session->newdata.time);
@@ -1552,6 +1788,21 @@ gps_mask_t gpsd_poll(struct gps_device_t *session)
     return 0;
 }
 
+gps_mask_t gpsd_report_mask(const struct gps_device_t *session,
+			    gps_mask_t changed)
+/* the mask gpsd_poll() returned, with REPORT_IS where a report is due */
+{
+    /*
+     * If no reliable end of cycle, must report every time
+     * a sentence changes position or mode. Likely to
+     * cause display jitter.
+     */
+    if (!session->cycle_end_reliable
+	&& (changed & (LATLON_SET | MODE_SET)) != 0)
+	changed |= REPORT_IS;
+    return changed;
+}
+
 int gpsd_multipoll(const bool data_ready,
 		   struct gps_device_t *device,
 		   void (*handler)(struct gps_device_t *, gps_mask_t),
@@ -1577,11 +1828,23 @@ int gpsd_multipoll(const bool data_ready,
 	    if (device->ntrip.conn_state == ntrip_conn_err) {
 		gpsd_log(&device->context->errout, LOG_WARN,
 			 "connection to ntrip server failed\n");
-		device->ntrip.conn_state = ntrip_conn_init;
-		return DEVICE_ERROR;
-	    } else {
-		return DEVICE_READY;
+		if (netgnss_retry(device) < 0) {
+		    device->ntrip.conn_state = ntrip_conn_init;
+		    return DEVICE_ERROR;
+		}
 	    }
+	    return DEVICE_READY;
+	}
+	/* likewise a DGPSIP connect may still be in its helper thread */
+	if (device->servicetype == service_dgpsip
+	    && device->dgpsip.connecting) {
+	    if (dgpsip_advance(device) < 0) {
+		gpsd_log(&device->context->errout, LOG_WARN,
+			 "connection to DGPS server failed\n");
+		if (netgnss_retry(device) < 0)
+		    return DEVICE_ERROR;
+	    }
+	    return DEVICE_READY;
 	}
 #endif /* NETFEED_ENABLE */
 
@@ -1608,21 +1871,22 @@ int gpsd_multipoll(const bool data_ready,
 		    gpsd_log(&device->context->errout, LOG_DATA,
 			     "%s returned zero bytes\n",
 			     device->gpsdata.dev.path);
+#ifdef NETFEED_ENABLE
+		    /*
+		     * A readable DGNSS socket with nothing in it means the
+		     * caster hung up.  Reconnect in the background with
+		     * backoff rather than going through the reawake dance.
+		     */
+		    if (device->servicetype == service_ntrip
+			|| device->servicetype == service_dgpsip) {
+			if (netgnss_retry(device) < 0)
+			    return DEVICE_ERROR;
+			return DEVICE_READY;
+		    }
+#endif /* NETFEED_ENABLE */
 		    if (device->zerokill) {
 			/* failed timeout-and-reawake, kill it */
 			gpsd_deactivate(device);
-			if (device->ntrip.works) {
-			    device->ntrip.works = false; // reset so we try this once only
-			    if (gpsd_activate(device, O_CONTINUE) < 0) {
-				gpsd_log(&device->context->errout, LOG_WARN,
-					 "reconnect to ntrip server failed\n");
-				return DEVICE_ERROR;
-			    } else {
-				gpsd_log(&device->context->errout, LOG_INFO,
-					 "reconnecting to ntrip server\n");
-				return DEVICE_READY;
-			    }
-			}
 		    } else if (reawake_time == 0) {
 			return DEVICE_ERROR;
 		    } else {
@@ -1633,7 +1897,7 @@ int gpsd_multipoll(const bool data_ready,
 			gpsd_log(&device->context->errout, LOG_DATA,
 				 "%s will be repolled in %f seconds\n",
 				 device->gpsdata.dev.path, reawake_time);
-			device->reawake = time(NULL) + reawake_time;
+			device->reawake = gps_clock_time() + reawake_time;
 			return DEVICE_UNREADY;
 		    }
 		}
@@ -1649,6 +1913,9 @@ int gpsd_multipoll(const bool data_ready,
 	    /* we got actual data, head off the reawake special case */
 	    device->zerokill = false;
 	    device->reawake = (time_t)0;
+	    /* ...and a DGNSS service that delivers has earned a fresh backoff */
+	    device->netgnss.backoff = 0;
+	    device->netgnss.attempts = 0;
 
 	    /* must have a full packet to continue */
 	    if ((changed & PACKET_SET) == 0)
@@ -1688,7 +1955,7 @@ int gpsd_multipoll(const bool data_ready,
 #endif /* __future__ */
 	}
     }
-    else if (device->reawake>0 && time(NULL) >device->reawake) {
+    else if (device->reawake>0 && gps_clock_time() >device->reawake) {
 	/* device may have had a zero-length read */
 	gpsd_log(&device->context->errout, LOG_DATA,
 		 "%s reawakened after zero-length read\n",
@@ -1742,7 +2009,7 @@ void ntp_latch(struct gps_device_t *device, struct timedelta_t *td)
     /* this should be an invariant of the way this function is called */
     assert(isfinite(device->newdata.time)!=0);
 
-    (void)clock_gettime(CLOCK_REALTIME, &td->clock);
+    gps_clock_gettime(&td->clock);
     fix_time = device->newdata.time;
 
 #ifdef TIMEHINT_ENABLE
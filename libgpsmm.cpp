@@ -9,6 +9,17 @@
 #include <cstdlib>
 #include "libgpsmm.h"
 
+#if __cplusplus >= 201103L && !defined(USE_QT)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "gps_json.h"
+#endif
+
 struct gps_data_t* gpsmm::gps_inner_open(const char *host, const char *port)
 {
     const bool err = (gps_open(host, port, gps_state()) != 0);
@@ -57,6 +68,13 @@ struct gps_data_t* gpsmm::read(void)
     }
 }
 
+const struct gps_data_t* gpsmm::read_view(void)
+{
+    if (to_user == NULL || gps_read(gps_state(), NULL, 0) <= 0)
+	return NULL;
+    return gps_state();
+}
+
 bool gpsmm::waiting(int timeout)
 {
     return gps_waiting(gps_state(), timeout);
@@ -94,3 +112,306 @@ gpsmm::~gpsmm()
 	delete to_user;
     }
 }
+
+#if __cplusplus >= 201103L && !defined(USE_QT)
+
+gpsmm_mux::gpsmm_mux(unsigned int workers, size_t queue_limit)
+    : limit(queue_limit > 0 ? queue_limit : 1), turn(0), stopping(false)
+{
+    if (pipe(wakeup) == -1)
+	wakeup[0] = wakeup[1] = -1;
+    else
+	for (int i = 0; i < 2; i++)
+	    (void)fcntl(wakeup[i], F_SETFL,
+			fcntl(wakeup[i], F_GETFL) | O_NONBLOCK);
+    if (workers == 0)
+	workers = 1;
+    for (unsigned int i = 0; i < workers; i++)
+	pool.emplace_back(&gpsmm_mux::worker, this);
+}
+
+gpsmm_mux::~gpsmm_mux()
+{
+    {
+	std::lock_guard<std::mutex> guard(lock);
+	stopping = true;
+    }
+    work.notify_all();
+    for (auto &t : pool)
+	t.join();
+    for (auto &c : conns)
+	if (c)
+	    (void)gps_close(&c->data);
+    if (wakeup[0] != -1) {
+	(void)close(wakeup[0]);
+	(void)close(wakeup[1]);
+    }
+}
+
+int gpsmm_mux::add(const char *host, const char *port, int flags)
+{
+    std::unique_ptr<conn_t> c(new conn_t());
+
+    if (gps_open(host, port, &c->data) != 0)
+	return -1;
+    if (gps_stream(&c->data, flags, NULL) == -1) {
+	(void)gps_close(&c->data);
+	return -1;
+    }
+    /* a worker reads until it would block, so it mustn't */
+    (void)fcntl(c->data.gps_fd, F_SETFL,
+		fcntl(c->data.gps_fd, F_GETFL) | O_NONBLOCK);
+    c->id = (int)conns.size();
+    conns.push_back(std::move(c));
+    return conns.back()->id;
+}
+
+void gpsmm_mux::remove(int conn)
+{
+    if (conn < 0 || (size_t)conn >= conns.size() || !conns[conn])
+	return;
+    {
+	/* a worker may be reading it; wait until it's done */
+	std::unique_lock<std::mutex> guard(lock);
+	while (conns[conn]->busy) {
+	    guard.unlock();
+	    std::this_thread::yield();
+	    guard.lock();
+	}
+    }
+    (void)gps_close(&conns[conn]->data);
+    conns[conn].reset();
+}
+
+bool gpsmm_mux::alive(int conn) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return conn >= 0 && (size_t)conn < conns.size() && conns[conn]
+	&& !conns[conn]->dead;
+}
+
+size_t gpsmm_mux::pending(int conn) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (conn < 0 || (size_t)conn >= conns.size() || !conns[conn])
+	return 0;
+    return conns[conn]->events.size();
+}
+
+bool gpsmm_mux::throttled(int conn) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (conn < 0 || (size_t)conn >= conns.size() || !conns[conn])
+	return false;
+    return conns[conn]->events.size() >= limit;
+}
+
+void gpsmm_mux::fds(std::vector<int> &out) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    out.clear();
+    if (wakeup[0] != -1)
+	out.push_back(wakeup[0]);
+    for (auto &c : conns)
+	if (c && !c->dead && !c->busy && c->events.size() < limit)
+	    out.push_back(c->data.gps_fd);
+}
+
+void gpsmm_mux::schedule(conn_t *c)
+/* hand a connection to the workers; call with the lock held */
+{
+    c->busy = true;
+    c->backlog = false;
+    jobs.push_back(c);
+    work.notify_one();
+}
+
+void gpsmm_mux::ready(int fd)
+{
+    ready(fd, false);
+}
+
+void gpsmm_mux::ready(int fd, bool hangup)
+{
+    if (fd == wakeup[0]) {
+	drain_wakeup();
+	return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &c : conns)
+	if (c && c->data.gps_fd == fd && !c->dead && !c->busy
+	    && c->events.size() < limit) {
+	    c->hangup = c->hangup || hangup;
+	    schedule(c.get());
+	    break;
+	}
+}
+
+void gpsmm_mux::drain_wakeup(void)
+{
+    char junk[64];
+
+    while (read(wakeup[0], junk, sizeof(junk)) > 0)
+	continue;
+}
+
+int gpsmm_mux::run_once(int timeout)
+{
+    std::vector<int> watch;
+    std::vector<struct pollfd> pfd;
+    int count = 0;
+
+    {
+	/* resume connections that stopped with whole lines buffered */
+	std::lock_guard<std::mutex> guard(lock);
+	bool live = false;
+
+	for (auto &c : conns) {
+	    if (!c || c->dead)
+		continue;
+	    live = true;
+	    if (c->backlog && !c->busy && c->events.size() < limit) {
+		schedule(c.get());
+		count++;
+	    }
+	}
+	if (!live) {
+	    bool busy = false;
+	    for (auto &c : conns)
+		if (c && c->busy)
+		    busy = true;
+	    if (!busy)
+		return -1;
+	}
+    }
+    fds(watch);
+    for (int fd : watch) {
+	struct pollfd p;
+
+	p.fd = fd;
+	p.events = POLLIN;
+	p.revents = 0;
+	pfd.push_back(p);
+    }
+    if (poll(pfd.data(), pfd.size(), count > 0 ? 0 : timeout) <= 0)
+	return count;
+    for (auto &p : pfd)
+	if ((p.revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+	    ready(p.fd, (p.revents & (POLLHUP | POLLERR)) != 0);
+	    if (p.fd != wakeup[0])
+		count++;
+	}
+    return count;
+}
+
+bool gpsmm_mux::next(struct gps_event &event)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    /* take turns, so one chatty daemon can't starve the others */
+    for (size_t i = 0; i < conns.size(); i++) {
+	conn_t *c = conns[(turn + i) % conns.size()].get();
+
+	if (c == NULL || c->events.empty())
+	    continue;
+	event = std::move(c->events.front());
+	c->events.pop_front();
+	turn = (turn + i + 1) % conns.size();
+	return true;
+    }
+    return false;
+}
+
+static bool hung_up(int fd)
+/* has the other end closed, or the connection failed? */
+{
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK);
+
+    return n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK
+		      && errno != EINTR);
+}
+
+void gpsmm_mux::parse(conn_t *c)
+/* read a connection until it runs dry or its queue fills */
+{
+    char line[GPS_JSON_RESPONSE_MAX];
+    int status;
+
+    for (;;) {
+	{
+	    std::lock_guard<std::mutex> guard(lock);
+	    if (c->events.size() >= limit) {
+		c->backlog = true;
+		return;
+	    }
+	}
+	status = gps_read(&c->data, line, (int)sizeof(line));
+	if (status < 0) {
+	    std::lock_guard<std::mutex> guard(lock);
+	    c->dead = true;
+	    return;
+	}
+	if (status == 0) {
+	    /*
+	     * No whole line yet.  gps_read() only reports end of file
+	     * with nothing buffered, so a daemon that went away in the
+	     * middle of a line would leave the fd readable forever.
+	     */
+	    if (c->hangup || hung_up(c->data.gps_fd)) {
+		std::lock_guard<std::mutex> guard(lock);
+		c->dead = true;
+	    }
+	    return;
+	}
+
+	struct gps_event ev;
+	ev.conn = c->id;
+	ev.device = c->data.dev.path;
+	if (strstr(line, "\"class\":\"TPV\"") != NULL) {
+	    ev.kind = gps_event::TPV;
+	    ev.status = c->data.status;
+	    ev.fix = c->data.fix;
+	} else if (strstr(line, "\"class\":\"SKY\"") != NULL) {
+	    ev.kind = gps_event::SKY;
+	    ev.dop = c->data.dop;
+	    ev.skyview.assign(c->data.skyview,
+			      c->data.skyview + c->data.satellites_visible);
+	} else if (strstr(line, "\"class\":\"AIS\"") != NULL) {
+	    ev.kind = gps_event::AIS;
+	    ev.ais.reset(new struct ais_t(c->data.ais));
+	} else
+	    continue;
+	std::lock_guard<std::mutex> guard(lock);
+	c->events.push_back(std::move(ev));
+    }
+}
+
+void gpsmm_mux::worker(void)
+{
+    for (;;) {
+	conn_t *c;
+	{
+	    std::unique_lock<std::mutex> guard(lock);
+	    work.wait(guard, [this] { return stopping || !jobs.empty(); });
+	    if (stopping)
+		return;
+	    c = jobs.front();
+	    jobs.pop_front();
+	}
+	parse(c);
+	{
+	    std::lock_guard<std::mutex> guard(lock);
+	    c->busy = false;
+	}
+	/* get the reactor to watch this connection again */
+	if (wakeup[1] != -1 && write(wakeup[1], "", 1) != 1)
+	    continue;	/* pipe full, so the reactor is awake anyway */
+    }
+}
+
+#endif // __cplusplus >= 201103L && !USE_QT
@@ -11,6 +11,29 @@
 #include <sys/types.h>
 #include "gps.h" //the C library we are going to wrap
 
+#if __cplusplus >= 201103L
+#include <memory>
+
+// A copy of the client state that stays valid across reads.  It can be
+// moved but not copied, so keeping one costs exactly one structure copy.
+class gps_snapshot {
+	public:
+		gps_snapshot() : data() {}
+		explicit gps_snapshot(const struct gps_data_t &from)
+			: data(new struct gps_data_t(from)) {}
+		gps_snapshot(gps_snapshot &&) = default;
+		gps_snapshot &operator=(gps_snapshot &&) = default;
+		gps_snapshot(const gps_snapshot &) = delete;
+		gps_snapshot &operator=(const gps_snapshot &) = delete;
+		explicit operator bool() const { return data != nullptr; }
+		const struct gps_data_t &operator*() const { return *data; }
+		const struct gps_data_t *operator->() const { return data.get(); }
+		const struct gps_data_t *get() const { return data.get(); }
+	private:
+		std::unique_ptr<struct gps_data_t> data;
+};
+#endif // __cplusplus >= 201103L
+
 #ifndef USE_QT
 class gpsmm {
 #else
@@ -46,6 +69,35 @@ class LIBQGPSMMSHARED_EXPORT gpsmm {
 		void clear_fix(void);
 		void enable_debug(int, FILE*);
 		bool is_open(void);	// check for constructor success
+
+		// The calls below hand out the client state itself instead of
+		// a copy.  What they return is read-only and good until the
+		// next read.
+		const struct gps_data_t* read_view(void); //block until gpsd returns new data, then return the state
+		const struct gps_data_t* view(void) const { //the state as of the last read
+			return to_user != NULL ? &_gps_state : NULL;
+		}
+		gps_mask_t changed(void) const { return _gps_state.set; } //what the last read set
+		bool changed(gps_mask_t mask) const { return (_gps_state.set & mask) != 0; }
+		// read one message and, if it set anything in mask, pass the
+		// state to callback(const struct gps_data_t &); returns what
+		// gps_read() did
+		template <class Callback>
+		int dispatch(gps_mask_t mask, Callback callback) {
+			int status;
+
+			if (to_user == NULL)
+				return -1;
+			status = gps_read(gps_state(), NULL, 0);
+			if (status > 0 && changed(mask))
+				callback(static_cast<const struct gps_data_t &>(_gps_state));
+			return status;
+		}
+#if __cplusplus >= 201103L
+		gps_snapshot snapshot(void) const { //keep a copy past the next read
+			return to_user != NULL ? gps_snapshot(_gps_state) : gps_snapshot();
+		}
+#endif
 	private:
 		struct gps_data_t *to_user;	//we return the user a copy of the internal structure. This way she can modify it without
 						//integrity loss for the entire class
@@ -55,4 +107,90 @@ class LIBQGPSMMSHARED_EXPORT gpsmm {
 		struct gps_data_t * gps_state() { return &_gps_state; }
 		struct gps_data_t* backup(void) { *to_user=*gps_state(); return to_user;}; //return the backup copy
 };
+
+#if __cplusplus >= 201103L && !defined(USE_QT)
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One report from one of the daemons a gpsmm_mux listens to.  Only the
+// members belonging to its kind are filled in.
+struct gps_event {
+	enum kind_t { TPV, SKY, AIS } kind;
+	int conn;				// the connection, as add() returned it
+	std::string device;			// the device that reported it
+	int status;				// TPV
+	struct gps_fix_t fix;			// TPV
+	struct dop_t dop;			// SKY
+	std::vector<struct satellite_t> skyview;	// SKY
+	std::unique_ptr<struct ais_t> ais;	// AIS
+};
+
+// Many gpsd sessions served by one reactor and a small pool of parsing
+// threads.  Reports of each connection come out in the order its
+// daemon sent them; no order is kept between connections.  A
+// connection with queue_limit events not yet taken by next() isn't
+// read until the caller catches up, which leaves the daemon to queue
+// or drop data for it as it would for any slow client.
+//
+// add(), remove(), run_once(), next() and the reactor calls are to be
+// made from one thread; only the parsing happens elsewhere.
+class gpsmm_mux {
+	public:
+		explicit gpsmm_mux(unsigned int workers = 2, size_t queue_limit = 256);
+		~gpsmm_mux();
+		gpsmm_mux(const gpsmm_mux &) = delete;
+		gpsmm_mux &operator=(const gpsmm_mux &) = delete;
+
+		int add(const char *host, const char *port,
+			int flags = WATCH_ENABLE | WATCH_JSON);	//returns a connection number, or -1
+		void remove(int conn);
+		bool alive(int conn) const;	//still connected to its daemon?
+		size_t pending(int conn) const;	//events waiting for next()
+		bool throttled(int conn) const;	//not being read until next() catches up
+
+		// the built-in reactor: wait up to timeout milliseconds for
+		// input and hand it to the workers; returns how many
+		// connections were handed over, or -1 when none are left
+		int run_once(int timeout);
+		bool next(struct gps_event &event);	//take the next event, if any
+
+		// For callers with their own reactor: watch what fds()
+		// lists for readability, including the wakeup descriptor,
+		// and call ready() for each that is.  A connection's fd is
+		// left out while it is being read or is throttled.
+		void fds(std::vector<int> &out) const;
+		int wakeup_fd(void) const { return wakeup[0]; }
+		void ready(int fd);
+
+	private:
+		struct conn_t {
+			int id;
+			struct gps_data_t data;
+			std::deque<struct gps_event> events;
+			bool busy;		//with a worker
+			bool backlog;		//stopped reading with lines buffered
+			bool hangup;		//poll() saw the daemon hang up
+			bool dead;
+		};
+		std::vector<std::unique_ptr<conn_t>> conns;
+		std::deque<conn_t *> jobs;
+		std::vector<std::thread> pool;
+		mutable std::mutex lock;
+		std::condition_variable work;
+		size_t limit;
+		size_t turn;			//where next() looks first
+		int wakeup[2];			//workers poke the reactor here
+		bool stopping;
+
+		void schedule(conn_t *c);
+		void ready(int fd, bool hangup);
+		void parse(conn_t *c);
+		void worker(void);
+		void drain_wakeup(void);
+};
+#endif // __cplusplus >= 201103L && !USE_QT
 #endif // _GPSD_GPSMM_H_
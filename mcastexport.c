@@ -0,0 +1,273 @@
+/****************************************************************************
+
+NAME
+   mcastexport.c - export JSON reports to UDP multicast groups
+
+DESCRIPTION
+   gps2udp can forward a client's view of gpsd to one UDP destination,
+but it is an extra process that re-reads and re-sends every line.  This
+module lets the daemon itself send selected report classes of a device
+to a multicast group.  Each report is rendered once per cycle and
+sent once per group, however many listeners have joined.
+
+   Every datagram carries one JSON report with a "seq" member, counting
+up per target, appended as its last member.  Receivers can use
+it to detect loss.
+
+   A target is specified as
+
+	group:port[,CLASS...][@device]
+
+where group is an IPv4 or bracketed IPv6 multicast address, the CLASS
+list (TPV, SKY, GST, ATT, SUBFRAME, RAW, RTCM2, RTCM3, AIS, OSC)
+defaults to all of them, and a device path limits the target to reports
+from that device.
+
+PERMISSIONS
+   This file is Copyright (c) 2019 by the GPSD project
+   SPDX-License-Identifier: BSD-2-clause
+
+***************************************************************************/
+
+#include "gpsd_config.h"  /* must be before all includes */
+
+#ifdef MCAST_EXPORT_ENABLE
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "gpsd.h"
+#include "gps_json.h"		/* needs gpsd.h */
+#include "strfuncs.h"
+
+struct mcast_target_t {
+    socket_t fd;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    gps_mask_t classes;
+    char devpath[GPS_PATH_MAX];	/* empty means every device */
+    unsigned long seq;
+};
+
+static struct mcast_target_t targets[MCAST_TARGETS];
+static int ntargets;
+
+static const struct {
+    const char *name;
+    gps_mask_t mask;
+} mcast_classes[] = {
+    {"TPV",		REPORT_IS},
+    {"SKY",		SATELLITE_SET},
+    {"GST",		GST_SET},
+    {"ATT",		ATTITUDE_SET},
+    {"SUBFRAME",	SUBFRAME_SET},
+    {"RAW",		RAW_IS},
+    {"RTCM2",		RTCM2_SET},
+    {"RTCM3",		RTCM3_SET},
+    {"AIS",		AIS_SET},
+    {"OSC",		OSCILLATOR_SET},
+};
+
+static gps_mask_t mcast_class(const char *name, size_t len)
+/* map a report class name to the mask bit that triggers it */
+{
+    int i;
+
+    for (i = 0; i < NITEMS(mcast_classes); i++)
+	if (strlen(mcast_classes[i].name) == len
+	    && strncmp(mcast_classes[i].name, name, len) == 0)
+	    return mcast_classes[i].mask;
+    return 0;
+}
+
+bool mcast_add(struct gps_context_t *context, const char *spec)
+/* parse a target specification and open its socket */
+{
+    struct mcast_target_t *tp;
+    char copy[GPS_PATH_MAX * 2], *group, *port, *classes, *device;
+    struct addrinfo hints, *result;
+    int ttl = MCAST_TTL, status;
+
+    if (ntargets >= MCAST_TARGETS) {
+	gpsd_log(&context->errout, LOG_ERROR,
+		 "too many multicast targets, %s ignored\n", spec);
+	return false;
+    }
+    tp = &targets[ntargets];
+    (void)strlcpy(copy, spec, sizeof(copy));
+
+    if ((device = strchr(copy, '@')) != NULL)
+	*device++ = '\0';
+    if ((classes = strchr(copy, ',')) != NULL)
+	*classes++ = '\0';
+    group = copy;
+    if (*group == '[') {
+	char *close = strchr(++group, ']');
+	if (close == NULL) {
+	    gpsd_log(&context->errout, LOG_ERROR,
+		     "bad multicast group in %s\n", spec);
+	    return false;
+	}
+	*close = '\0';
+	port = (close[1] == ':') ? close + 2 : NULL;
+    } else if ((port = strrchr(group, ':')) != NULL)
+	*port++ = '\0';
+    if (port == NULL || *port == '\0') {
+	gpsd_log(&context->errout, LOG_ERROR,
+		 "multicast target %s has no port\n", spec);
+	return false;
+    }
+
+    tp->classes = 0;
+    if (classes == NULL || *classes == '\0') {
+	int i;
+	for (i = 0; i < NITEMS(mcast_classes); i++)
+	    tp->classes |= mcast_classes[i].mask;
+    } else {
+	char *cp, *next;
+	for (cp = classes; cp != NULL; cp = next) {
+	    gps_mask_t mask;
+	    if ((next = strchr(cp, ',')) != NULL)
+		*next++ = '\0';
+	    if ((mask = mcast_class(cp, strlen(cp))) == 0) {
+		gpsd_log(&context->errout, LOG_ERROR,
+			 "unknown report class %s in %s\n", cp, spec);
+		return false;
+	    }
+	    tp->classes |= mask;
+	}
+    }
+    tp->devpath[0] = '\0';
+    if (device != NULL)
+	(void)strlcpy(tp->devpath, device, sizeof(tp->devpath));
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST;
+    if ((status = getaddrinfo(group, port, &hints, &result)) != 0) {
+	gpsd_log(&context->errout, LOG_ERROR,
+		 "multicast group %s: %s\n", spec, gai_strerror(status));
+	return false;
+    }
+    tp->fd = socket(result->ai_family, SOCK_DGRAM, 0);
+    if (BAD_SOCKET(tp->fd)) {
+	gpsd_log(&context->errout, LOG_ERROR,
+		 "multicast socket: %s\n", strerror(errno));
+	freeaddrinfo(result);
+	return false;
+    }
+    memcpy(&tp->addr, result->ai_addr, result->ai_addrlen);
+    tp->addrlen = result->ai_addrlen;
+    if (result->ai_family == AF_INET)
+	status = setsockopt(tp->fd, IPPROTO_IP, IP_MULTICAST_TTL,
+			    &ttl, sizeof(ttl));
+#ifdef IPV6_ENABLE
+    else if (result->ai_family == AF_INET6)
+	status = setsockopt(tp->fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+			    &ttl, sizeof(ttl));
+#endif /* IPV6_ENABLE */
+    freeaddrinfo(result);
+    if (status != 0)
+	gpsd_log(&context->errout, LOG_WARN,
+		 "can't set multicast TTL on %s: %s\n", spec, strerror(errno));
+
+    tp->seq = 0;
+    ntargets++;
+    gpsd_log(&context->errout, LOG_INF,
+	     "multicast export to %s:%s, mask %s\n",
+	     group, port, gps_maskdump(tp->classes));
+    return true;
+}
+
+static void mcast_send(struct mcast_target_t *tp, const char *line, size_t len)
+/* send one report, with the target's sequence number spliced in */
+{
+    char suffix[32];
+    struct iovec iov[2];
+    struct msghdr msg;
+
+    /*
+     * Add the member at the end, not the start: libgps stops
+     * unpacking an object at the first member it doesn't know.
+     */
+    if (len < 3 || strncmp(line + len - 3, "}\r\n", 3) != 0)
+	return;
+    (void)snprintf(suffix, sizeof(suffix), ",\"seq\":%lu}\r\n", tp->seq++);
+    iov[0].iov_base = (void *)line;
+    iov[0].iov_len = len - 3;		/* drop the closing brace */
+    iov[1].iov_base = suffix;
+    iov[1].iov_len = strlen(suffix);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &tp->addr;
+    msg.msg_namelen = tp->addrlen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    /* datagrams are fire-and-forget; a full socket buffer is a loss */
+    (void)sendmsg(tp->fd, &msg, MSG_DONTWAIT);
+}
+
+void mcast_report(const struct gps_device_t *device, gps_mask_t changed)
+/* render this cycle's reports once and send them to the targets */
+{
+    static const struct gps_policy_t policy = {.json = true};
+    char buf[GPS_JSON_RESPONSE_MAX * 4];
+    gps_mask_t wanted = 0;
+    struct mcast_target_t *tp;
+    char *line, *end;
+
+    for (tp = targets; tp < targets + ntargets; tp++)
+	if (tp->devpath[0] == '\0'
+	    || strcmp(tp->devpath, device->gpsdata.dev.path) == 0)
+	    wanted |= tp->classes;
+    if ((changed &= wanted) == 0)
+	return;
+
+    /* same rule as for socket watchers without split24 */
+    if ((changed & AIS_SET) != 0 && device->gpsdata.ais.type == 24
+	&& device->gpsdata.ais.type24.part != both)
+	changed &= ~AIS_SET;
+
+    json_data_report(changed, device, &policy, buf, sizeof(buf));
+
+    for (line = buf; *line == '{'; line = end) {
+	const char *name = line + sizeof("{\"class\":\"") - 1;
+	gps_mask_t mask = 0;
+
+	if ((end = strstr(line, "\r\n")) == NULL)
+	    break;
+	end += 2;
+	if (str_starts_with(line, "{\"class\":\"")) {
+	    const char *quote = strchr(name, '"');
+	    if (quote != NULL)
+		mask = mcast_class(name, (size_t)(quote - name));
+	}
+	for (tp = targets; tp < targets + ntargets; tp++)
+	    if ((tp->classes & mask) != 0
+		&& (tp->devpath[0] == '\0'
+		    || strcmp(tp->devpath, device->gpsdata.dev.path) == 0))
+		mcast_send(tp, line, (size_t)(end - line));
+    }
+}
+
+void mcast_release(void)
+/* close all multicast sockets */
+{
+    struct mcast_target_t *tp;
+
+    for (tp = targets; tp < targets + ntargets; tp++)
+	(void)close(tp->fd);
+    ntargets = 0;
+}
+
+#endif /* MCAST_EXPORT_ENABLE */
+
+/* mcastexport.c ends here */
@@ -0,0 +1,457 @@
+/* net_caster.c -- serve RTCM corrections to Ntrip clients
+ *
+ * gpsd already collects RTCM2/RTCM3 from attached devices and from
+ * Ntrip/DGPSIP feeds, but could only push it into its own receivers.
+ * This module lets the daemon act as a small Ntrip caster, so rovers
+ * on a LAN can take corrections straight from it.
+ *
+ * Every device that has delivered RTCM is offered as a mountpoint
+ * named after the last component of its path.  A request for "/" or
+ * for an unknown mountpoint gets a generated sourcetable.  Both Ntrip
+ * 1.0 and 2.0 requests are answered; 2.0 responses are plain HTTP/1.1
+ * bodies delimited by connection close.
+ *
+ * Frames are sent to each client directly out of the lexer's output
+ * buffer.  Only a client that cannot keep up gets a copy, in a bounded
+ * per-client queue that is drained ahead of the next frame.  Whole
+ * frames are dropped when that queue fills, so a slow rover never sees
+ * a torn frame, and a client that keeps overflowing it is disconnected.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+
+#include "gpsd_config.h"  /* must be before all includes */
+
+#ifdef NTRIP_ENABLE
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gpsd.h"
+#include "strfuncs.h"
+
+#define CASTER_REQUEST_MAX	1024	/* longest request header we accept */
+#define CASTER_DROP_LIMIT	32	/* frames dropped before we give up */
+
+struct caster_client_t {
+    socket_t fd;			/* UNALLOCATED_FD if slot is free */
+    enum {caster_request, caster_streaming} state;
+    const struct gps_device_t *device;	/* mountpoint being served */
+    bool v2;				/* client asked for Ntrip 2.0 */
+    char request[CASTER_REQUEST_MAX];
+    size_t reqlen;
+    /* backlog of frames the client couldn't take right away */
+    unsigned char queue[CASTER_QUEUE];
+    size_t qhead, qlen;
+    unsigned long dropped;
+};
+
+/* what we know about each device that has fed us RTCM */
+struct caster_mount_t {
+    const struct gps_device_t *device;
+    int format;				/* 2 or 3, RTCM major version */
+    unsigned long frames;
+};
+
+static struct gps_context_t *caster_context;
+static void (*caster_fdhook)(socket_t, bool);
+static struct caster_client_t clients[CASTER_CLIENTS];
+static struct caster_mount_t mounts[MAX_DEVICES];
+
+static void caster_mountname(const struct gps_device_t *device,
+			     char *buf, size_t len)
+/* derive a mountpoint name from a device path */
+{
+    const char *base = strrchr(device->gpsdata.dev.path, '/');
+    char *cp;
+
+    base = (base == NULL) ? device->gpsdata.dev.path : base + 1;
+    (void)strlcpy(buf, base, len);
+    /* mountpoints travel in request lines and sourcetable fields */
+    for (cp = buf; *cp != '\0'; cp++)
+	if (!isalnum((unsigned char)*cp) && *cp != '-' && *cp != '_')
+	    *cp = '_';
+}
+
+static struct caster_mount_t *caster_mount(const struct gps_device_t *device)
+/* find the mount table entry for a device, if it has served RTCM */
+{
+    struct caster_mount_t *mp;
+
+    for (mp = mounts; mp < mounts + MAX_DEVICES; mp++)
+	if (mp->device == device && device->gpsdata.dev.path[0] != '\0')
+	    return mp;
+    return NULL;
+}
+
+void caster_init(struct gps_context_t *context,
+		 void (*fdhook)(socket_t, bool))
+/* prepare the caster; fdhook adds or removes a descriptor from select */
+{
+    struct caster_client_t *cp;
+
+    caster_context = context;
+    caster_fdhook = fdhook;
+    for (cp = clients; cp < clients + CASTER_CLIENTS; cp++)
+	cp->fd = UNALLOCATED_FD;
+    memset(mounts, '\0', sizeof(mounts));
+}
+
+static void caster_detach(struct caster_client_t *cp, const char *why)
+{
+    gpsd_log(&caster_context->errout, LOG_INF,
+	     "caster: dropping client on fd %d: %s (%lu frames dropped)\n",
+	     cp->fd, why, cp->dropped);
+    caster_fdhook(cp->fd, false);
+    (void)shutdown(cp->fd, SHUT_RDWR);
+    (void)close(cp->fd);
+    cp->fd = UNALLOCATED_FD;
+}
+
+bool caster_attach(socket_t fd)
+/* take over a freshly accepted Ntrip client connection */
+{
+    struct caster_client_t *cp;
+
+    for (cp = clients; cp < clients + CASTER_CLIENTS; cp++)
+	if (cp->fd == UNALLOCATED_FD) {
+	    cp->fd = fd;
+	    cp->state = caster_request;
+	    cp->device = NULL;
+	    cp->v2 = false;
+	    cp->reqlen = 0;
+	    cp->qhead = cp->qlen = 0;
+	    cp->dropped = 0;
+	    caster_fdhook(fd, true);
+	    gpsd_log(&caster_context->errout, LOG_INF,
+		     "caster: client %s connected on fd %d\n",
+		     netlib_sock2ip(fd), fd);
+	    return true;
+	}
+    gpsd_log(&caster_context->errout, LOG_ERROR,
+	     "caster: no slot for client on fd %d\n", fd);
+    return false;
+}
+
+static bool caster_send(struct caster_client_t *cp, const char *buf,
+			size_t len)
+/* ship a response header or sourcetable; these always fit the socket */
+{
+    if (send(cp->fd, buf, len, 0) != (ssize_t)len) {
+	caster_detach(cp, "short write");
+	return false;
+    }
+    return true;
+}
+
+static size_t caster_sourcetable(char *buf, size_t len)
+/* generate a sourcetable body describing every live mountpoint */
+{
+    struct caster_mount_t *mp;
+
+    buf[0] = '\0';
+    for (mp = mounts; mp < mounts + MAX_DEVICES; mp++) {
+	const struct gps_device_t *dp = mp->device;
+	char name[GPS_PATH_MAX];
+	double lat = 0.0, lon = 0.0;
+
+	if (dp == NULL || dp->gpsdata.dev.path[0] == '\0')
+	    continue;
+	caster_mountname(dp, name, sizeof(name));
+	if (isfinite(dp->gpsdata.fix.latitude) != 0
+	    && isfinite(dp->gpsdata.fix.longitude) != 0) {
+	    lat = dp->gpsdata.fix.latitude;
+	    lon = dp->gpsdata.fix.longitude;
+	}
+	/* mountpoint;identifier;format;details;carrier;navsys;network;
+	 * country;lat;lon;nmea;solution;generator;compr;auth;fee;bitrate */
+	str_appendf(buf, len,
+		    "STR;%s;%s;RTCM %d;;0;GPS;gpsd;;%.2f;%.2f;0;0;"
+		    "gpsd %s;none;N;N;0;\r\n",
+		    name, dp->gpsdata.dev.path, mp->format,
+		    lat, lon, VERSION);
+    }
+    (void)strlcat(buf, "ENDSOURCETABLE\r\n", len);
+    return strlen(buf);
+}
+
+static void caster_reply_sourcetable(struct caster_client_t *cp, bool found)
+{
+    char body[BUFSIZ], head[BUFSIZ];
+    size_t blen = caster_sourcetable(body, sizeof(body));
+
+    if (cp->v2 && !found)
+	(void)snprintf(head, sizeof(head),
+		       "HTTP/1.1 404 Not Found\r\n"
+		       "Ntrip-Version: Ntrip/2.0\r\n"
+		       "Server: NTRIP gpsd/%s\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", VERSION);
+    else if (cp->v2)
+	(void)snprintf(head, sizeof(head),
+		       "HTTP/1.1 200 OK\r\n"
+		       "Ntrip-Version: Ntrip/2.0\r\n"
+		       "Server: NTRIP gpsd/%s\r\n"
+		       "Content-Type: gnss/sourcetable\r\n"
+		       "Content-Length: %zu\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", VERSION, blen);
+    else
+	(void)snprintf(head, sizeof(head),
+		       "SOURCETABLE 200 OK\r\n"
+		       "Server: NTRIP gpsd/%s\r\n"
+		       "Content-Type: text/plain\r\n"
+		       "Content-Length: %zu\r\n"
+		       "\r\n", VERSION, blen);
+    if (!caster_send(cp, head, strlen(head)))
+	return;
+    if (!cp->v2 || found)
+	if (!caster_send(cp, body, blen))
+	    return;
+    caster_detach(cp, "sourcetable sent");
+}
+
+static void caster_request_parse(struct caster_client_t *cp,
+				 struct gps_device_t *devices, size_t ndevices)
+/* act on a complete request header */
+{
+    char *mount, *end;
+    struct gps_device_t *dp;
+    char head[BUFSIZ];
+
+    cp->v2 = strstr(cp->request, "Ntrip-Version: Ntrip/2") != NULL;
+    if (!str_starts_with(cp->request, "GET /")) {
+	(void)snprintf(head, sizeof(head),
+		       "HTTP/1.1 400 Bad Request\r\n"
+		       "Server: NTRIP gpsd/%s\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", VERSION);
+	if (caster_send(cp, head, strlen(head)))
+	    caster_detach(cp, "bad request");
+	return;
+    }
+    mount = cp->request + 5;
+    if ((end = strpbrk(mount, " \r\n")) != NULL)
+	*end = '\0';
+    gpsd_log(&caster_context->errout, LOG_PROG,
+	     "caster: fd %d requests \"%s\" (Ntrip %d)\n",
+	     cp->fd, mount, cp->v2 ? 2 : 1);
+
+    if (mount[0] == '\0') {
+	caster_reply_sourcetable(cp, true);
+	return;
+    }
+    for (dp = devices; dp < devices + ndevices; dp++) {
+	char name[GPS_PATH_MAX];
+
+	if (caster_mount(dp) == NULL)
+	    continue;
+	caster_mountname(dp, name, sizeof(name));
+	if (strcmp(name, mount) == 0)
+	    break;
+    }
+    if (dp >= devices + ndevices) {
+	caster_reply_sourcetable(cp, false);
+	return;
+    }
+
+    if (cp->v2)
+	(void)snprintf(head, sizeof(head),
+		       "HTTP/1.1 200 OK\r\n"
+		       "Ntrip-Version: Ntrip/2.0\r\n"
+		       "Server: NTRIP gpsd/%s\r\n"
+		       "Content-Type: gnss/data\r\n"
+		       "Cache-Control: no-store, no-cache, max-age=0\r\n"
+		       "Pragma: no-cache\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", VERSION);
+    else
+	(void)strlcpy(head, "ICY 200 OK\r\n", sizeof(head));
+    if (!caster_send(cp, head, strlen(head)))
+	return;
+    cp->device = dp;
+    cp->state = caster_streaming;
+}
+
+void caster_poll(fd_set *rfds, struct gps_device_t *devices, size_t ndevices)
+/* service caster clients whose descriptors select() flagged */
+{
+    struct caster_client_t *cp;
+
+    for (cp = clients; cp < clients + CASTER_CLIENTS; cp++) {
+	ssize_t rd;
+
+	if (cp->fd == UNALLOCATED_FD || !FD_ISSET(cp->fd, rfds))
+	    continue;
+	if (cp->state == caster_streaming) {
+	    /* rovers may upload GGA; we have no use for it */
+	    char discard[BUFSIZ];
+	    if ((rd = recv(cp->fd, discard, sizeof(discard), 0)) <= 0) {
+		if (rd == 0 || (errno != EAGAIN && errno != EINTR))
+		    caster_detach(cp, "hangup");
+	    } else
+		gpsd_log(&caster_context->errout, LOG_IO,
+			 "caster: ignoring %zd bytes from fd %d\n",
+			 rd, cp->fd);
+	    continue;
+	}
+	rd = recv(cp->fd, cp->request + cp->reqlen,
+		  sizeof(cp->request) - 1 - cp->reqlen, 0);
+	if (rd <= 0) {
+	    if (rd == 0 || (errno != EAGAIN && errno != EINTR))
+		caster_detach(cp, "hangup during request");
+	    continue;
+	}
+	cp->reqlen += (size_t)rd;
+	cp->request[cp->reqlen] = '\0';
+	if (strstr(cp->request, "\r\n\r\n") != NULL
+	    || strstr(cp->request, "\n\n") != NULL)
+	    caster_request_parse(cp, devices, ndevices);
+	else if (cp->reqlen >= sizeof(cp->request) - 1)
+	    caster_detach(cp, "oversized request");
+    }
+}
+
+static void caster_enqueue(struct caster_client_t *cp,
+			   const unsigned char *buf, size_t len)
+/* append to a client's backlog; caller has checked it fits */
+{
+    size_t tail = (cp->qhead + cp->qlen) % CASTER_QUEUE;
+    size_t first = CASTER_QUEUE - tail;
+
+    if (first > len)
+	first = len;
+    memcpy(cp->queue + tail, buf, first);
+    memcpy(cp->queue, buf + first, len - first);
+    cp->qlen += len;
+}
+
+static bool caster_flush(struct caster_client_t *cp)
+/* push out as much backlog as the socket takes; false if client died */
+{
+    while (cp->qlen > 0) {
+	size_t chunk = CASTER_QUEUE - cp->qhead;
+	ssize_t sent;
+
+	if (chunk > cp->qlen)
+	    chunk = cp->qlen;
+	sent = send(cp->fd, cp->queue + cp->qhead, chunk, 0);
+	if (sent < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return true;
+	    caster_detach(cp, strerror(errno));
+	    return false;
+	}
+	cp->qhead = (cp->qhead + (size_t)sent) % CASTER_QUEUE;
+	cp->qlen -= (size_t)sent;
+	if ((size_t)sent < chunk)
+	    return true;
+    }
+    cp->qhead = 0;
+    return true;
+}
+
+void caster_relay(const struct gps_device_t *device, gps_mask_t changed)
+/* fan the RTCM frame now in the lexer out to every client of its mount */
+{
+    const unsigned char *frame = device->lexer.outbuffer;
+    size_t len = device->lexer.outbuflen;
+    struct caster_mount_t *mp;
+    struct caster_client_t *cp;
+
+    if (caster_context == NULL)
+	return;			/* no -C, so nobody to serve */
+    if ((mp = caster_mount(device)) == NULL) {
+	for (mp = mounts; mp < mounts + MAX_DEVICES; mp++)
+	    if (mp->device == NULL || mp->device->gpsdata.dev.path[0] == '\0')
+		break;
+	if (mp >= mounts + MAX_DEVICES)
+	    return;
+	mp->device = device;
+	mp->frames = 0;
+	gpsd_log(&caster_context->errout, LOG_INF,
+		 "caster: %s now offered as a mountpoint\n",
+		 device->gpsdata.dev.path);
+    }
+    mp->format = ((changed & RTCM3_SET) != 0) ? 3 : 2;
+    mp->frames++;
+
+    for (cp = clients; cp < clients + CASTER_CLIENTS; cp++) {
+	ssize_t sent;
+
+	if (cp->fd == UNALLOCATED_FD || cp->state != caster_streaming
+	    || cp->device != device)
+	    continue;
+	if (cp->qlen > 0 && !caster_flush(cp))
+	    continue;
+	if (cp->qlen > 0) {
+	    /* still backlogged; queue the whole frame or none of it */
+	    if (cp->qlen + len > CASTER_QUEUE) {
+		if (++cp->dropped > CASTER_DROP_LIMIT)
+		    caster_detach(cp, "too slow");
+		continue;
+	    }
+	    caster_enqueue(cp, frame, len);
+	    continue;
+	}
+	/* the common case: straight out of the lexer, no copy */
+	sent = send(cp->fd, frame, len, 0);
+	if (sent < 0) {
+	    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		caster_detach(cp, strerror(errno));
+		continue;
+	    }
+	    sent = 0;
+	}
+	/* the rest of a partly sent frame must reach the client intact */
+	if ((size_t)sent < len)
+	    caster_enqueue(cp, frame + sent, len - (size_t)sent);
+    }
+}
+
+void caster_device_gone(const struct gps_device_t *device)
+/* forget a device that is going away, and drop the clients it served */
+{
+    struct caster_mount_t *mp;
+    struct caster_client_t *cp;
+
+    if (caster_context == NULL)
+	return;
+    /*
+     * The device slot may be reused for another receiver, which must
+     * not inherit this one's clients or mountpoint.
+     */
+    for (cp = clients; cp < clients + CASTER_CLIENTS; cp++)
+	if (cp->fd != UNALLOCATED_FD && cp->device == device)
+	    caster_detach(cp, "device gone");
+    for (mp = mounts; mp < mounts + MAX_DEVICES; mp++)
+	if (mp->device == device) {
+	    gpsd_log(&caster_context->errout, LOG_INF,
+		     "caster: %s no longer offered as a mountpoint\n",
+		     device->gpsdata.dev.path);
+	    memset(mp, '\0', sizeof(*mp));
+	}
+}
+
+void caster_release(void)
+/* shut down every caster client */
+{
+    struct caster_client_t *cp;
+
+    for (cp = clients; cp < clients + CASTER_CLIENTS; cp++)
+	if (cp->fd != UNALLOCATED_FD)
+	    caster_detach(cp, "shutdown");
+}
+
+#endif /* NTRIP_ENABLE */
+
+/* end */
@@ -11,7 +11,6 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -21,45 +20,61 @@
 int dgpsip_open(struct gps_device_t *device, const char *dgpsserver)
 /* open a connection to a DGPSIP server */
 {
+    char server[GPS_PATH_MAX];
     char *colon, *dgpsport = "rtcm-sc104";
-    int opts;
 
+    /* work on a copy, the original is the device path */
+    (void)strlcpy(server, dgpsserver, sizeof(server));
     device->dgpsip.reported = false;
-    if ((colon = strchr(dgpsserver, ':')) != NULL) {
+    if ((colon = strchr(server, ':')) != NULL) {
 	dgpsport = colon + 1;
 	*colon = '\0';
     }
-    if (!getservbyname(dgpsport, "tcp"))
+    if (colon == NULL && !getservbyname(dgpsport, "tcp"))
 	dgpsport = DEFAULT_RTCM_PORT;
+    (void)strlcpy(device->netgnss.host, server, sizeof(device->netgnss.host));
+    (void)strlcpy(device->netgnss.port, dgpsport, sizeof(device->netgnss.port));
 
-    device->gpsdata.gps_fd =
-	netlib_connectsock(AF_UNSPEC, dgpsserver, dgpsport, "tcp");
-    // cppcheck-suppress pointerPositive
-    if (device->gpsdata.gps_fd >= 0) {
-	char hn[256], buf[BUFSIZ];
-	gpsd_log(&device->context->errout, LOG_PROG,
-		 "connection to DGPS server %s established.\n",
-		 dgpsserver);
-	(void)gethostname(hn, sizeof(hn));
-	/* greeting required by some RTCM104 servers; others will ignore it */
-	(void)snprintf(buf, sizeof(buf), "HELO %s gpsd %s\r\nR\r\n", hn,
-		       VERSION);
-	if (write(device->gpsdata.gps_fd, buf, strlen(buf)) != (ssize_t) strlen(buf))
-	    gpsd_log(&device->context->errout, LOG_ERROR,
-		     "hello to DGPS server %s failed\n",
-		     dgpsserver);
-    } else
-	gpsd_log(&device->context->errout, LOG_ERROR,
-		 "can't connect to DGPS server %s, netlib error %d.\n",
-		 dgpsserver, device->gpsdata.gps_fd);
-    opts = fcntl(device->gpsdata.gps_fd, F_GETFL);
-
-    if (opts >= 0)
-	(void)fcntl(device->gpsdata.gps_fd, F_SETFL, opts | O_NONBLOCK);
     device->servicetype = service_dgpsip;
+    /* the greeting goes out from dgpsip_advance() once we're connected */
+    device->dgpsip.connecting = true;
+    if (netgnss_connect_start(device, device->netgnss.host,
+			      device->netgnss.port, 0) < 0) {
+	gpsd_log(&device->context->errout, LOG_ERROR,
+		 "can't start connection to DGPS server %s\n",
+		 server);
+	device->dgpsip.connecting = false;
+	return -1;
+    }
     return device->gpsdata.gps_fd;
 }
 
+int dgpsip_advance(struct gps_device_t *device)
+/* ratchet a pending DGPSIP connection forward: 1 done, 0 wait, -1 failed */
+{
+    char hn[256], buf[BUFSIZ];
+    int ret = netgnss_connect_finish(device);
+
+    if (ret <= 0) {
+	if (ret < 0)
+	    device->dgpsip.connecting = false;
+	return ret;
+    }
+    device->dgpsip.connecting = false;
+    gpsd_log(&device->context->errout, LOG_PROG,
+	     "connection to DGPS server %s established.\n",
+	     device->netgnss.host);
+    (void)gethostname(hn, sizeof(hn));
+    /* greeting required by some RTCM104 servers; others will ignore it */
+    (void)snprintf(buf, sizeof(buf), "HELO %s gpsd %s\r\nR\r\n", hn,
+		   VERSION);
+    if (write(device->gpsdata.gps_fd, buf, strlen(buf)) != (ssize_t) strlen(buf))
+	gpsd_log(&device->context->errout, LOG_ERROR,
+		 "hello to DGPS server %s failed\n",
+		 device->netgnss.host);
+    return 1;
+}
+
 void dgpsip_report(struct gps_context_t *context,
 		   struct gps_device_t *gps,
 		   struct gps_device_t *dgpsip)
@@ -69,7 +84,8 @@ void dgpsip_report(struct gps_context_t *context,
      * 10 is an arbitrary number, the point is to have gotten several good
      * fixes before reporting usage to our DGPSIP server.
      */
-    if (context->fixcnt > 10 && !dgpsip->dgpsip.reported) {
+    if (context->fixcnt > 10 && !dgpsip->dgpsip.reported
+	&& !dgpsip->dgpsip.connecting) {
 	dgpsip->dgpsip.reported = true;
 	if (dgpsip->gpsdata.gps_fd > -1) {
 	    char buf[BUFSIZ];
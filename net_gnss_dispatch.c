@@ -6,8 +6,11 @@
 
 #include "gpsd_config.h"  /* must be before all includes */
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -28,9 +31,175 @@ bool netgnss_uri_check(char *name)
 }
 
 
+/*
+ * Asynchronous connection machinery.
+ *
+ * getaddrinfo(3) and connect(2) can each block for tens of seconds
+ * when a caster is slow or unreachable, and the main loop also services
+ * PPS reporting and every client.  So both run in a detached helper
+ * thread that hands the connected socket (or a netlib error code) back
+ * through a pipe.  The read end of that pipe stands in for the device
+ * descriptor until the result arrives, so select() in the main loop
+ * wakes us exactly when there is something to do.
+ *
+ * The connected socket is dup2()ed onto the pipe's descriptor number,
+ * which keeps gps_fd stable through every connection stage and retry;
+ * the daemon's select set never needs to know a swap happened.
+ */
+
+struct netgnss_job_t {
+    char host[256];
+    char port[32];
+    unsigned int delay;		/* seconds to sleep before trying */
+    int fd;			/* write end of the result pipe */
+};
+
+static void *netgnss_connect_thread(void *arg)
+/* resolve and connect off the main thread, then report through the pipe */
+{
+    struct netgnss_job_t *job = (struct netgnss_job_t *)arg;
+    socket_t s;
+
+    if (job->delay > 0)
+	(void)sleep(job->delay);
+    s = netlib_connectsock(AF_UNSPEC, job->host, job->port, "tcp");
+    /* if the device went away meanwhile, nobody wants the socket */
+    if (write(job->fd, &s, sizeof(s)) != (ssize_t)sizeof(s)
+	&& s >= 0)
+	(void)close(s);
+    (void)close(job->fd);
+    free(job);
+    return NULL;
+}
+
+socket_t netgnss_connect_start(struct gps_device_t *dev,
+			       const char *host, const char *port,
+			       unsigned int delay)
+/* begin a background connect; returns the descriptor to wait on */
+{
+    int pfd[2];
+    pthread_t pt;
+    pthread_attr_t attr;
+    struct netgnss_job_t *job;
+
+    if (pipe(pfd) == -1) {
+	gpsd_log(&dev->context->errout, LOG_ERROR,
+		 "netgnss: pipe() failed: %s\n", strerror(errno));
+	return -1;
+    }
+    if ((job = (struct netgnss_job_t *)malloc(sizeof(*job))) == NULL) {
+	(void)close(pfd[0]);
+	(void)close(pfd[1]);
+	return -1;
+    }
+    (void)strlcpy(job->host, host, sizeof(job->host));
+    (void)strlcpy(job->port, port, sizeof(job->port));
+    job->delay = delay;
+    job->fd = pfd[1];
+
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&pt, &attr, netgnss_connect_thread, job) != 0) {
+	(void)pthread_attr_destroy(&attr);
+	gpsd_log(&dev->context->errout, LOG_ERROR,
+		 "netgnss: can't start connect helper for %s:%s\n",
+		 host, port);
+	(void)close(pfd[0]);
+	(void)close(pfd[1]);
+	free(job);
+	return -1;
+    }
+    (void)pthread_attr_destroy(&attr);
+
+    (void)fcntl(pfd[0], F_SETFL, fcntl(pfd[0], F_GETFL) | O_NONBLOCK);
+    if (!BAD_SOCKET(dev->gpsdata.gps_fd) && dev->gpsdata.gps_fd != pfd[0]) {
+	/* retires any previous socket on this descriptor number */
+	(void)dup2(pfd[0], dev->gpsdata.gps_fd);
+	(void)close(pfd[0]);
+    } else
+	dev->gpsdata.gps_fd = pfd[0];
+    dev->netgnss.pending = true;
+
+    gpsd_log(&dev->context->errout, LOG_PROG,
+	     "netgnss: connecting to %s:%s in %u sec on fd %d\n",
+	     host, port, delay, dev->gpsdata.gps_fd);
+    return dev->gpsdata.gps_fd;
+}
+
+int netgnss_connect_finish(struct gps_device_t *dev)
+/* collect a background connect: 1 = connected, 0 = not yet, -1 = failed */
+{
+    socket_t s;
+    ssize_t n;
+
+    if (!dev->netgnss.pending)
+	return 1;
+    n = read(dev->gpsdata.gps_fd, &s, sizeof(s));
+    if (n == -1 && (errno == EAGAIN || errno == EINTR))
+	return 0;
+    dev->netgnss.pending = false;
+    if (n != (ssize_t)sizeof(s)) {
+	gpsd_log(&dev->context->errout, LOG_ERROR,
+		 "netgnss: connect helper for %s:%s vanished\n",
+		 dev->netgnss.host, dev->netgnss.port);
+	return -1;
+    }
+    if (s < 0) {
+	gpsd_log(&dev->context->errout, LOG_ERROR,
+		 "netgnss: can't connect to %s:%s: %s\n",
+		 dev->netgnss.host, dev->netgnss.port, netlib_errstr(s));
+	return -1;
+    }
+    (void)dup2(s, dev->gpsdata.gps_fd);
+    (void)close(s);
+    gpsd_log(&dev->context->errout, LOG_PROG,
+	     "netgnss: connected to %s:%s on fd %d\n",
+	     dev->netgnss.host, dev->netgnss.port, dev->gpsdata.gps_fd);
+    return 1;
+}
+
+int netgnss_retry(struct gps_device_t *dev)
+/* a DGNSS connection broke; schedule another attempt with backoff */
+{
+    unsigned int delay = dev->netgnss.backoff;
+
+    if (delay < NETGNSS_BACKOFF_MIN)
+	delay = NETGNSS_BACKOFF_MIN;
+    dev->netgnss.backoff = delay * 2;
+    if (dev->netgnss.backoff > NETGNSS_BACKOFF_MAX)
+	dev->netgnss.backoff = NETGNSS_BACKOFF_MAX;
+    dev->netgnss.attempts++;
+
+    gpsd_log(&dev->context->errout, LOG_WARN,
+	     "netgnss: reconnecting to %s:%s in %u sec (attempt %u)\n",
+	     dev->netgnss.host, dev->netgnss.port, delay,
+	     dev->netgnss.attempts);
+
+    /* whatever partial packet was in flight is useless now */
+    packet_reset(&dev->lexer);
+#ifdef NTRIP_ENABLE
+    if (dev->servicetype == service_ntrip) {
+	dev->ntrip.works = false;
+	dev->ntrip.sourcetable_parse = false;
+	dev->ntrip.buflen = 0;
+	/* a cached sourcetable match lets us skip straight to the GET */
+	dev->ntrip.conn_state = dev->ntrip.stream.set
+	    ? ntrip_conn_get_connecting : ntrip_conn_probe_connecting;
+    }
+#endif /* NTRIP_ENABLE */
+    if (dev->servicetype == service_dgpsip) {
+	dev->dgpsip.reported = false;
+	dev->dgpsip.connecting = true;
+    }
+    return netgnss_connect_start(dev, dev->netgnss.host, dev->netgnss.port,
+				 delay) < 0 ? -1 : 0;
+}
+
 int netgnss_uri_open(struct gps_device_t *dev, char *netgnss_service)
 /* open a connection to a DGNSS service */
 {
+    /* whatever descriptor number we had was closed on deactivation */
+    INVALIDATE_SOCKET(dev->gpsdata.gps_fd);
 #ifdef NTRIP_ENABLE
     if (str_starts_with(netgnss_service, NETGNSS_NTRIP)) {
 	dev->ntrip.conn_state = ntrip_conn_init;
@@ -164,37 +164,42 @@ static void ntrip_str_parse(char *str, size_t len,
 }
 
 static int ntrip_sourcetable_parse(struct gps_device_t *device)
+/* returns 1 on a match, 0 if more data is needed, -1 on error */
 {
     struct ntrip_stream_t hold;
-    ssize_t llen, len = 0;
+    ssize_t llen, len;
     char *line;
-    bool sourcetable = false;
-    bool match = false;
-    char buf[BUFSIZ];
-    size_t blen = sizeof(buf);
+    bool match = device->ntrip.stream.set;
+    char *buf = device->ntrip.buf;
+    size_t blen = sizeof(device->ntrip.buf);
     int fd = device->gpsdata.gps_fd;
 
+    /*
+     * The socket is non-blocking and select() only promises us some
+     * bytes, so a partial line is carried over in device->ntrip.buf
+     * until the next time the descriptor goes readable.
+     */
     for (;;) {
 	char *eol;
 	ssize_t rlen;
 
-	memset(&buf[len], 0, (size_t) (blen - len));
-	rlen = read(fd, &buf[len], (size_t) (blen - 1 - len));
+	rlen = read(fd, &buf[device->ntrip.buflen],
+		    blen - 1 - device->ntrip.buflen);
 	if (rlen == -1) {
 	    if (errno == EINTR) {
 		continue;
 	    }
-	    if (sourcetable && !match && errno == EAGAIN) { // we have not yet found a match, but there currently is no more data
-		return 0;
-	    }
-	    if (match) {
-		return 1;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		/* no more data for now, come back when select says so */
+		return match ? 1 : 0;
 	    }
 	    gpsd_log(&device->context->errout, LOG_ERROR,
 		     "ntrip stream read error %d on fd %d\n",
 		     errno, fd);
 	    return -1;
 	} else if (rlen == 0) { // server closed the connection
+	    if (match)
+		return 1;
 	    gpsd_log(&device->context->errout, LOG_ERROR,
 		     "ntrip stream unexpected close %d on fd %d during sourcetable read\n",
 		     errno, fd);
@@ -202,20 +207,24 @@ static int ntrip_sourcetable_parse(struct gps_device_t *device)
 	}
 
 	line = buf;
-	rlen = len += rlen;
+	len = (ssize_t)device->ntrip.buflen + rlen;
+	buf[len] = '\0';
 
 	gpsd_log(&device->context->errout, LOG_RAW,
 		 "Ntrip source table buffer %s\n", buf);
 
-	sourcetable = device->ntrip.sourcetable_parse;
-	if (!sourcetable) {
+	if (!device->ntrip.sourcetable_parse) {
 	    /* parse SOURCETABLE */
 	    if (str_starts_with(line, NTRIP_SOURCETABLE)) {
-		sourcetable = true;
 		device->ntrip.sourcetable_parse = true;
 		llen = (ssize_t) strlen(NTRIP_SOURCETABLE);
 		line += llen;
 		len -= llen;
+	    } else if ((size_t)len < strlen(NTRIP_SOURCETABLE)
+		       && strncmp(line, NTRIP_SOURCETABLE, (size_t)len) == 0) {
+		/* status line not complete yet */
+		device->ntrip.buflen = (size_t)len;
+		continue;
 	    } else {
 		gpsd_log(&device->context->errout, LOG_WARN,
 			 "Received unexpexted Ntrip reply %s.\n",
@@ -229,7 +238,7 @@ static int ntrip_sourcetable_parse(struct gps_device_t *device)
 	    if (str_starts_with(line, NTRIP_ENDSOURCETABLE))
 		goto done;
 
-	    /* coverity[string_null] - nul-terminated by previous memset */
+	    /* coverity[string_null] - nul-terminated above */
 	    if (!(eol = strstr(line, NTRIP_BR)))
 		break;
 
@@ -303,26 +312,22 @@ static int ntrip_sourcetable_parse(struct gps_device_t *device)
 	    return -1;
 
 	if (len > 0)
-	    memmove(buf, &buf[rlen - len], (size_t) len);
+	    memmove(buf, line, (size_t) len);
+	device->ntrip.buflen = (size_t)len;
     }
 
 done:
+    device->ntrip.buflen = 0;
     return match ? 1 : -1;
 }
 
 static int ntrip_stream_req_probe(const struct ntrip_stream_t *stream,
+				  const int dsock,
 				  struct gpsd_errout_t *errout)
 {
-    int dsock;
     ssize_t r;
     char buf[BUFSIZ];
 
-    dsock = netlib_connectsock(AF_UNSPEC, stream->url, stream->port, "tcp");
-    if (dsock < 0) {
-	gpsd_log(errout, LOG_ERROR,
-		 "ntrip stream connect error %d in req probe\n", dsock);
-	return -1;
-    }
     gpsd_log(errout, LOG_SPIN,
 	     "ntrip stream for req probe connected on fd %d\n", dsock);
     (void)snprintf(buf, sizeof(buf),
@@ -331,15 +336,14 @@ static int ntrip_stream_req_probe(const struct ntrip_stream_t *stream,
 	    "Host: %s\r\n"
 	    "Connection: close\r\n"
 	    "\r\n", VERSION, stream->url);
+    /* a fresh socket's send buffer always has room for this */
     r = write(dsock, buf, strlen(buf));
     if (r != (ssize_t)strlen(buf)) {
 	gpsd_log(errout, LOG_ERROR,
 		 "ntrip stream write error %d on fd %d during probe request %zd\n",
 		 errno, dsock, r);
-	(void)close(dsock);
 	return -1;
     }
-    /* coverity[leaked_handle] This is an intentional allocation */
     return dsock;
 }
 
@@ -370,20 +374,13 @@ static int ntrip_auth_encode(const struct ntrip_stream_t *stream,
 /* *INDENT-ON* */
 
 static int ntrip_stream_get_req(const struct ntrip_stream_t *stream,
+				const int dsock,
 				const struct gpsd_errout_t *errout)
 {
-    int dsock;
     char buf[BUFSIZ];
 
-    dsock = netlib_connectsock(AF_UNSPEC, stream->url, stream->port, "tcp");
-    if (BAD_SOCKET(dsock)) {
-	gpsd_log(errout, LOG_ERROR,
-		 "ntrip stream connect error %d\n", dsock);
-	return -1;
-    }
-
     gpsd_log(errout, LOG_SPIN,
-	     "netlib_connectsock() returns socket on fd %d\n",
+	     "ntrip stream for get request connected on fd %d\n",
 	     dsock);
 
     (void)snprintf(buf, sizeof(buf),
@@ -398,64 +395,84 @@ static int ntrip_stream_get_req(const struct ntrip_stream_t *stream,
 	gpsd_log(errout, LOG_ERROR,
 		 "ntrip stream write error %d on fd %d during get request\n", errno,
 		 dsock);
-	(void)close(dsock);
 	return -1;
     }
     return dsock;
 }
 
-static int ntrip_stream_get_parse(const struct ntrip_stream_t *stream,
-				  const int dsock,
-				  const struct gpsd_errout_t *errout)
+static int ntrip_stream_get_parse(struct gps_device_t *device)
+/* returns 1 once the stream is flowing, 0 if more data is needed, -1 on error */
 {
-    char buf[BUFSIZ];
-    int opts;
-    memset(buf, 0, sizeof(buf));
-    while (read(dsock, buf, sizeof(buf) - 1) == -1) {
+    const struct ntrip_stream_t *stream = &device->ntrip.stream;
+    const struct gpsd_errout_t *errout = &device->context->errout;
+    char *buf = device->ntrip.buf;
+    size_t blen = sizeof(device->ntrip.buf);
+    int dsock = device->gpsdata.gps_fd;
+    ssize_t rlen;
+
+    while ((rlen = read(dsock, &buf[device->ntrip.buflen],
+			blen - 1 - device->ntrip.buflen)) == -1) {
 	if (errno == EINTR)
 	    continue;
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
 	gpsd_log(errout, LOG_ERROR,
 		 "ntrip stream read error %d on fd %d during get rsp\n", errno,
 		 dsock);
-	goto close;
+	return -1;
+    }
+    if (rlen == 0) {
+	gpsd_log(errout, LOG_ERROR,
+		 "ntrip stream unexpected close on fd %d during get rsp\n",
+		 dsock);
+	return -1;
     }
+    device->ntrip.buflen += (size_t)rlen;
+    buf[device->ntrip.buflen] = '\0';
+
+    /* wait for a complete status line */
+    if (strstr(buf, NTRIP_BR) == NULL) {
+	if (device->ntrip.buflen == blen - 1) {
+	    gpsd_log(errout, LOG_ERROR,
+		     "oversized reply from Ntrip service %s:%s/%s\n",
+		     stream->url, stream->port, stream->mountpoint);
+	    return -1;
+	}
+	return 0;
+    }
+    device->ntrip.buflen = 0;
 
     /* parse 401 Unauthorized */
-    /* coverity[string_null] - guaranteed terminated by the memset above */
+    /* coverity[string_null] - guaranteed terminated above */
     if (strstr(buf, NTRIP_UNAUTH)!=NULL) {
 	gpsd_log(errout, LOG_ERROR,
 		 "not authorized for Ntrip stream %s/%s\n", stream->url,
 		 stream->mountpoint);
-	goto close;
+	return -1;
     }
     /* parse SOURCETABLE */
     if (strstr(buf, NTRIP_SOURCETABLE)!=NULL) {
 	gpsd_log(errout, LOG_ERROR,
 		 "Broadcaster doesn't recognize Ntrip stream %s:%s/%s\n",
 		 stream->url, stream->port, stream->mountpoint);
-	goto close;
+	/* our cached sourcetable entry is stale, re-probe next time */
+	device->ntrip.stream.set = false;
+	return -1;
     }
     /* parse ICY 200 OK */
     if (strstr(buf, NTRIP_ICY)==NULL) {
 	gpsd_log(errout, LOG_ERROR,
 		 "Unknown reply %s from Ntrip service %s:%s/%s\n", buf,
 		 stream->url, stream->port, stream->mountpoint);
-	goto close;
+	return -1;
     }
-    opts = fcntl(dsock, F_GETFL);
-
-    if (opts >= 0)
-	(void)fcntl(dsock, F_SETFL, opts | O_NONBLOCK);
-
-    return dsock;
-close:
-    (void)close(dsock);
-    return -1;
+    return 1;
 }
 
-int ntrip_open(struct gps_device_t *device, char *caster)
+int ntrip_open(struct gps_device_t *device, char *orig)
     /* open a connection to a Ntrip broadcaster */
 {
+    char caster[GPS_PATH_MAX];
     char *amp, *colon, *slash;
     char *auth = NULL;
     char *port = NULL;
@@ -463,40 +480,47 @@ int ntrip_open(struct gps_device_t *device, char *caster)
     char *url = NULL;
     int ret = -1;
 
+    /*
+     * Every stage below returns promptly: connects run in a helper
+     * thread and replies are accumulated across select() wakeups,
+     * so a slow caster never stalls the main loop.
+     */
     switch (device->ntrip.conn_state) {
 	case ntrip_conn_init:
 	    /* this has to be done here, because it is needed for multi-stage connection */
 	    device->servicetype = service_ntrip;
 	    device->ntrip.works = false;
 	    device->ntrip.sourcetable_parse = false;
-	    device->ntrip.stream.set = false;
-
-	    if ((amp = strchr(caster, '@')) != NULL) {
-		if (((colon = strchr(caster, ':')) != NULL) && colon < amp) {
-		    auth = caster;
+	    device->ntrip.buflen = 0;
+
+	    /* work on a copy, the original is the device path */
+	    (void)strlcpy(caster, orig, sizeof(caster));
+	    url = caster;
+	    if ((amp = strchr(url, '@')) != NULL) {
+		if (((colon = strchr(url, ':')) != NULL) && colon < amp) {
+		    auth = url;
 		    *amp = '\0';
-		    caster = amp + 1;
-		    url = caster;
+		    url = amp + 1;
 		} else {
 		    gpsd_log(&device->context->errout, LOG_ERROR,
 			     "can't extract user-ID and password from %s\n",
-			     caster);
+			     orig);
 		    device->ntrip.conn_state = ntrip_conn_err;
 		    return -1;
 		}
 	    }
-	    if ((slash = strchr(caster, '/')) != NULL) {
+	    if ((slash = strchr(url, '/')) != NULL) {
 		*slash = '\0';
 		stream = slash + 1;
 	    } else {
 		/* TODO: add autoconnect like in dgpsip.c */
 		gpsd_log(&device->context->errout, LOG_ERROR,
 			 "can't extract Ntrip stream from %s\n",
-			 caster);
+			 orig);
 		device->ntrip.conn_state = ntrip_conn_err;
 		return -1;
 	    }
-	    if ((colon = strchr(caster, ':')) != NULL) {
+	    if ((colon = strchr(url, ':')) != NULL) {
 		port = colon + 1;
 		*colon = '\0';
 	    }
@@ -506,35 +530,80 @@ int ntrip_open(struct gps_device_t *device, char *caster)
 		    port = DEFAULT_RTCM_PORT;
 	    }
 
-	    (void)strlcpy(device->ntrip.stream.mountpoint,
-		    stream,
-		    sizeof(device->ntrip.stream.mountpoint));
-	    if (auth != NULL)
-		(void)strlcpy(device->ntrip.stream.credentials,
-			      auth,
-			      sizeof(device->ntrip.stream.credentials));
 	    /*
-	     * Semantically url and port ought to be non-NULL by now,
-	     * but just in case...this code appeases Coverity.
+	     * The stream description survives reactivation.  If we already
+	     * matched this very mountpoint in a sourcetable, trust it and go
+	     * straight to the GET; that saves a whole connection round trip
+	     * when the correction stream restarts.
 	     */
-	    if (url != NULL)
+	    if (!device->ntrip.stream.set
+		|| strcmp(device->ntrip.stream.url, url) != 0
+		|| strcmp(device->ntrip.stream.port, port) != 0
+		|| strcmp(device->ntrip.stream.mountpoint, stream) != 0) {
+		device->ntrip.stream.set = false;
+		(void)strlcpy(device->ntrip.stream.mountpoint,
+			stream,
+			sizeof(device->ntrip.stream.mountpoint));
 		(void)strlcpy(device->ntrip.stream.url,
 			      url,
 			      sizeof(device->ntrip.stream.url));
-	    if (port != NULL)
 		(void)strlcpy(device->ntrip.stream.port,
 			      port,
 			      sizeof(device->ntrip.stream.port));
-
-	    ret = ntrip_stream_req_probe(&device->ntrip.stream,
-					 &device->context->errout);
+	    }
+	    if (auth != NULL)
+		(void)strlcpy(device->ntrip.stream.credentials,
+			      auth,
+			      sizeof(device->ntrip.stream.credentials));
+	    (void)strlcpy(device->netgnss.host, device->ntrip.stream.url,
+			  sizeof(device->netgnss.host));
+	    (void)strlcpy(device->netgnss.port, device->ntrip.stream.port,
+			  sizeof(device->netgnss.port));
+
+	    if (device->ntrip.stream.set) {
+		gpsd_log(&device->context->errout, LOG_PROG,
+			 "using cached sourcetable entry for %s\n",
+			 device->ntrip.stream.mountpoint);
+		if (ntrip_auth_encode(&device->ntrip.stream, device->ntrip.stream.credentials, device->ntrip.stream.authStr, sizeof(device->ntrip.stream.authStr)) != 0) {
+		    device->ntrip.conn_state = ntrip_conn_err;
+		    return -1;
+		}
+		device->ntrip.conn_state = ntrip_conn_get_connecting;
+	    } else
+		device->ntrip.conn_state = ntrip_conn_probe_connecting;
+	    ret = netgnss_connect_start(device, device->netgnss.host,
+					device->netgnss.port, 0);
 	    if (ret == -1) {
 		device->ntrip.conn_state = ntrip_conn_err;
 		return -1;
 	    }
-	    device->gpsdata.gps_fd = ret;
-	    device->ntrip.conn_state = ntrip_conn_sent_probe;
 	    return ret;
+	case ntrip_conn_probe_connecting:
+	case ntrip_conn_get_connecting:
+	    ret = netgnss_connect_finish(device);
+	    if (ret == 0)
+		return 0;	/* helper thread not done yet */
+	    if (ret == -1) {
+		device->ntrip.conn_state = ntrip_conn_err;
+		return -1;
+	    }
+	    device->ntrip.buflen = 0;
+	    if (device->ntrip.conn_state == ntrip_conn_probe_connecting) {
+		ret = ntrip_stream_req_probe(&device->ntrip.stream,
+					     device->gpsdata.gps_fd,
+					     &device->context->errout);
+		device->ntrip.conn_state = ntrip_conn_sent_probe;
+	    } else {
+		ret = ntrip_stream_get_req(&device->ntrip.stream,
+					   device->gpsdata.gps_fd,
+					   &device->context->errout);
+		device->ntrip.conn_state = ntrip_conn_sent_get;
+	    }
+	    if (ret == -1) {
+		device->ntrip.conn_state = ntrip_conn_err;
+		return -1;
+	    }
+	    break;
 	case ntrip_conn_sent_probe:
 	    ret = ntrip_sourcetable_parse(device);
 	    if (ret == -1) {
@@ -544,30 +613,30 @@ int ntrip_open(struct gps_device_t *device, char *caster)
 	    if (ret == 0 && device->ntrip.stream.set == false) {
 		return ret;
 	    }
-	    (void)close(device->gpsdata.gps_fd);
 	    if (ntrip_auth_encode(&device->ntrip.stream, device->ntrip.stream.credentials, device->ntrip.stream.authStr, sizeof(device->ntrip.stream.authStr)) != 0) {
 		device->ntrip.conn_state = ntrip_conn_err;
 		return -1;
 	    }
-	    ret = ntrip_stream_get_req(&device->ntrip.stream,
-				       &device->context->errout);
+	    /* replaces the probe socket on the same descriptor number */
+	    ret = netgnss_connect_start(device, device->netgnss.host,
+					device->netgnss.port, 0);
 	    if (ret == -1) {
 		device->ntrip.conn_state = ntrip_conn_err;
 		return -1;
 	    }
-	    device->gpsdata.gps_fd = ret;
-	    device->ntrip.conn_state = ntrip_conn_sent_get;
+	    device->ntrip.conn_state = ntrip_conn_get_connecting;
 	    break;
 	case ntrip_conn_sent_get:
-	    ret = ntrip_stream_get_parse(&device->ntrip.stream,
-					 device->gpsdata.gps_fd,
-					 &device->context->errout);
+	    ret = ntrip_stream_get_parse(device);
 	    if (ret == -1) {
 		device->ntrip.conn_state = ntrip_conn_err;
 		return -1;
 	    }
+	    if (ret == 0)
+		return 0;
 	    device->ntrip.conn_state = ntrip_conn_established;
 	    device->ntrip.works = true; // we know, this worked.
+	    ret = device->gpsdata.gps_fd;
 	    break;
 	case ntrip_conn_established:
 	case ntrip_conn_err:
@@ -591,7 +660,8 @@ void ntrip_report(struct gps_context_t *context,
      */
     count ++;
     if (caster->ntrip.stream.nmea != 0 && context->fixcnt > 10 && (count % 5)==0) {
-	if (caster->gpsdata.gps_fd > -1) {
+	if (caster->gpsdata.gps_fd > -1
+	    && caster->ntrip.conn_state == ntrip_conn_established) {
 	    char buf[BUFSIZ];
 	    gpsd_position_fix_dump(gps, buf, sizeof(buf));
 	    if (write(caster->gpsdata.gps_fd, buf, strlen(buf)) ==
@@ -45,6 +45,7 @@ PERMISSIONS
 #include "gpsd.h"
 #include "crc24q.h"
 #include "strfuncs.h"
+#include "tracepoints.h"
 
 /*
  * The packet-recognition state machine.  This takes an incoming byte stream
@@ -1641,6 +1642,7 @@ static void packet_accept(struct gps_lexer_t *lexer, int packet_type)
 	lexer->outbuflen = packetlen;
 	lexer->outbuffer[packetlen] = '\0';
 	lexer->type = packet_type;
+	GPSD_PROBE3(packet_accept, lexer, packet_type, packetlen);
 	if (lexer->errout.debug >= LOG_RAW+1) {
 	    char scratchbuf[MAX_PACKET_LENGTH*4+1];
 	    gpsd_log(&lexer->errout, LOG_RAW+1,
@@ -1704,6 +1706,7 @@ static void packet_unstash(struct gps_lexer_t *lexer)
 	memcpy(lexer->inbuffer, lexer->stashbuffer, stashlen);
 	lexer->inbuflen += stashlen;
 	lexer->stashbuflen = 0;
+	lexer->unstashlen = stashlen;
 	if (lexer->errout.debug >= LOG_RAW+1) {
 	    char scratchbuf[MAX_PACKET_LENGTH*4+1];
 	    gpsd_log(&lexer->errout, LOG_RAW+1,
@@ -1735,6 +1738,7 @@ void lexer_init(struct gps_lexer_t *lexer)
 #ifdef TIMING_ENABLE
     lexer->start_time = 0.0;
 #endif /* TIMING_ENABLE */
+    lexer->capture = NULL;
     packet_reset(lexer);
     errout_reset(&lexer->errout);
 }
@@ -2503,6 +2507,16 @@ ssize_t packet_get(int fd, struct gps_lexer_t *lexer)
 		     gpsd_packetdump(scratchbuf, sizeof(scratchbuf),
 				     (char *)lexer->inbufptr, (size_t) recvd));
 	}
+	/* log what was read straight from the input buffer */
+	if (lexer->capture != NULL && recvd > 0
+	    && !gpsd_capture_write(lexer->capture,
+				   lexer->inbuffer + lexer->inbuflen,
+				   (size_t)recvd)) {
+	    gpsd_log(&lexer->errout, LOG_ERROR,
+		     "capture write failed, %s; capture stopped\n",
+		     strerror(errno));
+	    lexer->capture = NULL;
+	}
 	lexer->inbuflen += recvd;
     }
     gpsd_log(&lexer->errout, LOG_SPIN,
@@ -2546,6 +2560,7 @@ ssize_t packet_get(int fd, struct gps_lexer_t *lexer)
      * be aware of the issue. It might also slightly affect
      * performance profiling.
      */
+    GPSD_PROBE4(packet_get, lexer, lexer->type, fd, lexer->outbuflen);
     if (lexer->outbuflen > 0)
 	return (ssize_t) lexer->outbuflen;
     else
@@ -2557,6 +2572,40 @@ ssize_t packet_get(int fd, struct gps_lexer_t *lexer)
 	return recvd;
 }
 
+ssize_t packet_frame(struct gps_lexer_t *lexer,
+		     const unsigned char *buf, size_t len, size_t *used)
+/*
+ * Like packet_get(), but take input from memory; *used is what was taken.
+ * A packet gathered ends packet_unread_input() bytes short of all input
+ * taken so far.
+ */
+{
+    size_t room = sizeof(lexer->inbuffer) - lexer->inbuflen;
+
+    *used = (len < room) ? len : room;
+    memcpy(lexer->inbuffer + lexer->inbuflen, buf, *used);
+    lexer->inbuflen += *used;
+
+    if (packet_buffered_input(lexer) <= 0)
+	return 0;
+
+#ifdef STASH_ENABLE
+    lexer->unstashlen = 0;
+#endif /* STASH_ENABLE */
+    packet_parse(lexer);
+
+    /* if input buffer is full, discard */
+    if (sizeof(lexer->inbuffer) == (lexer->inbuflen)) {
+	packet_discard(lexer);
+	lexer->state = GROUND_STATE;
+    }
+
+    if (lexer->outbuflen > 0)
+	return (ssize_t) lexer->outbuflen;
+    else
+	return (ssize_t) *used;
+}
+
 void packet_reset(struct gps_lexer_t *lexer)
 /* return the packet machine to the ground state */
 {
@@ -2569,6 +2618,7 @@ void packet_reset(struct gps_lexer_t *lexer)
 #endif /* BINARY_ENABLE */
 #ifdef STASH_ENABLE
     lexer->stashbuflen = 0;
+    lexer->unstashlen = 0;
 #endif /* STASH_ENABLE */
 }
 
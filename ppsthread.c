@@ -55,9 +55,13 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
 #include <errno.h>
 #include <math.h>
+#include <sched.h>
+#include <stdlib.h>		/* for llabs() */
+#include <sys/mman.h>		/* for mlock() */
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -84,9 +88,11 @@
 #include <sys/timepps.h>
 #endif
 
+#include "compiler.h"	/* for memory_barrier() */
 #include "timespec.h"
 #include "ppsthread.h"
 #include "os_compat.h"
+#include "tracepoints.h"
 
 /*
  * Tell GCC that we want thread-safe behavior with _REENTRANT;
@@ -140,8 +146,6 @@ static int get_edge_rfc2783(struct inner_context_t *,
                          volatile struct timedelta_t *);
 #endif  /* defined(HAVE_SYS_TIMEPPS_H) */
 
-static pthread_mutex_t ppslast_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 /*
  * Version of strerror_r() which explicitly ignores the return value.
  * This is needed to avoid warnings from some overly pedantic compilers.
@@ -157,28 +161,50 @@ static void pps_strerror_r(int errnum, char *buf, size_t len)
     }
 }
 
-static void thread_lock(volatile struct pps_thread_t *pps_thread)
+/*
+ * fix_in and pps_out each have exactly one writer, so instead of a
+ * mutex they carry a sequence count that is odd while an update is in
+ * progress, like the bookends of the SHM export.  A reader retries
+ * until it sees the same even count before and after its copy.  The
+ * PPS thread gives up after a few tries and keeps its previous copy,
+ * so that it can never spin on a writer it has preempted.
+ */
+#define SEQ_READ_TRIES	8
+
+/* the largest object guarded this way, for seq_read()'s scratch copy */
+union seq_object_t {
+    struct timedelta_t td;
+    struct pps_stats_t stats;
+};
+
+static void seq_write(volatile unsigned int *seq,
+		      volatile void *dst, const volatile void *src,
+		      size_t len)
 {
-    int pthread_err = pthread_mutex_lock(&ppslast_mutex);
-    if ( 0 != pthread_err ) {
-	char errbuf[BUFSIZ] = "unknown error";
-	pps_strerror_r(errno, errbuf, sizeof(errbuf));
-	pps_thread->log_hook(pps_thread, THREAD_ERROR,
-		"PPS:%s pthread_mutex_lock() : %s\n",
-	        pps_thread->devicename, errbuf);
-    }
+    (*seq)++;
+    memory_barrier();
+    memcpy((void *)dst, (const void *)src, len);
+    memory_barrier();
+    (*seq)++;
 }
 
-static void thread_unlock(volatile struct pps_thread_t *pps_thread)
+static bool seq_read(volatile unsigned int *seq,
+		     const volatile void *src, volatile void *dst,
+		     size_t len, int tries)
 {
-    int pthread_err = pthread_mutex_unlock(&ppslast_mutex);
-    if ( 0 != pthread_err ) {
-	char errbuf[BUFSIZ] = "unknown error";
-	pps_strerror_r(errno, errbuf, sizeof(errbuf));
-	pps_thread->log_hook(pps_thread, THREAD_ERROR,
-		    "TPPS:%s pthread_mutex_unlock() : %s\n",
-		    pps_thread->devicename, errno, errbuf);
+    while (tries-- > 0) {
+	union seq_object_t copy;
+	unsigned int before = *seq;
+
+	memory_barrier();
+	memcpy(&copy, (const void *)src, len);
+	memory_barrier();
+	if ((before & 1) == 0 && before == *seq) {
+	    memcpy((void *)dst, &copy, len);
+	    return true;
+	}
     }
+    return false;
 }
 
 #if defined(HAVE_SYS_TIMEPPS_H)
@@ -494,9 +520,8 @@ static int get_edge_tiocmiwait( volatile struct pps_thread_t *thread_context,
 
     /* duplicate copy in get_edge_rfc2783 */
     /* quick, grab a copy of last_fixtime before it changes */
-    thread_lock(thread_context);
-    *last_fixtime = thread_context->fix_in;
-    thread_unlock(thread_context);
+    (void)seq_read(&thread_context->fix_in_seq, &thread_context->fix_in,
+		   last_fixtime, sizeof(*last_fixtime), SEQ_READ_TRIES);
     /* end duplicate copy in get_edge_rfc2783 */
 
     /* get the time after we just woke up */
@@ -604,9 +629,8 @@ static int get_edge_rfc2783(struct inner_context_t *inner_context,
         /* get_edge_tiocmiwait() got this if !pps_canwait */
 
 	/* quick, grab a copy of last fixtime before it changes */
-	thread_lock(thread_context);
-	*last_fixtime = thread_context->fix_in;
-	thread_unlock(thread_context);
+	(void)seq_read(&thread_context->fix_in_seq, &thread_context->fix_in,
+		       last_fixtime, sizeof(*last_fixtime), SEQ_READ_TRIES);
     }
 
 
@@ -669,6 +693,116 @@ static int get_edge_rfc2783(struct inner_context_t *inner_context,
  * the core loop of the PPS thread.
  * All else is initialization, cleanup or subroutine
  */
+#define PPS_STATS_WEIGHT	(1.0 / 16)	/* rolling statistics weight */
+#define PPS_DISAGREE_NS		1000000	/* KPPS vs. TIOCMIWAIT tolerance */
+#define PPS_STACK_PREFAULT	(64 * 1024)	/* stack touched before edges */
+
+static void stats_publish(volatile struct pps_thread_t *thread_context,
+			  const struct pps_stats_t *stats)
+/* copy the thread's private statistics where the main loop can read them */
+{
+    seq_write(&thread_context->stats_seq, &thread_context->stats, stats,
+	      sizeof(*stats));
+}
+
+static void stats_edge(struct pps_stats_t *stats, long long interval_ns)
+/* fold the interval since the last accepted edge into the statistics */
+{
+    double interval = interval_ns / 1e9;
+
+    stats->edges++;
+    if (stats->edges < 2)
+	return;		/* first edge, no interval yet */
+    if (stats->edges == 2) {
+	stats->interval = interval;
+	return;
+    }
+    if (interval > stats->interval * 1.5) {
+	/* a gap, count what fell into it but keep it out of the mean */
+	stats->missed += (unsigned long)(interval / stats->interval + 0.5) - 1;
+    } else {
+	double diff = interval - stats->interval;
+	double incr = PPS_STATS_WEIGHT * diff;
+
+	stats->interval += incr;
+	stats->variance = (1 - PPS_STATS_WEIGHT) * (stats->variance + diff * incr);
+    }
+}
+
+static void pps_lock_memory(volatile struct pps_thread_t *thread_context,
+			    volatile char *prefault, size_t len)
+/* keep this thread's stack and context resident, and nothing else */
+{
+    void *stack = (void *)prefault;
+    size_t stacksize = len;
+#ifdef __linux__
+    pthread_attr_t attr;
+
+    /* the whole stack, which pps_thread_activate() kept small */
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+	if (pthread_attr_getstack(&attr, &stack, &stacksize) != 0) {
+	    stack = (void *)prefault;
+	    stacksize = len;
+	}
+	(void)pthread_attr_destroy(&attr);
+    }
+#endif /* __linux__ */
+    if (mlock(stack, stacksize) != 0
+	|| mlock((const void *)thread_context, sizeof(*thread_context)) != 0) {
+	char errbuf[BUFSIZ] = "unknown error";
+	pps_strerror_r(errno, errbuf, sizeof(errbuf));
+	thread_context->log_hook(thread_context, THREAD_WARN,
+		    "PPS:%s can't lock stack in memory: %s\n",
+		    thread_context->devicename, errbuf);
+    }
+}
+
+static void pps_realtime(volatile struct pps_thread_t *thread_context)
+/* in realtime mode, raise and pin this thread before the first edge */
+{
+    volatile char prefault[PPS_STACK_PREFAULT];
+    struct sched_param param;
+    size_t i;
+    int err;
+
+    /* touch the stack now so an edge never takes a page fault on it */
+    for (i = 0; i < sizeof(prefault); i += 512)
+	prefault[i] = 0;
+    pps_lock_memory(thread_context, prefault, sizeof(prefault));
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = thread_context->rtprio;
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (0 != err) {
+	char errbuf[BUFSIZ] = "unknown error";
+	pps_strerror_r(err, errbuf, sizeof(errbuf));
+	thread_context->log_hook(thread_context, THREAD_WARN,
+		    "PPS:%s can't set SCHED_FIFO priority %d: %s\n",
+		    thread_context->devicename, thread_context->rtprio, errbuf);
+    }
+#ifdef __linux__
+    if (0 <= thread_context->cpu) {
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(thread_context->cpu, &cpus);
+	err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if (0 != err) {
+	    char errbuf[BUFSIZ] = "unknown error";
+	    pps_strerror_r(err, errbuf, sizeof(errbuf));
+	    thread_context->log_hook(thread_context, THREAD_WARN,
+			"PPS:%s can't pin to CPU %d: %s\n",
+			thread_context->devicename, thread_context->cpu,
+			errbuf);
+	}
+    }
+#endif /* __linux__ */
+    thread_context->log_hook(thread_context, THREAD_INF,
+		"PPS:%s realtime, priority %d, CPU %d\n",
+		thread_context->devicename, thread_context->rtprio,
+		thread_context->cpu);
+}
+
 static void *gpsd_ppsmonitor(void *arg)
 {
     char ts_str1[TIMESPEC_LEN], ts_str2[TIMESPEC_LEN];
@@ -689,8 +823,14 @@ static void *gpsd_ppsmonitor(void *arg)
     int state_last = 0;
     /* edge, used as index into pulse to find previous edges */
     int edge = 0;       /* 0 = clear edge, 1 = assert edge */
+    /* rolling statistics, published after each accepted edge */
+    struct pps_stats_t stats;
+    struct timespec last_accepted = {0, 0};
 
 #if defined(TIOCMIWAIT)
+#if defined(HAVE_SYS_TIMEPPS_H)
+    bool have_tio = false;	/* TIOCMIWAIT saw this edge too */
+#endif /* HAVE_SYS_TIMEPPS_H */
     int edge_tio = 0;
     long long cycle_tio = 0;
     long long duration_tio = 0;
@@ -711,6 +851,10 @@ static void *gpsd_ppsmonitor(void *arg)
     /* Acknowledge that we've grabbed the inner_context data */
     ((volatile struct inner_context_t *)arg)->pps_thread = NULL;
 
+    memset(&stats, 0, sizeof(stats));
+    if (0 < thread_context->rtprio)
+	pps_realtime(thread_context);
+
     /* before the loop, figure out how we can detect edges:
      * TIOMCIWAIT, which is linux specifix
      * RFC2783, a.k.a kernel PPS (KPPS)
@@ -793,6 +937,9 @@ static void *gpsd_ppsmonitor(void *arg)
 
         /* Stage One; wait for the next edge */
 #if defined(TIOCMIWAIT)
+#if defined(HAVE_SYS_TIMEPPS_H)
+	have_tio = false;
+#endif /* HAVE_SYS_TIMEPPS_H */
         if ( !not_a_tty && !inner_context.pps_canwait ) {
             int ret;
 
@@ -829,6 +976,9 @@ static void *gpsd_ppsmonitor(void *arg)
 
             /* use this data */
             ok = true;
+#if defined(HAVE_SYS_TIMEPPS_H)
+	    have_tio = true;
+#endif /* HAVE_SYS_TIMEPPS_H */
 	    clock_ts = clock_ts_tio;
 	    state = edge_tio;
 	    edge = edge_tio;
@@ -895,6 +1045,17 @@ static void *gpsd_ppsmonitor(void *arg)
 	    pulse_kpps[edge_kpps ? 0 : 1] = prev_clock_ts;
             /* sanity checks are later */
 
+#if defined(TIOCMIWAIT)
+	    /* both saw this edge, do they agree on it? */
+	    if (have_tio
+		&& (edge_tio != edge_kpps
+		    || llabs(timespec_diff_ns(clock_ts_tio, clock_ts_kpps))
+		       > PPS_DISAGREE_NS)) {
+		stats.disagree++;
+		stats_publish(thread_context, &stats);
+	    }
+#endif /* TIOCMIWAIT */
+
             /* use this data */
 	    state = edge_kpps;
 	    edge = edge_kpps;
@@ -961,6 +1122,8 @@ static void *gpsd_ppsmonitor(void *arg)
         /* else, unchannged state, and weird cycle time */
 
 	state_last = state;
+	GPSD_PROBE4(pps_edge, thread_context->devicename, edge,
+		    clock_ts.tv_sec, clock_ts.tv_nsec);
 	timespec_str( &clock_ts, ts_str1, sizeof(ts_str1) );
 	thread_context->log_hook(thread_context, THREAD_PROG,
 	    "PPS:%s %.10s cycle: %7lld, duration: %7lld @ %s\n",
@@ -1194,14 +1357,20 @@ static void *gpsd_ppsmonitor(void *arg)
 	    log1 = "timestamp out of range";
 	} else {
 	    last_second_used = last_fixtime.real.tv_sec;
+	    /*
+	     * Publish before the report hook hands the event on, so
+	     * whoever takes it sees statistics that include this edge.
+	     */
+	    seq_write(&thread_context->pps_out_seq, &thread_context->pps_out,
+		      &ppstimes, sizeof(ppstimes));
+	    thread_context->ppsout_count++;
+	    stats_edge(&stats, timespec_diff_ns(clock_ts, last_accepted));
+	    last_accepted = clock_ts;
+	    stats_publish(thread_context, &stats);
 	    if (thread_context->report_hook != NULL)
 		log1 = thread_context->report_hook(thread_context, &ppstimes);
 	    else
 		log1 = "no report hook";
-	    thread_lock(thread_context);
-	    thread_context->pps_out = ppstimes;
-	    thread_context->ppsout_count++;
-	    thread_unlock(thread_context);
 	    timespec_str( &ppstimes.clock, ts_str1, sizeof(ts_str1) );
 	    timespec_str( &ppstimes.real, ts_str2, sizeof(ts_str2) );
 	    thread_context->log_hook(thread_context, THREAD_INF,
@@ -1272,7 +1441,18 @@ void pps_thread_activate(volatile struct pps_thread_t *pps_thread)
 #endif
 
     memset( &pt, 0, sizeof(pt));
-    retval = pthread_create(&pt, NULL, gpsd_ppsmonitor, (void *)&inner_context);
+    if (0 < pps_thread->rtprio) {
+	/* keep what pps_lock_memory() pins down small */
+	pthread_attr_t attr;
+
+	(void)pthread_attr_init(&attr);
+	(void)pthread_attr_setstacksize(&attr, PPS_THREAD_STACK);
+	retval = pthread_create(&pt, &attr, gpsd_ppsmonitor,
+				(void *)&inner_context);
+	(void)pthread_attr_destroy(&attr);
+    } else
+	retval = pthread_create(&pt, NULL, gpsd_ppsmonitor,
+				(void *)&inner_context);
     pps_thread->log_hook(pps_thread, THREAD_PROG, "PPS:%s thread %s\n",
 	        pps_thread->devicename,
 		(retval==0) ? "launched" : "FAILED");
@@ -1294,9 +1474,8 @@ void pps_thread_fixin(volatile struct pps_thread_t *pps_thread,
 			      volatile struct timedelta_t *fix_in)
 /* thread-safe update of last fix time - only way we pass data in */
 {
-    thread_lock(pps_thread);
-    pps_thread->fix_in = *fix_in;
-    thread_unlock(pps_thread);
+    seq_write(&pps_thread->fix_in_seq, &pps_thread->fix_in, fix_in,
+	      sizeof(*fix_in));
 }
 
 int pps_thread_ppsout(volatile struct pps_thread_t *pps_thread,
@@ -1305,13 +1484,59 @@ int pps_thread_ppsout(volatile struct pps_thread_t *pps_thread,
 {
     volatile int ret;
 
-    thread_lock(pps_thread);
-    *td = pps_thread->pps_out;
+    /* the PPS thread writes once a second, so this always succeeds */
+    while (!seq_read(&pps_thread->pps_out_seq, &pps_thread->pps_out,
+		     td, sizeof(*td), SEQ_READ_TRIES))
+	continue;
     ret = pps_thread->ppsout_count;
-    thread_unlock(pps_thread);
 
     return ret;
 }
 
+void pps_thread_post(volatile struct pps_thread_t *pps_thread,
+		     const struct timedelta_t *td)
+/* queue a PPS event for the main loop and wake it; PPS thread only */
+{
+    unsigned int head = pps_thread->event_head;
+    const uint64_t one = 1;
+
+    if (head - pps_thread->event_tail >= PPS_EVENT_DEPTH) {
+	/* main loop is behind; dropping beats blocking the edge path */
+	pps_thread->event_overruns++;
+	return;
+    }
+    pps_thread->events[head & (PPS_EVENT_DEPTH - 1)] = *td;
+    memory_barrier();
+    pps_thread->event_head = head + 1;
+    /* eventfd wants exactly 8 bytes, a pipe doesn't care */
+    if (pps_thread->wakefd >= 0)
+	(void)write(pps_thread->wakefd, &one, sizeof(one));
+}
+
+void pps_thread_stats(volatile struct pps_thread_t *pps_thread,
+		      struct pps_stats_t *stats)
+/* copy out the rolling edge statistics; main loop only */
+{
+    /* like pps_out, this is written at most once a second */
+    while (!seq_read(&pps_thread->stats_seq, &pps_thread->stats,
+		     stats, sizeof(*stats), SEQ_READ_TRIES))
+	continue;
+}
+
+bool pps_thread_event(volatile struct pps_thread_t *pps_thread,
+		      struct timedelta_t *td)
+/* take the oldest queued PPS event, if any; main loop only */
+{
+    unsigned int tail = pps_thread->event_tail;
+
+    if (tail == pps_thread->event_head)
+	return false;
+    memory_barrier();
+    *td = pps_thread->events[tail & (PPS_EVENT_DEPTH - 1)];
+    memory_barrier();
+    pps_thread->event_tail = tail + 1;
+    return true;
+}
+
 /* end */
 
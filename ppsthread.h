@@ -6,6 +6,7 @@
 #ifndef PPSTHREAD_H
 #define PPSTHREAD_H
 
+#include <stdbool.h>
 #include <time.h>
 
 #ifndef TIMEDELTA_DEFINED
@@ -17,17 +18,36 @@ struct timedelta_t {
 #endif /* TIMEDELTA_DEFINED */
 
 /*
- * Set context, devicefd, and devicename at initialization time, before
- * you call pps_thread_activate().  The context pointer can be used to
- * pass data to the hook routines.
+ * Set context, devicefd, devicename and wakefd at initialization time,
+ * before you call pps_thread_activate().  The context pointer can be
+ * used to pass data to the hook routines.
  *
- * Do not set the fix_in member or read the pps_out member directly,
- * these accesses need to be mutex-locked and that is what the last
- * two functions are for.
+ * Do not set the fix_in member or read the pps_out member directly.
+ * Each is a single-writer channel guarded by a sequence count rather
+ * than a mutex, so the PPS thread never waits on the main loop; use
+ * pps_thread_fixin() and pps_thread_ppsout().
  *
- * The report hook is called when each PPS event is recognized.  The log
- * hook is called to log error and status indications from the thread.
+ * The report hook is called, in the PPS thread, when each PPS event is
+ * recognized.  It may hand the event to the main loop with
+ * pps_thread_post(), which queues it and writes to wakefd; the main
+ * loop collects it with pps_thread_event().  The log hook is called to
+ * log error and status indications from the thread.
  */
+#define PPS_EVENT_DEPTH	8	/* queued PPS events, power of 2 */
+
+/*
+ * Rolling edge statistics, kept by the PPS thread and read with
+ * pps_thread_stats().  The interval mean and variance are
+ * exponentially weighted so they follow the recent behaviour.
+ */
+struct pps_stats_t {
+    unsigned long edges;	/* edges accepted */
+    unsigned long missed;	/* edges expected but never seen */
+    unsigned long disagree;	/* KPPS and TIOCMIWAIT saw different edges */
+    double interval;		/* mean interval between accepted edges, sec */
+    double variance;		/* variance of that interval, sec^2 */
+};
+
 struct pps_thread_t {
     void *context;		/* PPS thread code leaves this alone */
     int devicefd;		/* device file descriptor */
@@ -37,10 +57,24 @@ struct pps_thread_t {
     void (*log_hook)(volatile struct pps_thread_t *,
 		     int errlevel, const char *fmt, ...);
     struct timedelta_t fix_in;	/* real & clock time when in-band fix received */
+    unsigned int fix_in_seq;	/* odd while fix_in is being written */
     struct timedelta_t pps_out;	/* real & clock time of last PPS event */
+    unsigned int pps_out_seq;	/* odd while pps_out is being written */
     int ppsout_count;
+    /* events for the main loop, PPS thread writes head, main loop tail */
+    struct timedelta_t events[PPS_EVENT_DEPTH];
+    unsigned int event_head, event_tail;
+    unsigned long event_overruns;	/* events lost to a full queue */
+    int wakefd;			/* poked after each posted event, or -1 */
+    int rtprio;			/* SCHED_FIFO priority, 0 for normal */
+    int cpu;			/* CPU to pin the thread to, -1 for any */
+    struct pps_stats_t stats;
+    unsigned int stats_seq;	/* odd while stats is being written */
 };
 
+/* stack size of a realtime PPS thread, which locks it in memory */
+#define PPS_THREAD_STACK	(256 * 1024)
+
 #define THREAD_ERROR	0
 #define THREAD_WARN	1
 #define THREAD_INF	2
@@ -53,6 +87,12 @@ extern void pps_thread_fixin(volatile struct pps_thread_t *,
 				     volatile struct timedelta_t *);
 extern int pps_thread_ppsout(volatile struct pps_thread_t *,
 			      volatile struct timedelta_t *);
+extern void pps_thread_post(volatile struct pps_thread_t *,
+			    const struct timedelta_t *);
+extern bool pps_thread_event(volatile struct pps_thread_t *,
+			     struct timedelta_t *);
+extern void pps_thread_stats(volatile struct pps_thread_t *,
+			     struct pps_stats_t *);
 int pps_check_fake(const char *);
 char *pps_get_first(void);
 
@@ -307,11 +307,11 @@ static void gpsd_binary_quality_dump(struct gps_device_t *session,
 }
 
 /* Dump $GPZDA if we have time and a fix */
-static void gpsd_binary_time_dump(struct gps_device_t *session,
+static void gpsd_binary_time_dump(struct gps_device_t *session, int mode,
 				     char bufp[], size_t len)
 {
 
-    if (MODE_NO_FIX < session->newdata.mode &&
+    if (MODE_NO_FIX < mode &&
         0 != isfinite(session->gpsdata.fix.time)) {
 	struct tm tm;
 	char time_str[20];
@@ -467,18 +467,25 @@ static void gpsd_binary_ais_dump(struct gps_device_t *session,
 void nmea_tpv_dump(struct gps_device_t *session,
 		   char bufp[], size_t len)
 {
+    gps_mask_t set = session->gpsdata.set;
+    int mode = session->newdata.mode;
+
+    /* a cycle ender with no data of its own reports the whole epoch */
+    if ((set & (TIME_SET | LATLON_SET | MODE_SET)) == 0) {
+	set = session->cycle_set;
+	mode = session->gpsdata.fix.mode;
+    }
     bufp[0] = '\0';
-    if ((session->gpsdata.set & TIME_SET) != 0)
-	gpsd_binary_time_dump(session, bufp + strlen(bufp),
+    if ((set & TIME_SET) != 0)
+	gpsd_binary_time_dump(session, mode, bufp + strlen(bufp),
 			      len - strlen(bufp));
-    if ((session->gpsdata.set & LATLON_SET) != 0) {
+    if ((set & LATLON_SET) != 0) {
 	gpsd_position_fix_dump(session, bufp + strlen(bufp),
 			       len - strlen(bufp));
 	gpsd_transit_fix_dump(session, bufp + strlen(bufp),
 			      len - strlen(bufp));
     }
-    if ((session->gpsdata.set
-	 & (MODE_SET | DOP_SET | USED_IS | HERR_SET)) != 0)
+    if ((set & (MODE_SET | DOP_SET | USED_IS | HERR_SET)) != 0)
 	gpsd_binary_quality_dump(session, bufp + strlen(bufp),
 				 len - strlen(bufp));
 }
@@ -26,6 +26,7 @@
 #define GPSD_PY_MODULE_SUCCESS_VAL(val) val
 
 #define GPSD_PY_BYTE_FORMAT "y#"
+#define GPSD_PY_BUFFER_FORMAT "y*"
 
 #else /* !Python 3 */
 
@@ -38,6 +39,7 @@
 #define GPSD_PY_MODULE_SUCCESS_VAL(val)
 
 #define GPSD_PY_BYTE_FORMAT "s#"
+#define GPSD_PY_BUFFER_FORMAT "s*"
 
 #endif /* !Python 3 */
 
@@ -648,7 +648,8 @@ ssize_t gpsd_serial_write(struct gps_device_t * session,
     ssize_t status;
     bool ok;
     if (session == NULL ||
-	session->context == NULL || session->context->readonly)
+	session->context == NULL || session->context->readonly ||
+	session->sourcetype == source_replay)
 	return 0;
     status = write(session->gpsdata.gps_fd, buf, len);
     ok = (status == (ssize_t) len);
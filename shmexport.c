@@ -29,6 +29,7 @@ PERMISSIONS
 
 #include "gpsd.h"
 #include "libgps.h" /* for SHM_PSEUDO_FD */
+#include "tracepoints.h"
 
 
 bool shm_acquire(struct gps_context_t *context)
@@ -91,6 +92,7 @@ void shm_update(struct gps_context_t *context, struct gps_data_t *gpsdata)
 	volatile struct shmexport_t *shared = (struct shmexport_t *)context->shmexport;
 
 	++tick;
+	GPSD_PROBE3(shm_update, gpsdata->dev.path, gpsdata->set, tick);
 	/*
 	 * Following block of instructions must not be reordered, otherwise
 	 * havoc will ensue.
@@ -202,6 +202,7 @@ gps_mask_t gpsd_interpret_subframe(struct gps_device_t *session,
     subp->pageid  = (words[2] >> 16) & 0x00003F; /* only in frames 4 & 5 */
     subp->data_id = (words[2] >> 22) & 0x3;      /* only in frames 4 & 5 */
     subp->is_almanac = 0;
+    gpsd_assist_subframe(session->context, tSVID, words);
 
     switch (subp->subframe_num) {
     case 1:
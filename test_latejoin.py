@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+#
+# Test the replay of cached reports to a late-joining watcher.
+#
+# A log is fed to the daemon on a simulated clock before anyone watches,
+# then the clock is stepped on and two clients enable a JSON watch, one
+# of them asking for timing.  Each must get the device's TPV and SKY
+# straight after its WATCH response, flagged "cached" and carrying the
+# age of the last report, rendered under that client's own policy.
+#
+# This file is Copyright (c) 2019 by the GPSD project
+# SPDX-License-Identifier: BSD-2-clause
+#
+# This code runs compatibly under Python 2 and 3.x for x >= 2.
+# Preserve this property!
+from __future__ import absolute_import, print_function, division
+
+import json
+import socket
+import sys
+
+import gps.fake
+
+LOG = "test/daemon/bu303-moving.log"
+# how far the clock is stepped after the log's last report
+IDLE = 5.0
+
+errors = 0
+
+
+def check(ok, what):
+    "Count a failed check, and report it."
+    global errors
+    if not ok:
+        errors += 1
+        sys.stderr.write("latejoin test: FAIL: %s\n" % what)
+    else:
+        print("%s OK" % what)
+
+
+def watch(port, request):
+    "Enable a watch, return the reports that follow the WATCH response."
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.settimeout(1.0)
+    sock.sendall(gps.polybytes(request + "\n"))
+    data = b""
+    try:
+        while True:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    except socket.timeout:
+        pass
+    sock.close()
+    reports = [json.loads(gps.polystr(line))
+               for line in data.splitlines() if line.strip()]
+    classes = [report.get("class") for report in reports]
+    if "WATCH" not in classes:
+        return []
+    return reports[classes.index("WATCH") + 1:]
+
+
+test = gps.fake.TestSession(options="-n", virtual=True)
+try:
+    test.spawn()
+    name = test.gps_add(LOG)
+    fake = test.fakegpslist[name]
+    for line in fake.testload.sentences:
+        fake.feed()
+    test.advance(IDLE)
+
+    for (request, timing) in (('?WATCH={"enable":true,"json":true};', False),
+                              ('?WATCH={"enable":true,"json":true,'
+                               '"timing":true};', True)):
+        how = "timing" if timing else "plain"
+        reports = watch(test.port, request)
+        bycls = dict((report.get("class"), report) for report in reports)
+        for cls in ("TPV", "SKY"):
+            report = bycls.get(cls, {})
+            check(report.get("device") == name,
+                  "%s watcher gets a cached %s" % (how, cls))
+            check(report.get("cached") is True,
+                  "%s watcher's %s is flagged cached" % (how, cls))
+            check(IDLE <= report.get("age", -1) < IDLE + 1,
+                  "%s watcher's %s is %s seconds old"
+                  % (how, cls, report.get("age")))
+        check(reports and all(report.get("cached") for report in reports),
+              "%s watcher gets nothing but cached reports" % how)
+        check(("rtime" in bycls.get("TPV", {})) == timing,
+              "%s watcher's TPV follows its timing policy" % how)
+finally:
+    test.cleanup()
+
+if errors:
+    sys.exit(1)
+else:
+    sys.exit(0)
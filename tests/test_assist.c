@@ -0,0 +1,242 @@
+/* test driver for warm-start aiding
+ *
+ * Each log is replayed into a fresh session twice, after loading a
+ * saved aiding state with the clock frozen at a fixed time, and what
+ * the drivers write back to the receiver is captured through the
+ * context's serial_write hook.  The aiding messages written must be
+ * those the log's "# Aiding:" header line names, in order; that catches
+ * aiding sent before MON-VER says which protocol the receiver speaks.
+ * The second replay is read-only and must neither write any aiding nor
+ * claim to have aided.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#include "../gpsd_config.h"  /* must be before all includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../gpsd.h"
+#include "../bits.h"
+#include "../strfuncs.h"
+#include "../timespec.h"
+#include "test_check.h"
+
+/* 2019-07-01T00:00:00Z, what the times in the state file are relative to */
+#define ASSIST_EPOCH	1561939200
+
+#define MAX_WRITES	65536
+#define MAX_PACKETS	256
+
+static unsigned char written[MAX_WRITES];
+static size_t writtenlen;
+static bool aided;
+
+static ssize_t capture_write(struct gps_device_t *session,
+			     const char *buf, const size_t len)
+/* keep what the driver sends the receiver */
+{
+    size_t n = len;
+
+    (void)session;
+    if (n > sizeof(written) - writtenlen)
+	n = sizeof(written) - writtenlen;
+    (void)memcpy(written + writtenlen, buf, n);
+    writtenlen += n;
+    return (ssize_t)len;
+}
+
+static void capture_report(const char *buf)
+/* watch the log for a driver claiming to have aided */
+{
+    if (strstr(buf, "aided") != NULL)
+	aided = true;
+    if (verbose > 1)
+	(void)fputs(buf, stderr);
+}
+
+static void aiding_list(char *list, size_t size)
+/* name the aiding messages among those written */
+{
+    static const struct {
+	unsigned char class, id;
+	const char *name;
+    } ubx_aiding[] = {
+	{0x0b, 0x01, "AID-INI"},
+	{0x0b, 0x30, "AID-ALM"},
+	{0x0b, 0x31, "AID-EPH"},
+	{0x13, 0x40, "MGA-INI"},
+    };
+    size_t i = 0;
+    unsigned int j;
+
+    list[0] = '\0';
+    while (i + 4 <= writtenlen) {
+	const unsigned char *p = written + i;
+	const char *name = NULL;
+	size_t len;
+
+	if (p[0] == 0xb5 && p[1] == 0x62 && i + 6 <= writtenlen) {
+	    for (j = 0; j < sizeof(ubx_aiding) / sizeof(ubx_aiding[0]); j++)
+		if (p[2] == ubx_aiding[j].class && p[3] == ubx_aiding[j].id)
+		    name = ubx_aiding[j].name;
+	    len = 8 + (size_t)getleu16(p, 4);
+	} else if (p[0] == 0xa0 && p[1] == 0xa2) {
+	    if (p[4] == 0x80)
+		name = "MID-128";
+	    len = 8 + (size_t)getbeu16(p, 2);
+	} else {
+	    /* NMEA or anything else; skip to the next byte */
+	    len = 1;
+	}
+	if (name != NULL) {
+	    if (list[0] != '\0')
+		(void)strlcat(list, " ", size);
+	    (void)strlcat(list, name, size);
+	}
+	i += len;
+    }
+    if (list[0] == '\0')
+	(void)strlcpy(list, "none", size);
+}
+
+static void replay(const char *logfile, const char *statefile,
+		   bool readonly, char *expect, size_t expectsize)
+/* feed the log to a fresh session a packet at a time */
+{
+    struct gps_context_t context;
+    struct gps_device_t session;
+    struct gps_lexer_t lexer;
+    static struct {
+	unsigned char buf[MAX_PACKET_LENGTH];
+	size_t len;
+    } packets[MAX_PACKETS];
+    struct timespec epoch = {ASSIST_EPOCH, 0};
+    int npackets = 0, sent = 0;
+    int fd, pipefd[2];
+
+    if ((fd = open(logfile, O_RDONLY)) == -1) {
+	(void)fprintf(stderr, "test_assist: can't read %s\n", logfile);
+	exit(EXIT_FAILURE);
+    }
+    lexer_init(&lexer);
+    while (packet_get(fd, &lexer) > 0) {
+	if (lexer.type == COMMENT_PACKET) {
+	    char *aiding = strstr((char *)lexer.outbuffer, "# Aiding: ");
+
+	    if (aiding != NULL && expect != NULL) {
+		(void)strlcpy(expect, aiding + 10, expectsize);
+		expect[strcspn(expect, "\r\n")] = '\0';
+	    }
+	} else if (lexer.outbuflen > 0 && npackets < MAX_PACKETS) {
+	    (void)memcpy(packets[npackets].buf, lexer.outbuffer,
+			 lexer.outbuflen);
+	    packets[npackets++].len = lexer.outbuflen;
+	}
+    }
+    (void)close(fd);
+
+    if (pipe(pipefd) == -1) {
+	(void)perror("test_assist: pipe");
+	exit(EXIT_FAILURE);
+    }
+    (void)fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    gps_clock_set(&epoch);
+    gps_context_init(&context, "test_assist");
+    context.errout.debug = LOG_INF;
+    context.errout.report = capture_report;
+    context.readonly = readonly;
+    context.serial_write = capture_write;
+    gpsd_time_init(&context, gps_clock_time());
+    if (!gpsd_assist_load(&context, statefile)) {
+	(void)fprintf(stderr, "test_assist: can't load %s\n", statefile);
+	exit(EXIT_FAILURE);
+    }
+    memset(&session, '\0', sizeof(session));
+    gpsd_init(&session, &context, NULL);
+    gpsd_clear(&session);
+    session.gpsdata.gps_fd = pipefd[0];
+    session.sourcetype = source_pty;
+    session.gpsdata.dev.baudrate = 38400;
+    (void)strlcpy(session.gpsdata.dev.path, "test_assist",
+		  sizeof(session.gpsdata.dev.path));
+
+    writtenlen = 0;
+    aided = false;
+    for (;;) {
+	gps_mask_t changed = gpsd_poll(&session);
+
+	if (changed == EOF_IS || changed == ERROR_SET)
+	    break;
+	if (changed == NODATA_IS) {
+	    if (sent == npackets)
+		break;
+	    if (write(pipefd[1], packets[sent].buf, packets[sent].len)
+		!= (ssize_t)packets[sent].len)
+		break;
+	    sent++;
+	}
+    }
+    (void)close(pipefd[0]);
+    (void)close(pipefd[1]);
+    if (sent != npackets) {
+	(void)fprintf(stderr, "test_assist: %s replay stopped at packet %d\n",
+		      logfile, sent);
+	failures++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *statefile = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:v")) != -1) {
+	switch (option) {
+	case 's':
+	    statefile = optarg;
+	    break;
+	case 'v':
+	    verbose++;
+	    break;
+	default:
+	    statefile = NULL;
+	    optind = argc;
+	    break;
+	}
+    }
+    if (statefile == NULL || optind >= argc) {
+	(void)fputs("usage: test_assist [-v] -s statefile logfile...\n",
+		    stderr);
+	exit(EXIT_FAILURE);
+    }
+
+    for (; optind < argc; optind++) {
+	const char *logfile = argv[optind];
+	char expect[BUFSIZ] = "", got[BUFSIZ], what[BUFSIZ * 2 + 64];
+
+	replay(logfile, statefile, false, expect, sizeof(expect));
+	aiding_list(got, sizeof(got));
+	if (expect[0] == '\0') {
+	    (void)fprintf(stderr, "test_assist: %s has no Aiding header\n",
+			  logfile);
+	    failures++;
+	    continue;
+	}
+	(void)snprintf(what, sizeof(what), "aiding %s, expected %s",
+		       got, expect);
+	check(strcmp(got, expect) == 0, "%s: %s", logfile, what);
+
+	replay(logfile, statefile, true, NULL, 0);
+	aiding_list(got, sizeof(got));
+	(void)snprintf(what, sizeof(what), "read-only aiding %s", got);
+	check(strcmp(got, "none") == 0, "%s: %s", logfile, what);
+	check(!aided, "%s: read-only session doesn't claim aiding", logfile);
+    }
+    check_exit("test_assist");
+}
@@ -125,6 +125,17 @@ int main(int argc, char *argv[])
 	{buf, 32, 7,  0x20, true, "first seven bits of fifth byte (0x05)"},
 	{buf, 56, 12, 0xf10,true, "12 bits crossing 7th to 8th bytes (0x08ff)"},
 	{buf, 78, 4,  0xd,  true, "4 bits crossing 8th to 9th byte (0xfefd)"},
+	/* fields far enough in to be fetched with one 64-bit load */
+	{buf, 64, 16, 0xfffe, false, "9th and 10th bytes"},
+	{buf, 60, 8,  0x8f, false, "8 bits crossing 8th to 9th bytes (0x08ff)"},
+	{buf, 128, 64, 0x400921fb54442d18, false, "bytes 17 to 24 (pi)"},
+	{buf, 131, 25, 0x921f, false, "25 bits inside bytes 17 to 20"},
+	{buf, 64, 16, 0x7fff, true, "9th and 10th bytes"},
+	{buf, 128, 64, 0x18b4222adf849002, true, "bytes 17 to 24 (pi)"},
+	{buf, 131, 25, 0x1f09200, true, "25 bits inside bytes 17 to 20"},
+	/* a field straddling 9 bytes */
+	{buf, 68, 64, 0xffefdfcfbfaf9f84, false, "64 bits from the 9th byte's low nibble"},
+	{buf, 68, 64, 0x21f9f5fdf3fbf7ff, true, "64 bits from the 9th byte's low nibble"},
 	/* sporadic tests based on found bugs */
 	{(unsigned char *)"\x19\x23\f6",
 	 7, 2, 2, false, "2 bits crossing 1st to 2nd byte (0x1923)"},
@@ -209,6 +220,26 @@ int main(int argc, char *argv[])
 			 success ? "succeeded" : "FAILED");
     }
 
+    {
+	/* consecutive fields through a cursor */
+	struct bitreader_t br;
+	uint64_t u1, u2;
+	int64_t s3;
+
+	bitreader_init(&br, buf, 64);
+	u1 = bitreader_u(&br, 8);
+	u2 = bitreader_u(&br, 4);
+	s3 = bitreader_s(&br, 12);
+	bitreader_skip(&br, 20);
+	if (u1 != 0xff || u2 != 0xf || s3 != -259 || br.pos != 108) {
+	    failures = true;
+	    (void)printf("bitreader from bit 64 read %" PRIx64 " %" PRIx64
+			 " %" PRId64 " ending at %u, should be "
+			 "ff f -259 ending at 108: FAILED\n",
+			 u1, u2, s3, br.pos);
+	} else if (!quiet)
+	    (void)printf("bitreader from bit 64: succeeded\n");
+    }
 
     shiftleft(buf, 28, 30);
     if (!quiet)
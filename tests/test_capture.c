@@ -0,0 +1,266 @@
+/* test driver for input capture and replay:// playback
+ *
+ * Each log is fed a packet per read through a session capturing its
+ * input, with the clock frozen and stepped a quarter second per read,
+ * so the capture index must hold an entry for every fourth record.
+ * The capture is then played back through replay:// from several start
+ * times, which go through the binary search of the index, and at a
+ * finite speed, which goes through the feeder's pacing.  Every replay
+ * must yield exactly the packets captured from its start time on.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#include "../gpsd_config.h"  /* must be before all includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../gpsd.h"
+#include "../strfuncs.h"
+#include "../timespec.h"
+#include "test_check.h"
+
+/* 2019-07-01T00:00:00Z, when the captures start */
+#define CAPTURE_EPOCH	1561939200
+/* clock step per read, a quarter of the index interval */
+#define CAPTURE_STEP	250000000L
+
+#define MAX_PACKETS	1024
+
+struct packet_t {
+    unsigned char buf[MAX_PACKET_LENGTH];
+    size_t len;
+    int record;			/* the read it came in, in a capture */
+};
+
+static struct packet_t logged[MAX_PACKETS], captured[MAX_PACKETS];
+static struct packet_t replayed[MAX_PACKETS];
+static int nlogged, ncaptured;
+
+static void record_time(int record, struct timespec *ts)
+/* when a read is made during capture */
+{
+    long long ns = (long long)record * CAPTURE_STEP;
+
+    ts->tv_sec = CAPTURE_EPOCH + (time_t)(ns / 1000000000L);
+    ts->tv_nsec = (long)(ns % 1000000000L);
+}
+
+static void keep(struct packet_t *list, int *count,
+		 const struct gps_lexer_t *lexer, int record)
+/* add the packet the lexer just gathered to a list */
+{
+    if (*count >= MAX_PACKETS || lexer->outbuflen > MAX_PACKET_LENGTH)
+	return;
+    (void)memcpy(list[*count].buf, lexer->outbuffer, lexer->outbuflen);
+    list[*count].len = lexer->outbuflen;
+    list[*count].record = record;
+    (*count)++;
+}
+
+static void read_log(const char *logfile)
+/* split a test log into its packets, leaving out comments */
+{
+    struct gps_lexer_t lexer;
+    int fd;
+
+    if ((fd = open(logfile, O_RDONLY)) == -1) {
+	(void)fprintf(stderr, "test_capture: can't read %s\n", logfile);
+	exit(EXIT_FAILURE);
+    }
+    lexer_init(&lexer);
+    nlogged = 0;
+    while (packet_get(fd, &lexer) > 0)
+	if (lexer.type != COMMENT_PACKET && lexer.outbuflen > 0)
+	    keep(logged, &nlogged, &lexer, 0);
+    (void)close(fd);
+}
+
+static void capture(struct gps_context_t *context, const char *dir)
+/* feed the log's packets, one read each, to a capturing session */
+{
+    static struct gps_device_t session;
+    int pipefd[2];
+    int i;
+
+    if (pipe(pipefd) == -1) {
+	(void)perror("test_capture: pipe");
+	exit(EXIT_FAILURE);
+    }
+    (void)fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    context->capture_dir = dir;
+    memset(&session, '\0', sizeof(session));
+    gpsd_init(&session, context, "test_capture");
+    gpsd_capture_open(&session);
+    if (session.lexer.capture == NULL) {
+	(void)fprintf(stderr, "test_capture: can't capture to %s\n", dir);
+	exit(EXIT_FAILURE);
+    }
+
+    ncaptured = 0;
+    for (i = 0; i < nlogged; i++) {
+	struct timespec ts;
+
+	record_time(i, &ts);
+	gps_clock_set(&ts);
+	if (write(pipefd[1], logged[i].buf, logged[i].len)
+	    != (ssize_t)logged[i].len) {
+	    (void)perror("test_capture: write");
+	    exit(EXIT_FAILURE);
+	}
+	while (packet_get(pipefd[0], &session.lexer) > 0)
+	    if (session.lexer.outbuflen > 0)
+		keep(captured, &ncaptured, &session.lexer, i);
+    }
+    gpsd_capture_close(&session);
+    (void)close(pipefd[0]);
+    (void)close(pipefd[1]);
+}
+
+static int replay(struct gps_context_t *context, const char *log,
+		  const char *options)
+/* play the capture back, return how many packets came out */
+{
+    static struct gps_device_t session;
+    char path[GPS_PATH_MAX];
+    int count = 0;
+
+    (void)snprintf(path, sizeof(path), "replay://%s%s", log, options);
+    memset(&session, '\0', sizeof(session));
+    gpsd_init(&session, context, path);
+    if (gpsd_replay_open(&session) == -1) {
+	check(false, "replay of %s starts", path);
+	return -1;
+    }
+    /* the feeder closes its end after the last record */
+    while (packet_get(session.gpsdata.gps_fd, &session.lexer) > 0)
+	if (session.lexer.outbuflen > 0)
+	    keep(replayed, &count, &session.lexer, 0);
+    (void)close(session.gpsdata.gps_fd);
+    return count;
+}
+
+static void compare(const char *logfile, int first, int count,
+		    const char *how)
+/* the replay must match the capture from its first packet on */
+{
+    int expect = ncaptured - first, i;
+
+    if (count != expect) {
+	check(false, "%s: %s gave %d packets, expected %d",
+	      logfile, how, count, expect);
+	return;
+    }
+    for (i = 0; i < count; i++)
+	if (replayed[i].len != captured[first + i].len
+	    || memcmp(replayed[i].buf, captured[first + i].buf,
+		      replayed[i].len) != 0) {
+	    check(false, "%s: %s differs at packet %d", logfile, how, i);
+	    return;
+	}
+    check(true, "%s: %s gave the %d packets captured", logfile, how, count);
+}
+
+static void test_log(const char *logfile, const char *dir)
+{
+    struct gps_context_t context;
+    char log[GPS_PATH_MAX], idx[GPS_PATH_MAX + 4], how[64];
+    struct timespec epoch = {CAPTURE_EPOCH, 0}, t0, t1;
+    struct stat sb;
+    off_t entries;
+    int starts[4], i;
+    double elapsed;
+
+    read_log(logfile);
+    if (nlogged < 8) {
+	(void)fprintf(stderr, "test_capture: %s is too short\n", logfile);
+	failures++;
+	return;
+    }
+
+    gps_clock_set(&epoch);
+    gps_context_init(&context, "test_capture");
+    context.errout.debug = (verbose > 1) ? LOG_PROG : LOG_ERROR;
+    capture(&context, dir);
+    gps_clock_set(NULL);
+
+    (void)snprintf(log, sizeof(log), "%s/test_capture.gpscap", dir);
+    (void)snprintf(idx, sizeof(idx), "%s.idx", log);
+    entries = (stat(idx, &sb) == 0) ? sb.st_size / CAPTURE_INDEX_ENTRY : -1;
+    check(entries == (nlogged + 3) / 4,
+	  "%s: index holds %lld entries for %d reads a quarter second apart",
+	  logfile, (long long)entries, nlogged);
+
+    /* from the start, then from an indexed read, between, and past the end */
+    starts[0] = 0;
+    starts[1] = 4;
+    starts[2] = nlogged / 2 + 1;
+    starts[3] = nlogged + 4;
+    for (i = 0; i < 4; i++) {
+	char options[64] = "?speed=max";
+	struct timespec ts;
+	int first;
+
+	if (starts[i] > 0) {
+	    /* half a step early, to stay clear of rounding */
+	    record_time(starts[i], &ts);
+	    str_appendf(options, sizeof(options), "&start=%.3f",
+			(double)ts.tv_sec + ts.tv_nsec * 1e-9
+			- CAPTURE_STEP * 0.5e-9);
+	}
+	for (first = 0; first < ncaptured; first++)
+	    if (captured[first].record >= starts[i])
+		break;
+	(void)snprintf(how, sizeof(how), "replay from read %d", starts[i]);
+	compare(logfile, first, replay(&context, log, options), how);
+    }
+
+    /* paced at 100 times the recorded speed, it mustn't come out faster */
+    (void)clock_gettime(CLOCK_MONOTONIC, &t0);
+    compare(logfile, 0, replay(&context, log, "?speed=100"), "paced replay");
+    (void)clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed = (double)(t1.tv_sec - t0.tv_sec)
+	      + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    check(elapsed >= (nlogged - 1) * CAPTURE_STEP * 1e-9 / 100 * 0.9,
+	  "%s: paced replay took %.3f s", logfile, elapsed);
+
+    (void)unlink(idx);
+    (void)unlink(log);
+}
+
+int main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/test_capture.XXXXXX";
+    int option;
+
+    while ((option = getopt(argc, argv, "v")) != -1) {
+	switch (option) {
+	case 'v':
+	    verbose++;
+	    break;
+	default:
+	    optind = argc + 1;
+	    break;
+	}
+    }
+    if (optind >= argc) {
+	(void)fputs("usage: test_capture [-v] logfile...\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+    if (mkdtemp(dir) == NULL) {
+	(void)perror("test_capture: mkdtemp");
+	exit(EXIT_FAILURE);
+    }
+
+    for (; optind < argc; optind++)
+	test_log(argv[optind], dir);
+    (void)rmdir(dir);
+    check_exit("test_capture");
+}
@@ -0,0 +1,50 @@
+/* test_check.h -- pass/fail bookkeeping for the unit tests
+ *
+ * A test includes this once, bumps verbose for each -v, makes its
+ * checks with check() and leaves through check_exit().  Unlike the
+ * assert_* helpers in test_json.c a failed check does not stop the
+ * run, so one pass reports every check that failed.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#ifndef _GPSD_TEST_CHECK_H_
+#define _GPSD_TEST_CHECK_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../compiler.h"	/* for PRINTF_FUNC */
+
+static int verbose = 0;
+static int failures = 0;
+
+static void check(bool ok, const char *fmt, ...) PRINTF_FUNC(2, 3);
+
+static void check(bool ok, const char *fmt, ...)
+/* count a failed check; report it, and passes too when verbose */
+{
+    va_list ap;
+
+    if (!ok)
+	failures++;
+    if (ok && verbose == 0)
+	return;
+    (void)fputs(ok ? "pass: " : "FAIL: ", stdout);
+    va_start(ap, fmt);
+    (void)vprintf(fmt, ap);
+    va_end(ap);
+    (void)putchar('\n');
+}
+
+static void check_exit(const char *progname)
+/* sum up and exit, failing if any check did */
+{
+    if (failures > 0)
+	(void)printf("%s: %d checks failed\n", progname, failures);
+    exit(failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+#endif /* _GPSD_TEST_CHECK_H_ */
@@ -0,0 +1,239 @@
+/* test driver for gpsmm_mux
+ *
+ * A stub daemon on the loopback interface feeds canned TPV reports to
+ * several mux connections.  Each report's latitude is its sequence
+ * number, so the order next() hands them back in can be checked: turn
+ * about between connections, first-in first-out within one.  A
+ * connection whose queue is full must stop being read and resume once
+ * next() drains it, and one whose daemon goes away in the middle of a
+ * line must be declared dead rather than polled for ever.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#include "../gpsd_config.h"  /* must be before all includes */
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../libgpsmm.h"
+
+#if __cplusplus >= 201103L
+#include "test_check.h"
+
+/* how long a step may take before the test gives up on it */
+#define STEP_TIMEOUT	5
+
+static int listener = -1;
+static char port[16];
+
+static void stub_listen(void)
+/* open the stub daemon's listening socket on an ephemeral port */
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listener = socket(AF_INET, SOCK_STREAM, 0)) == -1
+	|| bind(listener, (struct sockaddr *)&sin, sizeof(sin)) == -1
+	|| listen(listener, 8) == -1
+	|| getsockname(listener, (struct sockaddr *)&sin, &len) == -1) {
+	(void)perror("test_gpsmm_mux: listen");
+	exit(EXIT_FAILURE);
+    }
+    (void)snprintf(port, sizeof(port), "%u", (unsigned)ntohs(sin.sin_port));
+}
+
+static int stub_connect(gpsmm_mux &mux, int *conn)
+/* add a mux connection to the stub, return the stub's end of it */
+{
+    int fd;
+
+    if ((*conn = mux.add("127.0.0.1", port)) == -1
+	|| (fd = accept(listener, NULL, NULL)) == -1) {
+	(void)fputs("test_gpsmm_mux: can't connect to the stub\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static void stub_send(int fd, const char *device, int first, int count)
+/* send numbered TPV reports */
+{
+    char line[256];
+
+    for (int i = first; i < first + count; i++) {
+	int len = snprintf(line, sizeof(line),
+			   "{\"class\":\"TPV\",\"device\":\"%s\",\"mode\":2,"
+			   "\"lat\":%d.0,\"lon\":0.0}\r\n", device, i);
+
+	if (write(fd, line, (size_t)len) != len) {
+	    (void)perror("test_gpsmm_mux: write");
+	    exit(EXIT_FAILURE);
+	}
+    }
+}
+
+static void stub_hangup(int fd)
+/* close cleanly, having read the ?WATCH, so the client sees EOF not RST */
+{
+    char junk[BUFSIZ];
+
+    (void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    while (read(fd, junk, sizeof(junk)) > 0)
+	continue;
+    (void)close(fd);
+}
+
+static bool pump(gpsmm_mux &mux, bool (*done)(gpsmm_mux &, int), int conn)
+/* run the reactor until done() holds, or give up */
+{
+    time_t start = time(NULL);
+
+    while (!done(mux, conn)) {
+	if (time(NULL) - start > STEP_TIMEOUT)
+	    return false;
+	if (mux.run_once(100) == -1)
+	    return done(mux, conn);
+    }
+    return true;
+}
+
+static void test_fairness(void)
+/* two connections with reports waiting take turns */
+{
+    gpsmm_mux mux(2, 64);
+    int a, b, afd, bfd;
+    struct gps_event ev;
+    int last[2] = {0, 0}, prev = -1;
+    bool alternate = true, ordered = true;
+
+    afd = stub_connect(mux, &a);
+    bfd = stub_connect(mux, &b);
+    stub_send(afd, "/dev/a", 1, 5);
+    stub_send(bfd, "/dev/b", 1, 5);
+    check(pump(mux, [](gpsmm_mux &m, int c) {
+		/* b was added right after a */
+		return m.pending(c) == 5 && m.pending(c + 1) == 5; }, a),
+	  "fairness: both connections queued their reports");
+    for (int i = 0; i < 10; i++) {
+	if (!mux.next(ev)) {
+	    check(false, "fairness: next() ran dry after %d events", i);
+	    break;
+	}
+	if (ev.conn == prev)
+	    alternate = false;
+	prev = ev.conn;
+	if ((int)ev.fix.latitude != last[ev.conn] + 1)
+	    ordered = false;
+	last[ev.conn] = (int)ev.fix.latitude;
+	if (ev.device != (ev.conn == a ? "/dev/a" : "/dev/b"))
+	    ordered = false;
+    }
+    check(alternate, "fairness: next() alternates between connections");
+    check(ordered, "fairness: each connection's reports come in order");
+    check(!mux.next(ev), "fairness: nothing left after ten events");
+    (void)close(afd);
+    (void)close(bfd);
+}
+
+static void test_limit(void)
+/* a full queue stops reading until next() makes room */
+{
+    gpsmm_mux mux(1, 4);
+    int a, afd, got = 0;
+    struct gps_event ev;
+    bool ordered = true, bounded = true;
+    time_t start;
+
+    afd = stub_connect(mux, &a);
+    stub_send(afd, "/dev/a", 1, 10);
+    check(pump(mux, [](gpsmm_mux &m, int c) {
+		return m.throttled(c); }, a),
+	  "limit: queue fills");
+    for (int i = 0; i < 5; i++)
+	(void)mux.run_once(20);
+    check(mux.pending(a) == 4,
+	  "limit: stays at the limit, %zu pending", mux.pending(a));
+    check(mux.throttled(a), "limit: connection is throttled");
+
+    start = time(NULL);
+    while (got < 10 && time(NULL) - start <= STEP_TIMEOUT) {
+	if (mux.pending(a) > 4)
+	    bounded = false;
+	if (mux.next(ev)) {
+	    if ((int)ev.fix.latitude != ++got)
+		ordered = false;
+	} else
+	    (void)mux.run_once(100);
+    }
+    check(got == 10, "limit: all reports arrive once drained, got %d", got);
+    check(ordered, "limit: backlogged reports keep their order");
+    check(bounded, "limit: queue never grows past the limit");
+    check(!mux.throttled(a), "limit: connection no longer throttled");
+    (void)close(afd);
+}
+
+static void test_hangup(void)
+/* a daemon dying in the middle of a line ends the connection */
+{
+    gpsmm_mux mux(1, 64);
+    int a, afd;
+    struct gps_event ev;
+    static const char partial[] = "{\"class\":\"TPV\",\"device\":\"/dev/a\",";
+
+    afd = stub_connect(mux, &a);
+    stub_send(afd, "/dev/a", 1, 1);
+    if (write(afd, partial, sizeof(partial) - 1)
+	!= (ssize_t)sizeof(partial) - 1) {
+	(void)perror("test_gpsmm_mux: write");
+	exit(EXIT_FAILURE);
+    }
+    stub_hangup(afd);
+    check(pump(mux, [](gpsmm_mux &m, int c) { return !m.alive(c); }, a),
+	  "hangup: connection dies with a partial line buffered");
+    check(mux.run_once(0) == -1, "hangup: reactor has nothing left to run");
+    check(mux.next(ev) && (int)ev.fix.latitude == 1,
+	  "hangup: the whole report before it is delivered");
+    check(!mux.next(ev), "hangup: the partial line is dropped");
+}
+
+int main(int argc, char *argv[])
+{
+    int option;
+
+    while ((option = getopt(argc, argv, "v")) != -1) {
+	switch (option) {
+	case 'v':
+	    verbose++;
+	    break;
+	default:
+	    (void)fputs("usage: test_gpsmm_mux [-v]\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    stub_listen();
+    test_fairness();
+    test_limit();
+    test_hangup();
+    (void)close(listener);
+    check_exit("test_gpsmm_mux");
+}
+
+#else /* __cplusplus < 201103L */
+
+int main(void)
+{
+    (void)puts("test_gpsmm_mux: gpsmm_mux needs C++11, skipped");
+    return 0;
+}
+
+#endif /* __cplusplus >= 201103L */
@@ -15,7 +15,7 @@
 #include "../revision.h"
 
 /* GPSD is built with JSON_MINIMAL.  Any !JSON_MINIMAL tests,
- * like 18, 19 and 20 will thus fail.
+ * like 19, 20 and 21 will thus fail.
  * So this define removes them, they never execute.
  */
 #define JSON_MINIMAL
@@ -279,9 +279,14 @@ static const struct json_attr_t json_short_string[] = {
 
 static char json_strOver2[7 * JSON_VAL_MAX];  /* dynamically built */
 
+/* Case 18: TPV report as gpsd sends it to a multicast group */
+
+static const char *json_strMcast = "{\"class\":\"TPV\",\"device\":\"GPS#1\",\
+    \"mode\":3,\"time\":\"2005-06-19T08:12:41.89Z\",\
+    \"lat\":7.568074350,\"lon\":46.498203637,\"seq\":42}\r\n";
 
 #ifndef JSON_MINIMAL
-/* Case 17: Read array of integers */
+/* Case 19: Read array of integers */
 
 static const char *json_strInt = "[23,-17,5]";
 static int intstore[4], intcount;
@@ -293,7 +298,7 @@ static const struct json_array_t json_array_Int = {
     .maxlen = sizeof(intstore)/sizeof(intstore[0]),
 };
 
-/* Case 18: Read array of booleans */
+/* Case 20: Read array of booleans */
 
 static const char *json_strBool = "[true,false,true]";
 static bool boolstore[4];
@@ -306,7 +311,7 @@ static const struct json_array_t json_array_Bool = {
     .maxlen = sizeof(boolstore)/sizeof(boolstore[0]),
 };
 
-/* Case 19: Read array of reals */
+/* Case 21: Read array of reals */
 
 static const char *json_strReal = "[23.1,-17.2,5.3]";
 static double realstore[4];
@@ -532,10 +537,21 @@ static void jsontest(int i)
 	assert_integer("count", json_short_string_cnt, 0);
 	break;
 
+    case 18:
+	/* the trailing "seq" member must not spoil the report */
+	status = libgps_json_unpack(json_strMcast, &gpsdata, NULL);
+	assert_case(status);
+	assert_string("device", gpsdata.dev.path, "GPS#1");
+	assert_integer("mode", gpsdata.fix.mode, 3);
+	assert_real("time", gpsdata.fix.time, 1119168761.8900001);
+	assert_real("lat", gpsdata.fix.latitude, 7.568074350);
+	assert_real("lon", gpsdata.fix.longitude, 46.498203637);
+	break;
+
 #ifdef JSON_MINIMAL
-#define MAXTEST 17
+#define MAXTEST 18
 #else
-    case 18:
+    case 19:
 	status = json_read_array(json_strInt, &json_array_Int, NULL);
 	assert_integer("count", intcount, 3);
 	assert_integer("intstore[0]", intstore[0], 23);
@@ -544,7 +560,7 @@ static void jsontest(int i)
 	assert_integer("intstore[3]", intstore[3], 0);
 	break;
 
-    case 19:
+    case 20:
 	status = json_read_array(json_strBool, &json_array_Bool, NULL);
 	assert_integer("count", boolcount, 3);
 	assert_boolean("boolstore[0]", boolstore[0], true);
@@ -553,7 +569,7 @@ static void jsontest(int i)
 	assert_boolean("boolstore[3]", boolstore[3], false);
 	break;
 
-    case 20:
+    case 21:
 	status = json_read_array(json_strReal, &json_array_Real, NULL);
 	assert_integer("count", realcount, 3);
 	assert_real("realstore[0]", realstore[0], 23.1);
@@ -562,7 +578,7 @@ static void jsontest(int i)
 	assert_real("realstore[3]", realstore[3], 0);
 	break;
 
-#define MAXTEST 20
+#define MAXTEST 21
 #endif /* JSON_MINIMAL */
 
     default:
@@ -0,0 +1,354 @@
+/* test driver for the asynchronous NTRIP and DGPSIP connection code
+ *
+ * A stub caster runs in a thread on the loopback interface, and the
+ * device is driven with gpsd_activate() and gpsd_multipoll() just as
+ * the daemon drives it.  The stub dribbles its replies out in small
+ * pieces with pauses between them, so a client that blocked on a
+ * reply would show up as a slow poll.  The tests cover the sourcetable
+ * probe, the GET, the restart from a cached sourcetable entry after
+ * the caster hangs up, reconnect backoff against a dead port, and the
+ * DGPSIP greeting.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#include "../gpsd_config.h"  /* must be before all includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "../gpsd.h"
+#include "../crc24q.h"
+#include "../strfuncs.h"
+#include "../timespec.h"
+#include "test_check.h"
+
+#define MOUNTPOINT	"TEST0"
+#define FRAMES		4	/* RTCM3 frames sent per connection */
+#define DRIBBLE		7	/* bytes per write of a reply */
+#define PAUSE_MS	20	/* between those writes */
+#define MAX_POLL	0.25	/* seconds any one poll may take */
+
+/* what the stub caster has seen, guarded by stub.lock */
+static struct {
+    pthread_mutex_t lock;
+    int port;
+    int listener;
+    int probes;			/* GET / */
+    int gets;			/* GET /MOUNTPOINT */
+    int helos;			/* DGPSIP greetings */
+    bool hangup;		/* close the stream after the frames */
+} stub = {PTHREAD_MUTEX_INITIALIZER, 0, -1, 0, 0, 0, false};
+
+static unsigned char frame[3 + 19 + 3];
+
+static void make_frame(void)
+/* an RTCM3 type 1005 message, zeroed apart from the type */
+{
+    unsigned crc;
+
+    memset(frame, '\0', sizeof(frame));
+    frame[0] = 0xd3;
+    frame[2] = 19;
+    frame[3] = (unsigned char)(1005 >> 4);
+    frame[4] = (unsigned char)((1005 & 0x0f) << 4);
+    crc = crc24q_hash(frame, 3 + 19);
+    frame[22] = (unsigned char)(crc >> 16);
+    frame[23] = (unsigned char)(crc >> 8);
+    frame[24] = (unsigned char)crc;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return TSTONS(&ts);
+}
+
+static void dribble(int fd, const char *buf, size_t len)
+/* send a reply in small pieces, the way a slow caster would */
+{
+    struct timespec pause = {0, PAUSE_MS * 1000000L};
+    size_t off;
+
+    for (off = 0; off < len; off += DRIBBLE) {
+	size_t n = (len - off < DRIBBLE) ? len - off : DRIBBLE;
+
+	if (write(fd, buf + off, n) != (ssize_t)n)
+	    return;
+	(void)nanosleep(&pause, NULL);
+    }
+}
+
+static void serve(int fd)
+/* answer one client connection */
+{
+    char req[BUFSIZ];
+    size_t len = 0;
+    ssize_t n;
+    int i;
+
+    /* a DGPSIP client talks first too, so read up to a blank line */
+    while (len < sizeof(req) - 1
+	   && (n = read(fd, req + len, sizeof(req) - 1 - len)) > 0) {
+	len += (size_t)n;
+	req[len] = '\0';
+	if (strstr(req, "\r\n\r\n") != NULL
+	    || (str_starts_with(req, "HELO ") && strstr(req, "R\r\n")))
+	    break;
+    }
+    req[len] = '\0';
+
+    (void)pthread_mutex_lock(&stub.lock);
+    if (str_starts_with(req, "GET / "))
+	stub.probes++;
+    else if (str_starts_with(req, "GET /" MOUNTPOINT " "))
+	stub.gets++;
+    else if (str_starts_with(req, "HELO "))
+	stub.helos++;
+    (void)pthread_mutex_unlock(&stub.lock);
+
+    if (str_starts_with(req, "GET / ")) {
+	static const char table[] =
+	    "SOURCETABLE 200 OK\r\n"
+	    "Server: stub\r\n"
+	    "\r\n"
+	    "STR;OTHER;Other;RTCM 3;1005(1);0;GPS;NET;USA;0.00;0.00;0;0;"
+	    "stub;none;N;N;0;\r\n"
+	    "STR;" MOUNTPOINT ";Test;RTCM 3;1005(1);0;GPS;NET;USA;"
+	    "0.00;0.00;0;0;stub;none;N;N;0;\r\n"
+	    "ENDSOURCETABLE\r\n";
+	dribble(fd, table, strlen(table));
+	return;
+    }
+    if (str_starts_with(req, "GET /" MOUNTPOINT " "))
+	dribble(fd, "ICY 200 OK\r\n", 12);
+    else if (!str_starts_with(req, "HELO "))
+	return;
+    for (i = 0; i < FRAMES; i++)
+	dribble(fd, (const char *)frame, sizeof(frame));
+    if (!stub.hangup) {
+	/* hold the stream open until the client goes away */
+	while (read(fd, req, sizeof(req)) > 0)
+	    continue;
+    }
+}
+
+static void *stub_thread(void *arg UNUSED)
+{
+    for (;;) {
+	int fd = accept(stub.listener, NULL, NULL);
+
+	if (fd == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return NULL;
+	}
+	serve(fd);
+	(void)close(fd);
+    }
+}
+
+static int stub_start(void)
+{
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    pthread_t pt;
+    int one = 1;
+
+    stub.listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (stub.listener == -1)
+	return -1;
+    (void)setsockopt(stub.listener, SOL_SOCKET, SO_REUSEADDR,
+		     &one, sizeof(one));
+    memset(&sin, '\0', sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(stub.listener, (struct sockaddr *)&sin, sizeof(sin)) == -1
+	|| listen(stub.listener, 4) == -1
+	|| getsockname(stub.listener, (struct sockaddr *)&sin, &slen) == -1)
+	return -1;
+    stub.port = ntohs(sin.sin_port);
+    return pthread_create(&pt, NULL, stub_thread, NULL);
+}
+
+static int dead_port(void)
+/* a loopback port that nothing listens on */
+{
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    int fd = socket(AF_INET, SOCK_STREAM, 0), port = -1;
+
+    memset(&sin, '\0', sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd != -1
+	&& bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0
+	&& getsockname(fd, (struct sockaddr *)&sin, &slen) == 0)
+	port = ntohs(sin.sin_port);
+    if (fd != -1)
+	(void)close(fd);
+    return port;
+}
+
+static int rtcm_frames;
+
+static void handler(struct gps_device_t *device, gps_mask_t changed)
+{
+    if ((changed & PACKET_SET) != 0 && device->lexer.type == RTCM3_PACKET)
+	rtcm_frames++;
+}
+
+struct run_t {
+    double slowest;		/* longest single poll, seconds */
+    double reconnect_at;	/* when the second stream began, or 0 */
+};
+
+static bool run(struct gps_device_t *session, double seconds,
+		int want_frames, struct run_t *run)
+/* poll the device like the daemon does until enough frames arrive */
+{
+    double start = now(), deadline = start + seconds;
+    int seen = rtcm_frames;
+
+    run->slowest = 0;
+    run->reconnect_at = 0;
+    while (now() < deadline && rtcm_frames < want_frames) {
+	struct timeval tv = {0, 100000};
+	fd_set rfds;
+	double before;
+	int r;
+
+	FD_ZERO(&rfds);
+	FD_SET(session->gpsdata.gps_fd, &rfds);
+	r = select(session->gpsdata.gps_fd + 1, &rfds, NULL, NULL, &tv);
+	if (r == -1 && errno != EINTR)
+	    return false;
+	if (r <= 0)
+	    continue;
+	before = now();
+	if (gpsd_multipoll(true, session, handler, 0) == DEVICE_ERROR)
+	    return false;
+	if (now() - before > run->slowest)
+	    run->slowest = now() - before;
+	if (seen == FRAMES && rtcm_frames > FRAMES && run->reconnect_at == 0)
+	    run->reconnect_at = now() - start;
+	seen = rtcm_frames;
+    }
+    return rtcm_frames >= want_frames;
+}
+
+static void session_open(struct gps_context_t *context,
+			 struct gps_device_t *session, const char *path)
+{
+    memset(session, '\0', sizeof(*session));
+    gpsd_init(session, context, path);
+    rtcm_frames = 0;
+    (void)gpsd_activate(session, O_PROBEONLY);
+}
+
+int main(int argc, char *argv[])
+{
+    struct gps_context_t context;
+    struct gps_device_t session;
+    struct run_t r;
+    char path[GPS_PATH_MAX];
+    bool ok;
+    int option, port, probes;
+
+    while ((option = getopt(argc, argv, "v")) != -1) {
+	switch (option) {
+	case 'v':
+	    verbose++;
+	    break;
+	default:
+	    (void)fputs("usage: test_netgnss [-v]\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    /* a connect helper may outlive its device and write to a dead pipe */
+    (void)signal(SIGPIPE, SIG_IGN);
+    make_frame();
+    if (stub_start() != 0) {
+	(void)fputs("test_netgnss: can't start the stub caster\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+    gps_context_init(&context, "test_netgnss");
+    context.errout.debug = verbose > 1 ? LOG_PROG : LOG_ERROR - 1;
+    gpsd_time_init(&context, time(NULL));
+
+    /* NTRIP: sourcetable probe, then GET, then the stream */
+    (void)snprintf(path, sizeof(path), "ntrip://127.0.0.1:%d/" MOUNTPOINT,
+		   stub.port);
+    stub.hangup = true;
+    session_open(&context, &session, path);
+    check(!BAD_SOCKET(session.gpsdata.gps_fd), "ntrip open returns a fd");
+    ok = run(&session, 10, FRAMES, &r);
+    check(ok, "ntrip stream delivers after probe and GET");
+    check(session.ntrip.stream.set, "ntrip sourcetable entry matched");
+    check(r.slowest < MAX_POLL, "ntrip setup never stalls a poll");
+    (void)pthread_mutex_lock(&stub.lock);
+    check(stub.probes == 1 && stub.gets == 1, "one probe and one GET");
+    probes = stub.probes;
+    (void)pthread_mutex_unlock(&stub.lock);
+
+    /*
+     * The stub hangs up after its frames.  The device must come back
+     * by itself after the minimum backoff, and go straight to the GET
+     * on the strength of the cached sourcetable entry.
+     */
+    ok = run(&session, 10, 2 * FRAMES, &r);
+    check(ok, "ntrip reconnects after the caster hangs up");
+    check(r.reconnect_at >= NETGNSS_BACKOFF_MIN,
+	  "ntrip reconnect waits out the backoff");
+    check(r.slowest < MAX_POLL, "ntrip reconnect never stalls a poll");
+    (void)pthread_mutex_lock(&stub.lock);
+    check(stub.probes == probes && stub.gets == 2,
+	  "cached sourcetable entry skips the probe");
+    (void)pthread_mutex_unlock(&stub.lock);
+    gpsd_deactivate(&session);
+
+    /* a dead caster: each failure doubles the delay before the next */
+    port = dead_port();
+    (void)snprintf(path, sizeof(path), "ntrip://127.0.0.1:%d/" MOUNTPOINT,
+		   port);
+    session_open(&context, &session, path);
+    (void)run(&session, 2.5, 1, &r);
+    check(session.netgnss.attempts == 2,
+	  "dead caster retried after 1 s and 2 s");
+    check(session.netgnss.backoff == 4 * NETGNSS_BACKOFF_MIN,
+	  "backoff doubles per failure");
+    check(r.slowest < MAX_POLL, "failed connects never stall a poll");
+    session.netgnss.backoff = NETGNSS_BACKOFF_MAX - 1;
+    (void)netgnss_retry(&session);
+    check(session.netgnss.backoff == NETGNSS_BACKOFF_MAX,
+	  "backoff is capped");
+    gpsd_deactivate(&session);
+
+    /* DGPSIP: greet the server, then take its stream */
+    (void)snprintf(path, sizeof(path), "dgpsip://127.0.0.1:%d", stub.port);
+    stub.hangup = false;
+    session_open(&context, &session, path);
+    ok = run(&session, 10, FRAMES, &r);
+    check(ok, "dgpsip stream delivers");
+    check(r.slowest < MAX_POLL, "dgpsip setup never stalls a poll");
+    (void)pthread_mutex_lock(&stub.lock);
+    check(stub.helos == 1, "dgpsip greeting sent once");
+    (void)pthread_mutex_unlock(&stub.lock);
+    gpsd_deactivate(&session);
+
+    check_exit("test_netgnss");
+}
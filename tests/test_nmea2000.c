@@ -0,0 +1,268 @@
+/* test driver for NMEA 2000 fast-packet reassembly
+ *
+ * A socketpair stands in for the CAN socket.  CAN frames carrying
+ * several fast packets, interleaved frame by frame, are written to one
+ * end, and the driver's get_packet method reads them from the other
+ * just as the daemon would.  The tests check that interleaved packets
+ * with the same or different PGNs and sequence IDs come out intact,
+ * that a packet missing a frame is dropped without harming its
+ * neighbours, and that a full reassembly table evicts the packet that
+ * has waited longest.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#include "../gpsd_config.h"  /* must be before all includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+
+#include "../gpsd.h"
+#include "test_check.h"
+
+#define UNIT		0x23	/* source address of our fake GPS */
+#define PGN_POS		129029	/* GNSS Position Data, fast */
+#define PGN_SATS	129540	/* GNSS Satellites in View, fast */
+#define PGN_TIME	126992	/* System Time, single frame */
+#define MAX_PACKETS	(NMEA2000_FAST_SLOTS + 4)
+#define MAX_FRAMES	256
+
+extern const struct gps_type_t driver_nmea2000;
+
+struct packet_t {
+    unsigned int pgn;
+    unsigned char seq;		/* sequence ID, 0 to 7 */
+    size_t len;
+    unsigned char payload[NMEA2000_FAST_MAX];
+    int received;
+};
+
+static struct packet_t packets[MAX_PACKETS];
+static int npackets;
+static struct can_frame frames[MAX_FRAMES];
+static int nframes;
+static int singles, strays;
+
+static struct packet_t *packet_add(unsigned int pgn, unsigned char seq,
+				   size_t len)
+/* make up a fast packet whose bytes tell it from the others */
+{
+    struct packet_t *pp = &packets[npackets++];
+    size_t i;
+
+    pp->pgn = pgn;
+    pp->seq = seq;
+    pp->len = len;
+    for (i = 0; i < len; i++)
+	pp->payload[i] = (unsigned char)(npackets * 37 + i);
+    pp->received = 0;
+    return pp;
+}
+
+static int fast_frames(const struct packet_t *pp)
+/* how many CAN frames a fast packet takes */
+{
+    /* six payload bytes in the first, seven in each after it */
+    return 1 + (int)((pp->len - 6 + 7 - 1) / 7);
+}
+
+static void frame_add(unsigned int pgn, const unsigned char *data)
+{
+    struct can_frame *fp = &frames[nframes++];
+
+    memset(fp, 0, sizeof(*fp));
+    /* extended frame, priority 3 */
+    fp->can_id = CAN_EFF_FLAG | (3U << 26) | (pgn << 8) | UNIT;
+    fp->can_dlc = 8;
+    memcpy(fp->data, data, 8);
+}
+
+static void fast_frame(const struct packet_t *pp, int counter)
+/* queue frame number counter of a fast packet */
+{
+    unsigned char data[8];
+    size_t off, i;
+
+    memset(data, 0xff, sizeof(data));
+    data[0] = (unsigned char)((pp->seq << 5) | counter);
+    if (counter == 0) {
+	data[1] = (unsigned char)pp->len;
+	for (i = 0; i < 6 && i < pp->len; i++)
+	    data[2 + i] = pp->payload[i];
+    } else {
+	off = 6 + (size_t)(counter - 1) * 7;
+	for (i = 0; i < 7 && off + i < pp->len; i++)
+	    data[1 + i] = pp->payload[off + i];
+    }
+    frame_add(pp->pgn, data);
+}
+
+static void single_frame(void)
+/* queue a single-frame PGN between the fast-packet frames */
+{
+    static const unsigned char data[8] = {0, 0xf0, 0x9c, 0x45, 0, 0, 0, 0};
+
+    frame_add(PGN_TIME, data);
+}
+
+static void reset(void)
+{
+    npackets = nframes = singles = strays = 0;
+}
+
+static void received(struct gps_device_t *session)
+/* match a completed packet against those sent */
+{
+    /* the driver's PGN table entries start with the PGN */
+    unsigned int pgn = *(unsigned int *)session->driver.nmea2000.workpgn;
+    int i;
+
+    if (pgn == PGN_TIME) {
+	singles++;
+	return;
+    }
+    for (i = 0; i < npackets; i++)
+	if (packets[i].pgn == pgn
+	    && packets[i].len == session->lexer.outbuflen
+	    && memcmp(packets[i].payload, session->lexer.outbuffer,
+		      packets[i].len) == 0) {
+	    packets[i].received++;
+	    return;
+	}
+    strays++;
+}
+
+static void run(struct gps_device_t *session, int fd)
+/* push the queued frames through the driver, a few dozen at a time */
+{
+    int sent = 0;
+
+    while (sent < nframes) {
+	int burst = 40;
+
+	while (sent < nframes && burst-- > 0) {
+	    if (write(fd, &frames[sent], sizeof(frames[0]))
+		!= (ssize_t)sizeof(frames[0])) {
+		(void)perror("test_nmea2000: write");
+		exit(EXIT_FAILURE);
+	    }
+	    sent++;
+	}
+	while (driver_nmea2000.get_packet(session) > 0)
+	    if (session->driver.nmea2000.workpgn != NULL
+		&& session->lexer.outbuflen > 0) {
+		received(session);
+		session->driver.nmea2000.workpgn = NULL;
+	    }
+    }
+    nframes = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct gps_context_t context;
+    struct gps_device_t session;
+    struct packet_t *a, *b, *c, *d, *e;
+    int sv[2], i, n, option, done;
+
+    while ((option = getopt(argc, argv, "v")) != -1) {
+	switch (option) {
+	case 'v':
+	    verbose++;
+	    break;
+	default:
+	    (void)fputs("usage: test_nmea2000 [-v]\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    /* SOCK_SEQPACKET keeps frame boundaries, as a CAN_RAW socket does */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0) {
+	(void)perror("test_nmea2000: socketpair");
+	exit(EXIT_FAILURE);
+    }
+    (void)fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+    gps_context_init(&context, "test_nmea2000");
+    context.errout.debug = verbose > 1 ? LOG_IO : LOG_ERROR - 1;
+    memset(&session, '\0', sizeof(session));
+    gpsd_init(&session, &context, "nmea2000://can0:35");
+    session.device_type = &driver_nmea2000;
+    session.gpsdata.gps_fd = sv[0];
+    session.driver.nmea2000.can_net = 0;
+    session.driver.nmea2000.unit = UNIT;
+    session.driver.nmea2000.unit_valid = true;
+
+    /*
+     * Two packets with the same PGN but different sequence IDs and a
+     * third with another PGN, interleaved frame by frame, with single
+     * frames in between.
+     */
+    reset();
+    a = packet_add(PGN_POS, 1, 43);
+    b = packet_add(PGN_POS, 2, 43);
+    c = packet_add(PGN_SATS, 1, 100);
+    n = fast_frames(c);
+    for (i = 0; i < n; i++) {
+	if (i < fast_frames(a))
+	    fast_frame(a, i);
+	if (i < fast_frames(b))
+	    fast_frame(b, i);
+	fast_frame(c, i);
+	if (i % 4 == 3)
+	    single_frame();
+    }
+    run(&session, sv[1]);
+    check(a->received == 1, "first of two same-PGN packets intact");
+    check(b->received == 1, "second of two same-PGN packets intact");
+    check(c->received == 1, "interleaved packet of another PGN intact");
+    check(singles == n / 4, "single frames between fast frames pass");
+    check(strays == 0, "no garbled packets");
+
+    /* a lost frame costs its own packet and no other */
+    reset();
+    d = packet_add(PGN_POS, 3, 43);
+    e = packet_add(PGN_POS, 4, 43);
+    for (i = 0; i < fast_frames(d); i++) {
+	if (i != 2)
+	    fast_frame(d, i);
+	fast_frame(e, i);
+    }
+    run(&session, sv[1]);
+    check(d->received == 0, "packet with a lost frame dropped");
+    check(e->received == 1, "neighbour of a broken packet intact");
+    for (i = 0; i < fast_frames(d); i++)
+	fast_frame(d, i);
+    run(&session, sv[1]);
+    check(d->received == 1, "resent packet reassembled after a loss");
+    check(strays == 0, "no garbled packets after a loss");
+
+    /*
+     * Start one packet more than there are slots, then finish them
+     * all.  The first started is evicted; the rest must survive.
+     */
+    reset();
+    for (i = 0; i < NMEA2000_FAST_SLOTS + 1; i++)
+	(void)packet_add(i < 8 ? PGN_POS : PGN_SATS, (unsigned char)(i % 8),
+			 43);
+    for (i = 0; i < npackets; i++)
+	fast_frame(&packets[i], 0);
+    for (n = 1; n < fast_frames(&packets[0]); n++)
+	for (i = 0; i < npackets; i++)
+	    fast_frame(&packets[i], n);
+    run(&session, sv[1]);
+    for (done = 0, i = 1; i < npackets; i++)
+	done += packets[i].received;
+    check(packets[0].received == 0, "oldest packet evicted from a full table");
+    check(done == npackets - 1, "packets in a full table intact");
+    check(strays == 0, "no garbled packets from a full table");
+
+    (void)close(sv[0]);
+    (void)close(sv[1]);
+    check_exit("test_nmea2000");
+}
@@ -0,0 +1,508 @@
+/* test driver that runs the daemon regression logs in process
+ *
+ * Each test/daemon log is fed through the packet lexer, the drivers
+ * and the report generator gpsd uses for its subscribers, with the
+ * policy of the watcher that "gpsfake -p" opens, and the result is
+ * compared with the log's .chk file.  Every log runs in a forked
+ * child, so driver state cannot leak between logs, and up to -j
+ * children run at once; a child that dies without reporting counts
+ * as a failure.  With -r the pipeline is repeated to make
+ * the run a decoder throughput benchmark.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#include "../gpsd_config.h"  /* must be before all includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../gpsd.h"
+#include "../gps_json.h"
+#include "../strfuncs.h"
+#include "../timespec.h"
+
+static int verbose = 0;
+static int repeat = 1;
+
+/* what a child tells the parent about one log; fits in one pipe write */
+struct result_t {
+    int index;
+    int line;			/* 0 on match, first bad .chk line, or -1 */
+    unsigned long packets;
+    size_t bytes;
+    double elapsed;
+};
+
+/* a running child, and the read end of the pipe it reports through */
+struct child_t {
+    pid_t pid;			/* 0 if the slot is free */
+    int fd;
+    int index;
+};
+
+struct outbuf_t {
+    char *text;
+    size_t len, size;
+};
+
+/* a log as gpsfake sends it: the bytes, and where each write ends */
+struct stream_t {
+    struct outbuf_t bytes;
+    size_t *ends;
+    size_t count, size;
+    sourcetype_t sourcetype;
+};
+
+static void out_append(struct outbuf_t *out, const char *buf, size_t len)
+{
+    if (out->len + len + 1 > out->size) {
+	size_t size = out->size ? out->size : BUFSIZ;
+	char *text;
+
+	while (out->len + len + 1 > size)
+	    size *= 2;
+	if ((text = realloc(out->text, size)) == NULL) {
+	    (void)fputs("test_regress: out of memory\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+	out->text = text;
+	out->size = size;
+    }
+    (void)memcpy(out->text + out->len, buf, len);
+    out->len += len;
+    out->text[out->len] = '\0';
+}
+
+static void stream_add(struct stream_t *stream, const char *buf, size_t len)
+/* queue one write of the stream */
+{
+    if (stream->count == stream->size) {
+	size_t size = stream->size ? stream->size * 2 : 1024;
+	size_t *ends = realloc(stream->ends, size * sizeof(size_t));
+
+	if (ends == NULL) {
+	    (void)fputs("test_regress: out of memory\n", stderr);
+	    exit(EXIT_FAILURE);
+	}
+	stream->ends = ends;
+	stream->size = size;
+    }
+    out_append(&stream->bytes, buf, len);
+    stream->ends[stream->count++] = stream->bytes.len;
+}
+
+static bool load_stream(const char *logfile, struct stream_t *stream)
+/* the writes gpsfake would make to the daemon for this log */
+{
+    struct gps_lexer_t lexer;
+    size_t commentlen = 0;
+    char cookie[16] = "";
+    int fd;
+
+    if ((fd = open(logfile, O_RDONLY)) == -1)
+	return false;
+    lexer_init(&lexer);
+    stream->sourcetype = source_pty;
+    while (packet_get(fd, &lexer) > 0) {
+	const char *packet = (const char *)lexer.outbuffer;
+
+	if (lexer.type == COMMENT_PACKET) {
+	    /* gpsfake drops comments, acting on the magic ones */
+	    commentlen += lexer.outbuflen;
+	    if (strstr(packet, "Transport: UDP") != NULL)
+		stream->sourcetype = source_udp;
+	    else if (strstr(packet, "Transport: TCP") != NULL)
+		stream->sourcetype = source_tcp;
+	    else if (strstr(packet, "Delay-Cookie:") != NULL)
+		(void)sscanf(packet, "# Delay-Cookie: %15s", cookie);
+	} else if (lexer.outbuflen > 0)
+	    stream_add(stream, packet, lexer.outbuflen);
+    }
+    if (cookie[0] != '\0') {
+	/* such logs are sent verbatim, one write per cookie */
+	struct outbuf_t text = {NULL, 0, 0};
+	char buf[BUFSIZ], *piece, *end;
+	ssize_t n;
+
+	if (lseek(fd, (off_t)commentlen, SEEK_SET) == -1) {
+	    (void)close(fd);
+	    return false;
+	}
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+	    out_append(&text, buf, (size_t)n);
+	stream->bytes.len = stream->count = 0;
+	for (piece = text.text; piece != NULL; piece = end) {
+	    if ((end = strstr(piece, cookie)) != NULL)
+		*end = '\0';
+	    stream_add(stream, piece, strlen(piece));
+	    if (end != NULL)
+		end += strlen(cookie);
+	}
+	free(text.text);
+    }
+    (void)close(fd);
+    return true;
+}
+
+static bool decode(struct stream_t *stream, struct outbuf_t *out,
+		   unsigned long *packets)
+/* run the stream through a fresh session, collecting watcher output */
+{
+    /* what "gpsfake -p" asks for */
+    static const struct gps_policy_t policy = {
+	.watcher = true, .json = true, .nmea = true,
+    };
+    static char buf[SUBSCRIBER_REPORT_MAX];
+    const char *report;
+    size_t len;
+    struct gps_context_t context;
+    struct gps_device_t session;
+    size_t sent = 0;
+    int pipefd[2];
+
+    /*
+     * Feed the session through a pipe one write at a time, as gpsfake
+     * does; handing the lexer the whole log at once loses whatever is
+     * buffered when a driver resets it on a mode switch.
+     */
+    if (pipe(pipefd) == -1)
+	return false;
+    (void)fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    gps_context_init(&context, "test_regress");
+    context.errout.debug = verbose;
+    context.readonly = true;		/* gpsfake runs gpsd with -b */
+    gpsd_time_init(&context, time(NULL));
+    memset(&session, '\0', sizeof(session));
+    gpsd_init(&session, &context, NULL);
+    gpsd_clear(&session);
+    session.gpsdata.gps_fd = pipefd[0];
+    session.sourcetype = stream->sourcetype;
+    session.gpsdata.dev.baudrate = 38400;	/* gpsfake -s 38400 */
+    (void)strlcpy(session.gpsdata.dev.path, "test_regress",
+		  sizeof(session.gpsdata.dev.path));
+
+    for (;;) {
+	gps_mask_t changed = gpsd_poll(&session);
+
+	if (changed == EOF_IS || changed == ERROR_SET)
+	    break;
+	if (changed == NODATA_IS) {
+	    /* the session has drained the last write, make the next */
+	    size_t start = (sent > 0) ? stream->ends[sent - 1] : 0;
+
+	    if (sent == stream->count)
+		break;
+	    if (write(pipefd[1], stream->bytes.text + start,
+		      stream->ends[sent] - start)
+		!= (ssize_t)(stream->ends[sent] - start))
+		break;
+	    sent++;
+	    continue;
+	}
+	if ((changed & PACKET_SET) == 0 || session.lexer.type == BAD_PACKET)
+	    continue;
+	(*packets)++;
+	changed = gpsd_report_mask(&session, changed);
+	len = json_subscriber_report(changed, &session, &policy,
+				     buf, sizeof(buf), &report);
+	out_append(out, report, len);
+    }
+    (void)close(pipefd[0]);
+    (void)close(pipefd[1]);
+    return sent == stream->count;
+}
+
+static bool filtered(char *line, size_t *len)
+/* apply the regress-driver output filter; false means drop the line */
+{
+    static const char *drop[] = {"GPS-DATA", "WATCH", "DEVICE", "VERSION"};
+    char *dev, *end;
+    unsigned int i;
+
+    if (*len >= 5 && memcmp(line, "gpsd:", 5) == 0)
+	return false;
+    if (*len >= 7 && memcmp(line, "gpsfake", 7) == 0)
+	return false;
+    for (i = 0; i < sizeof(drop) / sizeof(drop[0]); i++)
+	if (memmem(line, *len, drop[i], strlen(drop[i])) != NULL)
+	    return false;
+    if ((dev = memmem(line, *len, ",\"device\":", 10)) != NULL) {
+	for (end = dev + 1; end < line + *len && *end != ',' && *end != '}';
+	     end++)
+	    continue;
+	(void)memmove(dev, end, (size_t)(line + *len - end));
+	*len -= (size_t)(end - dev);
+    }
+    return true;
+}
+
+static int compare(struct outbuf_t *out, const char *chkfile, FILE *dump)
+/* return 0 if out matches the check file, else the first bad line */
+{
+    struct outbuf_t chk = {NULL, 0, 0};
+    char *line, *next, *expect, *expectnext = NULL;
+    int lineno = 0;
+
+    if (dump == NULL) {
+	char buf[BUFSIZ];
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(chkfile, O_RDONLY)) == -1)
+	    return -1;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+	    out_append(&chk, buf, (size_t)n);
+	(void)close(fd);
+	if (chk.text == NULL)
+	    out_append(&chk, "", 0);
+	expectnext = chk.text;
+    }
+    /* lines may hold binary, NULs included, so go by length */
+    for (line = out->text; line < out->text + out->len; line = next) {
+	size_t len;
+
+	if ((next = memchr(line, '\n', out->text + out->len - line)) == NULL)
+	    next = out->text + out->len;
+	len = (size_t)(next - line);
+	if (next < out->text + out->len)
+	    next++;
+	if (!filtered(line, &len))
+	    continue;
+	lineno++;
+	if (dump != NULL) {
+	    (void)fwrite(line, 1, len, dump);
+	    (void)fputc('\n', dump);
+	    continue;
+	}
+	expect = expectnext;
+	if (expect >= chk.text + chk.len)
+	    goto mismatch;
+	if ((expectnext = memchr(expect, '\n',
+				 chk.text + chk.len - expect)) == NULL)
+	    expectnext = chk.text + chk.len;
+	if ((size_t)(expectnext - expect) != len
+	    || memcmp(line, expect, len) != 0)
+	    goto mismatch;
+	if (expectnext < chk.text + chk.len)
+	    expectnext++;
+    }
+    /* the check file must end where the output does */
+    if (dump == NULL && expectnext < chk.text + chk.len) {
+	lineno++;
+	goto mismatch;
+    }
+    lineno = 0;
+  mismatch:
+    free(chk.text);
+    return lineno;
+}
+
+static void run_log(const char *logfile, FILE *dump, struct result_t *result)
+/* process one log in the current process */
+{
+    struct stream_t stream;
+    struct outbuf_t out = {NULL, 0, 0};
+    char chkfile[PATH_MAX];
+    struct timespec start, end;
+    int i;
+
+    result->line = -1;
+    memset(&stream, '\0', sizeof(stream));
+    if (!load_stream(logfile, &stream)) {
+	(void)fprintf(stderr, "test_regress: can't read %s: %s\n",
+		      logfile, strerror(errno));
+	return;
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < repeat; i++) {
+	out.len = 0;
+	result->packets = 0;
+	if (!decode(&stream, &out, &result->packets)) {
+	    (void)fprintf(stderr, "test_regress: can't decode %s: %s\n",
+			  logfile, strerror(errno));
+	    break;
+	}
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &end);
+    result->elapsed = TSTONS(&end) - TSTONS(&start);
+    result->bytes = stream.bytes.len;
+
+    if (i == repeat) {
+	(void)snprintf(chkfile, sizeof(chkfile), "%s.chk", logfile);
+	if (out.text == NULL)
+	    out_append(&out, "", 0);
+	result->line = compare(&out, chkfile, dump);
+    }
+    free(stream.bytes.text);
+    free(stream.ends);
+    free(out.text);
+}
+
+static void usage(void)
+{
+    (void)fputs("usage: test_regress [-o] [-q] [-j jobs] [-r repeat] "
+		"[-v level] logfile...\n"
+		"  -o         print a single log's filtered output, don't compare\n"
+		"  -q         report only failures and the summary\n"
+		"  -j jobs    logs to run at once (default: number of CPUs)\n"
+		"  -r repeat  decode each log this many times, for benchmarking\n"
+		"  -v level   set the libgpsd debug level\n", stderr);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    struct result_t result;
+    struct timespec start, end;
+    unsigned long packets = 0;
+    size_t bytes = 0;
+    double decoding = 0.0, elapsed;
+    struct child_t *children;
+    int option, jobs, next = 0, failcount = 0, done = 0;
+    bool dump = false, quiet = false;
+
+    jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((option = getopt(argc, argv, "j:oqr:v:")) != -1) {
+	switch (option) {
+	case 'j':
+	    jobs = atoi(optarg);
+	    break;
+	case 'o':
+	    dump = true;
+	    break;
+	case 'q':
+	    quiet = true;
+	    break;
+	case 'r':
+	    repeat = atoi(optarg);
+	    break;
+	case 'v':
+	    verbose = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 1 || (dump && argc != 1))
+	usage();
+    if (jobs < 1)
+	jobs = 1;
+    if (repeat < 1)
+	repeat = 1;
+
+    if (dump) {
+	memset(&result, '\0', sizeof(result));
+	run_log(argv[0], stdout, &result);
+	exit(result.line < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    /*
+     * Each child reports through a pipe of its own, whose write end
+     * only it holds, and is reaped before its pipe is read; a child
+     * that crashed leaves its pipe empty.
+     */
+    if ((children = calloc((size_t)jobs, sizeof(*children))) == NULL) {
+	(void)fputs("test_regress: out of memory\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    while (done < argc) {
+	struct child_t *cp;
+	pid_t pid;
+	int status;
+	ssize_t n;
+
+	for (cp = children; cp < children + jobs && next < argc; cp++) {
+	    int resultfd[2];
+
+	    if (cp->pid != 0)
+		continue;
+	    if (pipe(resultfd) == -1) {
+		(void)fprintf(stderr, "test_regress: pipe: %s\n",
+			      strerror(errno));
+		exit(EXIT_FAILURE);
+	    }
+	    if ((pid = fork()) == -1) {
+		(void)fprintf(stderr, "test_regress: fork: %s\n",
+			      strerror(errno));
+		exit(EXIT_FAILURE);
+	    } else if (pid == 0) {
+		(void)close(resultfd[0]);
+		memset(&result, '\0', sizeof(result));
+		result.index = next;
+		run_log(argv[next], NULL, &result);
+		/* a result is far smaller than a pipe buffer */
+		_exit(write(resultfd[1], &result, sizeof(result))
+		      == (ssize_t)sizeof(result) ? EXIT_SUCCESS : EXIT_FAILURE);
+	    }
+	    (void)close(resultfd[1]);
+	    cp->pid = pid;
+	    cp->fd = resultfd[0];
+	    cp->index = next++;
+	}
+
+	if ((pid = waitpid(-1, &status, 0)) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    (void)fprintf(stderr, "test_regress: waitpid: %s\n",
+			  strerror(errno));
+	    exit(EXIT_FAILURE);
+	}
+	for (cp = children; cp < children + jobs; cp++)
+	    if (cp->pid == pid)
+		break;
+	if (cp == children + jobs)
+	    continue;
+	n = read(cp->fd, &result, sizeof(result));
+	(void)close(cp->fd);
+	cp->pid = 0;
+	done++;
+
+	if (n != (ssize_t)sizeof(result)
+	    || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+	    failcount++;
+	    if (WIFSIGNALED(status))
+		(void)printf("%s: FAILED, killed by signal %d\n",
+			     argv[cp->index], WTERMSIG(status));
+	    else
+		(void)printf("%s: FAILED, no result from the test\n",
+			     argv[cp->index]);
+	    continue;
+	}
+	if (result.line != 0) {
+	    failcount++;
+	    if (result.line < 0)
+		(void)printf("%s: FAILED, log or check file unreadable\n",
+			     argv[result.index]);
+	    else
+		(void)printf("%s: FAILED at line %d of the check file\n",
+			     argv[result.index], result.line);
+	} else if (!quiet)
+	    (void)printf("%s: OK\n", argv[result.index]);
+	packets += result.packets * repeat;
+	bytes += result.bytes * repeat;
+	decoding += result.elapsed;
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = TSTONS(&end) - TSTONS(&start);
+    free(children);
+
+    (void)printf("%d of %d logs failed; %lu packets, %zu bytes "
+		 "decoded in %.3f s (%.1f MB/s per job), %.3f s elapsed\n",
+		 failcount, argc, packets, bytes, decoding,
+		 decoding > 0 ? bytes / decoding / 1e6 : 0.0, elapsed);
+    exit(failcount > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -353,7 +353,8 @@ static void chrony_send(struct gps_device_t *session, struct timedelta_t *td)
     gpsd_log(&session->context->errout, LOG_RAW,
 	     "PPS chrony_send %s @ %s Offset: %0.9f\n",
 	     real_str, clock_str, sample.offset);
-    (void)send(session->chronyfd, &sample, sizeof (sample), 0);
+    /* never stall the PPS thread on a chronyd that isn't reading */
+    (void)send(session->chronyfd, &sample, sizeof (sample), MSG_DONTWAIT);
 }
 
 static char *report_hook(volatile struct pps_thread_t *pps_thread,
@@ -392,9 +393,9 @@ static char *report_hook(volatile struct pps_thread_t *pps_thread,
     if (session->shm_pps != NULL)
 	(void)ntpshm_put(session, session->shm_pps, td);
 
-    /* session context might have a hook set, too */
+    /* the context hook talks to clients, so it runs in the main loop */
     if (session->context->pps_hook != NULL)
-	session->context->pps_hook(session, td);
+	pps_thread_post(pps_thread, td);
 
     return log1;
 }
@@ -107,6 +107,12 @@ extern void timespec_str(const struct timespec *, char *, size_t);
 
 bool nanowait(int, int);
 
+/* the daemon's clock, which a test harness may run virtually */
+extern void gps_clock_set(const struct timespec *);
+extern bool gps_clock_is_virtual(void);
+extern void gps_clock_gettime(struct timespec *);
+extern time_t gps_clock_time(void);
+
 #endif /* GPSD_TIMESPEC_H */
 
 /* end */
@@ -0,0 +1,41 @@
+/*
+ * tracepoints.h - static probes at gpsd's hot-path boundaries
+ *
+ * With the systemtap <sys/sdt.h> available each GPSD_PROBEn() compiles
+ * to a single nop plus an ELF note naming the probe and where its
+ * arguments live; perf, bpftrace and systemtap can attach to them in a
+ * running production binary, e.g.
+ *
+ *	bpftrace -e 'usdt:/usr/sbin/gpsd:gpsd:parse_done
+ *		{ printf("%s %d\n", str(arg0), arg1); }'
+ *
+ * Without it they compile to nothing.  The provider is "gpsd"; probes
+ * inside the device layer carry the device path and packet type as
+ * their first two arguments.  The packet layer doesn't know device
+ * paths, so its probes carry the lexer address instead, which
+ * parse_start also reports so the two can be joined.
+ *
+ * This file is Copyright (c) 2019 by the GPSD project
+ * SPDX-License-Identifier: BSD-2-clause
+ */
+#ifndef _GPSD_TRACEPOINTS_H_
+#define _GPSD_TRACEPOINTS_H_
+
+#include "gpsd_config.h"
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define GPSD_PROBE1(name, a)		STAP_PROBE1(gpsd, name, a)
+#define GPSD_PROBE2(name, a, b)		STAP_PROBE2(gpsd, name, a, b)
+#define GPSD_PROBE3(name, a, b, c)	STAP_PROBE3(gpsd, name, a, b, c)
+#define GPSD_PROBE4(name, a, b, c, d)	STAP_PROBE4(gpsd, name, a, b, c, d)
+#else
+#define GPSD_PROBE1(name, a)		do { } while (0)
+#define GPSD_PROBE2(name, a, b)		do { } while (0)
+#define GPSD_PROBE3(name, a, b, c)	do { } while (0)
+#define GPSD_PROBE4(name, a, b, c, d)	do { } while (0)
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* _GPSD_TRACEPOINTS_H_ */
+/* end */